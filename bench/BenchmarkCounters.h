@@ -0,0 +1,42 @@
+#ifndef __BenchmarkCounters_h
+#define __BenchmarkCounters_h
+
+#include "benchmark/benchmark.h"
+
+#include "Util/PerfCounters.h"
+
+/**
+   Hardware counters per iteration of a benchmark, reported as user counters
+   next to the time. Construct it right before the benchmark loop and call
+   Report after it. Work done with the timing paused is counted too.
+
+   When the counters are not permitted the benchmark runs as usual and the
+   label says why.
+*/
+class BenchmarkCounters {
+public:
+  BenchmarkCounters()
+    : m_Group( PerfCounterGroup::ForCurrentThread() )
+    , m_Start( m_Group.Read() )
+  {}
+
+  void Report( benchmark::State& state ) const {
+    if ( !m_Group.Available() ) {
+      state.SetLabel( m_Group.Error() );
+      return;
+    }
+    const PerfCounterValues delta = m_Group.Read() - m_Start;
+    for ( int i = 0; i < PerfCounterValues::NumberOfEvents; ++i ) {
+      if ( m_Group.Available( i ) ) {
+	state.counters[PerfCounterValues::EventName( i )] =
+	  benchmark::Counter( static_cast< double >( delta.counts[i] ), benchmark::Counter::kAvgIterations );
+      }
+    }
+  }
+
+private:
+  const PerfCounterGroup& m_Group;
+  PerfCounterValues m_Start;
+};
+
+#endif
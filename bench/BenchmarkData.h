@@ -0,0 +1,84 @@
+#ifndef __BenchmarkData_h
+#define __BenchmarkData_h
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "Eigen/Dense"
+
+#include "IO/SyntheticBaggedDataset.h"
+
+/*
+  Synthetic data for the benchmarks.
+
+  Everything is generated from a fixed seed, so repeated runs, and runs on
+  different revisions, measure the same inputs.
+*/
+const uint32_t BenchmarkSeed = 20160525;
+
+/**
+   n row-major instances of histograms x bins features. Every histogram is
+   normalized to sum to one and has a peak at a random bin.
+*/
+template< typename TMatrix >
+TMatrix
+randomHistograms( std::size_t n, std::size_t histograms, std::size_t bins, std::mt19937& gen ) {
+  std::uniform_real_distribution<double> disValue(0, 1);
+  std::uniform_int_distribution<std::size_t> disBin(0, bins - 1);
+  TMatrix instances( n, histograms * bins );
+  for ( std::size_t i = 0; i < n; ++i ) {
+    for ( std::size_t h = 0; h < histograms; ++h ) {
+      double* histogram = instances.data() + i * histograms * bins + h * bins;
+      const std::size_t peakBin = disBin( gen );
+      double sum = 0;
+      for ( std::size_t b = 0; b < bins; ++b ) {
+	histogram[b] = disValue( gen ) + ( b == peakBin ? bins : 0 );
+	sum += histogram[b];
+      }
+      for ( std::size_t b = 0; b < bins; ++b ) {
+	histogram[b] /= sum;
+      }
+    }
+  }
+  return instances;
+}
+
+/**
+   Bags of bagSize instances of two classes of histograms, labeled with the
+   proportion of positive instances. See SyntheticBaggedDataset.
+*/
+template< typename TBaggedDataset >
+TBaggedDataset
+syntheticBags( std::size_t numberOfBags, std::size_t bagSize, std::size_t histograms, std::size_t bins ) {
+  SyntheticBaggedDatasetParameters params( numberOfBags,
+					   bagSize,
+					   SyntheticBaggedDatasetParameters::FIXED,
+					   bagSize,
+					   bagSize,
+					   histograms,
+					   bins );
+  params.seed = BenchmarkSeed;
+  return SyntheticBaggedDataset( params ).ToBaggedDataset< TBaggedDataset >();
+}
+
+/**
+   A random numberOfBags x k cluster to bag map with rows that sum to one
+*/
+template< typename TMatrix >
+TMatrix
+randomClusterBagMap( std::size_t numberOfBags, std::size_t k ) {
+  std::mt19937 gen( BenchmarkSeed );
+  std::uniform_real_distribution<double> disValue(0, 1);
+  TMatrix clusterBagMap( numberOfBags, k );
+  for ( std::size_t i = 0; i < numberOfBags; ++i ) {
+    for ( std::size_t j = 0; j < k; ++j ) {
+      clusterBagMap( i, j ) = disValue( gen );
+    }
+    clusterBagMap.row( i ) /= clusterBagMap.row( i ).sum();
+  }
+  return clusterBagMap;
+}
+
+#endif
@@ -0,0 +1,202 @@
+/*
+  Benchmark instance clustering and prediction with a cluster model
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "bd/BaggedDataset.h"
+
+#include "Algorithms/DeduplicatingInstanceClusterer.h"
+#include "Algorithms/KMeansInstanceClusterer.h"
+#include "Algorithms/MiniBatchKMeansInstanceClusterer.h"
+#include "Distances/EarthMoversDistance.h"
+#include "Distances/WeightedNxMDistance.h"
+#include "Models/ClusterModel.h"
+#include "Util/MatrixOperations.h"
+#include "Util/ParallelMatrixOperations.h"
+
+#include "BenchmarkCounters.h"
+#include "BenchmarkData.h"
+
+typedef BaggedDataset< 1, 1 > BaggedDatasetType;
+typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
+typedef KMeansInstanceClusterer< BaggedDatasetType, DistanceType > ClustererType;
+typedef ClusterModel< DistanceType, BaggedDatasetType > ModelType;
+typedef BaggedDatasetType::MatrixType MatrixType;
+
+// bags, bag size, histograms x bins and k
+static void ClusteringArguments( benchmark::internal::Benchmark* b ) {
+  b->ArgNames({ "bags", "bagSize", "histograms", "bins", "k" })
+    ->Args({  20,  50,  4, 16,   8 })
+    ->Args({ 100,  50,  4, 16,   8 })
+    ->Args({ 100, 100, 16, 32,   8 })
+    ->Args({ 100, 100, 16, 32,  32 })
+    ->Args({ 500, 100, 16, 32,  32 })
+    ->Args({ 500, 100, 16, 32, 128 });
+}
+
+static void BM_KMeansInstanceClusterer_Cluster( benchmark::State& state ) {
+  BaggedDatasetType bags =
+    syntheticBags< BaggedDatasetType >( state.range(0), state.range(1), state.range(2), state.range(3) );
+  const std::vector< double > weights( state.range(2), 0.5 );
+  const DistanceType dist( weights.data(), weights.size() );
+  ClustererType::ParameterType params( state.range(4) );
+  BenchmarkCounters counters;
+  for ( auto _ : state ) {
+    // Cluster adjusts k to the branching factor, so we start from the same
+    // parameters every time
+    ClustererType clusterer( params );
+    ClustererType::InstanceClusteringType clustering = clusterer.Cluster( bags, dist );
+    benchmark::DoNotOptimize( clustering.clusterBagMap.data() );
+  }
+  counters.Report( state );
+  state.SetItemsProcessed( state.iterations() * bags.NumberOfInstances() );
+}
+BENCHMARK( BM_KMeansInstanceClusterer_Cluster )
+  ->Apply( ClusteringArguments )
+  ->Unit( benchmark::kMillisecond );
+
+static void BM_MiniBatchKMeansInstanceClusterer_Cluster( benchmark::State& state ) {
+  typedef MiniBatchKMeansInstanceClusterer< BaggedDatasetType, DistanceType > MiniBatchClustererType;
+  BaggedDatasetType bags =
+    syntheticBags< BaggedDatasetType >( state.range(0), state.range(1), state.range(2), state.range(3) );
+  const std::vector< double > weights( state.range(2), 0.5 );
+  const DistanceType dist( weights.data(), weights.size() );
+  MiniBatchClustererType clusterer( MiniBatchClustererType::ParameterType( state.range(4) ) );
+  BenchmarkCounters counters;
+  for ( auto _ : state ) {
+    MiniBatchClustererType::InstanceClusteringType clustering = clusterer.Cluster( bags, dist );
+    benchmark::DoNotOptimize( clustering.clusterBagMap.data() );
+  }
+  counters.Report( state );
+  state.SetItemsProcessed( state.iterations() * bags.NumberOfInstances() );
+}
+BENCHMARK( BM_MiniBatchKMeansInstanceClusterer_Cluster )
+  ->Apply( ClusteringArguments )
+  ->Unit( benchmark::kMillisecond );
+
+// Clustering with a share of the instances being copies of other instances
+static void BM_DeduplicatingInstanceClusterer_Cluster( benchmark::State& state ) {
+  typedef DeduplicatingInstanceClusterer< ClustererType > DeduplicatingClustererType;
+  const BaggedDatasetType synthetic =
+    syntheticBags< BaggedDatasetType >( state.range(0), state.range(1), state.range(2), state.range(3) );
+  // Every instance is replaced by one of the first distinct instances
+  MatrixType instances = synthetic.Instances();
+  const std::size_t n = synthetic.NumberOfInstances();
+  const std::size_t distinct = std::max< std::size_t >( 1, n * ( 100 - state.range(5) ) / 100 );
+  std::mt19937 gen( BenchmarkSeed );
+  std::uniform_int_distribution< std::size_t > disDistinct( 0, distinct - 1 );
+  for ( std::size_t i = distinct; i < n; ++i ) {
+    instances.row( i ) = instances.row( disDistinct( gen ) );
+  }
+  BaggedDatasetType bags( instances, synthetic.Indices(), synthetic.BagLabels(), synthetic.InstanceLabels() );
+  const std::vector< double > weights( state.range(2), 0.5 );
+  const DistanceType dist( weights.data(), weights.size() );
+  ClustererType::ParameterType params( state.range(4) );
+  BenchmarkCounters counters;
+  for ( auto _ : state ) {
+    // The distinct instances are found once per clusterer, as in training
+    state.PauseTiming();
+    DeduplicatingClustererType clusterer( params );
+    clusterer.Cluster( bags, dist );
+    state.ResumeTiming();
+    DeduplicatingClustererType::InstanceClusteringType clustering = clusterer.Cluster( bags, dist );
+    benchmark::DoNotOptimize( clustering.clusterBagMap.data() );
+  }
+  counters.Report( state );
+  state.SetItemsProcessed( state.iterations() * bags.NumberOfInstances() );
+}
+BENCHMARK( BM_DeduplicatingInstanceClusterer_Cluster )
+  ->ArgNames({ "bags", "bagSize", "histograms", "bins", "k", "duplicates%" })
+  ->Args({ 100, 100, 16, 32,  32,  0 })
+  ->Args({ 100, 100, 16, 32,  32, 50 })
+  ->Args({ 500, 100, 16, 32,  32,  0 })
+  ->Args({ 500, 100, 16, 32,  32, 50 })
+  ->Unit( benchmark::kMillisecond );
+
+// instances, bags, k, sorted bag indices and strategy, where strategy -1 is
+// the serial coOccurenceMatrix
+static void BM_CoOccurenceMatrix( benchmark::State& state ) {
+  const std::size_t n = state.range(0);
+  std::mt19937 gen( BenchmarkSeed );
+  std::uniform_int_distribution< std::size_t > disBag( 0, state.range(1) - 1 );
+  std::uniform_int_distribution< int > disCluster( 0, state.range(2) - 1 );
+  std::vector< std::size_t > bagIndices( n );
+  std::vector< int > clusters( n );
+  for ( std::size_t i = 0; i < n; ++i ) {
+    bagIndices[i] = disBag( gen );
+    clusters[i] = disCluster( gen );
+  }
+  if ( state.range(3) ) {
+    std::sort( bagIndices.begin(), bagIndices.end() );
+  }
+  MatrixType counts( state.range(1), state.range(2) );
+  for ( auto _ : state ) {
+    counts.setZero();
+    if ( state.range(4) < 0 ) {
+      coOccurenceMatrix( bagIndices.cbegin(), bagIndices.cend(), clusters.cbegin(), clusters.cend(), counts );
+    }
+    else {
+      parallelCoOccurenceMatrix( bagIndices.cbegin(), bagIndices.cend(), clusters.cbegin(), clusters.cend(), counts,
+				 0, static_cast< CoOccurenceStrategy >( state.range(4) ) );
+    }
+    benchmark::DoNotOptimize( counts.data() );
+  }
+  state.SetItemsProcessed( state.iterations() * n );
+}
+BENCHMARK( BM_CoOccurenceMatrix )
+  ->ArgNames({ "instances", "bags", "k", "sorted", "strategy" })
+  ->ArgsProduct({ { 1 << 22 }, { 1000 }, { 32 }, { 0, 1 }, { -1, 0, 3, 4 } })
+  ->Args({ 1 << 22, 1000, 32, 1, 2 })
+  ->Unit( benchmark::kMillisecond );
+
+// The last argument is the chunk size of the scratch: 0 predicts without a
+// scratch, i.e. all instances at once, -1 uses the default scratch, which
+// covers all cores, and 4096 the former default, which used at most 4
+// threads of the search
+static void PredictionArguments( benchmark::internal::Benchmark* b ) {
+  b->ArgNames({ "bags", "bagSize", "histograms", "bins", "k", "chunk" })
+    ->Args({  20,  50,  4, 16,   8, -1 })
+    ->Args({ 100, 100, 16, 32,  32, -1 })
+    ->ArgsProduct({ { 500 }, { 100 }, { 16 }, { 32 }, { 128 }, { 0, -1, 4096 } });
+}
+
+static void BM_ClusterModel_Predict( benchmark::State& state ) {
+  const BaggedDatasetType bags =
+    syntheticBags< BaggedDatasetType >( state.range(0), state.range(1), state.range(2), state.range(3) );
+  const std::size_t k = state.range(4);
+  std::mt19937 gen( BenchmarkSeed );
+  const MatrixType centroids = randomHistograms< MatrixType >( k, state.range(2), state.range(3), gen );
+  ModelType::LabelVectorType centroidLabels = ModelType::LabelVectorType::Zero( k );
+  for ( std::size_t i = 0; i < k; i += 2 ) {
+    centroidLabels( i ) = 1;
+  }
+  const std::vector< double > weights( state.range(2), 0.5 );
+  const ModelType model( centroids, centroidLabels, weights );
+
+  std::vector< double > labels( bags.NumberOfInstances() );
+  const long chunk = state.range(5);
+  PredictionScratch scratch( chunk > 0 ? chunk : PredictionScratch::DefaultChunkSize() );
+  BenchmarkCounters counters;
+  for ( auto _ : state ) {
+    if ( chunk == 0 ) {
+      model.Predict( bags.Instances().data(), bags.NumberOfInstances(), labels.data() );
+    }
+    else {
+      model.Predict( bags.Instances().data(), bags.NumberOfInstances(), labels.data(), scratch );
+    }
+    benchmark::DoNotOptimize( labels.data() );
+  }
+  counters.Report( state );
+  state.SetItemsProcessed( state.iterations() * bags.NumberOfInstances() );
+}
+BENCHMARK( BM_ClusterModel_Predict )
+  ->Apply( PredictionArguments )
+  ->Unit( benchmark::kMillisecond )
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
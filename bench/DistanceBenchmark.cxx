@@ -0,0 +1,117 @@
+/*
+  Benchmark the distance functors and the Hausdorff distance between bags
+ */
+
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "bd/BaggedDataset.h"
+
+#include "Algorithms/BagDistanceMatrix.h"
+#include "Distances/EarthMoversDistance.h"
+#include "Distances/Hausdorff.h"
+#include "Distances/WeightedEarthMoversDistance2.h"
+#include "Distances/WeightedNxMDistance.h"
+
+#include "BenchmarkData.h"
+
+typedef Eigen::Matrix< double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor > MatrixType;
+
+// Distances are measured between all pairs of a pool of instances that is
+// small enough to stay in cache, so we measure computation and not memory.
+const std::size_t PoolSize = 64;
+
+// histograms x bins
+static void DistanceArguments( benchmark::internal::Benchmark* b ) {
+  b->ArgNames({ "histograms", "bins" })
+    ->ArgsProduct({ { 1, 4, 16 }, { 8, 32, 128 } });
+}
+
+template< typename TDistance >
+static void runPairwise( benchmark::State& state, const TDistance& dist ) {
+  const std::size_t histograms = state.range(0);
+  const std::size_t bins = state.range(1);
+  const std::size_t dimension = histograms * bins;
+  std::mt19937 gen( BenchmarkSeed );
+  const MatrixType pool = randomHistograms< MatrixType >( PoolSize, histograms, bins, gen );
+  for ( auto _ : state ) {
+    double sum = 0;
+    for ( std::size_t i = 0; i < PoolSize; ++i ) {
+      for ( std::size_t j = 0; j < PoolSize; ++j ) {
+	sum += dist( pool.data() + i * dimension, pool.data() + j * dimension, dimension );
+      }
+    }
+    benchmark::DoNotOptimize( sum );
+  }
+  state.SetItemsProcessed( state.iterations() * PoolSize * PoolSize );
+  state.SetBytesProcessed( state.iterations() * PoolSize * PoolSize * 2 * dimension * sizeof(double) );
+}
+
+static void BM_EarthMoversDistance( benchmark::State& state ) {
+  runPairwise( state, EarthMoversDistance() );
+}
+BENCHMARK( BM_EarthMoversDistance )->Apply( DistanceArguments );
+
+static void BM_WeightedNxMDistance( benchmark::State& state ) {
+  const std::vector< double > weights( state.range(0), 0.5 );
+  runPairwise( state, WeightedNxMDistance< EarthMoversDistance >( weights.data(), weights.size() ) );
+}
+BENCHMARK( BM_WeightedNxMDistance )->Apply( DistanceArguments );
+
+static void BM_WeightedEarthMoversDistance2( benchmark::State& state ) {
+  const std::vector< double > weights( state.range(0), 0.5 );
+  runPairwise( state, WeightedEarthMoversDistance2( weights.data(), weights.size() ) );
+}
+BENCHMARK( BM_WeightedEarthMoversDistance2 )->Apply( DistanceArguments );
+
+// Hausdorff distance between two bags of bagSize instances. Items are the
+// pairs a brute force computation compares.
+static void BM_Hausdorff( benchmark::State& state ) {
+  const std::size_t bagSize = state.range(0);
+  const std::size_t histograms = state.range(1);
+  const std::size_t bins = state.range(2);
+  const HausdorffParameters params( state.range(3) );
+  const std::size_t dimension = histograms * bins;
+  std::mt19937 gen( BenchmarkSeed );
+  const MatrixType x = randomHistograms< MatrixType >( bagSize, histograms, bins, gen );
+  const MatrixType y = randomHistograms< MatrixType >( bagSize, histograms, bins, gen );
+  const std::vector< double > weights( histograms, 0.5 );
+  const WeightedNxMDistance< EarthMoversDistance > dist( weights.data(), weights.size() );
+  for ( auto _ : state ) {
+    double d = hausdorff( x.data(), x.data() + x.size(),
+			  y.data(), y.data() + y.size(),
+			  dimension, dist, params );
+    benchmark::DoNotOptimize( d );
+  }
+  state.SetItemsProcessed( state.iterations() * 2 * bagSize * bagSize );
+}
+BENCHMARK( BM_Hausdorff )
+  ->ArgNames({ "bagSize", "histograms", "bins", "pivots" })
+  ->ArgsProduct({ { 10, 100, 500 }, { 4, 16 }, { 32 }, { 0, 4 } });
+
+// Hausdorff distances between all pairs of bags
+static void BM_BagDistanceMatrix( benchmark::State& state ) {
+  typedef BaggedDataset< 1, 1 > BaggedDatasetType;
+  const std::size_t numberOfBags = state.range(0);
+  const std::size_t bagSize = state.range(1);
+  const std::size_t histograms = 4;
+  const BaggedDatasetType bags = syntheticBags< BaggedDatasetType >( numberOfBags, bagSize, histograms, 32 );
+  const std::vector< double > weights( histograms, 0.5 );
+  const WeightedNxMDistance< EarthMoversDistance > dist( weights.data(), weights.size() );
+  const BagDistanceMatrixParameters params( 32, state.range(2) );
+  const BagDistanceMatrixEngine< WeightedNxMDistance< EarthMoversDistance > > engine( dist, params );
+  for ( auto _ : state ) {
+    BagDistanceMatrix matrix = engine.Compute( bags );
+    benchmark::DoNotOptimize( matrix.Data() );
+  }
+  state.SetItemsProcessed( state.iterations() * numberOfBags * ( numberOfBags - 1 ) / 2 );
+}
+BENCHMARK( BM_BagDistanceMatrix )
+  ->ArgNames({ "bags", "bagSize", "threads" })
+  ->ArgsProduct({ { 32, 128 }, { 20, 100 }, { 1, 0 } })
+  ->Unit( benchmark::kMillisecond )
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,119 @@
+/*
+  Benchmark cluster labeling given a cluster to bag map
+ */
+
+#include "benchmark/benchmark.h"
+
+#include "bd/BaggedDataset.h"
+
+#include "Algorithms/ContinuousClusterLabeler.h"
+#include "Algorithms/GreedyBinaryClusterLabeler.h"
+#include "Losses/CeresCostFunction2.h"
+#include "Losses/ScalarLosses.h"
+#include "Losses/ScalarRisk.h"
+
+#include "BenchmarkCounters.h"
+#include "BenchmarkData.h"
+
+typedef GreedyBinaryClusterLabeler< ScalarRisk< L1_ScalarLoss > > GreedyLabelerType;
+typedef ContinuousClusterLabeler< CeresCostFunction2 > ContinuousLabelerType;
+
+// The labelers only see the bag labels and the cluster to bag map, so the
+// instances are kept small
+const std::size_t BagSize = 10;
+const std::size_t Histograms = 1;
+const std::size_t Bins = 8;
+
+// bags and k
+static void LabelerArguments( benchmark::internal::Benchmark* b ) {
+  b->ArgNames({ "bags", "k" })
+    ->ArgsProduct({ { 20, 100, 1000 }, { 8, 32, 128 } });
+}
+
+template< typename TLabeler >
+static void runLabeler( benchmark::State& state, TLabeler labeler = TLabeler() ) {
+  typedef typename TLabeler::BaggedDatasetType BaggedDatasetType;
+  typedef typename TLabeler::MatrixType MatrixType;
+  typedef typename TLabeler::ClusterLabelVectorType ClusterLabelVectorType;
+
+  const std::size_t numberOfBags = state.range(0);
+  const std::size_t k = state.range(1);
+  const BaggedDatasetType bags = syntheticBags< BaggedDatasetType >( numberOfBags, BagSize, Histograms, Bins );
+  const MatrixType clusterBagMap = randomClusterBagMap< MatrixType >( numberOfBags, k );
+  BenchmarkCounters counters;
+  for ( auto _ : state ) {
+    ClusterLabelVectorType labels = ClusterLabelVectorType::Zero( k );
+    double risk = labeler.Label( bags, clusterBagMap, labels );
+    benchmark::DoNotOptimize( risk );
+  }
+  counters.Report( state );
+  state.SetItemsProcessed( state.iterations() * numberOfBags * k );
+}
+
+static void BM_GreedyBinaryClusterLabeler_Label( benchmark::State& state ) {
+  runLabeler< GreedyLabelerType >( state );
+}
+BENCHMARK( BM_GreedyBinaryClusterLabeler_Label )
+  ->Apply( LabelerArguments )
+  ->Unit( benchmark::kMicrosecond );
+
+// One risk for each candidate of a greedy step
+static void BM_GreedyBinaryClusterLabeler_LabelSequential( benchmark::State& state ) {
+  const GreedyLabelerType::ParameterType params( false );
+  runLabeler< GreedyLabelerType >( state, GreedyLabelerType( params ) );
+}
+BENCHMARK( BM_GreedyBinaryClusterLabeler_LabelSequential )
+  ->Apply( LabelerArguments )
+  ->Unit( benchmark::kMicrosecond );
+
+// The risk of all single flips of a labeling, as separate predictions, as
+// fused risks and as one batched risk
+static void BM_ScalarRisk_SingleFlips( benchmark::State& state ) {
+  typedef ScalarRisk< L1_ScalarLoss > RiskType;
+  typedef GreedyLabelerType::MatrixType MatrixType;
+  typedef RiskType::PredictedLabelVectorType VectorType;
+
+  const std::size_t numberOfBags = state.range(0);
+  const std::size_t k = state.range(1);
+  const MatrixType clusterBagMap = randomClusterBagMap< MatrixType >( numberOfBags, k );
+  const VectorType bagLabels = VectorType::Constant( numberOfBags, 0.5 );
+  VectorType labeling = VectorType::Zero( k );
+  MatrixType labelings = MatrixType::Identity( k, k );
+  RiskType::RiskVectorType risks( k );
+  const RiskType risk;
+  for ( auto _ : state ) {
+    switch ( state.range(2) ) {
+    case 0:
+      for ( std::size_t j = 0; j < k; ++j ) {
+	labeling( j ) = 1;
+	risks( j ) = risk( bagLabels, VectorType( clusterBagMap * labeling ) );
+	labeling( j ) = 0;
+      }
+      break;
+    case 1:
+      for ( std::size_t j = 0; j < k; ++j ) {
+	labeling( j ) = 1;
+	risks( j ) = risk( bagLabels, clusterBagMap, labeling );
+	labeling( j ) = 0;
+      }
+      break;
+    default:
+      risk.Risks( bagLabels, clusterBagMap, labelings, risks );
+    }
+    benchmark::DoNotOptimize( risks.data() );
+  }
+  state.SetItemsProcessed( state.iterations() * numberOfBags * k );
+}
+BENCHMARK( BM_ScalarRisk_SingleFlips )
+  ->ArgNames({ "bags", "k", "mode" })
+  ->ArgsProduct({ { 100, 1000 }, { 32, 128 }, { 0, 1, 2 } })
+  ->Unit( benchmark::kMicrosecond );
+
+static void BM_ContinuousClusterLabeler_Label( benchmark::State& state ) {
+  runLabeler< ContinuousLabelerType >( state );
+}
+BENCHMARK( BM_ContinuousClusterLabeler_Label )
+  ->Apply( LabelerArguments )
+  ->Unit( benchmark::kMicrosecond );
+
+BENCHMARK_MAIN();
@@ -0,0 +1,53 @@
+/*
+  Benchmark one evaluation of the CMSTrainer objective, i.e. the work CMA-ES
+  asks for per candidate: cluster the instances with the candidate weights and
+  label the clusters.
+ */
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "bd/BaggedDataset.h"
+
+#include "Algorithms/GreedyBinaryClusterLabeler.h"
+#include "Algorithms/KMeansInstanceClusterer.h"
+#include "Algorithms/Trainers/CMSTrainer.h"
+#include "Distances/EarthMoversDistance.h"
+#include "Distances/WeightedNxMDistance.h"
+#include "Losses/ScalarLosses.h"
+#include "Losses/ScalarRisk.h"
+#include "Tracers/SilentTracer.h"
+
+#include "BenchmarkData.h"
+
+typedef GreedyBinaryClusterLabeler< ScalarRisk< L1_ScalarLoss > > LabelerType;
+typedef LabelerType::BaggedDatasetType BaggedDatasetType;
+typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
+typedef KMeansInstanceClusterer< BaggedDatasetType, DistanceType > ClustererType;
+typedef SilentTracer TracerType;
+typedef CMSTrainer< BaggedDatasetType, ClustererType, LabelerType, TracerType > TrainerType;
+
+static void BM_CMSTrainer_Objective( benchmark::State& state ) {
+  const std::size_t histograms = state.range(2);
+  BaggedDatasetType bags =
+    syntheticBags< BaggedDatasetType >( state.range(0), state.range(1), histograms, state.range(3) );
+  const std::vector< double > weights( histograms, 0.5 );
+  ClustererType::ParameterType clustererParams( state.range(4) );
+  LabelerType labeler;
+  TracerType tracer;
+  for ( auto _ : state ) {
+    ClustererType clusterer( clustererParams );
+    double risk = TrainerType::Objective( bags, clusterer, labeler, tracer, weights.data(), histograms );
+    benchmark::DoNotOptimize( risk );
+  }
+  state.SetItemsProcessed( state.iterations() * bags.NumberOfInstances() );
+}
+BENCHMARK( BM_CMSTrainer_Objective )
+  ->ArgNames({ "bags", "bagSize", "histograms", "bins", "k" })
+  ->Args({  20,  50,  4, 16,  8 })
+  ->Args({ 100, 100, 16, 32, 32 })
+  ->Args({ 500, 100, 16, 32, 32 })
+  ->Unit( benchmark::kMillisecond );
+
+BENCHMARK_MAIN();
@@ -0,0 +1,202 @@
+#ifndef __BagCoreset_h
+#define __BagCoreset_h
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "bd/BaggedDataset.h"
+#include "llp/Algorithms/BagCoresetParameters.h"
+
+/**
+   A weighted subset of the instances of a bagged dataset.
+
+   bags has the same bags and bag labels as the dataset it was built from, and
+   the sampled instances with their instance labels. weights[i] is the weight
+   of instance i of bags and sourceIndices[i] is its index in the full
+   dataset. The weights of the instances of a bag sum to the number of
+   instances of the bag in the full dataset.
+*/
+template< typename TBaggedDataset >
+struct BagCoreset {
+  typedef TBaggedDataset BaggedDatasetType;
+
+  std::size_t Size() const {
+    return weights.size();
+  }
+
+  BaggedDatasetType bags;
+  std::vector< double > weights;
+  std::vector< std::size_t > sourceIndices;
+};
+
+
+/*
+  Build a coreset of the instances of a bagged dataset by sensitivity
+  sampling (Bachem, Lucic and Krause, Scalable k-means clustering via
+  lightweight coresets, 2018), done separately in every bag.
+
+  A bag gets a share of the sampled instances in proportion to its size. The
+  instances of a bag are drawn with replacement with probability
+    q(x) = 1 / (2 n_b) + d(x, mean) / (2 sum_{y in bag} d(y, mean)) ,
+  where mean is the mean of all instances and d is the distance, and get
+  weight 1 / (share q(x)). An instance that is drawn more than once has the
+  sum of the weights of its draws. Finally the weights of a bag are scaled to
+  sum to its number of instances, so the weighted proportions of the clusters
+  in a bag estimate the proportions in the full bag. A bag that is not larger
+  than its share is kept whole with unit weights.
+
+  The sampling is fixed once the coreset is built, so when the distance has
+  parameters that change, such as the feature weights of WeightedNxMDistance,
+  the coreset reflects the geometry of the distance it is built with.
+*/
+template< typename TBaggedDataset, typename TDistance >
+class BagCoresetBuilder
+{
+public:
+  typedef TBaggedDataset BaggedDatasetType;
+  typedef TDistance DistanceType;
+  typedef BagCoresetBuilder< BaggedDatasetType, DistanceType > Self;
+
+  typedef BagCoresetParameters ParameterType;
+  typedef BagCoreset< BaggedDatasetType > CoresetType;
+
+  typedef typename BaggedDatasetType::MatrixType MatrixType;
+  typedef typename BaggedDatasetType::IndexVectorType IndexVectorType;
+  typedef typename BaggedDatasetType::InstanceLabelVectorType InstanceLabelVectorType;
+
+  BagCoresetBuilder( const DistanceType& dist, const ParameterType& params = ParameterType() )
+    : m_Distance( dist )
+    , m_Params( params )
+  {}
+
+  ~BagCoresetBuilder() {}
+
+  /**
+     Sample a coreset of bags
+
+     @param bags   A collection of bags of instances
+     @return       The coreset
+  */
+  CoresetType Build( const BaggedDatasetType& bags ) const {
+    if ( ! bags.Instances().IsRowMajor ) {
+      throw std::logic_error( "Matrix storage order must be row-major" );
+    }
+    if ( bags.NumberOfInstances() == 0 ) {
+      throw std::invalid_argument( "Can not build a coreset of an empty dataset" );
+    }
+
+    const std::size_t n = bags.NumberOfInstances();
+    const std::size_t dimension = bags.Dimension();
+    const std::size_t numberOfBags = bags.NumberOfBags();
+    const double* instances = bags.Instances().data();
+    const IndexVectorType& indices = bags.Indices();
+
+    std::vector< double > mean( dimension, 0 );
+    for ( std::size_t i = 0; i < n; ++i ) {
+      for ( std::size_t j = 0; j < dimension; ++j ) {
+	mean[j] += instances[i * dimension + j];
+      }
+    }
+    for ( double& m : mean ) {
+      m /= n;
+    }
+    std::vector< double > toMean( n );
+    for ( std::size_t i = 0; i < n; ++i ) {
+      toMean[i] = m_Distance( instances + i * dimension, mean.data(), dimension );
+    }
+
+    // Instances of each bag are members[bagStart[b]] ... members[bagStart[b+1]-1]
+    std::vector< std::size_t > bagStart( numberOfBags + 1, 0 );
+    for ( std::size_t i = 0; i < n; ++i ) {
+      ++bagStart[indices[i] + 1];
+    }
+    for ( std::size_t b = 0; b < numberOfBags; ++b ) {
+      bagStart[b + 1] += bagStart[b];
+    }
+    std::vector< std::size_t > members( n );
+    {
+      std::vector< std::size_t > next( bagStart.begin(), bagStart.end() - 1 );
+      for ( std::size_t i = 0; i < n; ++i ) {
+	members[next[indices[i]]++] = i;
+      }
+    }
+
+    // Weight of every instance, instances that are not sampled have weight 0
+    std::vector< double > weights( n, 0 );
+    std::vector< double > probabilities;
+    std::mt19937 gen( m_Params.seed );
+    for ( std::size_t b = 0; b < numberOfBags; ++b ) {
+      const std::size_t* bagMembers = members.data() + bagStart[b];
+      const std::size_t bagSize = bagStart[b + 1] - bagStart[b];
+      if ( bagSize == 0 ) {
+	continue;
+      }
+      const std::size_t share = std::max< std::size_t >( std::max< std::size_t >( 1, m_Params.minimumPerBag ),
+							 m_Params.size * bagSize / n );
+      if ( share >= bagSize ) {
+	for ( std::size_t m = 0; m < bagSize; ++m ) {
+	  weights[bagMembers[m]] = 1;
+	}
+	continue;
+      }
+
+      double total = 0;
+      for ( std::size_t m = 0; m < bagSize; ++m ) {
+	total += toMean[bagMembers[m]];
+      }
+      probabilities.resize( bagSize );
+      for ( std::size_t m = 0; m < bagSize; ++m ) {
+	probabilities[m] = 0.5 / bagSize + ( total > 0 ? 0.5 * toMean[bagMembers[m]] / total : 0.5 / bagSize );
+      }
+      std::discrete_distribution< std::size_t > disMember( probabilities.begin(), probabilities.end() );
+      double sum = 0;
+      for ( std::size_t s = 0; s < share; ++s ) {
+	const std::size_t m = disMember( gen );
+	const double w = 1.0 / ( share * probabilities[m] );
+	weights[bagMembers[m]] += w;
+	sum += w;
+      }
+      const double scale = bagSize / sum;
+      for ( std::size_t m = 0; m < bagSize; ++m ) {
+	weights[bagMembers[m]] *= scale;
+      }
+    }
+
+    // The sampled instances keep their order
+    CoresetType coreset;
+    for ( std::size_t i = 0; i < n; ++i ) {
+      if ( weights[i] > 0 ) {
+	coreset.sourceIndices.push_back( i );
+	coreset.weights.push_back( weights[i] );
+      }
+    }
+    const std::size_t size = coreset.Size();
+    MatrixType coresetInstances( size, dimension );
+    IndexVectorType coresetIndices( size );
+    // Datasets without instance labels give a coreset without instance labels
+    const bool hasLabels = static_cast< std::size_t >( bags.InstanceLabels().rows() ) == n;
+    InstanceLabelVectorType coresetLabels( hasLabels ? size : 0, bags.InstanceLabels().cols() );
+    for ( std::size_t i = 0; i < size; ++i ) {
+      const std::size_t source = coreset.sourceIndices[i];
+      coresetInstances.row( i ) = bags.Instances().row( source );
+      coresetIndices( i ) = indices( source );
+      if ( hasLabels ) {
+	coresetLabels.row( i ) = bags.InstanceLabels().row( source );
+      }
+    }
+    coreset.bags = BaggedDatasetType( coresetInstances, coresetIndices, bags.BagLabels(), coresetLabels );
+    return coreset;
+  }
+
+  ParameterType& Parameters() {
+    return m_Params;
+  }
+
+private:
+  DistanceType m_Distance;
+  ParameterType m_Params;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __BagCoresetParameters_h
+#define __BagCoresetParameters_h
+
+#include <cstddef>
+
+struct BagCoresetParameters {
+  /*
+    Parameters for building a weighted coreset of the instances of a bagged
+    dataset
+
+    @param size           Number of instances sampled over all bags. A bag
+                          gets a share in proportion to its number of
+			  instances
+    @param minimumPerBag  Number of instances sampled from every bag, even if
+                          its share of size is smaller
+    @param seed           Seed of the sampling. The same seed gives the same
+                          coreset
+  */
+  BagCoresetParameters( std::size_t size = 4096,
+			std::size_t minimumPerBag = 1,
+			unsigned int seed = 0 )
+    : size( size )
+    , minimumPerBag( minimumPerBag )
+    , seed( seed )
+  {}
+
+  std::size_t size;
+  std::size_t minimumPerBag;
+  unsigned int seed;
+};
+
+#endif
@@ -0,0 +1,441 @@
+#ifndef __BagDistanceMatrix_h
+#define __BagDistanceMatrix_h
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "Eigen/Dense"
+
+#include "llp/Algorithms/BagDistanceMatrixParameters.h"
+#include "llp/Distances/Hausdorff.h"
+#include "llp/Util/MappedFile.h"
+#include "llp/Util/Parallel.h"
+
+/*
+  Hausdorff distances between all pairs of bags of a bagged dataset.
+
+  The symmetric matrix is split in square tiles of bagsPerTile x bagsPerTile
+  bags and only the tiles on and above the diagonal are computed. Tiles are
+  distributed over threads. For a tile the instances of its row bags and
+  column bags are gathered into two contiguous blocks once, and every bag
+  pair in the tile reads its instances from these blocks, so the instances
+  stay in cache while a thread works on the tile. Only the instances are
+  shared, the distances between instances are computed per bag pair. The
+  second direction of the Hausdorff distance reuses bounds from the first,
+  but not the distances themselves, see HausdorffDistance.
+
+  The matrix can be stored in a file, which is mapped into memory and reused
+  when the matrix is computed again for the same dataset. The file is written
+  in native byte order as a 64 byte header followed by the matrix
+
+    Header
+      char[8]   "LLPBDM02"
+      uint64_t  number of bags
+      uint64_t  fingerprint of the dataset, see bagDatasetFingerprint
+      uint64_t  key of the instance distance, see bagDistanceKey
+    Matrix
+      double    row-major number of bags x number of bags
+
+  The header is written after the matrix, so an interrupted computation never
+  leaves a file that looks complete. A stored matrix is reused only when both
+  the dataset fingerprint and the distance key match.
+*/
+
+struct BagDistanceMatrixHeader {
+  char magic[8];
+  uint64_t numberOfBags;
+  uint64_t fingerprint;
+  uint64_t distanceKey;
+  char reserved[64 - 8 - 3*8];
+
+  static const char* Magic() {
+    return "LLPBDM02";
+  }
+
+  static BagDistanceMatrixHeader Make( uint64_t numberOfBags, uint64_t fingerprint, uint64_t distanceKey ) {
+    BagDistanceMatrixHeader header;
+    std::memset( &header, 0, sizeof header );
+    std::memcpy( header.magic, Magic(), sizeof header.magic );
+    header.numberOfBags = numberOfBags;
+    header.fingerprint = fingerprint;
+    header.distanceKey = distanceKey;
+    return header;
+  }
+
+  uint64_t FileSize() const {
+    return sizeof( BagDistanceMatrixHeader ) + sizeof(double) * numberOfBags * numberOfBags;
+  }
+};
+
+static_assert( sizeof(BagDistanceMatrixHeader) == 64, "Bag distance matrix header must be 64 bytes" );
+
+
+/*
+  Add the bytes of value to the 64 bit FNV-1a hash
+*/
+inline void
+fnv1aAdd( uint64_t& hash, uint64_t value ) {
+  for ( int i = 0; i < 8; ++i ) {
+    hash ^= ( value >> ( 8 * i ) ) & 0xff;
+    hash *= 1099511628211ULL;
+  }
+}
+
+inline uint64_t
+doubleBits( double value ) {
+  uint64_t bits;
+  std::memcpy( &bits, &value, sizeof bits );
+  return bits;
+}
+
+
+/**
+   Fingerprint of the instances and bag membership of a bagged dataset, used
+   to recognize a stored bag distance matrix. 64 bit FNV-1a of the values.
+*/
+template< typename TBaggedDataset >
+uint64_t
+bagDatasetFingerprint( const TBaggedDataset& bags ) {
+  uint64_t hash = 14695981039346656037ULL;
+  const auto& instances = bags.Instances();
+  const auto& indices = bags.Indices();
+  fnv1aAdd( hash, bags.NumberOfBags() );
+  fnv1aAdd( hash, bags.NumberOfInstances() );
+  fnv1aAdd( hash, bags.Dimension() );
+  for ( std::size_t i = 0; i < bags.NumberOfInstances(); ++i ) {
+    fnv1aAdd( hash, indices[i] );
+    for ( std::size_t j = 0; j < bags.Dimension(); ++j ) {
+      fnv1aAdd( hash, doubleBits( instances( i, j ) ) );
+    }
+  }
+  return hash;
+}
+
+
+/**
+   value is true if TDistance has weights, i.e. Weights() and
+   NumberOfWeights() like WeightedNxMDistance
+*/
+template< typename TDistance >
+class HasDistanceWeights {
+  template< typename T >
+  static auto Test( int )
+    -> decltype( std::declval< const T& >().Weights()[0],
+		 std::declval< const T& >().NumberOfWeights(),
+		 std::true_type() );
+
+  template< typename T >
+  static std::false_type Test( ... );
+
+public:
+  static const bool value = decltype( Test< TDistance >( 0 ) )::value;
+};
+
+template< typename TDistance >
+void
+addDistanceWeights( uint64_t& hash, const TDistance& dist, std::true_type ) {
+  fnv1aAdd( hash, dist.NumberOfWeights() );
+  for ( std::size_t i = 0; i < dist.NumberOfWeights(); ++i ) {
+    fnv1aAdd( hash, doubleBits( dist.Weights()[i] ) );
+  }
+}
+
+template< typename TDistance >
+void
+addDistanceWeights( uint64_t&, const TDistance&, std::false_type ) {}
+
+/**
+   Key of the instance distance of a stored bag distance matrix. 64 bit
+   FNV-1a of tag and, if the distance has weights, of the weights. 0 if the
+   distance has no weights and tag is empty, then the distance can not be
+   recognized and a stored matrix is never reused.
+*/
+template< typename TDistance >
+uint64_t
+bagDistanceKey( const TDistance& dist, const std::string& tag ) {
+  const bool hasWeights = HasDistanceWeights< TDistance >::value;
+  if ( !hasWeights && tag.empty() ) {
+    return 0;
+  }
+  uint64_t hash = 14695981039346656037ULL;
+  fnv1aAdd( hash, tag.size() );
+  for ( char c : tag ) {
+    fnv1aAdd( hash, static_cast< unsigned char >( c ) );
+  }
+  addDistanceWeights( hash, dist, std::integral_constant< bool, hasWeights >() );
+  return hash == 0 ? 1 : hash;
+}
+
+
+/**
+   Symmetric matrix of distances between bags, either in memory or mapped from
+   a file
+*/
+class BagDistanceMatrix {
+public:
+  typedef Eigen::Matrix< double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor > RowMajorMatrixType;
+  typedef Eigen::Map< const RowMajorMatrixType > MatrixMapType;
+
+  BagDistanceMatrix()
+    : m_NumberOfBags( 0 )
+    , m_Fingerprint( 0 )
+    , m_DistanceKey( 0 )
+    , m_Values()
+    , m_File()
+    , m_Data( nullptr )
+  {}
+
+  /**
+     Matrix owning values, row-major numberOfBags x numberOfBags
+  */
+  BagDistanceMatrix( std::vector< double >&& values, std::size_t numberOfBags )
+    : m_NumberOfBags( numberOfBags )
+    , m_Fingerprint( 0 )
+    , m_DistanceKey( 0 )
+    , m_Values( std::move( values ) )
+    , m_File()
+    , m_Data( m_Values.data() )
+  {
+    if ( m_Values.size() != numberOfBags * numberOfBags ) {
+      throw std::invalid_argument( "Bag distance matrix must be square" );
+    }
+  }
+
+  BagDistanceMatrix( BagDistanceMatrix&& ) = default;
+  BagDistanceMatrix& operator=( BagDistanceMatrix&& ) = default;
+
+  /**
+     Map a matrix stored by BagDistanceMatrixEngine
+  */
+  static BagDistanceMatrix Open( const std::string& path ) {
+    BagDistanceMatrix matrix;
+    matrix.m_File = MappedFile::OpenReadOnly( path );
+    BagDistanceMatrixHeader header;
+    if ( matrix.m_File.Size() < sizeof header ) {
+      throw std::runtime_error( "Bag distance matrix is truncated: " + path );
+    }
+    std::memcpy( &header, matrix.m_File.Data(), sizeof header );
+    if ( std::memcmp( header.magic, BagDistanceMatrixHeader::Magic(), sizeof header.magic ) != 0 ) {
+      throw std::runtime_error( "Not a bag distance matrix: " + path );
+    }
+    if ( matrix.m_File.Size() < header.FileSize() ) {
+      throw std::runtime_error( "Bag distance matrix is truncated: " + path );
+    }
+    matrix.m_NumberOfBags = header.numberOfBags;
+    matrix.m_Fingerprint = header.fingerprint;
+    matrix.m_DistanceKey = header.distanceKey;
+    matrix.m_Data = reinterpret_cast< const double* >( matrix.m_File.Data() + sizeof header );
+    return matrix;
+  }
+
+  std::size_t NumberOfBags() const {
+    return m_NumberOfBags;
+  }
+
+  /**
+     Fingerprint of the dataset of a stored matrix, 0 for a matrix in memory
+  */
+  uint64_t Fingerprint() const {
+    return m_Fingerprint;
+  }
+
+  /**
+     Key of the instance distance of a stored matrix, 0 for a matrix in memory
+  */
+  uint64_t DistanceKey() const {
+    return m_DistanceKey;
+  }
+
+  bool IsMapped() const {
+    return m_File.Data() != nullptr;
+  }
+
+  double operator()( std::size_t i, std::size_t j ) const {
+    return m_Data[i * m_NumberOfBags + j];
+  }
+
+  const double* Data() const {
+    return m_Data;
+  }
+
+  MatrixMapType Matrix() const {
+    return MatrixMapType( m_Data, m_NumberOfBags, m_NumberOfBags );
+  }
+
+private:
+  std::size_t m_NumberOfBags;
+  uint64_t m_Fingerprint;
+  uint64_t m_DistanceKey;
+  std::vector< double > m_Values;
+  MappedFile m_File;
+  const double* m_Data;
+};
+
+
+/**
+   Compute the Hausdorff distances between all pairs of bags.
+
+   TDistance is the distance between instances, see HausdorffDistance. The
+   diagonal is zero. The result does not depend on the tiling or the number
+   of threads.
+*/
+template< typename TDistance >
+class BagDistanceMatrixEngine {
+public:
+  typedef TDistance DistanceType;
+  typedef BagDistanceMatrixParameters ParameterType;
+
+  BagDistanceMatrixEngine( const DistanceType& dist,
+			   const ParameterType& params=ParameterType() )
+    : m_Distance( dist )
+    , m_Params( params )
+  {}
+
+  /**
+     Distance matrix of bags. If a path is given and it holds the matrix of
+     the same dataset and distance, the stored matrix is mapped instead of
+     computed. Otherwise the matrix is computed into a new file at path. The
+     distance is recognized by bagDistanceKey of the distance and the
+     distanceTag parameter.
+  */
+  template< typename TBaggedDataset >
+  BagDistanceMatrix Compute( const TBaggedDataset& bags ) const {
+    const std::size_t numberOfBags = bags.NumberOfBags();
+    if ( m_Params.path.empty() ) {
+      std::vector< double > values( numberOfBags * numberOfBags );
+      Fill( bags, values.data() );
+      return BagDistanceMatrix( std::move( values ), numberOfBags );
+    }
+
+    const uint64_t fingerprint = bagDatasetFingerprint( bags );
+    const uint64_t distanceKey = bagDistanceKey( m_Distance, m_Params.distanceTag );
+    struct stat st;
+    if ( distanceKey != 0 && stat( m_Params.path.c_str(), &st ) == 0 ) {
+      try {
+	BagDistanceMatrix stored = BagDistanceMatrix::Open( m_Params.path );
+	if ( stored.NumberOfBags() == numberOfBags && stored.Fingerprint() == fingerprint &&
+	     stored.DistanceKey() == distanceKey ) {
+	  return stored;
+	}
+      }
+      catch ( const std::runtime_error& ) {
+	// Not a usable matrix, compute it again
+      }
+    }
+
+    const BagDistanceMatrixHeader header = BagDistanceMatrixHeader::Make( numberOfBags, fingerprint, distanceKey );
+    {
+      MappedFile file = MappedFile::Create( m_Params.path, header.FileSize() );
+      Fill( bags, reinterpret_cast< double* >( file.Data() + sizeof header ) );
+      file.Sync();
+      std::memcpy( file.Data(), &header, sizeof header );
+      file.Sync();
+    }
+    return BagDistanceMatrix::Open( m_Params.path );
+  }
+
+private:
+  /*
+    Compute the matrix into values, row-major numberOfBags x numberOfBags
+  */
+  template< typename TBaggedDataset >
+  void Fill( const TBaggedDataset& bags, double* values ) const {
+    const std::size_t numberOfBags = bags.NumberOfBags();
+    const std::size_t dimension = bags.Dimension();
+    const auto& instances = bags.Instances();
+    const auto& indices = bags.Indices();
+
+    // Instances of each bag are members[bagStart[b]] ... members[bagStart[b+1]-1]
+    std::vector< std::size_t > bagStart( numberOfBags + 1, 0 );
+    for ( std::size_t i = 0; i < bags.NumberOfInstances(); ++i ) {
+      ++bagStart[indices[i] + 1];
+    }
+    for ( std::size_t b = 0; b < numberOfBags; ++b ) {
+      bagStart[b + 1] += bagStart[b];
+    }
+    std::vector< std::size_t > members( bags.NumberOfInstances() );
+    {
+      std::vector< std::size_t > next( bagStart.begin(), bagStart.end() - 1 );
+      for ( std::size_t i = 0; i < bags.NumberOfInstances(); ++i ) {
+	members[next[indices[i]]++] = i;
+      }
+    }
+
+    // Copy the instances of bags [first, last) into block. Instances of bag
+    // first + k start at row offsets[k] of the block.
+    auto gather = [&]( std::size_t first, std::size_t last,
+		       std::vector< double >& block, std::vector< std::size_t >& offsets ) {
+      block.resize( ( bagStart[last] - bagStart[first] ) * dimension );
+      offsets.resize( last - first + 1 );
+      for ( std::size_t b = first; b <= last; ++b ) {
+	offsets[b - first] = bagStart[b] - bagStart[first];
+      }
+      double* row = block.data();
+      for ( std::size_t m = bagStart[first]; m < bagStart[last]; ++m, row += dimension ) {
+	for ( std::size_t j = 0; j < dimension; ++j ) {
+	  row[j] = instances( members[m], j );
+	}
+      }
+    };
+
+    const std::size_t bagsPerTile = std::max< std::size_t >( 1, m_Params.bagsPerTile );
+    const std::size_t tilesPerSide = ( numberOfBags + bagsPerTile - 1 ) / bagsPerTile;
+    const std::size_t numberOfTiles = tilesPerSide * ( tilesPerSide + 1 ) / 2;
+    const HausdorffDistance< DistanceType > hausdorff( m_Distance, m_Params.hausdorff );
+
+    parallelFor( numberOfTiles, 1, m_Params.numberOfThreads,
+		 [&]( std::size_t begin, std::size_t end ) {
+		   std::vector< double > rowBlock, colBlock;
+		   std::vector< std::size_t > rowOffsets, colOffsets;
+		   for ( std::size_t tile = begin; tile < end; ++tile ) {
+		     // Tiles are numbered row by row through the upper triangle
+		     std::size_t tileRow = 0, tileCol = tile;
+		     while ( tileCol >= tilesPerSide - tileRow ) {
+		       tileCol -= tilesPerSide - tileRow;
+		       ++tileRow;
+		     }
+		     tileCol += tileRow;
+
+		     const std::size_t rowFirst = tileRow * bagsPerTile;
+		     const std::size_t rowLast = std::min( numberOfBags, rowFirst + bagsPerTile );
+		     const std::size_t colFirst = tileCol * bagsPerTile;
+		     const std::size_t colLast = std::min( numberOfBags, colFirst + bagsPerTile );
+		     gather( rowFirst, rowLast, rowBlock, rowOffsets );
+		     const bool diagonal = tileRow == tileCol;
+		     if ( !diagonal ) {
+		       gather( colFirst, colLast, colBlock, colOffsets );
+		     }
+		     const std::vector< double >& cols = diagonal ? rowBlock : colBlock;
+		     const std::vector< std::size_t >& colOffs = diagonal ? rowOffsets : colOffsets;
+
+		     for ( std::size_t i = rowFirst; i < rowLast; ++i ) {
+		       const double* x = rowBlock.data() + rowOffsets[i - rowFirst] * dimension;
+		       const double* xEnd = rowBlock.data() + rowOffsets[i - rowFirst + 1] * dimension;
+		       if ( diagonal ) {
+			 values[i * numberOfBags + i] = 0;
+		       }
+		       for ( std::size_t j = diagonal ? i + 1 : colFirst; j < colLast; ++j ) {
+			 const double* y = cols.data() + colOffs[j - colFirst] * dimension;
+			 const double* yEnd = cols.data() + colOffs[j - colFirst + 1] * dimension;
+			 const double d = hausdorff( x, xEnd, y, yEnd, dimension );
+			 values[i * numberOfBags + j] = d;
+			 values[j * numberOfBags + i] = d;
+		       }
+		     }
+		   }
+		 } );
+  }
+
+  const DistanceType m_Distance;
+  const ParameterType m_Params;
+};
+
+#endif
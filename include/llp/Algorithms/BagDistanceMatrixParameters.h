@@ -0,0 +1,45 @@
+#ifndef __BagDistanceMatrixParameters_h
+#define __BagDistanceMatrixParameters_h
+
+#include <cstddef>
+#include <string>
+
+#include "llp/Distances/HausdorffParameters.h"
+
+struct BagDistanceMatrixParameters {
+  /*
+    Parameters for computing the distances between all pairs of bags
+
+    @param bagsPerTile      Number of bags on each side of a tile of the
+                            matrix. A tile is the unit of work of a thread
+    @param numberOfThreads  Maximum number of threads. 0 means use all cores
+    @param path             File the matrix is stored in and reused from. Empty
+                            means keep the matrix in memory
+    @param hausdorff        Parameters of the Hausdorff distance between two
+                            bags
+    @param distanceTag      Name of the instance distance, stored with the
+                            matrix. A stored matrix is only reused for the same
+                            tag and, if the distance has weights, the same
+                            weights. A distance without weights and an empty
+                            tag never reuses a stored matrix
+  */
+  BagDistanceMatrixParameters( std::size_t bagsPerTile = 32,
+			       unsigned int numberOfThreads = 0,
+			       const std::string& path = std::string(),
+			       const HausdorffParameters& hausdorff = HausdorffParameters(),
+			       const std::string& distanceTag = std::string() )
+    : bagsPerTile( bagsPerTile )
+    , numberOfThreads( numberOfThreads )
+    , path( path )
+    , hausdorff( hausdorff )
+    , distanceTag( distanceTag )
+  {}
+
+  std::size_t bagsPerTile;
+  unsigned int numberOfThreads;
+  std::string path;
+  HausdorffParameters hausdorff;
+  std::string distanceTag;
+};
+
+#endif
@@ -6,6 +6,7 @@
 #include "ceres/ceres.h"
 
 #include "bd/BaggedDataset.h"
+#include "llp/Util/PerfCounters.h"
 
 /*
   Find optimal proportional labelling of K clusters of N Bags.
@@ -91,6 +92,7 @@ public:
   double Label( const BaggedDatasetType& bags,
 		const MatrixType& clusterBagMap,
 		ClusterLabelVectorType& labeling ) {
+    LLP_COUNT_PHASE( "label" );
 
     // Ceres is responsible for freeing
     CostFunctionType* costFunction = new CostFunctionType(bags.BagLabels(), clusterBagMap);
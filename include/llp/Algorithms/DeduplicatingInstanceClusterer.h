@@ -0,0 +1,180 @@
+#ifndef __DeduplicatingInstanceClusterer_h
+#define __DeduplicatingInstanceClusterer_h
+
+#include <stdexcept>
+#include <vector>
+
+#include "bd/BaggedDataset.h"
+#include "llp/Algorithms/InstanceDeduplication.h"
+#include "llp/Util/MatrixOperations.h"
+#include "llp/Util/ParallelMatrixOperations.h"
+#include "llp/Util/PerfCounters.h"
+#include "llp/Util/PhaseTimer.h"
+
+/*
+  Cluster the distinct instances of bags instead of every copy.
+
+  TInstanceClusterer clusters the distinct instances, each weighted by its
+  number of copies, so it must accept instance weights. The clusterBagMap is
+  counted from the number of copies of each distinct instance in each bag,
+  and every instance gets the cluster of its distinct instance. With a
+  clusterer that treats an instance of weight w as w copies, the clustering is
+  the same as clustering all instances, at the cost of the distinct instances.
+
+  The distinct instances are found on the first call and reused as long as
+  Cluster is called with a dataset of the same size whose instances and bag
+  indices are at the same addresses. A dataset that is changed in place or
+  replaced by another one at the same address is not recognized, so after
+  such a change Invalidate must be called.
+*/
+template< typename TInstanceClusterer >
+class DeduplicatingInstanceClusterer
+{
+public:
+  typedef TInstanceClusterer InstanceClustererType;
+  typedef DeduplicatingInstanceClusterer< InstanceClustererType > Self;
+
+  typedef typename InstanceClustererType::BaggedDatasetType BaggedDatasetType;
+  typedef typename InstanceClustererType::DistanceType DistanceType;
+  typedef typename InstanceClustererType::ParameterType ParameterType;
+  typedef typename InstanceClustererType::InstanceClusteringType InstanceClusteringType;
+
+  typedef typename BaggedDatasetType::MatrixType MatrixType;
+  typedef typename BaggedDatasetType::IndexVectorType IndexVectorType;
+  typedef typename BaggedDatasetType::BagLabelVectorType BagLabelVectorType;
+  typedef typename BaggedDatasetType::InstanceLabelVectorType InstanceLabelVectorType;
+  typedef InstanceDeduplication< BaggedDatasetType > DeduplicationType;
+
+  DeduplicatingInstanceClusterer( const ParameterType& params )
+    : m_Clusterer( params )
+    , m_Instances( nullptr )
+    , m_Indices( nullptr )
+  {}
+
+  ~DeduplicatingInstanceClusterer() {}
+
+
+  /**
+     Cluster all instances from bags using the weighted featurespace defined by
+     DistanceType and weights.
+
+     @param bags             A collection of bags of instances.
+     @param dist             A distance functor
+     @return                 A clustering of instances in bags
+  */
+  InstanceClusteringType Cluster( BaggedDatasetType& bags, const DistanceType& dist )  {
+    const DeduplicationType& deduplication = Deduplicate( bags );
+    return ClusterUnique( bags, dist, deduplication.Multiplicities(), deduplication.BagCounts() );
+  }
+
+  /**
+     Cluster all instances from bags where instance i has weight
+     instanceWeights[i]. A distinct instance has the sum of the weights of its
+     copies.
+
+     @param bags             A collection of bags of instances.
+     @param dist             A distance functor
+     @param instanceWeights  Non-negative weight of each instance
+     @return                 A clustering of instances in bags
+  */
+  InstanceClusteringType Cluster( BaggedDatasetType& bags,
+				  const DistanceType& dist,
+				  const std::vector< double >& instanceWeights )  {
+    if ( instanceWeights.size() != bags.NumberOfInstances() ) {
+      throw std::invalid_argument( "There must be one weight for each instance" );
+    }
+    const DeduplicationType& deduplication = Deduplicate( bags );
+    const std::vector< std::size_t >& uniqueOfInstance = deduplication.UniqueOfInstance();
+    const std::vector< std::size_t >& entryOfInstance = deduplication.EntryOfInstance();
+    std::vector< double > uniqueWeights( deduplication.NumberOfUniqueInstances(), 0 );
+    std::vector< double > entryWeights( deduplication.BagCounts().size(), 0 );
+    for ( std::size_t i = 0; i < instanceWeights.size(); ++i ) {
+      uniqueWeights[uniqueOfInstance[i]] += instanceWeights[i];
+      entryWeights[entryOfInstance[i]] += instanceWeights[i];
+    }
+    return ClusterUnique( bags, dist, uniqueWeights, entryWeights );
+  }
+
+
+  ParameterType& Parameters() {
+    return m_Clusterer.Parameters();
+  }
+
+  /**
+     Forget the distinct instances, so they are found again on the next call
+     of Cluster. Must be called after the dataset is changed in place or
+     replaced by another one at the same address.
+  */
+  void Invalidate() {
+    m_Instances = nullptr;
+    m_Indices = nullptr;
+  }
+
+  /**
+     The distinct instances of the last clustered bags
+  */
+  const DeduplicationType& Deduplication() const {
+    return m_Deduplication;
+  }
+
+private:
+  const DeduplicationType& Deduplicate( const BaggedDatasetType& bags ) {
+    LLP_TIME_PHASE( "deduplication" );
+    LLP_COUNT_PHASE( "deduplication" );
+    if ( m_Instances == bags.Instances().data()
+	 && m_Indices == bags.Indices().data()
+	 && m_Deduplication.NumberOfInstances() == bags.NumberOfInstances()
+	 && static_cast< std::size_t >( m_UniqueBags.Instances().cols() ) == bags.Dimension() ) {
+      return m_Deduplication;
+    }
+    m_Deduplication = DeduplicationType( bags );
+    m_Instances = bags.Instances().data();
+    m_Indices = bags.Indices().data();
+
+    // The distinct instances are given to the clusterer as a single bag, their
+    // bags are counted here
+    const std::size_t numberOfUnique = m_Deduplication.NumberOfUniqueInstances();
+    m_UniqueBags = BaggedDatasetType( m_Deduplication.UniqueInstances(),
+				      IndexVectorType::Zero( numberOfUnique ),
+				      BagLabelVectorType::Zero( 1, bags.BagLabels().cols() ),
+				      InstanceLabelVectorType::Zero( numberOfUnique, bags.InstanceLabels().cols() ) );
+    return m_Deduplication;
+  }
+
+  InstanceClusteringType ClusterUnique( const BaggedDatasetType& bags,
+					const DistanceType& dist,
+					const std::vector< double >& uniqueWeights,
+					const std::vector< double >& entryWeights ) {
+    const InstanceClusteringType unique = m_Clusterer.Cluster( m_UniqueBags, dist, uniqueWeights );
+
+    InstanceClusteringType clustering;
+    clustering.centroids = unique.centroids;
+    clustering.clusterMembershipIndices = m_Deduplication.Expand( unique.clusterMembershipIndices );
+
+    LLP_TIME_PHASE( "cooccurrence" );
+    LLP_COUNT_PHASE( "cooccurrence" );
+    const std::vector< std::size_t >& uniqueIndices = m_Deduplication.UniqueIndices();
+    std::vector< int > entryClusters( uniqueIndices.size() );
+    for ( std::size_t e = 0; e < uniqueIndices.size(); ++e ) {
+      entryClusters[e] = unique.clusterMembershipIndices[uniqueIndices[e]];
+    }
+    clustering.clusterBagMap = MatrixType::Zero( bags.NumberOfBags(), unique.NumberOfClusters() );
+    parallelCoOccurenceMatrix( m_Deduplication.BagIndices().cbegin(),
+			       m_Deduplication.BagIndices().cend(),
+			       entryClusters.cbegin(),
+			       entryClusters.cend(),
+			       entryWeights.cbegin(),
+			       clustering.clusterBagMap
+			       );
+    rowNormalize( clustering.clusterBagMap );
+    return clustering;
+  }
+
+  InstanceClustererType m_Clusterer;
+  DeduplicationType m_Deduplication;
+  BaggedDatasetType m_UniqueBags;
+  const typename MatrixType::Scalar* m_Instances;
+  const typename IndexVectorType::Scalar* m_Indices;
+};
+
+#endif
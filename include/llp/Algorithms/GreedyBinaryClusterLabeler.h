@@ -1,10 +1,56 @@
 #ifndef __GreedyBinaryClusterLabeler_h
 #define __GreedyBinaryClusterLabeler_h
 
+#include <type_traits>
 #include <unordered_set>
+#include <utility>
 
 #include "llp/Algorithms/GreedyBinaryClusterLabelerParameters.h"
 #include "bd/BaggedDataset.h"
+#include "llp/Util/PerfCounters.h"
+
+/**
+   value is true if TRisk can calculate the risk of clusterBagMap *
+   clusterLabels from clusterBagMap and clusterLabels
+*/
+template< typename TRisk, typename TBagLabelVector, typename TMatrix, typename TClusterLabelVector >
+class TakesClusterBagMap {
+  template< typename T >
+  static auto Test( int )
+    -> decltype( std::declval< T& >()( std::declval< const TBagLabelVector& >(),
+				       std::declval< const TMatrix& >(),
+				       std::declval< const TClusterLabelVector& >() ),
+		 std::true_type() );
+
+  template< typename T >
+  static std::false_type Test( ... );
+
+public:
+  static const bool value = decltype( Test< TRisk >( 0 ) )::value;
+};
+
+
+/**
+   value is true if TRisk can calculate the risks of raising each cluster
+   label by one with IncrementRisks
+*/
+template< typename TRisk, typename TBagLabelVector, typename TMatrix >
+class HasIncrementRisks {
+  template< typename T >
+  static auto Test( int )
+    -> decltype( std::declval< const T& >().IncrementRisks( std::declval< const TBagLabelVector& >(),
+							    std::declval< const TMatrix& >(),
+							    std::declval< const typename T::PredictedLabelVectorType& >(),
+							    std::declval< typename T::RiskVectorType& >() ),
+		 std::true_type() );
+
+  template< typename T >
+  static std::false_type Test( ... );
+
+public:
+  static const bool value = decltype( Test< TRisk >( 0 ) )::value;
+};
+
 
 /*
   Find optimal binary labelling of K clusters of N Bags using a greedy 
@@ -25,8 +71,22 @@
   not decrease the error.
 
   TRisk must define
-    double operator()( const BagLabelVectorType& bagLabels, const ClusterLabelVectorType& clusterLabels)
-  which calculates the risk when assigning clusterLabels given bagLabels
+    double operator()( const BagLabelVectorType& bagLabels, const PredictedLabelVectorType& predictedLabels)
+  which calculates the risk when assigning clusterBagMap * clusterLabels
+  given bagLabels. If TRisk also defines
+    double operator()( const BagLabelVectorType& bagLabels, const MatrixType& clusterBagMap, const ClusterLabelVectorType& clusterLabels)
+  it is used instead, as ScalarRisk and IntervalRisk calculate the risk
+  without forming clusterBagMap * clusterLabels. Their sums are in a
+  different order, so candidates with nearly equal risks can be ordered
+  differently than with the first operator.
+
+  With params.batchedCandidates, which is the default, and a TRisk that
+  defines
+    void IncrementRisks( const BagLabelVectorType& bagLabels, const MatrixType& clusterBagMap, const PredictedLabelVectorType& predictedLabels, RiskVectorType& risks ) const
+  which calculates the risk of predictedLabels + clusterBagMap.col(j) for
+  every cluster j, the predictions of all candidates of a step are
+  predictedLabels * 1^T + clusterBagMap, so the candidates are evaluated in
+  one sweep over clusterBagMap. Other risks evaluate one candidate at a time.
 
 */
 template< typename TRisk, size_t BagLabelDim=1 >
@@ -61,6 +121,22 @@ public:
   double Label( const BaggedDatasetType& bags,
 		const MatrixType& clusterBagMap,
 		ClusterLabelVectorType& labeling ) {
+    LLP_COUNT_PHASE( "label" );
+    if ( m_Params.batchedCandidates ) {
+      return LabelBatched( bags, clusterBagMap, labeling,
+			   std::integral_constant< bool, HasIncrementRisks< RiskType, BagLabelVectorType, MatrixType >::value >() );
+    }
+    return LabelSequential( bags, clusterBagMap, labeling );
+  }
+
+
+ private:
+  /*
+    Evaluate the candidates of each greedy step one at a time
+  */
+  double LabelSequential( const BaggedDatasetType& bags,
+			  const MatrixType& clusterBagMap,
+			  ClusterLabelVectorType& labeling ) {
     // We start with all zeros. Then we find best labeling using a single
     // one cluster. We continue like that untill we cannot label more
     // clusters with one without increasing the error.
@@ -74,7 +150,7 @@ public:
 
     RiskType risk;
     ClusterLabelVectorType bestLabeling = ClusterLabelVectorType::Zero( K );
-    double bestRisk = risk( bags.BagLabels(), clusterBagMap * bestLabeling );
+    double bestRisk = ClusterRisk( risk, bags.BagLabels(), clusterBagMap, bestLabeling );
 
     for ( std::size_t i = 1; i <= K; ++i ) {
       labeling = bestLabeling;
@@ -83,7 +159,7 @@ public:
     
       for ( auto it = zeroIdxs.begin(); it != zeroIdxs.end(); ++it ) {
 	labeling(*it) = 1;
-	double thisRisk = risk( bags.BagLabels(), clusterBagMap * labeling);
+	double thisRisk = ClusterRisk( risk, bags.BagLabels(), clusterBagMap, labeling );
 	if ( thisRisk < bestRisk ) {
 	  improved = true;
 	  bestRisk = thisRisk;
@@ -99,11 +175,88 @@ public:
       }     
       zeroIdxs.erase( bestIdx );
     }
+    // When every cluster is labelled with 1 the last step is not undone by
+    // a step without improvement
+    labeling = bestLabeling;
+    return bestRisk;
+  }
+
+  /*
+    The same greedy search, where all candidates of a step are evaluated at
+    once. The candidates are tried in order of cluster index, and the first
+    of equally good candidates is labelled with 1.
+  */
+  double LabelBatched( const BaggedDatasetType& bags,
+		       const MatrixType& clusterBagMap,
+		       ClusterLabelVectorType& labeling,
+		       std::true_type ) {
+    typedef typename RiskType::PredictedLabelVectorType PredictedLabelVectorType;
+    typedef typename RiskType::RiskVectorType RiskVectorType;
+    const std::size_t K = labeling.rows();
+
+    RiskType risk;
+    labeling = ClusterLabelVectorType::Zero( K );
+    PredictedLabelVectorType predictedLabels = PredictedLabelVectorType::Zero( clusterBagMap.rows() );
+    double bestRisk = ClusterRisk( risk, bags.BagLabels(), clusterBagMap, labeling );
+    RiskVectorType risks;
+
+    for ( std::size_t i = 1; i <= K; ++i ) {
+      risk.IncrementRisks( bags.BagLabels(), clusterBagMap, predictedLabels, risks );
+      std::size_t bestIdx = K;
+      for ( std::size_t j = 0; j < K; ++j ) {
+	if ( labeling(j) == 0 && risks(j) < bestRisk ) {
+	  bestRisk = risks(j);
+	  bestIdx = j;
+	}
+      }
+
+      if ( bestIdx == K ) {
+	break;
+      }
+      labeling(bestIdx) = 1;
+      predictedLabels += clusterBagMap.col( bestIdx );
+    }
     return bestRisk;
   }
 
+  /*
+    Risks without IncrementRisks evaluate one candidate at a time
+  */
+  double LabelBatched( const BaggedDatasetType& bags,
+		       const MatrixType& clusterBagMap,
+		       ClusterLabelVectorType& labeling,
+		       std::false_type ) {
+    return LabelSequential( bags, clusterBagMap, labeling );
+  }
+
+  /*
+    Risk of clusterBagMap * clusterLabels, without forming it when the risk
+    can take clusterBagMap and clusterLabels
+  */
+  static double ClusterRisk( RiskType& risk,
+			     const BagLabelVectorType& bagLabels,
+			     const MatrixType& clusterBagMap,
+			     const ClusterLabelVectorType& clusterLabels ) {
+    return ClusterRisk( risk, bagLabels, clusterBagMap, clusterLabels,
+			std::integral_constant< bool, TakesClusterBagMap< RiskType, BagLabelVectorType, MatrixType, ClusterLabelVectorType >::value >() );
+  }
+
+  static double ClusterRisk( RiskType& risk,
+			     const BagLabelVectorType& bagLabels,
+			     const MatrixType& clusterBagMap,
+			     const ClusterLabelVectorType& clusterLabels,
+			     std::true_type ) {
+    return risk( bagLabels, clusterBagMap, clusterLabels );
+  }
+
+  static double ClusterRisk( RiskType& risk,
+			     const BagLabelVectorType& bagLabels,
+			     const MatrixType& clusterBagMap,
+			     const ClusterLabelVectorType& clusterLabels,
+			     std::false_type ) {
+    return risk( bagLabels, clusterBagMap * clusterLabels );
+  }
 
- private:
   ParameterType m_Params;
   
 };
@@ -3,7 +3,18 @@
 
 
 struct GreedyBinaryClusterLabelerParameters {
-  bool dummy;
+  /*
+    @param batchedCandidates  Evaluate all candidate clusters of a greedy step
+                              with RiskType::IncrementRisks in one sweep over
+                              the cluster to bag map, instead of one risk per
+                              candidate. Risks without IncrementRisks always
+                              evaluate one candidate at a time.
+  */
+  GreedyBinaryClusterLabelerParameters( bool batchedCandidates = true )
+    : batchedCandidates( batchedCandidates )
+  {}
+
+  bool batchedCandidates;
 };
 
 #endif
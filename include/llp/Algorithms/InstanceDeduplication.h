@@ -0,0 +1,275 @@
+#ifndef __InstanceDeduplication_h
+#define __InstanceDeduplication_h
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "bd/BaggedDataset.h"
+
+/**
+   The distinct instances of a bagged dataset, with a mapping from every
+   instance to its distinct instance and the number of copies of each distinct
+   instance in each bag.
+
+   Instances are the same when all their values have the same bits. Distinct
+   instances are found by hashing the rows of bags.Instances() and are kept in
+   the order of their first copy.
+
+   A distinct instance u has Multiplicities()[u] copies. Its copies in bag b
+   are one entry e of the bag multiplicities with BagIndices()[e] == b,
+   UniqueIndices()[e] == u and BagCounts()[e] copies, so the co-occurence of
+   bags and clusters of the distinct instances can be counted without going
+   through every copy.
+
+   Fingerprint() recognizes the bags a deduplication was made from, so it can
+   be reused without keeping the bags.
+*/
+template< typename TBaggedDataset >
+class InstanceDeduplication
+{
+public:
+  typedef TBaggedDataset BaggedDatasetType;
+  typedef InstanceDeduplication< BaggedDatasetType > Self;
+  typedef typename BaggedDatasetType::MatrixType MatrixType;
+
+  InstanceDeduplication()
+    : m_NumberOfInstances( 0 )
+    , m_Fingerprint( 0 )
+  {}
+
+  /**
+     Find the distinct instances of bags
+
+     @param bags   A collection of bags of instances
+  */
+  explicit InstanceDeduplication( const BaggedDatasetType& bags )
+    : m_NumberOfInstances( bags.NumberOfInstances() )
+    , m_Fingerprint( StartFingerprint( bags ) )
+  {
+    if ( ! bags.Instances().IsRowMajor ) {
+      throw std::logic_error( "Matrix storage order must be row-major" );
+    }
+    const std::size_t n = bags.NumberOfInstances();
+    const std::size_t dimension = bags.Dimension();
+    const double* instances = bags.Instances().data();
+    const auto& indices = bags.Indices();
+
+    // Distinct instances by hash. Distinct instances with the same hash are
+    // chained through sameHash.
+    std::unordered_map< uint64_t, std::size_t > firstWithHash;
+    firstWithHash.reserve( n );
+    std::vector< std::size_t > sameHash;
+    std::vector< std::size_t > firstCopy;
+    m_UniqueOfInstance.resize( n );
+    for ( std::size_t i = 0; i < n; ++i ) {
+      const double* row = instances + i * dimension;
+      const uint64_t hash = Hash( row, dimension );
+      m_Fingerprint = AddToFingerprint( m_Fingerprint, hash, indices[i] );
+      auto found = firstWithHash.find( hash );
+      std::size_t unique = NotFound;
+      if ( found != firstWithHash.end() ) {
+	for ( std::size_t u = found->second; u != NotFound; u = sameHash[u] ) {
+	  if ( std::memcmp( row, instances + firstCopy[u] * dimension, dimension * sizeof( double ) ) == 0 ) {
+	    unique = u;
+	    break;
+	  }
+	}
+      }
+      if ( unique == NotFound ) {
+	unique = firstCopy.size();
+	firstCopy.push_back( i );
+	m_Multiplicities.push_back( 0 );
+	if ( found != firstWithHash.end() ) {
+	  sameHash.push_back( found->second );
+	  found->second = unique;
+	}
+	else {
+	  sameHash.push_back( NotFound );
+	  firstWithHash.emplace( hash, unique );
+	}
+      }
+      m_UniqueOfInstance[i] = unique;
+      ++m_Multiplicities[unique];
+    }
+
+    m_UniqueInstances = MatrixType( firstCopy.size(), dimension );
+    for ( std::size_t u = 0; u < firstCopy.size(); ++u ) {
+      std::memcpy( m_UniqueInstances.data() + u * dimension,
+		   instances + firstCopy[u] * dimension,
+		   dimension * sizeof( double ) );
+    }
+
+    // One entry for every pair of bag and distinct instance
+    std::unordered_map< uint64_t, std::size_t > entryOfPair;
+    entryOfPair.reserve( firstCopy.size() );
+    m_EntryOfInstance.resize( n );
+    for ( std::size_t i = 0; i < n; ++i ) {
+      const uint64_t pair = static_cast< uint64_t >( indices[i] ) * firstCopy.size() + m_UniqueOfInstance[i];
+      auto inserted = entryOfPair.emplace( pair, m_BagIndices.size() );
+      if ( inserted.second ) {
+	m_BagIndices.push_back( indices[i] );
+	m_UniqueIndices.push_back( m_UniqueOfInstance[i] );
+	m_BagCounts.push_back( 0 );
+      }
+      m_EntryOfInstance[i] = inserted.first->second;
+      ++m_BagCounts[inserted.first->second];
+    }
+  }
+
+  ~InstanceDeduplication() {}
+
+  std::size_t NumberOfInstances() const {
+    return m_NumberOfInstances;
+  }
+
+  /**
+     Fingerprint of the instances and bag membership this deduplication was
+     made from
+  */
+  uint64_t Fingerprint() const {
+    return m_Fingerprint;
+  }
+
+  /**
+     Fingerprint of the instances and bag membership of bags. It is the
+     Fingerprint() of a deduplication of the same bags, and takes one hash of
+     every instance.
+
+     @param bags   A collection of bags of instances
+  */
+  static uint64_t Fingerprint( const BaggedDatasetType& bags ) {
+    if ( ! bags.Instances().IsRowMajor ) {
+      throw std::logic_error( "Matrix storage order must be row-major" );
+    }
+    const std::size_t dimension = bags.Dimension();
+    const double* instances = bags.Instances().data();
+    const auto& indices = bags.Indices();
+    uint64_t fingerprint = StartFingerprint( bags );
+    for ( std::size_t i = 0; i < bags.NumberOfInstances(); ++i ) {
+      fingerprint = AddToFingerprint( fingerprint, Hash( instances + i * dimension, dimension ), indices[i] );
+    }
+    return fingerprint;
+  }
+
+  std::size_t NumberOfUniqueInstances() const {
+    return m_UniqueInstances.rows();
+  }
+
+  /**
+     The distinct instances, one per row
+  */
+  const MatrixType& UniqueInstances() const {
+    return m_UniqueInstances;
+  }
+
+  /**
+     Index of the distinct instance of each instance
+  */
+  const std::vector< std::size_t >& UniqueOfInstance() const {
+    return m_UniqueOfInstance;
+  }
+
+  /**
+     Number of copies of each distinct instance
+  */
+  const std::vector< double >& Multiplicities() const {
+    return m_Multiplicities;
+  }
+
+  /**
+     Bag, distinct instance and number of copies of each entry of the bag
+     multiplicities
+  */
+  const std::vector< std::size_t >& BagIndices() const {
+    return m_BagIndices;
+  }
+
+  const std::vector< std::size_t >& UniqueIndices() const {
+    return m_UniqueIndices;
+  }
+
+  const std::vector< double >& BagCounts() const {
+    return m_BagCounts;
+  }
+
+  /**
+     Entry of the bag multiplicities of each instance
+  */
+  const std::vector< std::size_t >& EntryOfInstance() const {
+    return m_EntryOfInstance;
+  }
+
+  /**
+     Give every instance the value of its distinct instance
+
+     @param uniqueValues  A value for each distinct instance
+     @return              A value for each instance
+  */
+  template< typename T >
+  std::vector< T > Expand( const std::vector< T >& uniqueValues ) const {
+    if ( uniqueValues.size() != NumberOfUniqueInstances() ) {
+      throw std::invalid_argument( "There must be one value for each distinct instance" );
+    }
+    std::vector< T > values( m_UniqueOfInstance.size() );
+    for ( std::size_t i = 0; i < m_UniqueOfInstance.size(); ++i ) {
+      values[i] = uniqueValues[m_UniqueOfInstance[i]];
+    }
+    return values;
+  }
+
+private:
+  static const std::size_t NotFound = static_cast< std::size_t >( -1 );
+
+  /*
+    Hash of the bits of a row, 64 bit words mixed with the FNV-1a prime and
+    finalized with the murmur3 mixer
+  */
+  static uint64_t Hash( const double* row, std::size_t dimension ) {
+    uint64_t hash = 14695981039346656037ULL;
+    for ( std::size_t j = 0; j < dimension; ++j ) {
+      uint64_t bits;
+      std::memcpy( &bits, row + j, sizeof bits );
+      hash = ( hash ^ bits ) * 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+  }
+
+  /*
+    The fingerprint is the row hashes and bags of the instances in order,
+    chained with the FNV-1a prime
+  */
+  static uint64_t StartFingerprint( const BaggedDatasetType& bags ) {
+    uint64_t fingerprint = 14695981039346656037ULL;
+    fingerprint = ( fingerprint ^ bags.NumberOfInstances() ) * 1099511628211ULL;
+    fingerprint = ( fingerprint ^ bags.Dimension() ) * 1099511628211ULL;
+    return ( fingerprint ^ bags.NumberOfBags() ) * 1099511628211ULL;
+  }
+
+  static uint64_t AddToFingerprint( uint64_t fingerprint, uint64_t rowHash, std::size_t bag ) {
+    fingerprint = ( fingerprint ^ rowHash ) * 1099511628211ULL;
+    return ( fingerprint ^ bag ) * 1099511628211ULL;
+  }
+
+  std::size_t m_NumberOfInstances;
+  uint64_t m_Fingerprint;
+  MatrixType m_UniqueInstances;
+  std::vector< std::size_t > m_UniqueOfInstance;
+  std::vector< double > m_Multiplicities;
+  std::vector< std::size_t > m_BagIndices;
+  std::vector< std::size_t > m_UniqueIndices;
+  std::vector< double > m_BagCounts;
+  std::vector< std::size_t > m_EntryOfInstance;
+};
+
+template< typename TBaggedDataset >
+const std::size_t InstanceDeduplication< TBaggedDataset >::NotFound;
+
+#endif
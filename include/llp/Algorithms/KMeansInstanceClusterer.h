@@ -1,6 +1,7 @@
 #ifndef __KMeansInstanceClusterer_h
 #define __KMeansInstanceClusterer_h
 
+#include <stdexcept>
 #include <vector>
 #include <cassert>
 
@@ -9,7 +10,11 @@
 #include "bd/BaggedDataset.h"
 #include "Algorithms/InstanceClustering.h"
 #include "Algorithms/KMeansClusteringParameters.h"
+#include "Algorithms/NearestCentroidSearch.h"
 #include "Util/MatrixOperations.h"
+#include "Util/ParallelMatrixOperations.h"
+#include "Util/PerfCounters.h"
+#include "Util/PhaseTimer.h"
 
 template< typename TBaggedDataset, typename TDistance >
 class KMeansInstanceClusterer
@@ -40,6 +45,45 @@ public:
      @return                 A clustering of instances in bags
   */
   InstanceClusteringType Cluster( BaggedDatasetType& bags, const DistanceType& dist )  {
+    return ClusterInstances( bags, dist, nullptr );
+  }
+
+  /**
+     Cluster all instances from bags where instance i has weight
+     instanceWeights[i]. The hierarchical k-means of flann does not take
+     weights, so each centroid it finds is moved to the weighted mean of the
+     instances that are nearest to it, and the instances are assigned again.
+     An instance with weight w counts w times in the clusterBagMap.
+
+     @param bags             A collection of bags of instances.
+     @param dist             A distance functor
+     @param instanceWeights  Non-negative weight of each instance
+     @return                 A clustering of instances in bags
+  */
+  InstanceClusteringType Cluster( BaggedDatasetType& bags,
+				  const DistanceType& dist,
+				  const std::vector< double >& instanceWeights )  {
+    if ( instanceWeights.size() != bags.NumberOfInstances() ) {
+      throw std::invalid_argument( "There must be one weight for each instance" );
+    }
+    return ClusterInstances( bags, dist, instanceWeights.data() );
+  }
+
+
+  ParameterType& Parameters() {
+    return m_Params;
+  }
+  
+private:
+  typedef flann::Matrix< double > FlannMatrixType;
+
+  /*
+    Cluster with unit weights when weights is null
+  */
+  InstanceClusteringType ClusterInstances( BaggedDatasetType& bags,
+					   const DistanceType& dist,
+					   const double* weights )  {
+    LLP_COUNT_PHASE( "cluster" );
     // We use a k-means tree to do the clustering. The possible number of
     // clusters we can have is given by the equation
     //   (branching - 1) * n + 1 = k ,
@@ -86,10 +130,15 @@ public:
 					   m_Params.centersInit,
 					   m_Params.cbIndex );
 
-    int actualK = flann::hierarchicalClustering< DistanceType >( flannInstances,
-								 flannCentroids,
-								 kmeansParams,
-								 dist );
+    int actualK;
+    {
+      LLP_TIME_PHASE( "kmeans" );
+      LLP_COUNT_PHASE( "kmeans" );
+      actualK = flann::hierarchicalClustering< DistanceType >( flannInstances,
+							       flannCentroids,
+							       kmeansParams,
+							       dist );
+    }
 
     if ( actualK != m_Params.k ) {
       throw std::logic_error( "Calculated k is not equal to actual k" );
@@ -97,49 +146,66 @@ public:
 
 
     // The hierarchicalClustering gives us centroids, but not a clustering of
-    // instances, so we build an index with the the centroids and cluster
-    // instances
-    flann::LinearIndexParams centroidsIndexParams;
-    flann::LinearIndex< DistanceType > centroidsIndex ( flannCentroids, centroidsIndexParams, dist );
-    centroidsIndex.buildIndex();
-    
-    clustering.clusterMembershipIndices.resize( bags.NumberOfInstances() );
-    FlannIndexVectorType flannIndices( clustering.clusterMembershipIndices.data(), bags.NumberOfInstances(), 1 );
-    
-    std::vector< double > distances( bags.NumberOfInstances() );
-    FlannMatrixType flannDistances( distances.data(),
-				    distances.size(),
-				    1 );
-    
-    flann::SearchParams searchParams( flann::FLANN_CHECKS_UNLIMITED );
-    searchParams.use_heap = flann::FLANN_False;
-    searchParams.cores = 0;
-
-    centroidsIndex.knnSearch( flannInstances,
-			      flannIndices,
-			      flannDistances,
-			      1,            // We only want the closest cluster
-			      searchParams );
-
-    clustering.clusterBagMap = MatrixType::Zero( bags.NumberOfBags(), m_Params.k );
-    coOccurenceMatrix( bags.Indices().data(),
-		       bags.Indices().data() + bags.NumberOfInstances(), 
+    // instances, so we search for the nearest centroid of each instance
+    Assign( bags, dist, clustering );
+
+    if ( weights != nullptr ) {
+      {
+	LLP_TIME_PHASE( "kmeans" );
+	LLP_COUNT_PHASE( "kmeans" );
+	weightedMeans( bags.Instances(),
 		       clustering.clusterMembershipIndices.cbegin(),
-		       clustering.clusterMembershipIndices.cend(),
-		       clustering.clusterBagMap
-		       );
-    rowNormalize( clustering.clusterBagMap );
+		       weights,
+		       clustering.centroids );
+      }
+      Assign( bags, dist, clustering );
+    }
+
+    {
+      LLP_TIME_PHASE( "cooccurrence" );
+      LLP_COUNT_PHASE( "cooccurrence" );
+      clustering.clusterBagMap = MatrixType::Zero( bags.NumberOfBags(), m_Params.k );
+      if ( weights == nullptr ) {
+	parallelCoOccurenceMatrix( bags.Indices().data(),
+				   bags.Indices().data() + bags.NumberOfInstances(), 
+				   clustering.clusterMembershipIndices.cbegin(),
+				   clustering.clusterMembershipIndices.cend(),
+				   clustering.clusterBagMap
+				   );
+      }
+      else {
+	parallelCoOccurenceMatrix( bags.Indices().data(),
+				   bags.Indices().data() + bags.NumberOfInstances(), 
+				   clustering.clusterMembershipIndices.cbegin(),
+				   clustering.clusterMembershipIndices.cend(),
+				   weights,
+				   clustering.clusterBagMap
+				   );
+      }
+      rowNormalize( clustering.clusterBagMap );
+    }
     return clustering;
   }
 
-
-  ParameterType& Parameters() {
-    return m_Params;
+  /*
+    Assign each instance to the nearest centroid of clustering
+  */
+  void Assign( const BaggedDatasetType& bags,
+	       const DistanceType& dist,
+	       InstanceClusteringType& clustering ) const {
+    LLP_TIME_PHASE( "assignment" );
+    LLP_COUNT_PHASE( "assignment" );
+    NearestCentroidSearch< DistanceType > centroidsSearch( clustering.centroids.data(),
+							   m_Params.k,
+							   bags.Dimension(),
+							   dist );
+    clustering.clusterMembershipIndices.resize( bags.NumberOfInstances() );
+    centroidsSearch.Search( bags.Instances().data(),
+			    bags.NumberOfInstances(),
+			    clustering.clusterMembershipIndices.data(),
+			    nullptr );    // We only want the closest cluster
   }
-  
-private:
-  typedef flann::Matrix< double > FlannMatrixType;
-  typedef flann::Matrix< int >    FlannIndexVectorType;
+
   ParameterType m_Params;
 };
 
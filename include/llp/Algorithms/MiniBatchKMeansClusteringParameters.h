@@ -0,0 +1,54 @@
+#ifndef __MiniBatchKMeansClusteringParameters_h
+#define __MiniBatchKMeansClusteringParameters_h
+
+#include <cstddef>
+
+struct MiniBatchKMeansClusteringParameters {
+  /*
+    Parameters for mini-batch k-means
+
+    @param k                Number of clusters
+    @param batchSize        Number of instances sampled in each iteration
+    @param maxIterations    Maximum number of mini-batches
+    @param tolerance        Stop when no centroid moves further than tolerance
+                            times the mean distance from the instances in the
+			    batch to their centroids
+    @param maxNoImprovement Stop when the smoothed mean distance from the
+                            batches to their centroids has not decreased for
+			    this many batches. 0 means never
+    @param initSampleSize   Number of instances sampled for the k-means++
+                            initialization. It is at least k
+    @param seed             Seed of the sampling. The same seed gives the same
+                            clustering
+    @param numberOfThreads  Maximum number of threads for the assignments. 0
+                            means use all cores
+  */
+  MiniBatchKMeansClusteringParameters( int k = 1,
+				       std::size_t batchSize = 1024,
+				       std::size_t maxIterations = 100,
+				       double tolerance = 1e-3,
+				       std::size_t maxNoImprovement = 10,
+				       std::size_t initSampleSize = 4096,
+				       unsigned int seed = 0,
+				       unsigned int numberOfThreads = 0 )
+    : k( k )
+    , batchSize( batchSize )
+    , maxIterations( maxIterations )
+    , tolerance( tolerance )
+    , maxNoImprovement( maxNoImprovement )
+    , initSampleSize( initSampleSize )
+    , seed( seed )
+    , numberOfThreads( numberOfThreads )
+  {}
+
+  int k;
+  std::size_t batchSize;
+  std::size_t maxIterations;
+  double tolerance;
+  std::size_t maxNoImprovement;
+  std::size_t initSampleSize;
+  unsigned int seed;
+  unsigned int numberOfThreads;
+};
+
+#endif
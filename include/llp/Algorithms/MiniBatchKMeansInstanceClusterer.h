@@ -0,0 +1,376 @@
+#ifndef __MiniBatchKMeansInstanceClusterer_h
+#define __MiniBatchKMeansInstanceClusterer_h
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "bd/BaggedDataset.h"
+#include "llp/Algorithms/InstanceClustering.h"
+#include "llp/Algorithms/MiniBatchKMeansClusteringParameters.h"
+#include "llp/Algorithms/NearestCentroidSearch.h"
+#include "llp/Util/MatrixOperations.h"
+#include "llp/Util/ParallelMatrixOperations.h"
+#include "llp/Util/PerfCounters.h"
+#include "llp/Util/PhaseTimer.h"
+
+/*
+  Mini-batch k-means (Sculley, Web-scale k-means clustering, 2010).
+
+  Every iteration samples batchSize instances, assigns them to their nearest
+  centroid and moves each centroid towards its instances with a per-centroid
+  learning rate of one over the number of instances it has been assigned so
+  far. A centroid is therefore the running mean of the instances assigned to
+  it. Iterations stop when the centroids no longer move, or when the smoothed
+  mean distance of the batches to their centroids stops decreasing. The cost
+  of an iteration is independent of the number of instances, only the final
+  assignment of all instances, which gives the clusterBagMap, touches every
+  instance. It is done in parallel.
+
+  The centroids are initialized with k-means++ on a sample of the instances.
+
+  Instances can have weights, such as the weights of a BagCoreset. An
+  instance with weight w then moves its centroid as much as w copies of it
+  and counts w times in the clusterBagMap.
+
+  The clustering only depends on the instances, the distance and the
+  parameters, so repeated calls with the same distance give the same result.
+ */
+template< typename TBaggedDataset, typename TDistance >
+class MiniBatchKMeansInstanceClusterer
+{
+public:
+  typedef TBaggedDataset BaggedDatasetType;
+  typedef TDistance DistanceType;
+  typedef MiniBatchKMeansInstanceClusterer< BaggedDatasetType, DistanceType > Self;
+
+  typedef MiniBatchKMeansClusteringParameters ParameterType;
+
+  typedef typename BaggedDatasetType::MatrixType MatrixType;
+  typedef InstanceClustering< MatrixType > InstanceClusteringType;
+
+  MiniBatchKMeansInstanceClusterer( const ParameterType& params )
+    : m_Params( params )
+    , m_NumberOfIterations( 0 )
+  {}
+
+  ~MiniBatchKMeansInstanceClusterer() {}
+
+
+  /**
+     Cluster all instances from bags using the weighted featurespace defined by
+     DistanceType and weights.
+
+     @param bags             A collection of bags of instances.
+     @param dist             A distance functor
+     @return                 A clustering of instances in bags
+  */
+  InstanceClusteringType Cluster( BaggedDatasetType& bags, const DistanceType& dist )  {
+    return ClusterInstances( bags, dist, nullptr );
+  }
+
+  /**
+     Cluster all instances from bags where instance i has weight
+     instanceWeights[i]. An instance with weight w counts as w instances, both
+     in the centroid updates and in the clusterBagMap.
+
+     @param bags             A collection of bags of instances.
+     @param dist             A distance functor
+     @param instanceWeights  Non-negative weight of each instance
+     @return                 A clustering of instances in bags
+  */
+  InstanceClusteringType Cluster( BaggedDatasetType& bags,
+				  const DistanceType& dist,
+				  const std::vector< double >& instanceWeights )  {
+    if ( instanceWeights.size() != bags.NumberOfInstances() ) {
+      throw std::invalid_argument( "There must be one weight for each instance" );
+    }
+    return ClusterInstances( bags, dist, instanceWeights.data() );
+  }
+
+
+  /**
+     The centroids Cluster would find for bags, without assigning the
+     instances to them. Assigning every instance to its nearest centroid and
+     counting the co-occurences of bags and clusters gives the same
+     clustering as Cluster.
+
+     @param bags             A collection of bags of instances.
+     @param dist             A distance functor
+     @return                 k centroids, one per row
+  */
+  MatrixType Centroids( BaggedDatasetType& bags, const DistanceType& dist ) {
+    LLP_COUNT_PHASE( "cluster" );
+    return ComputeCentroids( bags, dist, nullptr );
+  }
+
+
+  ParameterType& Parameters() {
+    return m_Params;
+  }
+
+  /**
+     Number of mini-batches used by the last call of Cluster
+  */
+  std::size_t NumberOfIterations() const {
+    return m_NumberOfIterations;
+  }
+
+private:
+  /*
+    Cluster with unit weights when weights is null
+  */
+  InstanceClusteringType ClusterInstances( BaggedDatasetType& bags,
+					   const DistanceType& dist,
+					   const double* weights )  {
+    LLP_COUNT_PHASE( "cluster" );
+    const std::size_t k = m_Params.k;
+    const std::size_t dimension = bags.Dimension();
+    const NearestCentroidSearchParameters searchParams = SearchParameters();
+
+    InstanceClusteringType clustering;
+    clustering.centroids = ComputeCentroids( bags, dist, weights );
+
+    {
+      LLP_TIME_PHASE( "assignment" );
+      LLP_COUNT_PHASE( "assignment" );
+      NearestCentroidSearch< DistanceType > centroidsSearch( clustering.centroids.data(),
+							     k,
+							     dimension,
+							     dist,
+							     searchParams );
+      clustering.clusterMembershipIndices.resize( bags.NumberOfInstances() );
+      centroidsSearch.Search( bags.Instances().data(),
+			      bags.NumberOfInstances(),
+			      clustering.clusterMembershipIndices.data(),
+			      nullptr );    // We only want the closest cluster
+    }
+
+    {
+      LLP_TIME_PHASE( "cooccurrence" );
+      LLP_COUNT_PHASE( "cooccurrence" );
+      clustering.clusterBagMap = MatrixType::Zero( bags.NumberOfBags(), k );
+      if ( weights == nullptr ) {
+	parallelCoOccurenceMatrix( bags.Indices().data(),
+				   bags.Indices().data() + bags.NumberOfInstances(),
+				   clustering.clusterMembershipIndices.cbegin(),
+				   clustering.clusterMembershipIndices.cend(),
+				   clustering.clusterBagMap,
+				   m_Params.numberOfThreads
+				   );
+      }
+      else {
+	parallelCoOccurenceMatrix( bags.Indices().data(),
+				   bags.Indices().data() + bags.NumberOfInstances(),
+				   clustering.clusterMembershipIndices.cbegin(),
+				   clustering.clusterMembershipIndices.cend(),
+				   weights,
+				   clustering.clusterBagMap,
+				   m_Params.numberOfThreads
+				   );
+      }
+      rowNormalize( clustering.clusterBagMap );
+    }
+    return clustering;
+  }
+
+  /*
+    Centroids of the mini-batch iterations, with unit weights when weights is
+    null
+  */
+  MatrixType ComputeCentroids( const BaggedDatasetType& bags,
+			       const DistanceType& dist,
+			       const double* weights ) {
+    if ( ! bags.Instances().IsRowMajor ) {
+      throw std::logic_error( "Matrix storage order must be row-major" );
+    }
+    if ( m_Params.k < 1 ) {
+      throw std::invalid_argument( "Number of clusters must be positive" );
+    }
+    if ( bags.NumberOfInstances() == 0 ) {
+      throw std::invalid_argument( "Can not cluster an empty dataset" );
+    }
+
+    LLP_TIME_PHASE( "kmeans" );
+    LLP_COUNT_PHASE( "kmeans" );
+    std::mt19937 gen( m_Params.seed );
+    MatrixType centroids = InitialCentroids( bags, dist, weights, gen );
+    m_NumberOfIterations = Iterate( bags, dist, weights, SearchParameters(), gen, centroids );
+    return centroids;
+  }
+
+  NearestCentroidSearchParameters SearchParameters() const {
+    return NearestCentroidSearchParameters( NearestCentroidSearchParameters().centroidBlockBytes,
+					    NearestCentroidSearchParameters().instancesPerTask,
+					    m_Params.numberOfThreads );
+  }
+
+  /*
+    k-means++ on a sample of the instances. Each centroid is drawn with
+    probability proportional to the distance to the nearest centroid drawn so
+    far, times its weight.
+  */
+  MatrixType InitialCentroids( const BaggedDatasetType& bags,
+			       const DistanceType& dist,
+			       const double* weights,
+			       std::mt19937& gen ) const {
+    const std::size_t k = m_Params.k;
+    const std::size_t dimension = bags.Dimension();
+    const std::size_t n = bags.NumberOfInstances();
+    const double* instances = bags.Instances().data();
+
+    std::vector< std::size_t > sample;
+    const std::size_t sampleSize = std::max( k, m_Params.initSampleSize );
+    if ( sampleSize >= n ) {
+      sample.resize( n );
+      for ( std::size_t i = 0; i < n; ++i ) {
+	sample[i] = i;
+      }
+    }
+    else {
+      std::uniform_int_distribution< std::size_t > disInstance( 0, n - 1 );
+      sample.resize( sampleSize );
+      for ( std::size_t& i : sample ) {
+	i = disInstance( gen );
+      }
+    }
+
+    MatrixType centroids( k, dimension );
+    std::vector< double > nearest( sample.size(), std::numeric_limits< double >::max() );
+    // Unit weights when there are no weights, so both draw the same centroids
+    std::vector< double > sampleWeights( sample.size(), 1 );
+    if ( weights != nullptr ) {
+      for ( std::size_t i = 0; i < sample.size(); ++i ) {
+	sampleWeights[i] = weights[sample[i]];
+      }
+    }
+    std::vector< double > probabilities( sampleWeights );
+    std::uniform_int_distribution< std::size_t > disSample( 0, sample.size() - 1 );
+    for ( std::size_t c = 0; c < k; ++c ) {
+      std::size_t chosen;
+      if ( std::accumulate( probabilities.begin(), probabilities.end(), 0.0 ) > 0 ) {
+	std::discrete_distribution< std::size_t > disNext( probabilities.begin(), probabilities.end() );
+	chosen = sample[disNext( gen )];
+      }
+      else {
+	// Fewer distinct instances than clusters
+	chosen = sample[disSample( gen )];
+      }
+      std::copy( instances + chosen * dimension, instances + ( chosen + 1 ) * dimension,
+		 centroids.data() + c * dimension );
+      if ( c + 1 == k ) {
+	break;
+      }
+      for ( std::size_t i = 0; i < sample.size(); ++i ) {
+	nearest[i] = std::min< double >( nearest[i],
+					 dist( instances + sample[i] * dimension,
+					       centroids.data() + c * dimension,
+					       dimension ) );
+	probabilities[i] = nearest[i] * sampleWeights[i];
+      }
+    }
+    return centroids;
+  }
+
+  /*
+    Update centroids with mini-batches until they converge or maxIterations
+    is reached. Return the number of iterations.
+  */
+  std::size_t Iterate( const BaggedDatasetType& bags,
+		       const DistanceType& dist,
+		       const double* weights,
+		       const NearestCentroidSearchParameters& searchParams,
+		       std::mt19937& gen,
+		       MatrixType& centroids ) const {
+    const std::size_t k = m_Params.k;
+    const std::size_t dimension = bags.Dimension();
+    const std::size_t n = bags.NumberOfInstances();
+    const double* instances = bags.Instances().data();
+
+    // With a batch as large as the data, every iteration uses all instances
+    const bool fullBatch = m_Params.batchSize >= n;
+    const std::size_t batchSize = fullBatch ? n : std::max< std::size_t >( 1, m_Params.batchSize );
+    std::vector< double > batch( fullBatch ? 0 : batchSize * dimension );
+    std::vector< std::size_t > sampled( fullBatch ? 0 : batchSize );
+    std::vector< int > assignment( batchSize );
+    std::vector< double > distances( batchSize );
+    std::vector< double > counts( k, 0 );
+    std::uniform_int_distribution< std::size_t > disInstance( 0, n - 1 );
+    MatrixType previous;
+    // Mean distance of the batches to their centroids, smoothed over about as
+    // many batches as make up the data
+    const double smoothing = std::min( 1.0, 2.0 * batchSize / ( n + 1 ) );
+    double smoothedDistance = 0;
+    double bestSmoothedDistance = std::numeric_limits< double >::max();
+    std::size_t noImprovement = 0;
+
+    std::size_t iteration = 0;
+    while ( iteration < m_Params.maxIterations ) {
+      ++iteration;
+      const double* batchInstances = instances;
+      if ( !fullBatch ) {
+	for ( std::size_t i = 0; i < batchSize; ++i ) {
+	  sampled[i] = disInstance( gen );
+	  std::copy( instances + sampled[i] * dimension, instances + ( sampled[i] + 1 ) * dimension,
+		     batch.data() + i * dimension );
+	}
+	batchInstances = batch.data();
+      }
+
+      NearestCentroidSearch< DistanceType > search( centroids.data(), k, dimension, dist, searchParams );
+      search.Search( batchInstances, batchSize, assignment.data(), distances.data() );
+
+      previous = centroids;
+      double batchWeight = 0;
+      double meanDistance = 0;
+      for ( std::size_t i = 0; i < batchSize; ++i ) {
+	const double w = weights == nullptr ? 1 : weights[fullBatch ? i : sampled[i]];
+	batchWeight += w;
+	meanDistance += w * distances[i];
+	if ( w <= 0 ) {
+	  continue;
+	}
+	const std::size_t c = assignment[i];
+	counts[c] += w;
+	const double eta = w / counts[c];
+	double* centroid = centroids.data() + c * dimension;
+	const double* x = batchInstances + i * dimension;
+	for ( std::size_t j = 0; j < dimension; ++j ) {
+	  centroid[j] += eta * ( x[j] - centroid[j] );
+	}
+      }
+
+      if ( batchWeight > 0 ) {
+	meanDistance /= batchWeight;
+      }
+      double movement = 0;
+      for ( std::size_t c = 0; c < k; ++c ) {
+	movement = std::max< double >( movement,
+				       dist( previous.data() + c * dimension,
+					     centroids.data() + c * dimension,
+					     dimension ) );
+      }
+      if ( movement <= m_Params.tolerance * meanDistance ) {
+	break;
+      }
+
+      smoothedDistance = iteration == 1 ? meanDistance : ( 1 - smoothing ) * smoothedDistance + smoothing * meanDistance;
+      if ( smoothedDistance < bestSmoothedDistance ) {
+	bestSmoothedDistance = smoothedDistance;
+	noImprovement = 0;
+      }
+      else if ( m_Params.maxNoImprovement > 0 && ++noImprovement >= m_Params.maxNoImprovement ) {
+	break;
+      }
+    }
+    return iteration;
+  }
+
+  ParameterType m_Params;
+  std::size_t m_NumberOfIterations;
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef __NearestCentroidSearch_h
+#define __NearestCentroidSearch_h
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "llp/Algorithms/NearestCentroidSearchParameters.h"
+#include "llp/Util/Parallel.h"
+
+/*
+  Exhaustive nearest centroid search for assigning instances to centroids.
+
+  This replaces a flann::LinearIndex with k=1. The linear index walks all
+  centroids for every instance, so when there are many centroids they are
+  pulled through the cache once per instance. Here the instances are split in
+  small tiles and the centroids in blocks that fit in L2, and every tile is
+  compared against one centroid block at a time. Tiles are distributed over
+  threads.
+
+  Ties are broken in favour of the centroid with the lowest index, so the
+  result does not depend on the blocking or the number of threads.
+
+  Besides the nearest centroid, the k nearest centroids can be found in the
+  same pass. The running k best are then kept directly in the output arrays.
+
+  TDistance must be a flann compatible distance functor, i.e. define
+    ResultType operator()( const double*, const double*, size_t, ResultType ) const
+  The last argument is the current best distance, which the functor may use to
+  terminate early, as long as it then returns a value not smaller than it.
+
+  The search does not own the centroids, they must outlive the search.
+ */
+template< typename TDistance >
+class NearestCentroidSearch {
+public:
+  typedef TDistance DistanceType;
+  typedef NearestCentroidSearch< DistanceType > Self;
+  typedef NearestCentroidSearchParameters ParameterType;
+
+  /**
+     @param centroids          Row-major numberOfCentroids x dimension matrix
+     @param numberOfCentroids  Number of centroids
+     @param dimension          Dimension of the feature space
+     @param dist               Distance functor
+     @param params             Blocking and threading parameters
+  */
+  NearestCentroidSearch( const double* centroids,
+			 std::size_t numberOfCentroids,
+			 std::size_t dimension,
+			 const DistanceType& dist,
+			 const ParameterType& params=ParameterType() )
+    : m_Centroids( centroids )
+    , m_NumberOfCentroids( numberOfCentroids )
+    , m_Dimension( dimension )
+    , m_Distance( dist )
+    , m_Params( params )
+    , m_CentroidBlockSize( std::max< std::size_t >( 1, params.centroidBlockBytes /
+						    ( sizeof(double) * std::max< std::size_t >( 1, dimension ) ) ) )
+  {}
+
+  std::size_t NumberOfCentroids() const {
+    return m_NumberOfCentroids;
+  }
+
+  std::size_t Dimension() const {
+    return m_Dimension;
+  }
+
+  /**
+     Find the nearest centroid of each instance.
+
+     @param instances          Row-major numberOfInstances x dimension matrix
+     @param numberOfInstances  Number of instances
+     @param indices            Output array of length numberOfInstances
+     @param distances          Output array of length numberOfInstances. Can be
+                               nullptr if the distances are not needed.
+  */
+  void Search( const double* instances,
+	       std::size_t numberOfInstances,
+	       int* indices,
+	       double* distances ) const {
+    if ( m_NumberOfCentroids == 0 ) {
+      throw std::logic_error( "Cannot search without centroids" );
+    }
+    parallelFor( numberOfInstances,
+		 m_Params.instancesPerTask,
+		 m_Params.numberOfThreads,
+		 [&]( std::size_t begin, std::size_t end ) {
+		   for ( std::size_t tile = begin; tile < end; tile += TileSize ) {
+		     SearchTile( instances, tile, std::min( end, tile + TileSize ), indices, distances );
+		   }
+		 });
+  }
+
+  /**
+     Find the k nearest centroids of each instance, sorted by increasing
+     distance. If k is larger than the number of centroids, the remaining
+     entries get index -1 and infinite distance.
+
+     @param instances          Row-major numberOfInstances x dimension matrix
+     @param numberOfInstances  Number of instances
+     @param k                  Number of centroids to find for each instance
+     @param indices            Output. Row-major numberOfInstances x k matrix
+     @param distances          Output. Row-major numberOfInstances x k matrix
+  */
+  void Search( const double* instances,
+	       std::size_t numberOfInstances,
+	       std::size_t k,
+	       int* indices,
+	       double* distances ) const {
+    if ( m_NumberOfCentroids == 0 ) {
+      throw std::logic_error( "Cannot search without centroids" );
+    }
+    if ( k == 0 ) {
+      return;
+    }
+    parallelFor( numberOfInstances,
+		 m_Params.instancesPerTask,
+		 m_Params.numberOfThreads,
+		 [&]( std::size_t begin, std::size_t end ) {
+		   for ( std::size_t tile = begin; tile < end; tile += TileSize ) {
+		     SearchTile( instances, tile, std::min( end, tile + TileSize ), k, indices, distances );
+		   }
+		 });
+  }
+
+private:
+  // Number of instances kept in registers/L1 while a centroid block is streamed
+  static const std::size_t TileSize = 32;
+
+  void SearchTile( const double* instances,
+		   std::size_t begin,
+		   std::size_t end,
+		   int* indices,
+		   double* distances ) const {
+    double bestDistance[TileSize];
+    int bestIndex[TileSize];
+    const std::size_t n = end - begin;
+    std::fill( bestDistance, bestDistance + n, std::numeric_limits< double >::infinity() );
+    std::fill( bestIndex, bestIndex + n, 0 );
+
+    for ( std::size_t blockBegin = 0; blockBegin < m_NumberOfCentroids; blockBegin += m_CentroidBlockSize ) {
+      const std::size_t blockEnd = std::min( m_NumberOfCentroids, blockBegin + m_CentroidBlockSize );
+      for ( std::size_t i = 0; i < n; ++i ) {
+	const double* x = instances + ( begin + i ) * m_Dimension;
+	double best = bestDistance[i];
+	int bestIdx = bestIndex[i];
+	const double* c = m_Centroids + blockBegin * m_Dimension;
+	for ( std::size_t j = blockBegin; j < blockEnd; ++j, c += m_Dimension ) {
+	  const double d = m_Distance( x, c, m_Dimension, best );
+	  if ( d < best ) {
+	    best = d;
+	    bestIdx = static_cast< int >( j );
+	  }
+	}
+	bestDistance[i] = best;
+	bestIndex[i] = bestIdx;
+      }
+    }
+
+    std::copy( bestIndex, bestIndex + n, indices + begin );
+    if ( distances != nullptr ) {
+      std::copy( bestDistance, bestDistance + n, distances + begin );
+    }
+  }
+
+  void SearchTile( const double* instances,
+		   std::size_t begin,
+		   std::size_t end,
+		   std::size_t k,
+		   int* indices,
+		   double* distances ) const {
+    std::fill( indices + begin * k, indices + end * k, -1 );
+    std::fill( distances + begin * k, distances + end * k, std::numeric_limits< double >::infinity() );
+
+    for ( std::size_t blockBegin = 0; blockBegin < m_NumberOfCentroids; blockBegin += m_CentroidBlockSize ) {
+      const std::size_t blockEnd = std::min( m_NumberOfCentroids, blockBegin + m_CentroidBlockSize );
+      for ( std::size_t i = begin; i < end; ++i ) {
+	const double* x = instances + i * m_Dimension;
+	int* bestIdx = indices + i * k;
+	double* best = distances + i * k;
+	const double* c = m_Centroids + blockBegin * m_Dimension;
+	for ( std::size_t j = blockBegin; j < blockEnd; ++j, c += m_Dimension ) {
+	  const double d = m_Distance( x, c, m_Dimension, best[k-1] );
+	  if ( d < best[k-1] ) {
+	    // Insertion into the sorted k best. Equal distances stay in front,
+	    // so ties go to the lowest index.
+	    std::size_t pos = k - 1;
+	    for ( ; pos > 0 && best[pos-1] > d; --pos ) {
+	      best[pos] = best[pos-1];
+	      bestIdx[pos] = bestIdx[pos-1];
+	    }
+	    best[pos] = d;
+	    bestIdx[pos] = static_cast< int >( j );
+	  }
+	}
+      }
+    }
+  }
+
+  const double* m_Centroids;
+  std::size_t m_NumberOfCentroids;
+  std::size_t m_Dimension;
+  DistanceType m_Distance;
+  ParameterType m_Params;
+  std::size_t m_CentroidBlockSize;
+};
+
+template< typename TDistance >
+const std::size_t NearestCentroidSearch< TDistance >::TileSize;
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef __NearestCentroidSearchParameters_h
+#define __NearestCentroidSearchParameters_h
+
+#include <cstddef>
+
+struct NearestCentroidSearchParameters {
+  /*
+    Parameters for the blocked nearest centroid search
+
+    @param centroidBlockBytes  Size in bytes of the block of centroids that is
+                               compared against a tile of instances. Should be
+			       about the size of the L2 cache.
+    @param instancesPerTask    Number of instances handed to a thread at a time
+    @param numberOfThreads     Maximum number of threads. 0 means use all cores
+  */
+  NearestCentroidSearchParameters( std::size_t centroidBlockBytes = 256*1024,
+				   std::size_t instancesPerTask = 1024,
+				   unsigned int numberOfThreads = 0 )
+    : centroidBlockBytes( centroidBlockBytes )
+    , instancesPerTask( instancesPerTask )
+    , numberOfThreads( numberOfThreads )
+  {}
+
+  std::size_t centroidBlockBytes;
+  std::size_t instancesPerTask;
+  unsigned int numberOfThreads;
+};
+
+#endif
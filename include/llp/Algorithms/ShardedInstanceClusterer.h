@@ -0,0 +1,323 @@
+#ifndef __ShardedInstanceClusterer_h
+#define __ShardedInstanceClusterer_h
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "Eigen/Dense"
+
+#include "bd/BaggedDataset.h"
+#include "llp/Algorithms/NearestCentroidSearch.h"
+#include "llp/Algorithms/ShardedInstanceClustererParameters.h"
+#include "llp/Util/MappedFile.h"
+#include "llp/Util/MatrixOperations.h"
+#include "llp/Util/Parallel.h"
+#include "llp/Util/PerfCounters.h"
+#include "llp/Util/PhaseTimer.h"
+#include "llp/Util/WorkerProcesses.h"
+
+/*
+  Cluster with the instances sharded over worker processes on one machine.
+
+  TInstanceClusterer finds the centroids in the calling process with
+    MatrixType Centroids( BaggedDatasetType& bags, const DistanceType& dist )
+  as MiniBatchKMeansInstanceClusterer does. The assignment of every instance
+  to its nearest centroid and the counting of the co-occurences of bags and
+  clusters, which are the parts that touch every instance, are done by
+  numberOfProcesses forked worker processes. Worker w handles the w'th of
+  numberOfProcesses consecutive ranges of instances and counts a partial
+  clusterBagMap. The partial maps are summed in the calling process.
+
+  The workers are forked on the first call of Cluster and reused as long as
+  Cluster is called with a dataset of the same size whose instances and bag
+  indices are at the same addresses. They read the instances from the memory
+  they share copy-on-write with the calling process, so the dataset is not
+  copied, but they only see the dataset as it was when they were forked.
+  Checking the addresses costs nothing per call, but it can not see a
+  dataset that is changed in place or replaced by another one at the same
+  address, so after such a change Invalidate must be called. The centroids,
+  the distance weights, the assignments and the partial maps are passed
+  through one shared anonymous mapping.
+
+  The clustering is the same as the clustering of TInstanceClusterer, since
+  the assignments do not depend on the shards and counts are exact in any
+  order.
+
+  Weighted clustering, which is used on small coresets, is done by
+  TInstanceClusterer in the calling process, so it must accept instance
+  weights when Cluster is called with them.
+
+  DistanceType must be constructible from its weights as
+  DistanceType( dist.Weights(), dist.NumberOfWeights() ), which is how the
+  workers get the distance of the calling process.
+
+  Linux only, see WorkerProcesses.
+*/
+template< typename TInstanceClusterer >
+class ShardedInstanceClusterer
+{
+public:
+  typedef TInstanceClusterer InstanceClustererType;
+  typedef ShardedInstanceClusterer< InstanceClustererType > Self;
+
+  typedef typename InstanceClustererType::BaggedDatasetType BaggedDatasetType;
+  typedef typename InstanceClustererType::DistanceType DistanceType;
+  typedef typename InstanceClustererType::ParameterType InstanceClustererParameterType;
+  typedef ShardedInstanceClustererParameters< InstanceClustererParameterType > ParameterType;
+  typedef typename InstanceClustererType::InstanceClusteringType InstanceClusteringType;
+
+  typedef typename BaggedDatasetType::MatrixType MatrixType;
+  typedef typename BaggedDatasetType::IndexVectorType IndexVectorType;
+  typedef typename IndexVectorType::Scalar IndexType;
+
+  ShardedInstanceClusterer( const ParameterType& params )
+    : m_Params( params )
+    , m_Clusterer( params )
+    , m_Instances( nullptr )
+    , m_Indices( nullptr )
+    , m_NumberOfInstances( 0 )
+    , m_NumberOfBags( 0 )
+    , m_Dimension( 0 )
+    , m_MaximumK( 0 )
+    , m_WeightsOffset( 0 )
+    , m_CentroidsOffset( 0 )
+    , m_MembershipsOffset( 0 )
+    , m_PartialsOffset( 0 )
+    , m_PartialSize( 0 )
+  {}
+
+  ~ShardedInstanceClusterer() {}
+
+
+  /**
+     Cluster all instances from bags using the weighted featurespace defined by
+     DistanceType and weights.
+
+     @param bags             A collection of bags of instances.
+     @param dist             A distance functor
+     @return                 A clustering of instances in bags
+  */
+  InstanceClusteringType Cluster( BaggedDatasetType& bags, const DistanceType& dist )  {
+    UpdateClustererParameters();
+    if ( m_Params.numberOfProcesses <= 1 ) {
+      return m_Clusterer.Cluster( bags, dist );
+    }
+
+    InstanceClusteringType clustering;
+    clustering.centroids = m_Clusterer.Centroids( bags, dist );
+    const std::size_t k = clustering.centroids.rows();
+    if ( ! IsStarted( bags, k ) ) {
+      Start( bags, k );
+    }
+    if ( dist.NumberOfWeights() > m_Dimension ) {
+      throw std::invalid_argument( "There can not be more distance weights than dimensions" );
+    }
+
+    {
+      LLP_TIME_PHASE( "assignment" );
+      LLP_COUNT_PHASE( "assignment" );
+      Job* job = GetJob();
+      job->k = k;
+      job->numberOfWeights = dist.NumberOfWeights();
+      std::memcpy( Weights(), dist.Weights(), dist.NumberOfWeights() * sizeof( double ) );
+      std::memcpy( Centroids(), clustering.centroids.data(), k * m_Dimension * sizeof( double ) );
+      try {
+	m_Workers->Run();
+      }
+      catch ( ... ) {
+	// Workers are forked again on the next call
+	m_Workers.reset();
+	throw;
+      }
+    }
+
+    {
+      LLP_TIME_PHASE( "cooccurrence" );
+      LLP_COUNT_PHASE( "cooccurrence" );
+      // The copy is split over threads, like the assignment it follows
+      clustering.clusterMembershipIndices.resize( m_NumberOfInstances );
+      const int* memberships = Memberships();
+      int* target = clustering.clusterMembershipIndices.data();
+      parallelFor( m_NumberOfInstances, MembershipsPerCopyTask, m_Params.numberOfProcesses,
+		   [memberships, target]( std::size_t begin, std::size_t end ) {
+		     std::memcpy( target + begin, memberships + begin, ( end - begin ) * sizeof( int ) );
+		   } );
+      clustering.clusterBagMap = MatrixType::Zero( m_NumberOfBags, k );
+      for ( std::size_t w = 0; w < m_Params.numberOfProcesses; ++w ) {
+	clustering.clusterBagMap += Eigen::Map< const MatrixType >( Partial( w ), m_NumberOfBags, k );
+      }
+      rowNormalize( clustering.clusterBagMap );
+    }
+    return clustering;
+  }
+
+  /**
+     Cluster all instances from bags where instance i has weight
+     instanceWeights[i], with TInstanceClusterer in the calling process.
+
+     @param bags             A collection of bags of instances.
+     @param dist             A distance functor
+     @param instanceWeights  Non-negative weight of each instance
+     @return                 A clustering of instances in bags
+  */
+  InstanceClusteringType Cluster( BaggedDatasetType& bags,
+				  const DistanceType& dist,
+				  const std::vector< double >& instanceWeights )  {
+    UpdateClustererParameters();
+    return m_Clusterer.Cluster( bags, dist, instanceWeights );
+  }
+
+
+  /**
+     Stop the workers, so they are forked again with the current dataset on
+     the next call of Cluster. Must be called after the dataset is changed in
+     place or replaced by another one at the same address.
+  */
+  void Invalidate() {
+    m_Workers.reset();
+  }
+
+  /**
+     The parameters. Changes, e.g. of the seed, apply from the next call of
+     Cluster.
+  */
+  ParameterType& Parameters() {
+    return m_Params;
+  }
+
+private:
+  void UpdateClustererParameters() {
+    m_Clusterer.Parameters() = static_cast< const InstanceClustererParameterType& >( m_Params );
+  }
+
+  /*
+    Header of the shared mapping. It is followed by the distance weights, the
+    centroids, the assignment of every instance and a partial clusterBagMap
+    for every worker, each starting at a 64 byte aligned offset.
+  */
+  struct Job {
+    uint64_t k;
+    uint64_t numberOfWeights;
+  };
+
+  static const std::size_t MembershipsPerCopyTask = 1 << 16;
+
+  static std::size_t Align( std::size_t offset ) {
+    return ( offset + 63 ) / 64 * 64;
+  }
+
+  bool IsStarted( const BaggedDatasetType& bags, std::size_t k ) const {
+    return m_Workers
+      && m_Workers->NumberOfWorkers() == m_Params.numberOfProcesses
+      && m_NumberOfInstances == bags.NumberOfInstances()
+      && m_NumberOfBags == bags.NumberOfBags()
+      && m_Dimension == bags.Dimension()
+      && k <= m_MaximumK
+      && m_Instances == bags.Instances().data()
+      && m_Indices == bags.Indices().data();
+  }
+
+  /*
+    Map the shared memory for bags and up to k clusters and fork the workers
+  */
+  void Start( const BaggedDatasetType& bags, std::size_t k ) {
+    if ( ! bags.Instances().IsRowMajor ) {
+      throw std::logic_error( "Matrix storage order must be row-major" );
+    }
+    m_Workers.reset();
+    m_Instances = bags.Instances().data();
+    m_Indices = bags.Indices().data();
+    m_NumberOfInstances = bags.NumberOfInstances();
+    m_NumberOfBags = bags.NumberOfBags();
+    m_Dimension = bags.Dimension();
+    m_MaximumK = k;
+
+    m_WeightsOffset = Align( sizeof( Job ) );
+    m_CentroidsOffset = Align( m_WeightsOffset + m_Dimension * sizeof( double ) );
+    m_MembershipsOffset = Align( m_CentroidsOffset + m_MaximumK * m_Dimension * sizeof( double ) );
+    m_PartialsOffset = Align( m_MembershipsOffset + m_NumberOfInstances * sizeof( int ) );
+    m_PartialSize = Align( m_NumberOfBags * m_MaximumK * sizeof( double ) );
+    m_Shared = MappedFile::Anonymous( m_PartialsOffset + m_Params.numberOfProcesses * m_PartialSize );
+
+    const double* instances = m_Instances;
+    const IndexType* indices = m_Indices;
+    m_Workers.reset( new WorkerProcesses( m_Params.numberOfProcesses,
+					  [this, instances, indices]( std::size_t worker ) {
+					    AssignShard( worker, instances, indices );
+					  } ) );
+  }
+
+  /*
+    Assign the instances of shard worker and count its partial clusterBagMap.
+    Runs in the worker process.
+  */
+  void AssignShard( std::size_t worker, const double* instances, const IndexType* indices ) {
+    const Job* job = GetJob();
+    const std::size_t k = job->k;
+    const std::size_t begin = worker * m_NumberOfInstances / m_Params.numberOfProcesses;
+    const std::size_t end = ( worker + 1 ) * m_NumberOfInstances / m_Params.numberOfProcesses;
+
+    const DistanceType dist( Weights(), job->numberOfWeights );
+    const NearestCentroidSearchParameters searchParams( NearestCentroidSearchParameters().centroidBlockBytes,
+							NearestCentroidSearchParameters().instancesPerTask,
+							m_Params.threadsPerProcess );
+    NearestCentroidSearch< DistanceType > centroidsSearch( Centroids(), k, m_Dimension, dist, searchParams );
+    int* memberships = Memberships();
+    centroidsSearch.Search( instances + begin * m_Dimension,
+			    end - begin,
+			    memberships + begin,
+			    nullptr );    // We only want the closest cluster
+
+    Eigen::Map< MatrixType > partial( Partial( worker ), m_NumberOfBags, k );
+    partial.setZero();
+    coOccurenceMatrix( indices + begin,
+		       indices + end,
+		       memberships + begin,
+		       memberships + end,
+		       partial
+		       );
+  }
+
+  Job* GetJob() {
+    return reinterpret_cast< Job* >( m_Shared.Data() );
+  }
+
+  double* Weights() {
+    return reinterpret_cast< double* >( m_Shared.Data() + m_WeightsOffset );
+  }
+
+  double* Centroids() {
+    return reinterpret_cast< double* >( m_Shared.Data() + m_CentroidsOffset );
+  }
+
+  int* Memberships() {
+    return reinterpret_cast< int* >( m_Shared.Data() + m_MembershipsOffset );
+  }
+
+  double* Partial( std::size_t worker ) {
+    return reinterpret_cast< double* >( m_Shared.Data() + m_PartialsOffset + worker * m_PartialSize );
+  }
+
+  ParameterType m_Params;
+  InstanceClustererType m_Clusterer;
+
+  const double* m_Instances;
+  const IndexType* m_Indices;
+  std::size_t m_NumberOfInstances;
+  std::size_t m_NumberOfBags;
+  std::size_t m_Dimension;
+  std::size_t m_MaximumK;
+
+  MappedFile m_Shared;
+  std::size_t m_WeightsOffset;
+  std::size_t m_CentroidsOffset;
+  std::size_t m_MembershipsOffset;
+  std::size_t m_PartialsOffset;
+  std::size_t m_PartialSize;
+  std::unique_ptr< WorkerProcesses > m_Workers;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __ShardedInstanceClustererParameters_h
+#define __ShardedInstanceClustererParameters_h
+
+/*
+  The parameters of the clusterer that finds the centroids, e.g. its k and
+  seed, extended with the sharding
+*/
+template< typename TClustererParameters >
+struct ShardedInstanceClustererParameters : public TClustererParameters {
+  /*
+    @param clustererParams    Parameters of the clusterer that finds the
+                              centroids
+    @param numberOfProcesses  Number of worker processes the instances are
+                              sharded over. With 1 or fewer nothing is forked
+			      and the clusterer does all the work
+    @param threadsPerProcess  Maximum number of threads each worker uses for
+                              its shard. 0 means use all cores
+  */
+  ShardedInstanceClustererParameters( const TClustererParameters& clustererParams = TClustererParameters(),
+				      unsigned int numberOfProcesses = 2,
+				      unsigned int threadsPerProcess = 1 )
+    : TClustererParameters( clustererParams )
+    , numberOfProcesses( numberOfProcesses )
+    , threadsPerProcess( threadsPerProcess )
+  {}
+
+  unsigned int numberOfProcesses;
+  unsigned int threadsPerProcess;
+};
+
+#endif
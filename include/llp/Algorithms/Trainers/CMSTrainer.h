@@ -1,12 +1,61 @@
 #ifndef __CMSTrainer_h
 #define __CMSTrainer_h
 
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 #include "libcmaes/cmaes.h"
 
 #include "llp/Models/ClusterModel.h"
+#include "llp/Algorithms/BagCoreset.h"
 #include "llp/Algorithms/Trainers/CMSTrainerParameters.h"
+#include "llp/Tracers/TracerBase.h"
+#include "llp/Util/PerfCounters.h"
+#include "llp/Util/PhaseTimer.h"
 #include "bd/BaggedDataset.h"
 
+/**
+   value is true if TInstanceClusterer can cluster bags of type TBaggedDataset
+   with a weight per instance
+*/
+template< typename TInstanceClusterer, typename TBaggedDataset >
+class AcceptsInstanceWeights {
+  template< typename T >
+  static auto Test( int )
+    -> decltype( std::declval< T& >().Cluster( std::declval< TBaggedDataset& >(),
+					       std::declval< const typename T::DistanceType& >(),
+					       std::declval< const std::vector< double >& >() ),
+		 std::true_type() );
+
+  template< typename T >
+  static std::false_type Test( ... );
+
+public:
+  static const bool value = decltype( Test< TInstanceClusterer >( 0 ) )::value;
+};
+
+
+/**
+   value is true if the parameters of TInstanceClusterer have a seed, i.e. the
+   clusterer gives the same clustering every time for the same seed
+*/
+template< typename TInstanceClusterer >
+class HasSeed {
+  template< typename T >
+  static auto Test( int )
+    -> decltype( std::declval< T& >().Parameters().seed = 0u, std::true_type() );
+
+  template< typename T >
+  static std::false_type Test( ... );
+
+public:
+  static const bool value = decltype( Test< TInstanceClusterer >( 0 ) )::value;
+};
+
+
 // TODO: Rewrite to return a model
 
 /**
@@ -18,6 +67,9 @@
    and the methods
      TClusterer( ParameterType& )
      InstanceClusteringType Cluster( BaggedDataset&, const DistanceType& )
+   and, to train on a coreset, the method
+     InstanceClusteringType Cluster( BaggedDataset&, const DistanceType&, const std::vector< double >& )
+   that clusters with a weight per instance.
      
    TLabeler should define the types
      ParameterType
@@ -29,7 +81,12 @@
      ParameterType
    and the methods
      TTracer( const ParameterType& )
-     void Trace( double )
+     void Trace( key, payload ), Debug, Info, Warning and Error
+     void BeginSpan( name ), EndSpan() and CompleteSpan( name, start, end )
+   where key and payload can be callables that are evaluated lazily, see
+   TracerBase. Training is traced as spans per generation, per candidate and
+   per final clustering. When LLP_PHASE_TIMING is defined the timed phases are
+   traced as spans too.
 */
 template< typename TBaggedDataset,
 	  typename TInstanceClusterer,
@@ -59,6 +116,7 @@ public:
   typedef libcmaes::GenoPheno< libcmaes::pwqBoundStrategy > GenoPheno;
   typedef libcmaes::CMAParameters< GenoPheno > CMAParameters;
   typedef libcmaes::CMASolutions CMASolutions;  
+  typedef libcmaes::ProgressFunc< CMAParameters, CMASolutions > ProgressFunc;
 
   CMSTrainer( const ParameterType&          trainerParams   = ParameterType(),
 	      const ClustererParameterType& clustererParams = ClustererParameterType(),
@@ -77,6 +135,56 @@ public:
     return m_TrainError;
   }
   
+  /**
+     \brief Evaluate the training objective for one set of feature weights.
+            This is what CMA-ES calls for every candidate.
+     \param w   Feature weights
+     \param N   Number of feature weights
+     \param instanceWeights  Weight of each instance of bags, such as the
+                             weights of a coreset. Null means unit weights
+     \return    Risk of the best labeling of a clustering of bags
+  */
+  static double
+  Objective( BaggedDatasetType& bags,
+	     ClustererType& clusterer,
+	     LabelerType& labeler,
+	     TracerType& tracer,
+	     const double* w,
+	     const int N,
+	     const std::vector< double >* instanceWeights = nullptr ) {
+    ScopedTraceSpan< TracerType > span( tracer, "candidate" );
+    DistanceType dist(w, N);
+    // Keys are built lazily, so nothing is done when TRACE is filtered out
+    for ( int i = 0; i < N; ++i ) {
+      tracer.Trace([i]{ return "Weight " + std::to_string(i); }, w[i]);
+    }
+    InstanceClusteringType clustering;
+    {
+      LLP_TIME_PHASE( "cluster" );
+      if ( instanceWeights == nullptr ) {
+	clustering = clusterer.Cluster( bags, dist );
+      }
+      else {
+	clustering = ClusterWeighted( clusterer, bags, dist, *instanceWeights,
+				      std::integral_constant< bool, AcceptsInstanceWeights< ClustererType, BaggedDatasetType >::value >() );
+      }
+    }
+    tracer.Trace("ClusterBagMap", clustering.clusterBagMap );
+	
+    // In some cases we have a clustering algorithm that is not guaranteed to
+    // give us the requested number of clusters, so we need to check how many
+    // we actually got
+    ClusterLabelVectorType labels = ClusterLabelVectorType::Zero( clustering.NumberOfClusters() );
+    double risk;
+    {
+      LLP_TIME_PHASE( "label" );
+      risk = labeler.Label( bags, clustering.clusterBagMap, labels );
+    }
+	
+    tracer.Trace("Risk", risk );
+    return risk;
+  }
+
   /**
      \brief Train cluster model         
      \param bags   Training data as a collection of bags
@@ -114,34 +222,85 @@ public:
     ClustererType clusterer( m_ClustererParams );
     LabelerType   labeler( m_LabelerParams );
     TracerType    tracer( m_TracerParams );
+
+    // The feature weights are optimized on a coreset of the bags when one is
+    // requested. It is sampled with the distance at the starting point of
+    // CMA-ES.
+    typedef BagCoresetBuilder< BaggedDatasetType, DistanceType > CoresetBuilderType;
+    typename CoresetBuilderType::CoresetType coreset;
+    const bool useCoreset = m_Params.coresetSize > 0;
+    if ( useCoreset ) {
+      if ( !AcceptsInstanceWeights< ClustererType, BaggedDatasetType >::value ) {
+	throw std::logic_error( "Training on a coreset needs a clusterer that accepts instance weights" );
+      }
+      ScopedTraceSpan< TracerType > span( tracer, "coreset" );
+      const BagCoresetParameters coresetParams( m_Params.coresetSize, 1, m_Params.seed );
+      coreset = CoresetBuilderType( DistanceType( weights.data(), weights.size() ), coresetParams ).Build( bags );
+      tracer.Info("Coreset instances", coreset.Size());
+    }
+    BaggedDatasetType& optimizationBags = useCoreset ? coreset.bags : bags;
+    const std::vector< double >* instanceWeights = useCoreset ? &coreset.weights : nullptr;
     
     
-    // Define and wrap the objective for cmaes
+    // Define and wrap the objective for cmaes. A generation span starts with
+    // the first candidate of a generation and ends when CMA-ES reports
+    // progress after the last.
+    int generation = 1;
+    bool inGeneration = false;
     std::function< double(const double*, const int&) > objective =
-      [&bags, &clusterer, &labeler, &tracer]
+      [&optimizationBags, instanceWeights, &clusterer, &labeler, &tracer, &generation, &inGeneration]
       ( const double* w, const int& N )
       {
-	DistanceType dist(w, N);
-	for ( int i = 0; i < N; ++i ) {
-	  tracer.Trace("Weight " + std::to_string(i), w[i]);
+	if ( !inGeneration ) {
+	  tracer.BeginSpan( [generation]{ return "generation " + std::to_string( generation ); } );
+	  inGeneration = true;
 	}
-	InstanceClusteringType clustering = clusterer.Cluster( bags, dist );
-	tracer.Trace("ClusterBagMap", clustering.clusterBagMap );
-	
-	// In some cases we have a clustering algorithm that is not guaranteed to
-	// give us the requested number of clusters, so we need to check how many
-	// we actually got
-	ClusterLabelVectorType labels = ClusterLabelVectorType::Zero( clustering.NumberOfClusters() );
-	double risk = labeler.Label( bags, clustering.clusterBagMap, labels );
-	
-	tracer.Trace("Risk", risk );
-	return risk;
+	return Self::Objective( optimizationBags, clusterer, labeler, tracer, w, N, instanceWeights );
       };
   
+    // Phase timings are collected over a generation and reported when CMA-ES
+    // reports progress. They stay empty unless LLP_PHASE_TIMING is defined.
+    PhaseTimings timings;
+    timings.SetSpanListener(
+      [&tracer]
+      ( const std::string& phase, PhaseTimings::ClockType::time_point start, PhaseTimings::ClockType::time_point end )
+      {
+	tracer.CompleteSpan( phase, start, end );
+      } );
+    PhaseTimingScope timingScope( timings );
+
+    // Hardware counters of the clusterer, labeler and model phases are
+    // reported the same way. They stay empty unless LLP_PERF_COUNTERS is
+    // defined.
+    PerfCounterTotals counters;
+    PerfCounterScope counterScope( counters );
+#ifdef LLP_PERF_COUNTERS
+    if ( !PerfCounterGroup::ForCurrentThread().Available() ) {
+      tracer.Warning("Performance counters unavailable", PerfCounterGroup::ForCurrentThread().Error());
+    }
+#endif
+
+    ProgressFunc progress =
+      [&tracer, &timings, &counters, &generation, &inGeneration]
+      ( const CMAParameters& params, const CMASolutions& solutions )
+      {
+	if ( inGeneration ) {
+	  tracer.EndSpan();
+	  inGeneration = false;
+	}
+	++generation;
+	TraceTimings( tracer, timings, "generation " + std::to_string( solutions.niter() ) );
+	TraceCounters( tracer, counters, "generation " + std::to_string( solutions.niter() ) );
+	return libcmaes::CMAStrategy< libcmaes::CovarianceUpdate, GenoPheno >::_defaultPFunc( params, solutions );
+      };
+
     tracer.Info("Status", "Running CMA-ES");
 
     // Run the optimization
-    CMASolutions solutions = libcmaes::cmaes< GenoPheno >( objective, cmaParams );
+    CMASolutions solutions = libcmaes::cmaes< GenoPheno >( objective, cmaParams, progress );
+    if ( inGeneration ) {
+      tracer.EndSpan();
+    }
 
     // TODO: Handle the diferent ways that CMAES can terminate
     if ( solutions.run_status() < 0 ) {
@@ -166,9 +325,23 @@ public:
     ClusterLabelVectorType bestLabels;
     DistanceType dist(weights.data(), weights.size());
     for ( size_t i = 0; i < m_Params.finalNumberOfClusterings; ++i ) {
-      InstanceClusteringType clustering = clusterer.Cluster( bags, dist );
+      ScopedTraceSpan< TracerType > span( tracer, [i]{ return "final clustering " + std::to_string( i ); } );
+      // A seeded clusterer would repeat the same clustering, so every final
+      // clustering after the first gets the next seed
+      if ( i > 0 ) {
+	AdvanceSeed( clusterer, std::integral_constant< bool, HasSeed< ClustererType >::value >() );
+      }
+      InstanceClusteringType clustering;
+      {
+	LLP_TIME_PHASE( "cluster" );
+	clustering = clusterer.Cluster( bags, dist );
+      }
       ClusterLabelVectorType labels = ClusterLabelVectorType::Zero( clustering.NumberOfClusters() );
-      double risk = labeler.Label( bags, clustering.clusterBagMap, labels );
+      double risk;
+      {
+	LLP_TIME_PHASE( "label" );
+	risk = labeler.Label( bags, clustering.clusterBagMap, labels );
+      }
 
       tracer.Debug("Risk", risk);
 
@@ -179,13 +352,71 @@ public:
       }
     }
 
+    TraceTimings( tracer, timings, "final clusterings" );
+    TraceCounters( tracer, counters, "final clusterings" );
+
     m_TrainError = bestRisk;
     typename ModelType::Pointer model = ModelType::New( bestCentroids, bestLabels, weights );
-    model->Build();
     return model;
   }
  
 protected:
+  static InstanceClusteringType
+  ClusterWeighted( ClustererType& clusterer,
+		   BaggedDatasetType& bags,
+		   const DistanceType& dist,
+		   const std::vector< double >& instanceWeights,
+		   std::true_type ) {
+    return clusterer.Cluster( bags, dist, instanceWeights );
+  }
+
+  static InstanceClusteringType
+  ClusterWeighted( ClustererType&,
+		   BaggedDatasetType&,
+		   const DistanceType&,
+		   const std::vector< double >&,
+		   std::false_type ) {
+    throw std::logic_error( "The clusterer does not accept instance weights" );
+  }
+
+  static void
+  AdvanceSeed( ClustererType& clusterer, std::true_type ) {
+    ++clusterer.Parameters().seed;
+  }
+
+  static void
+  AdvanceSeed( ClustererType&, std::false_type ) {}
+
+  /**
+     Report the summary of each phase at INFO and clear the timings
+  */
+  static void TraceTimings( TracerType& tracer, PhaseTimings& timings, const std::string& when ) {
+    if ( timings.Empty() ) {
+      return;
+    }
+    for ( const auto& summary : timings.Summarize() ) {
+      std::ostringstream ss;
+      ss << summary;
+      tracer.Info("Time " + summary.phase + " (" + when + ")", ss.str());
+    }
+    timings.Clear();
+  }
+
+  /**
+     Report the counter totals of each phase at INFO and clear the totals
+  */
+  static void TraceCounters( TracerType& tracer, PerfCounterTotals& counters, const std::string& when ) {
+    if ( counters.Empty() ) {
+      return;
+    }
+    for ( const auto& summary : counters.Summarize() ) {
+      std::ostringstream ss;
+      ss << summary;
+      tracer.Info("Counters " + summary.phase + " (" + when + ")", ss.str());
+    }
+    counters.Clear();
+  }
+
   ParameterType           m_Params;
   ClustererParameterType  m_ClustererParams;
   LabelerParameterType    m_LabelerParams;
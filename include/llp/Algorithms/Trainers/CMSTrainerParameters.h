@@ -12,6 +12,10 @@ struct CMSTrainerParameters {
     @param sigma   	 Initial step size
     @param lambda  	 Initial population size
     @param seed    	 Seed for random generator
+    @param coresetSize   Number of instances in a weighted coreset of the bags
+                         that the feature weights are optimized on. The final
+			 clusterings use all instances. 0 means optimize on
+			 all instances
   */
   CMSTrainerParameters( int maxIterations = 0,
 			std::string out = "",
@@ -19,14 +23,16 @@ struct CMSTrainerParameters {
 			int lambda = -1,
 			uint64_t seed = 0,
 			bool trace = false,
-			std::size_t finalNumberOfClusterings=10 )
+			std::size_t finalNumberOfClusterings=10,
+			std::size_t coresetSize = 0 )
     : maxIterations( maxIterations ),
       out( out ),
       sigma( sigma ),
       lambda( lambda ),
       seed( seed ),
       trace( trace ),
-      finalNumberOfClusterings( finalNumberOfClusterings )
+      finalNumberOfClusterings( finalNumberOfClusterings ),
+      coresetSize( coresetSize )
   {}
 
   const int maxIterations;
@@ -36,6 +42,7 @@ struct CMSTrainerParameters {
   const uint64_t seed;
   const bool trace;
   const std::size_t finalNumberOfClusterings;
+  const std::size_t coresetSize;
 };
 
 #endif
@@ -1,52 +1,256 @@
 #ifndef __Hausdorff_h
 #define __Hausdorff_h
 
-/* 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "llp/Distances/HausdorffParameters.h"
+
+/*
    Let X,Y \subseteq M and d a metric on M.
    The Hausdorff distance is defined as
      d_H(X,Y) = max( sup_{x \in X} inf_{y \in Y} d(x,y), sup_{y \in Y} inf_{x \in X} d(x,y) )
 
+   The distance is exact, but most pairs are never compared:
+
+   - Each directed distance is found with the early break of Taha and Hanbury
+     (An efficient algorithm for calculating the exact Hausdorff distance,
+     2015). The inner loop over y stops as soon as a y closer to x than the
+     current sup is found, because x can not raise the sup. The points are
+     visited in random order, which makes such a y likely to come early.
+
+   - The second direction starts with the first directed distance as its
+     sup, so it only has to look for points that are further away.
+
+   - The first direction keeps, for every point of Y, the smallest distance
+     to the points of X it was compared with. It is an upper bound on the inf
+     of that point in the second direction, so every point of Y whose bound
+     is already below the sup is skipped without comparing it to anything.
+     Memory is linear in the number of points, pairs are not cached.
+   - Optionally the second set of each direction is indexed by pivots. The
+     triangle inequality gives lower bounds |d(x,p) - d(p,y)| on d(x,y), and
+     the inner loop skips every y whose lower bound is not below the nearest
+     distance found. This requires d to be a metric, which the weighted EMD
+     distances are for non-negative weights. The pivot distances take
+     numberOfPivots times the size of the set.
+
+   TDistance must be a flann compatible distance functor, i.e. define
+     ResultType operator()( Iter, Iter, size_t ) const
  */
-template<typename IterType, typename Distance>
-typename Distance::ResultType
-hausdorff(IterType xBegin, IterType xEnd, 
-	  IterType yBegin, IterType yEnd,
-	  size_t cols,
-	  Distance dist) {
-  
-  typedef typename Distance::ResultType ResultType;
-
-  // Calculate sup_{x \in X} inf_{y \in Y} d(x,y)
-  ResultType sup_xy = std::numeric_limits<ResultType>::lowest();
-  for ( auto x = xBegin; x < xEnd; x += cols ) {
-    ResultType inf_xy = std::numeric_limits<ResultType>::max();
-    for ( auto y = yBegin; y < yEnd; y += cols ) {
-      auto distance = dist(x, y, cols);
-      if ( distance < inf_xy ) {
-	inf_xy = distance;
-      }
+template< typename TDistance >
+class HausdorffDistance {
+public:
+  typedef TDistance DistanceType;
+  typedef typename DistanceType::ResultType ResultType;
+  typedef HausdorffParameters ParameterType;
+
+  HausdorffDistance( const DistanceType& dist,
+		     const ParameterType& params=ParameterType() )
+    : m_Distance( dist )
+    , m_Params( params )
+  {}
+
+  /**
+     @param xBegin, xEnd   Row-major instances of X
+     @param yBegin, yEnd   Row-major instances of Y
+     @param cols           Dimension of the instances
+     @return               Hausdorff distance between X and Y
+   */
+  template< typename IterType >
+  ResultType operator()( IterType xBegin, IterType xEnd,
+			 IterType yBegin, IterType yEnd,
+			 std::size_t cols ) const {
+    std::size_t evaluations;
+    return ( *this )( xBegin, xEnd, yBegin, yEnd, cols, evaluations );
+  }
+
+  /**
+     As above, and give the number of times the distance functor was called
+   */
+  template< typename IterType >
+  ResultType operator()( IterType xBegin, IterType xEnd,
+			 IterType yBegin, IterType yEnd,
+			 std::size_t cols,
+			 std::size_t& evaluations ) const {
+    const std::size_t nx = std::distance( xBegin, xEnd ) / cols;
+    const std::size_t ny = std::distance( yBegin, yEnd ) / cols;
+    evaluations = 0;
+    // Same as the sup of inf over empty sets
+    if ( nx == 0 && ny == 0 ) {
+      return std::numeric_limits< ResultType >::lowest();
     }
-    if ( inf_xy > sup_xy) {
-      sup_xy = inf_xy;
+    if ( nx == 0 || ny == 0 ) {
+      return std::numeric_limits< ResultType >::max();
     }
+
+    Points< IterType > points( m_Distance, xBegin, nx, yBegin, ny, cols );
+    std::mt19937 gen( m_Params.seed );
+    std::vector< ResultType > minimaY( ny, std::numeric_limits< ResultType >::max() );
+    ResultType sup = std::numeric_limits< ResultType >::lowest();
+    sup = DirectedSup( points, false, sup, nullptr, &minimaY, gen );
+    sup = DirectedSup( points, true, sup, &minimaY, nullptr, gen );
+    evaluations = points.evaluations;
+    return sup;
   }
 
-  // Calculate sup_{x \in X} inf_{y \in Y} d(x,y)
-  ResultType sup_yx = std::numeric_limits<ResultType>::lowest();
-  for ( auto y = yBegin; y < yEnd; y += cols ) {
-    ResultType inf_yx = std::numeric_limits<ResultType>::max();
-    for ( auto x = xBegin; x < xEnd; x += cols ) {
-      auto distance = dist(x, y, cols);
-      if ( distance < inf_yx ) {
-	inf_yx = distance;
+private:
+  /*
+    The points of X and Y. With transposed the first index is in Y and the
+    second in X.
+  */
+  template< typename IterType >
+  struct Points {
+    Points( const DistanceType& dist,
+	    IterType x, std::size_t nx,
+	    IterType y, std::size_t ny,
+	    std::size_t cols )
+      : dist( dist )
+      , x( x )
+      , nx( nx )
+      , y( y )
+      , ny( ny )
+      , cols( cols )
+      , evaluations( 0 )
+    {}
+
+    std::size_t Size( bool transposed ) const {
+      return transposed ? ny : nx;
+    }
+
+    ResultType Distance( bool transposed, std::size_t a, std::size_t b ) {
+      const std::size_t i = transposed ? b : a;
+      const std::size_t j = transposed ? a : b;
+      ++evaluations;
+      return dist( x + i * cols, y + j * cols, cols );
+    }
+
+    // Distance between two points of the same set. Used for the pivots.
+    ResultType Within( bool ofY, std::size_t i, std::size_t j ) {
+      ++evaluations;
+      IterType points = ofY ? y : x;
+      return dist( points + i * cols, points + j * cols, cols );
+    }
+
+    const DistanceType& dist;
+    IterType x;
+    std::size_t nx;
+    IterType y;
+    std::size_t ny;
+    std::size_t cols;
+    std::size_t evaluations;
+  };
+
+  /*
+    sup over a in A of inf over b in B of d(a,b), or sup if that is larger.
+    A is X and B is Y, or the other way round when transposed.
+
+    If given, upperBounds[a] is an upper bound on the inf of a, and
+    minimaB[b] is lowered to every distance to b that is computed.
+  */
+  template< typename IterType >
+  ResultType DirectedSup( Points< IterType >& points,
+			  bool transposed,
+			  ResultType sup,
+			  const std::vector< ResultType >* upperBounds,
+			  std::vector< ResultType >* minimaB,
+			  std::mt19937& gen ) const {
+    const std::size_t na = points.Size( transposed );
+    const std::size_t nb = points.Size( !transposed );
+    std::vector< std::size_t > orderA( na ), orderB( nb );
+    std::iota( orderA.begin(), orderA.end(), 0 );
+    std::iota( orderB.begin(), orderB.end(), 0 );
+    std::shuffle( orderA.begin(), orderA.end(), gen );
+    std::shuffle( orderB.begin(), orderB.end(), gen );
+
+    // The pivots are the first points of B in the random order
+    const std::vector< std::size_t > pivots( orderB.begin(), orderB.begin() + std::min( m_Params.numberOfPivots, nb ) );
+    const std::size_t numberOfPivots = pivots.size();
+    // The distances of point b to the pivots start at b * numberOfPivots
+    std::vector< ResultType > pivotDistances( numberOfPivots * nb );
+    for ( std::size_t p = 0; p < numberOfPivots; ++p ) {
+      for ( std::size_t b = 0; b < nb; ++b ) {
+	pivotDistances[b * numberOfPivots + p] = b == pivots[p] ? ResultType() : points.Within( !transposed, pivots[p], b );
       }
     }
-    if ( inf_yx > sup_yx) {
-      sup_yx = inf_yx;
+    std::vector< ResultType > distancesToPivots( numberOfPivots );
+
+    // Lower bound on the distance between a and b from the triangle
+    // inequality, given the distances of a to the pivots
+    auto lowerBound = [&]( std::size_t b ) {
+      const ResultType* db = pivotDistances.data() + b * numberOfPivots;
+      ResultType bound = ResultType();
+      for ( std::size_t p = 0; p < numberOfPivots; ++p ) {
+	bound = std::max( bound, static_cast< ResultType >( std::abs( distancesToPivots[p] - db[p] ) ) );
+      }
+      return bound;
+    };
+
+    auto distance = [&]( std::size_t a, std::size_t b ) {
+      const ResultType d = points.Distance( transposed, a, b );
+      if ( minimaB != nullptr ) {
+	( *minimaB )[b] = std::min( ( *minimaB )[b], d );
+      }
+      return d;
+    };
+
+    for ( std::size_t a : orderA ) {
+      // A distance found in the other direction may already show that a can
+      // not raise sup
+      ResultType inf = upperBounds != nullptr ? ( *upperBounds )[a] : std::numeric_limits< ResultType >::max();
+      if ( inf < sup ) {
+	continue;
+      }
+
+      if ( numberOfPivots > 0 ) {
+	for ( std::size_t p = 0; p < numberOfPivots; ++p ) {
+	  distancesToPivots[p] = distance( a, pivots[p] );
+	  inf = std::min( inf, distancesToPivots[p] );
+	}
+	if ( inf < sup ) {
+	  continue;
+	}
+      }
+
+      // The lower bound of b is only computed when b is reached, so points
+      // after the early break cost nothing
+      for ( std::size_t b : orderB ) {
+	if ( numberOfPivots > 0 && lowerBound( b ) >= inf ) {
+	  // b is at least as far as the nearest point found
+	  continue;
+	}
+	inf = std::min( inf, distance( a, b ) );
+	if ( inf < sup ) {
+	  // Early break, a can not raise sup
+	  break;
+	}
+      }
+      sup = std::max( sup, inf );
     }
+    return sup;
   }
-  
-  return std::max(sup_xy, sup_yx);
+
+  const DistanceType m_Distance;
+  const ParameterType m_Params;
+};
+
+
+/**
+   Hausdorff distance between the row-major instances in [xBegin, xEnd) and
+   [yBegin, yEnd), see HausdorffDistance
+ */
+template<typename IterType, typename Distance>
+typename Distance::ResultType
+hausdorff(IterType xBegin, IterType xEnd,
+	  IterType yBegin, IterType yEnd,
+	  size_t cols,
+	  Distance dist,
+	  const HausdorffParameters& params=HausdorffParameters()) {
+  return HausdorffDistance< Distance >( dist, params )( xBegin, xEnd, yBegin, yEnd, cols );
 }
 
 #endif
@@ -0,0 +1,28 @@
+#ifndef __HausdorffParameters_h
+#define __HausdorffParameters_h
+
+#include <cstddef>
+
+struct HausdorffParameters {
+  /*
+    Parameters for the Hausdorff distance between sets of instances
+
+    @param numberOfPivots  Number of pivots in the index on each set. The
+                           pivots give lower bounds on distances through the
+			   triangle inequality, so the distance must be a
+			   metric. 0 means no index, which is best for small
+			   sets
+    @param seed            Seed of the random order the points are visited in.
+                           The result does not depend on it
+  */
+  HausdorffParameters( std::size_t numberOfPivots = 0,
+		       unsigned int seed = 0 )
+    : numberOfPivots( numberOfPivots )
+    , seed( seed )
+  {}
+
+  std::size_t numberOfPivots;
+  unsigned int seed;
+};
+
+#endif
@@ -38,7 +38,16 @@ struct WeightedNxMDistance {
     }
     return distance;
   }
-  
+
+  // The weights, so an equal distance can be made from a copy of them
+  const ResultType* Weights() const {
+    return m_W;
+  }
+
+  size_t NumberOfWeights() const {
+    return m_N;
+  }
+
 private:
   const ResultType* m_W;
   const size_t m_N;
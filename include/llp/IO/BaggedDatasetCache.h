@@ -0,0 +1,333 @@
+#ifndef __BaggedDatasetCache_h
+#define __BaggedDatasetCache_h
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Eigen/Dense"
+
+#include "llp/IO/ParallelTextLoader.h"
+#include "llp/Util/BufferedWriter.h"
+#include "llp/Util/MappedFile.h"
+
+/*
+  Binary cache of a bagged dataset that can be mapped into memory instead of
+  parsed.
+
+  The file is written in native byte order as a 128 byte header followed by
+  four sections. Every section starts at a 64 byte aligned offset, so the rows
+  of the instance matrix are aligned and can be handed directly to FLANN or the
+  distance functors.
+
+    Header
+      char[8]   "LLPBAGS1"
+      uint32_t  bag label dimension
+      uint32_t  instance label dimension
+      uint64_t  number of instances
+      uint64_t  number of bags
+      uint64_t  dimension of the feature space
+      uint64_t  offset of each section, in the order below
+      uint64_t  size of the text file the cache was made from, or 0
+      int64_t   modification time in nanoseconds of the text file, or 0
+    Sections
+      double    instances, row-major number of instances x dimension
+      uint64_t  bag index of each instance
+      double    bag labels, row-major number of bags x bag label dimension
+      double    instance labels, row-major number of instances x instance
+                label dimension
+*/
+struct BaggedDatasetCacheHeader {
+  char magic[8];
+  uint32_t bagLabelDim;
+  uint32_t instanceLabelDim;
+  uint64_t numberOfInstances;
+  uint64_t numberOfBags;
+  uint64_t dimension;
+  uint64_t instancesOffset;
+  uint64_t indicesOffset;
+  uint64_t bagLabelsOffset;
+  uint64_t instanceLabelsOffset;
+  FileStamp source;
+  char reserved[128 - 8 - 2*4 - 7*8 - sizeof(FileStamp)];
+
+  static const char* Magic() {
+    return "LLPBAGS1";
+  }
+
+  static uint64_t Align( uint64_t offset ) {
+    return ( offset + 63 ) / 64 * 64;
+  }
+
+  /**
+     Fill in the header for a dataset of the given size
+  */
+  static BaggedDatasetCacheHeader Make( uint32_t bagLabelDim,
+					uint32_t instanceLabelDim,
+					uint64_t numberOfInstances,
+					uint64_t numberOfBags,
+					uint64_t dimension ) {
+    BaggedDatasetCacheHeader header;
+    std::memset( &header, 0, sizeof header );
+    std::memcpy( header.magic, Magic(), sizeof header.magic );
+    header.bagLabelDim = bagLabelDim;
+    header.instanceLabelDim = instanceLabelDim;
+    header.numberOfInstances = numberOfInstances;
+    header.numberOfBags = numberOfBags;
+    header.dimension = dimension;
+    header.instancesOffset = Align( sizeof header );
+    header.indicesOffset = Align( header.instancesOffset + sizeof(double) * numberOfInstances * dimension );
+    header.bagLabelsOffset = Align( header.indicesOffset + sizeof(uint64_t) * numberOfInstances );
+    header.instanceLabelsOffset = Align( header.bagLabelsOffset + sizeof(double) * numberOfBags * bagLabelDim );
+    return header;
+  }
+
+  uint64_t FileSize() const {
+    return instanceLabelsOffset + sizeof(double) * numberOfInstances * instanceLabelDim;
+  }
+};
+
+static_assert( sizeof(BaggedDatasetCacheHeader) == 128, "Cache header must be 128 bytes" );
+
+
+/**
+   Write bags to os in the cache format. source is the stamp of the text file
+   bags was loaded from, taken before it was loaded, which makes
+   loadBaggedDataset ignore the cache when the text file changes.
+*/
+template< typename TBaggedDataset >
+void
+saveBaggedDatasetCache( const TBaggedDataset& bags, std::ostream& os, const FileStamp& source=FileStamp() ) {
+  const auto& instances = bags.Instances();
+  const auto& indices = bags.Indices();
+  const auto& bagLabels = bags.BagLabels();
+  const auto& instanceLabels = bags.InstanceLabels();
+
+  BaggedDatasetCacheHeader header =
+    BaggedDatasetCacheHeader::Make( bagLabels.cols(),
+				    instanceLabels.cols(),
+				    bags.NumberOfInstances(),
+				    bags.NumberOfBags(),
+				    bags.Dimension() );
+  header.source = source;
+
+  BufferedWriter writer( os );
+  uint64_t offset = 0;
+  auto pad = [&]( uint64_t to ) {
+    for ( ; offset < to; ++offset ) {
+      writer.Put( '\0' );
+    }
+  };
+
+  writer.WriteBinary( header );
+  offset += sizeof header;
+
+  pad( header.instancesOffset );
+  for ( uint64_t i = 0; i < header.numberOfInstances; ++i ) {
+    for ( uint64_t j = 0; j < header.dimension; ++j ) {
+      writer.WriteBinary< double >( instances(i,j) );
+    }
+  }
+  offset += sizeof(double) * header.numberOfInstances * header.dimension;
+
+  pad( header.indicesOffset );
+  for ( uint64_t i = 0; i < header.numberOfInstances; ++i ) {
+    writer.WriteBinary< uint64_t >( indices[i] );
+  }
+  offset += sizeof(uint64_t) * header.numberOfInstances;
+
+  pad( header.bagLabelsOffset );
+  for ( uint64_t i = 0; i < header.numberOfBags; ++i ) {
+    for ( uint64_t j = 0; j < header.bagLabelDim; ++j ) {
+      writer.WriteBinary< double >( bagLabels(i,j) );
+    }
+  }
+  offset += sizeof(double) * header.numberOfBags * header.bagLabelDim;
+
+  pad( header.instanceLabelsOffset );
+  for ( uint64_t i = 0; i < header.numberOfInstances; ++i ) {
+    for ( uint64_t j = 0; j < header.instanceLabelDim; ++j ) {
+      writer.WriteBinary< double >( instanceLabels(i,j) );
+    }
+  }
+  writer.Flush();
+}
+
+template< typename TBaggedDataset >
+void
+saveBaggedDatasetCache( const TBaggedDataset& bags, const std::string& path, const FileStamp& source=FileStamp() ) {
+  std::ofstream os( path, std::ios::binary );
+  if ( !os ) {
+    throw std::runtime_error( "Could not open " + path );
+  }
+  saveBaggedDatasetCache( bags, os, source );
+}
+
+
+/**
+   A bagged dataset cache mapped into memory.
+
+   The accessors give Eigen::Map views directly into the mapped file, so
+   nothing is copied or parsed until ToBaggedDataset() is called. The views are
+   valid as long as the MappedBaggedDataset is alive.
+*/
+template< typename TBaggedDataset >
+class MappedBaggedDataset {
+public:
+  typedef TBaggedDataset BaggedDatasetType;
+  typedef Eigen::Matrix< double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor > RowMajorMatrixType;
+  typedef Eigen::Map< const RowMajorMatrixType, Eigen::Aligned > MatrixMapType;
+  typedef Eigen::Map< const Eigen::Matrix< uint64_t, Eigen::Dynamic, 1 >, Eigen::Aligned > IndexMapType;
+
+  explicit MappedBaggedDataset( const std::string& path )
+    : m_File( MappedFile::OpenReadOnly( path ) )
+    , m_Header()
+  {
+    if ( m_File.Size() < sizeof m_Header ) {
+      throw std::runtime_error( "Bagged dataset cache is truncated: " + path );
+    }
+    std::memcpy( &m_Header, m_File.Data(), sizeof m_Header );
+    if ( std::memcmp( m_Header.magic, BaggedDatasetCacheHeader::Magic(), sizeof m_Header.magic ) != 0 ) {
+      throw std::runtime_error( "Not a bagged dataset cache: " + path );
+    }
+    const BaggedDatasetCacheHeader expected =
+      BaggedDatasetCacheHeader::Make( m_Header.bagLabelDim,
+				      m_Header.instanceLabelDim,
+				      m_Header.numberOfInstances,
+				      m_Header.numberOfBags,
+				      m_Header.dimension );
+    if ( expected.instancesOffset != m_Header.instancesOffset ||
+	 expected.indicesOffset != m_Header.indicesOffset ||
+	 expected.bagLabelsOffset != m_Header.bagLabelsOffset ||
+	 expected.instanceLabelsOffset != m_Header.instanceLabelsOffset ||
+	 m_File.Size() < m_Header.FileSize() ) {
+      throw std::runtime_error( "Bagged dataset cache is corrupt: " + path );
+    }
+
+    typedef typename BaggedDatasetType::BagLabelVectorType BagLabelVectorType;
+    typedef typename BaggedDatasetType::InstanceLabelVectorType InstanceLabelVectorType;
+    if ( ( BagLabelVectorType::ColsAtCompileTime != Eigen::Dynamic &&
+	   BagLabelVectorType::ColsAtCompileTime != static_cast< int >( m_Header.bagLabelDim ) ) ||
+	 ( InstanceLabelVectorType::ColsAtCompileTime != Eigen::Dynamic &&
+	   InstanceLabelVectorType::ColsAtCompileTime != static_cast< int >( m_Header.instanceLabelDim ) ) ) {
+      throw std::runtime_error( "Label dimensions of bagged dataset cache do not match: " + path );
+    }
+  }
+
+  std::size_t NumberOfInstances() const {
+    return m_Header.numberOfInstances;
+  }
+
+  std::size_t NumberOfBags() const {
+    return m_Header.numberOfBags;
+  }
+
+  std::size_t Dimension() const {
+    return m_Header.dimension;
+  }
+
+  /**
+     Stamp of the text file the cache was made from, unset if unknown
+  */
+  const FileStamp& Source() const {
+    return m_Header.source;
+  }
+
+  MatrixMapType Instances() const {
+    return MatrixMapType( Section< double >( m_Header.instancesOffset ),
+			  m_Header.numberOfInstances,
+			  m_Header.dimension );
+  }
+
+  IndexMapType Indices() const {
+    return IndexMapType( Section< uint64_t >( m_Header.indicesOffset ),
+			 m_Header.numberOfInstances );
+  }
+
+  MatrixMapType BagLabels() const {
+    return MatrixMapType( Section< double >( m_Header.bagLabelsOffset ),
+			  m_Header.numberOfBags,
+			  m_Header.bagLabelDim );
+  }
+
+  MatrixMapType InstanceLabels() const {
+    return MatrixMapType( Section< double >( m_Header.instanceLabelsOffset ),
+			  m_Header.numberOfInstances,
+			  m_Header.instanceLabelDim );
+  }
+
+  /**
+     Copy the mapped data into a BaggedDatasetType, which owns its storage
+  */
+  BaggedDatasetType ToBaggedDataset() const {
+    typedef typename BaggedDatasetType::MatrixType MatrixType;
+    typedef typename BaggedDatasetType::IndexVectorType IndexVectorType;
+    typedef typename BaggedDatasetType::BagLabelVectorType BagLabelVectorType;
+    typedef typename BaggedDatasetType::InstanceLabelVectorType InstanceLabelVectorType;
+
+    MatrixType instances = Instances();
+    IndexVectorType indices = Indices().template cast< typename IndexVectorType::Scalar >();
+    BagLabelVectorType bagLabels = BagLabels();
+    InstanceLabelVectorType instanceLabels = InstanceLabels();
+    return BaggedDatasetType( instances, indices, bagLabels, instanceLabels );
+  }
+
+private:
+  template< typename T >
+  const T* Section( uint64_t offset ) const {
+    return reinterpret_cast< const T* >( m_File.Data() + offset );
+  }
+
+  MappedFile m_File;
+  BaggedDatasetCacheHeader m_Header;
+};
+
+
+/**
+   Path of the cache belonging to the text dataset at path
+*/
+inline std::string
+baggedDatasetCachePath( const std::string& path ) {
+  return path + ".llpbin";
+}
+
+/**
+   Load the bagged dataset at path. If path is itself a cache, or there is an
+   up-to-date cache next to it, the cache is used. Otherwise the text file is
+   parsed with LoadText, or with ParallelTextLoader if parallelParse is set.
+
+   A cache that records the stamp of its text file is up-to-date when the
+   text file still has that size and modification time. Otherwise it must have
+   been modified no earlier than the text file. If the text file no longer
+   exists, the cache next to it is used as is.
+*/
+template< typename TBaggedDataset >
+TBaggedDataset
+loadBaggedDataset( const std::string& path, bool parallelParse=false ) {
+  std::ifstream is( path, std::ios::binary );
+  char magic[8] = {};
+  if ( is.read( magic, sizeof magic ) &&
+       std::memcmp( magic, BaggedDatasetCacheHeader::Magic(), sizeof magic ) == 0 ) {
+    return MappedBaggedDataset< TBaggedDataset >( path ).ToBaggedDataset();
+  }
+
+  const std::string cachePath = baggedDatasetCachePath( path );
+  if ( isUpToDate( cachePath, path ) ) {
+    MappedBaggedDataset< TBaggedDataset > cache( cachePath );
+    if ( ! is.is_open() || ! cache.Source().IsSet() || cache.Source() == FileStamp::Of( path ) ) {
+      return cache.ToBaggedDataset();
+    }
+  }
+
+  if ( parallelParse ) {
+    return ParallelTextLoader< TBaggedDataset >().Load( path );
+  }
+  is.clear();
+  is.seekg( 0 );
+  return TBaggedDataset::LoadText( is, true );
+}
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef __ParallelTextLoader_h
+#define __ParallelTextLoader_h
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Eigen/Dense"
+
+#include "llp/IO/ParallelTextLoaderParameters.h"
+#include "llp/Util/MappedFile.h"
+#include "llp/Util/Parallel.h"
+#include "llp/Util/ParseNumber.h"
+
+/*
+  Multi-threaded loader for bagged datasets in text format.
+
+  The format is the one read by BaggedDataset::LoadText. Each line holds one
+  instance as delimited fields
+    bag, bag label(s), instance label(s), features
+  where the number of bag and instance labels is given by the label dimensions
+  of TBaggedDataset, and all lines have the same number of features. Bags are
+  numbered by the rank of their bag id, so ids 0..B-1 are kept and ids 1..B
+  become 0..B-1. The bag label of a bag is taken from its first line.
+
+  In detail:
+  - Fields are separated by params.delimiter, ',' by default. Spaces and tabs
+    around a field are ignored. Fields are numbers as read by strtod.
+  - The first line is a header and is skipped if params.hasHeader is set.
+  - Lines end with '\n'. A '\r' before it is ignored, so are blank lines, and
+    the last line does not need a '\n'.
+
+  The file is mapped into memory and split in line aligned byte ranges that are
+  parsed in parallel. A first pass counts the lines in each range, so the
+  second pass can parse every range directly into its final rows. The result
+  does not depend on the number of threads.
+*/
+template< typename TBaggedDataset >
+class ParallelTextLoader {
+public:
+  typedef TBaggedDataset BaggedDatasetType;
+  typedef ParallelTextLoader< BaggedDatasetType > Self;
+  typedef ParallelTextLoaderParameters ParameterType;
+
+  typedef typename BaggedDatasetType::MatrixType MatrixType;
+  typedef typename BaggedDatasetType::IndexVectorType IndexVectorType;
+  typedef typename BaggedDatasetType::BagLabelVectorType BagLabelVectorType;
+  typedef typename BaggedDatasetType::InstanceLabelVectorType InstanceLabelVectorType;
+
+  static const int BagLabelDim = BagLabelVectorType::ColsAtCompileTime;
+  static const int InstanceLabelDim = InstanceLabelVectorType::ColsAtCompileTime;
+  static_assert( BagLabelDim > 0 && InstanceLabelDim > 0, "Label dimensions must be known at compile time" );
+
+  ParallelTextLoader( const ParameterType& params=ParameterType() )
+    : m_Params( params )
+  {}
+
+  BaggedDatasetType Load( const std::string& path ) const {
+    MappedFile file = MappedFile::OpenReadOnly( path );
+    const char* begin = file.Data();
+    const char* end = begin + file.Size();
+    if ( m_Params.hasHeader ) {
+      begin = NextLine( begin, end );
+    }
+
+    // Split in line aligned ranges. We use more ranges than threads so
+    // uneven lines do not leave threads idle.
+    const std::size_t numberOfRanges =
+      std::max< std::size_t >( 1, std::min< std::size_t >( 4 * resolveNumberOfThreads( m_Params.numberOfThreads ),
+							   ( end - begin ) / MinRangeBytes ) );
+    std::vector< const char* > bounds( numberOfRanges + 1, end );
+    bounds[0] = begin;
+    for ( std::size_t i = 1; i < numberOfRanges; ++i ) {
+      const char* approx = begin + ( end - begin ) * i / numberOfRanges;
+      bounds[i] = std::max( bounds[i-1], approx == begin ? begin : NextLine( approx - 1, end ) );
+    }
+
+    // First pass: count lines so every range knows its first row
+    std::vector< std::size_t > firstRow( numberOfRanges + 1, 0 );
+    parallelFor( numberOfRanges, 1, m_Params.numberOfThreads,
+		 [&]( std::size_t rb, std::size_t re ) {
+		   for ( std::size_t r = rb; r < re; ++r ) {
+		     std::size_t lines = 0;
+		     ForEachLine( bounds[r], bounds[r+1], [&lines]( const char*, const char* ) { ++lines; } );
+		     firstRow[r+1] = lines;
+		   }
+		 });
+    for ( std::size_t r = 0; r < numberOfRanges; ++r ) {
+      firstRow[r+1] += firstRow[r];
+    }
+    const std::size_t numberOfInstances = firstRow[numberOfRanges];
+    if ( numberOfInstances == 0 ) {
+      throw std::runtime_error( "No instances in " + path );
+    }
+
+    // The dimension is given by the first line
+    std::size_t numberOfFields = 0;
+    for ( const char* line = begin; line < end && numberOfFields == 0; line = NextLine( line, end ) ) {
+      ForEachLine( line, NextLine( line, end ), [&]( const char* lineBegin, const char* lineEnd ) {
+	  numberOfFields = ParseLine( lineBegin, lineEnd, nullptr, 0 );
+	});
+    }
+    const std::size_t labelFields = 1 + BagLabelDim + InstanceLabelDim;
+    if ( numberOfFields <= labelFields ) {
+      throw std::runtime_error( "Too few fields in " + path );
+    }
+    const std::size_t dimension = numberOfFields - labelFields;
+
+    // Second pass: parse into the final rows
+    std::vector< double > rows( numberOfInstances * dimension );
+    std::vector< double > bagIds( numberOfInstances );
+    std::vector< double > bagLabelRows( numberOfInstances * BagLabelDim );
+    std::vector< double > instanceLabelRows( numberOfInstances * InstanceLabelDim );
+    parallelFor( numberOfRanges, 1, m_Params.numberOfThreads,
+		 [&]( std::size_t rb, std::size_t re ) {
+		   std::vector< double > fields( numberOfFields );
+		   for ( std::size_t r = rb; r < re; ++r ) {
+		     std::size_t row = firstRow[r];
+		     ForEachLine( bounds[r], bounds[r+1], [&]( const char* lineBegin, const char* lineEnd ) {
+			 if ( ParseLine( lineBegin, lineEnd, fields.data(), numberOfFields ) != numberOfFields ) {
+			   throw std::runtime_error( "Wrong number of fields on line " +
+						     std::to_string( row + 1 + m_Params.hasHeader ) );
+			 }
+			 const double* f = fields.data();
+			 bagIds[row] = *f++;
+			 std::copy( f, f + BagLabelDim, bagLabelRows.begin() + row * BagLabelDim );
+			 f += BagLabelDim;
+			 std::copy( f, f + InstanceLabelDim, instanceLabelRows.begin() + row * InstanceLabelDim );
+			 f += InstanceLabelDim;
+			 std::copy( f, f + dimension, rows.begin() + row * dimension );
+			 ++row;
+		       });
+		   }
+		 });
+
+    // Number the bags by the rank of their id
+    std::vector< double > distinctIds( bagIds );
+    std::sort( distinctIds.begin(), distinctIds.end() );
+    distinctIds.erase( std::unique( distinctIds.begin(), distinctIds.end() ), distinctIds.end() );
+    const std::size_t numberOfBags = distinctIds.size();
+
+    typedef Eigen::Matrix< double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor > RowMajorMatrixType;
+    MatrixType instances = Eigen::Map< const RowMajorMatrixType >( rows.data(), numberOfInstances, dimension );
+    InstanceLabelVectorType instanceLabels =
+      Eigen::Map< const RowMajorMatrixType >( instanceLabelRows.data(), numberOfInstances, InstanceLabelDim );
+    IndexVectorType indices( numberOfInstances );
+    BagLabelVectorType bagLabels( numberOfBags, BagLabelDim );
+    std::vector< bool > hasBagLabel( numberOfBags, false );
+    for ( std::size_t i = 0; i < numberOfInstances; ++i ) {
+      const std::size_t bag =
+	std::lower_bound( distinctIds.begin(), distinctIds.end(), bagIds[i] ) - distinctIds.begin();
+      indices[i] = bag;
+      if ( !hasBagLabel[bag] ) {
+	hasBagLabel[bag] = true;
+	for ( int j = 0; j < BagLabelDim; ++j ) {
+	  bagLabels( bag, j ) = bagLabelRows[i * BagLabelDim + j];
+	}
+      }
+    }
+    return BaggedDatasetType( instances, indices, bagLabels, instanceLabels );
+  }
+
+private:
+  // Do not split files in ranges smaller than this
+  static const std::size_t MinRangeBytes = 1 << 16;
+
+  static const char* NextLine( const char* p, const char* end ) {
+    const void* newline = std::memchr( p, '\n', end - p );
+    return newline == nullptr ? end : static_cast< const char* >( newline ) + 1;
+  }
+
+  /**
+     Call fn(lineBegin, lineEnd) for each line in [begin, end) that is not blank
+  */
+  template< typename Function >
+  static void ForEachLine( const char* begin, const char* end, Function fn ) {
+    while ( begin < end ) {
+      const char* next = NextLine( begin, end );
+      const char* lineEnd = next;
+      while ( lineEnd > begin && IsSpace( lineEnd[-1] ) ) {
+	--lineEnd;
+      }
+      if ( lineEnd > begin ) {
+	fn( begin, lineEnd );
+      }
+      begin = next;
+    }
+  }
+
+  static bool IsSpace( char c ) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  /**
+     Parse the fields of a line. At most maxFields fields are stored.
+     @return The number of fields on the line
+  */
+  std::size_t ParseLine( const char* p, const char* end, double* fields, std::size_t maxFields ) const {
+    std::size_t n = 0;
+    while ( true ) {
+      while ( p < end && IsSpace( *p ) ) {
+	++p;
+      }
+      double value;
+      const char* q = parseDouble( p, end, value );
+      if ( q == p ) {
+	throw std::runtime_error( "Could not parse number '" +
+				  std::string( p, std::min( end, p + 20 ) ) + "'" );
+      }
+      if ( n < maxFields ) {
+	fields[n] = value;
+      }
+      ++n;
+      p = q;
+      while ( p < end && IsSpace( *p ) && *p != m_Params.delimiter ) {
+	++p;
+      }
+      if ( p == end ) {
+	return n;
+      }
+      if ( *p != m_Params.delimiter ) {
+	throw std::runtime_error( "Unexpected character '" + std::string( 1, *p ) + "'" );
+      }
+      ++p;
+    }
+  }
+
+  ParameterType m_Params;
+};
+
+template< typename TBaggedDataset >
+const std::size_t ParallelTextLoader< TBaggedDataset >::MinRangeBytes;
+
+#endif
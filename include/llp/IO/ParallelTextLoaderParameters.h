@@ -0,0 +1,25 @@
+#ifndef __ParallelTextLoaderParameters_h
+#define __ParallelTextLoaderParameters_h
+
+struct ParallelTextLoaderParameters {
+  /*
+    Parameters for parsing a bagged dataset in text format
+
+    @param numberOfThreads  Maximum number of threads. 0 means use all cores
+    @param hasHeader        If the first line is a header that should be skipped
+    @param delimiter        Field delimiter. Whitespace around fields is ignored
+  */
+  ParallelTextLoaderParameters( unsigned int numberOfThreads = 0,
+				bool hasHeader = true,
+				char delimiter = ',' )
+    : numberOfThreads( numberOfThreads )
+    , hasHeader( hasHeader )
+    , delimiter( delimiter )
+  {}
+
+  unsigned int numberOfThreads;
+  bool hasHeader;
+  char delimiter;
+};
+
+#endif
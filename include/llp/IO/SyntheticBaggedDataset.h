@@ -0,0 +1,323 @@
+#ifndef __SyntheticBaggedDataset_h
+#define __SyntheticBaggedDataset_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Eigen/Dense"
+
+#include "llp/IO/BaggedDatasetCache.h"
+#include "llp/IO/SyntheticBaggedDatasetParameters.h"
+#include "llp/Util/BufferedWriter.h"
+#include "llp/Util/MappedFile.h"
+#include "llp/Util/Parallel.h"
+
+/*
+  Deterministic synthetic bagged dataset of two classes of histograms.
+
+  Every instance consists of histograms x bins features. Each histogram is a
+  discretized Gaussian bump plus a little noise, normalized to sum to one.
+  Negative instances have the bump left of the center and positive instances
+  right of the center, separated by separation times the histogram width.
+  Each bag gets a uniformly distributed proportion of positive instances and
+  is labeled with the proportion, or with an interval of width intervalWidth
+  that contains it.
+
+  The dataset is a function of the parameters only. Bag sizes are drawn from
+  the seed and each bag is drawn from its own stream derived from the seed
+  and the bag index, so bags can be generated in any order and in parallel.
+  The result is bit-identical for any number of threads on the same platform.
+  The random streams are implemented here and do not depend on the standard
+  library, but the histograms and bag sizes use exp, log, sqrt, sin and cos,
+  whose last bits may differ between libm implementations.
+*/
+class SyntheticBaggedDataset {
+public:
+  typedef SyntheticBaggedDatasetParameters ParameterType;
+
+  SyntheticBaggedDataset( const ParameterType& params=ParameterType() )
+    : m_Params( params )
+    , m_BagOffsets()
+  {
+    if ( m_Params.numberOfBags == 0 || m_Params.histograms == 0 || m_Params.bins == 0 ) {
+      throw std::logic_error( "Synthetic dataset must have bags, histograms and bins" );
+    }
+    if ( m_Params.minBagSize == 0 || m_Params.minBagSize > m_Params.maxBagSize ) {
+      throw std::logic_error( "Bag sizes must satisfy 0 < minBagSize <= maxBagSize" );
+    }
+
+    Random random( m_Params.seed, 0 );
+    m_BagOffsets.resize( m_Params.numberOfBags + 1, 0 );
+    for ( std::size_t i = 0; i < m_Params.numberOfBags; ++i ) {
+      m_BagOffsets[i+1] = m_BagOffsets[i] + DrawBagSize( random );
+    }
+  }
+
+  std::size_t NumberOfBags() const {
+    return m_Params.numberOfBags;
+  }
+
+  std::size_t NumberOfInstances() const {
+    return m_BagOffsets.back();
+  }
+
+  std::size_t Dimension() const {
+    return m_Params.histograms * m_Params.bins;
+  }
+
+  std::size_t BagLabelDim() const {
+    return m_Params.intervalLabels ? 2 : 1;
+  }
+
+  std::size_t BagSize( std::size_t bag ) const {
+    return m_BagOffsets[bag+1] - m_BagOffsets[bag];
+  }
+
+  /**
+     Index of the first instance of bag
+  */
+  std::size_t BagOffset( std::size_t bag ) const {
+    return m_BagOffsets[bag];
+  }
+
+  /**
+     Generate a single bag.
+
+     @param bag             Index of the bag
+     @param bagLabel        BagLabelDim() values
+     @param instances       Row-major BagSize(bag) x Dimension() values
+     @param instanceLabels  BagSize(bag) values, 1 for positive instances
+  */
+  void GenerateBag( std::size_t bag, double* bagLabel, double* instances, double* instanceLabels ) const {
+    Random random( m_Params.seed, bag + 1 );
+    const std::size_t size = BagSize( bag );
+    const std::size_t positives = std::min( size, static_cast< std::size_t >( random.Uniform() * ( size + 1 ) ) );
+    const double proportion = static_cast< double >( positives ) / size;
+    if ( m_Params.intervalLabels ) {
+      const double low = proportion - random.Uniform() * m_Params.intervalWidth;
+      bagLabel[0] = std::max( 0.0, low );
+      bagLabel[1] = std::min( 1.0, low + m_Params.intervalWidth );
+    }
+    else {
+      bagLabel[0] = proportion;
+    }
+
+    // Place the positive instances at random positions in the bag
+    for ( std::size_t i = 0; i < size; ++i ) {
+      instanceLabels[i] = i < positives ? 1 : 0;
+    }
+    for ( std::size_t i = size; i > 1; --i ) {
+      std::swap( instanceLabels[i-1], instanceLabels[random.Index( i )] );
+    }
+
+    const double bins = static_cast< double >( m_Params.bins );
+    const double width = std::max( 0.5, bins / 8 );
+    for ( std::size_t i = 0; i < size; ++i ) {
+      const double side = instanceLabels[i] > 0 ? 1 : -1;
+      for ( std::size_t h = 0; h < m_Params.histograms; ++h ) {
+	double* histogram = instances + i * Dimension() + h * m_Params.bins;
+	const double center =
+	  ( bins - 1 ) * ( 0.5 + side * m_Params.separation / 2 ) + random.Normal() * width / 2;
+	double sum = 0;
+	for ( std::size_t b = 0; b < m_Params.bins; ++b ) {
+	  const double z = ( b - center ) / width;
+	  histogram[b] = std::exp( -z * z / 2 ) + 0.05 * random.Uniform();
+	  sum += histogram[b];
+	}
+	for ( std::size_t b = 0; b < m_Params.bins; ++b ) {
+	  histogram[b] /= sum;
+	}
+      }
+    }
+  }
+
+  /**
+     Generate the whole dataset in memory
+  */
+  template< typename TBaggedDataset >
+  TBaggedDataset ToBaggedDataset( unsigned int numberOfThreads=0 ) const {
+    typedef typename TBaggedDataset::MatrixType MatrixType;
+    typedef typename TBaggedDataset::IndexVectorType IndexVectorType;
+    typedef typename TBaggedDataset::BagLabelVectorType BagLabelVectorType;
+    typedef typename TBaggedDataset::InstanceLabelVectorType InstanceLabelVectorType;
+    if ( BagLabelVectorType::ColsAtCompileTime != static_cast< int >( BagLabelDim() ) ||
+	 InstanceLabelVectorType::ColsAtCompileTime != 1 ) {
+      throw std::logic_error( "Label dimensions do not match the synthetic dataset" );
+    }
+
+    // Generate into row-major buffers and copy into the dataset
+    std::vector< double > instances( NumberOfInstances() * Dimension() );
+    std::vector< double > bagLabels( NumberOfBags() * BagLabelDim() );
+    std::vector< double > instanceLabels( NumberOfInstances() );
+    GenerateAll( instances.data(), bagLabels.data(), instanceLabels.data(), numberOfThreads );
+
+    typedef Eigen::Matrix< double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor > RowMajorMatrixType;
+    MatrixType instanceMatrix =
+      Eigen::Map< const RowMajorMatrixType >( instances.data(), NumberOfInstances(), Dimension() );
+    BagLabelVectorType bagLabelMatrix =
+      Eigen::Map< const RowMajorMatrixType >( bagLabels.data(), NumberOfBags(), BagLabelDim() );
+    InstanceLabelVectorType instanceLabelMatrix =
+      Eigen::Map< const RowMajorMatrixType >( instanceLabels.data(), NumberOfInstances(), 1 );
+    IndexVectorType indices( NumberOfInstances() );
+    for ( std::size_t bag = 0; bag < NumberOfBags(); ++bag ) {
+      for ( std::size_t i = m_BagOffsets[bag]; i < m_BagOffsets[bag+1]; ++i ) {
+	indices[i] = bag;
+      }
+    }
+    return TBaggedDataset( instanceMatrix, indices, bagLabelMatrix, instanceLabelMatrix );
+  }
+
+  /**
+     Write the dataset as text with a header and one instance per line
+       bag, bag label(s), instance label, features
+     which is the format read by ParallelTextLoader. Values are written with 17
+     significant digits, so the text and the cache hold the same numbers.
+  */
+  void WriteText( std::ostream& os ) const {
+    BufferedWriter writer( os );
+    writer.Write( m_Params.intervalLabels ? "bag,low,high,label" : "bag,proportion,label" );
+    for ( std::size_t j = 0; j < Dimension(); ++j ) {
+      writer.Write( ",h" ).WriteUnsigned( j / m_Params.bins ).Put( 'b' ).WriteUnsigned( j % m_Params.bins );
+    }
+    writer.Put( '\n' );
+
+    std::vector< double > bagLabel( BagLabelDim() );
+    std::vector< double > instances;
+    std::vector< double > instanceLabels;
+    for ( std::size_t bag = 0; bag < NumberOfBags(); ++bag ) {
+      const std::size_t size = BagSize( bag );
+      instances.resize( size * Dimension() );
+      instanceLabels.resize( size );
+      GenerateBag( bag, bagLabel.data(), instances.data(), instanceLabels.data() );
+      for ( std::size_t i = 0; i < size; ++i ) {
+	writer.WriteUnsigned( bag );
+	for ( double label : bagLabel ) {
+	  writer.Put( ',' ).WriteDouble( label, 17 );
+	}
+	writer.Put( ',' ).WriteDouble( instanceLabels[i] );
+	for ( std::size_t j = 0; j < Dimension(); ++j ) {
+	  writer.Put( ',' ).WriteDouble( instances[i * Dimension() + j], 17 );
+	}
+	writer.Put( '\n' );
+      }
+    }
+    writer.Flush();
+  }
+
+  /**
+     Write the dataset in the bagged dataset cache format. The bags are
+     generated in parallel directly into the mapped file.
+  */
+  void WriteCache( const std::string& path, unsigned int numberOfThreads=0 ) const {
+    const BaggedDatasetCacheHeader header =
+      BaggedDatasetCacheHeader::Make( BagLabelDim(), 1, NumberOfInstances(), NumberOfBags(), Dimension() );
+    MappedFile file = MappedFile::Create( path, header.FileSize() );
+    char* data = file.Data();
+    std::memcpy( data, &header, sizeof header );
+
+    uint64_t* indices = reinterpret_cast< uint64_t* >( data + header.indicesOffset );
+    for ( std::size_t bag = 0; bag < NumberOfBags(); ++bag ) {
+      std::fill( indices + m_BagOffsets[bag], indices + m_BagOffsets[bag+1], bag );
+    }
+    GenerateAll( reinterpret_cast< double* >( data + header.instancesOffset ),
+		 reinterpret_cast< double* >( data + header.bagLabelsOffset ),
+		 reinterpret_cast< double* >( data + header.instanceLabelsOffset ),
+		 numberOfThreads );
+    file.Sync();
+  }
+
+private:
+  /*
+    SplitMix64 generator. We do not use the standard distributions because
+    their output differs between standard library implementations.
+  */
+  class Random {
+  public:
+    Random( uint64_t seed, uint64_t stream )
+      : m_State( seed ^ ( stream * 0xD1B54A32D192ED03ull ) )
+      , m_HasNormal( false )
+      , m_Normal( 0 )
+    {}
+
+    uint64_t Next() {
+      uint64_t z = ( m_State += 0x9E3779B97F4A7C15ull );
+      z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+      z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+      return z ^ ( z >> 31 );
+    }
+
+    // Uniform in [0,1)
+    double Uniform() {
+      return ( Next() >> 11 ) * ( 1.0 / 9007199254740992.0 );
+    }
+
+    // Uniform in [0,n)
+    std::size_t Index( std::size_t n ) {
+      return std::min( n - 1, static_cast< std::size_t >( Uniform() * n ) );
+    }
+
+    // Standard normal by the Box-Muller transform
+    double Normal() {
+      if ( m_HasNormal ) {
+	m_HasNormal = false;
+	return m_Normal;
+      }
+      const double twoPi = 6.283185307179586;
+      const double u = 1 - Uniform();
+      const double v = Uniform();
+      const double r = std::sqrt( -2 * std::log( u ) );
+      m_Normal = r * std::sin( twoPi * v );
+      m_HasNormal = true;
+      return r * std::cos( twoPi * v );
+    }
+
+  private:
+    uint64_t m_State;
+    bool m_HasNormal;
+    double m_Normal;
+  };
+
+  std::size_t DrawBagSize( Random& random ) const {
+    double size = static_cast< double >( m_Params.meanBagSize );
+    switch ( m_Params.bagSizeDistribution ) {
+    case ParameterType::FIXED:
+      return std::max< std::size_t >( 1, m_Params.meanBagSize );
+    case ParameterType::UNIFORM:
+      return m_Params.minBagSize + random.Index( m_Params.maxBagSize - m_Params.minBagSize + 1 );
+    case ParameterType::LOGNORMAL:
+      {
+	// Log-normal with the requested mean and a standard deviation of half
+	// the mean
+	const double sigma2 = std::log( 1.25 );
+	size = std::exp( std::log( size ) - sigma2 / 2 + std::sqrt( sigma2 ) * random.Normal() );
+      }
+      break;
+    }
+    return std::min( m_Params.maxBagSize,
+		     std::max( m_Params.minBagSize, static_cast< std::size_t >( std::round( size ) ) ) );
+  }
+
+  void GenerateAll( double* instances, double* bagLabels, double* instanceLabels,
+		    unsigned int numberOfThreads ) const {
+    parallelFor( NumberOfBags(), 1, numberOfThreads,
+		 [&]( std::size_t begin, std::size_t end ) {
+		   for ( std::size_t bag = begin; bag < end; ++bag ) {
+		     GenerateBag( bag,
+				  bagLabels + bag * BagLabelDim(),
+				  instances + m_BagOffsets[bag] * Dimension(),
+				  instanceLabels + m_BagOffsets[bag] );
+		   }
+		 });
+  }
+
+  ParameterType m_Params;
+  std::vector< std::size_t > m_BagOffsets;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __SyntheticBaggedDatasetParameters_h
+#define __SyntheticBaggedDatasetParameters_h
+
+#include <cstdint>
+
+struct SyntheticBaggedDatasetParameters {
+  enum BagSizeDistribution {
+    FIXED,      // All bags have meanBagSize instances
+    UNIFORM,    // Uniform in [minBagSize, maxBagSize]
+    LOGNORMAL   // Log-normal with the given mean, clipped to [minBagSize, maxBagSize]
+  };
+
+  /*
+    Parameters for generating a synthetic bagged dataset
+
+    @param numberOfBags         Number of bags
+    @param meanBagSize          Mean number of instances in a bag
+    @param bagSizeDistribution  Distribution of the number of instances in a bag
+    @param minBagSize           Smallest bag size for UNIFORM and LOGNORMAL
+    @param maxBagSize           Largest bag size for UNIFORM and LOGNORMAL
+    @param histograms           Number of histograms in an instance
+    @param bins                 Number of bins in a histogram
+    @param separation           Distance between the peaks of the two classes 
+                                as a fraction of the histogram width, in [0,1]
+    @param intervalLabels       Label bags with [low, high] intervals around
+                                the proportion instead of the proportion
+    @param intervalWidth        Width of the interval labels
+    @param seed                 Seed for the random generator
+  */
+  SyntheticBaggedDatasetParameters( std::size_t numberOfBags = 100,
+				    std::size_t meanBagSize = 100,
+				    BagSizeDistribution bagSizeDistribution = FIXED,
+				    std::size_t minBagSize = 1,
+				    std::size_t maxBagSize = 1000,
+				    std::size_t histograms = 4,
+				    std::size_t bins = 16,
+				    double separation = 0.5,
+				    bool intervalLabels = false,
+				    double intervalWidth = 0.2,
+				    uint64_t seed = 0 )
+    : numberOfBags( numberOfBags )
+    , meanBagSize( meanBagSize )
+    , bagSizeDistribution( bagSizeDistribution )
+    , minBagSize( minBagSize )
+    , maxBagSize( maxBagSize )
+    , histograms( histograms )
+    , bins( bins )
+    , separation( separation )
+    , intervalLabels( intervalLabels )
+    , intervalWidth( intervalWidth )
+    , seed( seed )
+  {}
+
+  std::size_t numberOfBags;
+  std::size_t meanBagSize;
+  BagSizeDistribution bagSizeDistribution;
+  std::size_t minBagSize;
+  std::size_t maxBagSize;
+  std::size_t histograms;
+  std::size_t bins;
+  double separation;
+  bool intervalLabels;
+  double intervalWidth;
+  uint64_t seed;
+};
+
+#endif
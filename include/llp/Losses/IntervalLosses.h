@@ -1,6 +1,8 @@
 #ifndef __IntervalLosses_h
 #define __IntervalLosses_h
 
+#include <cstddef>
+
 struct L1_IntervalLoss {
   /*
     Calculate the L1 distance from y to the interval [low,high].
@@ -9,7 +11,7 @@ struct L1_IntervalLoss {
     Predicates:
     low <= high    
    */
-  double operator()( double low, double high, double y ) {
+  double operator()( double low, double high, double y ) const {
     if ( y < low ) {
       return low - y;
     }
@@ -20,4 +22,47 @@ struct L1_IntervalLoss {
   }
 };
 
+
+/*
+  Sums of an interval loss over Eigen arrays.
+  Sum is the sum of the losses of known intervals [low,high] and predicted
+  labels y of the same size. Add adds the loss of the known interval
+  [low,high] and each predicted label in y to the Eigen vector sums.
+
+  The general kernel is as ScalarLossKernel. L1 is specialized with Eigen
+  array expressions, which are vectorized. At most one of low - y and
+  y - high is positive when low <= high.
+*/
+template< typename TLoss >
+struct IntervalLossKernel {
+  template< typename TLossArg, typename TArray1, typename TArray2, typename TArray3 >
+  static double Sum( TLossArg& loss, const TArray1& low, const TArray2& high, const TArray3& y ) {
+    double sum = 0;
+    for ( std::ptrdiff_t i = 0; i < y.size(); ++i ) {
+      sum += loss( low(i), high(i), y(i) );
+    }
+    return sum;
+  }
+
+  template< typename TLossArg, typename TArray, typename TVector >
+  static void Add( TLossArg& loss, double low, double high, const TArray& y, TVector& sums ) {
+    for ( std::ptrdiff_t i = 0; i < y.size(); ++i ) {
+      sums(i) += loss( low, high, y(i) );
+    }
+  }
+};
+
+template<>
+struct IntervalLossKernel< L1_IntervalLoss > {
+  template< typename TArray1, typename TArray2, typename TArray3 >
+  static double Sum( const L1_IntervalLoss&, const TArray1& low, const TArray2& high, const TArray3& y ) {
+    return ( ( low - y ).max( 0.0 ) + ( y - high ).max( 0.0 ) ).sum();
+  }
+
+  template< typename TArray, typename TVector >
+  static void Add( const L1_IntervalLoss&, double low, double high, const TArray& y, TVector& sums ) {
+    sums.array() += ( low - y ).max( 0.0 ) + ( y - high ).max( 0.0 );
+  }
+};
+
 #endif
@@ -1,9 +1,12 @@
 #ifndef __IntervalRisk_h
 #define __IntervalRisk_h
 
+#include <algorithm>
 #include <cassert>
 #include "Eigen/Dense"
 
+#include "llp/Losses/IntervalLosses.h"
+
 template< typename TLoss >
 struct IntervalRisk {
   typedef TLoss LossType;
@@ -17,12 +20,23 @@ struct IntervalRisk {
 			 1,
 			 Eigen::ColMajor > PredictedLabelVectorType;
 
+  typedef Eigen::Matrix< double,
+			 Eigen::Dynamic,
+			 1,
+			 Eigen::ColMajor > RiskVectorType;
+
+  // Number of bags predicted at a time by the fused risks
+  static const std::ptrdiff_t BlockSize = 256;
+
+  // Maximum number of labels predicted at a time by the batched risks
+  static const std::ptrdiff_t MaximumBatchSize = 1 << 18;
+
   IntervalRisk(LossType loss=LossType())
     : m_Loss(loss)
   {}
   
   double operator()( const KnownLabelVectorType& knownLabels,
-		     const PredictedLabelVectorType& predictedLabels ) {
+		     const PredictedLabelVectorType& predictedLabels ) const {
     assert( knownLabels.rows() == predictedLabels.rows() );
     size_t rows = std::min( knownLabels.rows(), predictedLabels.rows() );
     double risk = 0;
@@ -32,8 +46,126 @@ struct IntervalRisk {
     return risk / rows;
   }
 
+  /**
+     Risk of the predicted labels clusterBagMap * clusterLabels, without
+     forming the predicted labels. The labels are predicted for BlockSize
+     bags at a time and the loss is summed with IntervalLossKernel. The risk
+     can differ in the last bits from the risk of the predicted labels, see
+     ScalarRisk.
+
+     @param knownLabels    Known interval of each bag
+     @param clusterBagMap  Eigen matrix mapping cluster labels to bag labels
+     @param clusterLabels  Eigen vector with a label for each cluster
+  */
+  template< typename TMatrix, typename TVector >
+  double operator()( const KnownLabelVectorType& knownLabels,
+		     const TMatrix& clusterBagMap,
+		     const TVector& clusterLabels ) const {
+    assert( knownLabels.rows() == clusterBagMap.rows() );
+    const std::ptrdiff_t rows = std::min< std::ptrdiff_t >( knownLabels.rows(), clusterBagMap.rows() );
+    Eigen::Matrix< double, Eigen::Dynamic, 1, Eigen::ColMajor, BlockSize, 1 > predicted;
+    double risk = 0;
+    for ( std::ptrdiff_t i = 0; i < rows; i += BlockSize ) {
+      const std::ptrdiff_t blockRows = std::min( BlockSize, rows - i );
+      predicted.noalias() = clusterBagMap.middleRows( i, blockRows ) * clusterLabels;
+      risk += IntervalLossKernel< LossType >::Sum( m_Loss,
+						   knownLabels.col( 0 ).segment( i, blockRows ).array(),
+						   knownLabels.col( 1 ).segment( i, blockRows ).array(),
+						   predicted.array() );
+    }
+    return risk / rows;
+  }
+
+  /**
+     Risks of many cluster labelings at once. risks(j) is the risk of the
+     labeling in column j of labelings. The predicted labels of all
+     labelings are computed with one matrix product.
+
+     @param knownLabels    Known interval of each bag
+     @param clusterBagMap  Eigen matrix mapping cluster labels to bag labels
+     @param labelings      Eigen matrix with a cluster labeling in each column
+     @param risks          Risk of each labeling
+  */
+  template< typename TMatrix, typename TLabelings >
+  void Risks( const KnownLabelVectorType& knownLabels,
+	      const TMatrix& clusterBagMap,
+	      const TLabelings& labelings,
+	      RiskVectorType& risks ) const {
+    assert( knownLabels.rows() == clusterBagMap.rows() );
+    const std::ptrdiff_t rows = std::min< std::ptrdiff_t >( knownLabels.rows(), clusterBagMap.rows() );
+    const std::ptrdiff_t numberOfLabelings = labelings.cols();
+    // One product for all bags, unless the predicted labels would be larger
+    // than about 2MB
+    const std::ptrdiff_t blockRows =
+      std::max< std::ptrdiff_t >( 1, std::min( rows, std::max( BlockSize, MaximumBatchSize / std::max< std::ptrdiff_t >( 1, numberOfLabelings ) ) ) );
+    Eigen::Matrix< double, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor > predicted( blockRows, numberOfLabelings );
+    risks = RiskVectorType::Zero( numberOfLabelings );
+    for ( std::ptrdiff_t i = 0; i < rows; i += blockRows ) {
+      const std::ptrdiff_t n = std::min( blockRows, rows - i );
+      predicted.topRows( n ).noalias() = clusterBagMap.middleRows( i, n ) * labelings;
+      for ( std::ptrdiff_t j = 0; j < numberOfLabelings; ++j ) {
+	risks( j ) += IntervalLossKernel< LossType >::Sum( m_Loss,
+							   knownLabels.col( 0 ).segment( i, n ).array(),
+							   knownLabels.col( 1 ).segment( i, n ).array(),
+							   predicted.col( j ).head( n ).array() );
+      }
+    }
+    risks /= rows;
+  }
+
+  /**
+     Risks of raising the label of each cluster by one. risks(j) is the risk
+     of the predicted labels predictedLabels + clusterBagMap.col(j), which
+     for a binary labeling x with x(j) == 0 and predictedLabels ==
+     clusterBagMap * x is the risk of labeling cluster j with one.
+
+     All risks are computed in one sweep over clusterBagMap, along the rows
+     of a row-major and along the columns of a column-major matrix.
+
+     @param knownLabels      Known interval of each bag
+     @param clusterBagMap    Eigen matrix mapping cluster labels to bag labels
+     @param predictedLabels  Eigen vector with the predicted label of each bag
+     @param risks            Risk of raising the label of each cluster
+  */
+  template< typename TMatrix, typename TVector >
+  void IncrementRisks( const KnownLabelVectorType& knownLabels,
+		       const TMatrix& clusterBagMap,
+		       const TVector& predictedLabels,
+		       RiskVectorType& risks ) const {
+    assert( knownLabels.rows() == clusterBagMap.rows() );
+    assert( predictedLabels.rows() == clusterBagMap.rows() );
+    const std::ptrdiff_t rows = std::min< std::ptrdiff_t >( knownLabels.rows(), clusterBagMap.rows() );
+    const std::ptrdiff_t clusters = clusterBagMap.cols();
+    risks = RiskVectorType::Zero( clusters );
+    if ( TMatrix::IsRowMajor ) {
+      for ( std::ptrdiff_t i = 0; i < rows; ++i ) {
+	IntervalLossKernel< LossType >::Add( m_Loss,
+					     knownLabels( i, 0 ),
+					     knownLabels( i, 1 ),
+					     clusterBagMap.row( i ).transpose().array() + predictedLabels( i ),
+					     risks );
+      }
+    }
+    else {
+      for ( std::ptrdiff_t j = 0; j < clusters; ++j ) {
+	risks( j ) = IntervalLossKernel< LossType >::Sum( m_Loss,
+							  knownLabels.col( 0 ).head( rows ).array(),
+							  knownLabels.col( 1 ).head( rows ).array(),
+							  predictedLabels.head( rows ).array() + clusterBagMap.col( j ).head( rows ).array() );
+      }
+    }
+    risks /= rows;
+  }
+
 private:
-  LossType m_Loss;
+  // Mutable for losses with a non-const call operator, see ScalarRisk
+  mutable LossType m_Loss;
 };
 
+template< typename TLoss >
+const std::ptrdiff_t IntervalRisk< TLoss >::BlockSize;
+
+template< typename TLoss >
+const std::ptrdiff_t IntervalRisk< TLoss >::MaximumBatchSize;
+
 #endif
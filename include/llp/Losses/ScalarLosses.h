@@ -1,19 +1,77 @@
 #ifndef __ScalarLosses_h
 #define __ScalarLosses_h
 
+#include <cstddef>
+
 struct L1_ScalarLoss {
-  double operator()( double t, double y ) {
+  double operator()( double t, double y ) const {
   return t < y ?  y - t :  t - y;
   }
 };
 
   
 struct L2_ScalarLoss {
-  double operator()( double t, double y ) {
+  double operator()( double t, double y ) const {
     double d = t - y;
     return d*d;
   }
 };
 
 
+/*
+  Sums of a scalar loss over Eigen arrays.
+  Sum is the sum of the losses of known labels t and predicted labels y of
+  the same size. Add adds the loss of the known label t and each predicted
+  label in y to the Eigen vector sums.
+
+  The general kernel calls the loss for each element, also when the call
+  operator of the loss is not const. L1 and L2 are
+  specialized with Eigen array expressions, which are vectorized.
+*/
+template< typename TLoss >
+struct ScalarLossKernel {
+  template< typename TLossArg, typename TArray1, typename TArray2 >
+  static double Sum( TLossArg& loss, const TArray1& t, const TArray2& y ) {
+    double sum = 0;
+    for ( std::ptrdiff_t i = 0; i < y.size(); ++i ) {
+      sum += loss( t(i), y(i) );
+    }
+    return sum;
+  }
+
+  template< typename TLossArg, typename TArray, typename TVector >
+  static void Add( TLossArg& loss, double t, const TArray& y, TVector& sums ) {
+    for ( std::ptrdiff_t i = 0; i < y.size(); ++i ) {
+      sums(i) += loss( t, y(i) );
+    }
+  }
+};
+
+template<>
+struct ScalarLossKernel< L1_ScalarLoss > {
+  template< typename TArray1, typename TArray2 >
+  static double Sum( const L1_ScalarLoss&, const TArray1& t, const TArray2& y ) {
+    return ( t - y ).abs().sum();
+  }
+
+  template< typename TArray, typename TVector >
+  static void Add( const L1_ScalarLoss&, double t, const TArray& y, TVector& sums ) {
+    sums.array() += ( y - t ).abs();
+  }
+};
+
+template<>
+struct ScalarLossKernel< L2_ScalarLoss > {
+  template< typename TArray1, typename TArray2 >
+  static double Sum( const L2_ScalarLoss&, const TArray1& t, const TArray2& y ) {
+    return ( t - y ).square().sum();
+  }
+
+  template< typename TArray, typename TVector >
+  static void Add( const L2_ScalarLoss&, double t, const TArray& y, TVector& sums ) {
+    sums.array() += ( y - t ).square();
+  }
+};
+
+
 #endif
@@ -5,6 +5,8 @@
 #include <istream>
 #include <ostream>
 
+#include "llp/Models/PredictionScratch.h"
+
 
 template< typename TBaggedDataset >
 class BaseModel {
@@ -15,7 +17,12 @@ public:
 
   virtual ~BaseModel() {};
   virtual void Build() = 0;
+  // Stores the predicted labels in bags
   virtual void Predict( BaggedDatasetType& bags ) = 0;
+  virtual void Predict( const double* instances,
+			std::size_t numberOfInstances,
+			double* labels,
+			PredictionScratch& scratch ) const = 0;
   virtual std::ostream& Save( std::ostream& os ) const = 0;
   //virtual Pointer Load( std::istream& is );
 };
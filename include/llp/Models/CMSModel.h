@@ -13,10 +13,13 @@
 #include <istream>
 #include <ostream>
 #include <ios>
+#include <fstream>
+#include <vector>
+#include <stdexcept>
 
-#include "flann/flann.hpp"
-
+#include "llp/Algorithms/NearestCentroidSearch.h"
 #include "llp/Models/BaseModel.h"
+#include "llp/Models/PredictionScratch.h"
 
 // TODO: Specify requirements on TDistanceFunctor and TBaggedDataset
 template< typename TDistanceFunctor, typename TBaggedDataset >
@@ -30,6 +33,7 @@ public:
 
   typedef typename BaggedDatasetType::MatrixType MatrixType;
   typedef typename BaggedDatasetType::InstanceLabelVectorType LabelVectorType;
+  typedef NearestCentroidSearchParameters SearchParameterType;
   
   /**
      Factory to simplify testing, where it is easier if we have a model member 
@@ -50,18 +54,12 @@ public:
     : m_Centroids( centroids )
     , m_Labels( centroidLabels )
     , m_Weights( featureWeights )
-    , m_Index()
-    , m_IndexIsBuilt( false )
+    , m_Search()
   {
     if ( m_Centroids.rows() != m_Labels.rows() ) {
       throw std::logic_error( "Number of centroid labels do not match number of centroids" );
     }
-    // This is just a wrapper around the memory allocated in m_Centroids.
-    flann::Matrix< double > flannCentroids( m_Centroids.data(),
-					    m_Centroids.rows(),
-					    m_Centroids.cols() );  
-    DistanceFunctorType dist( m_Weights.data(), m_Weights.size() );   
-    m_Index = std::unique_ptr< IndexType >( new IndexType( flannCentroids, IndexParamsType(), dist ) );
+    Build();
   }
   
   ~CMSModel() {
@@ -81,42 +79,88 @@ public:
   }
 
   /** 
-      This is expensive if the number of centroids is large
+      Prepare the nearest centroid search over the centroids. This is done by
+      the constructors, so it is only needed to change the search parameters.
+      Must not be called while other threads are predicting with the model.
   */ 
   void Build() override {
-    m_Index->buildIndex();
-    m_IndexIsBuilt = true;
+    Build( SearchParameterType() );
+  }
+
+  void Build( const SearchParameterType& params ) {
+    DistanceFunctorType dist( m_Weights.data(), m_Weights.size() );
+    m_Search = std::unique_ptr< SearchType >( new SearchType( m_Centroids.data(),
+							      m_Centroids.rows(),
+							      m_Centroids.cols(),
+							      dist,
+							      params ) );
   }
 
 
   /**
-     Predict instances in bags with a 1-NN centroid classifier
+     Predict instances in bags with a 1-NN centroid classifier and store the
+     labels as the instance labels of bags.
+
+     Allocates the labels and a scratch for all instances on every call, and
+     searches all instances at once. Use the overload on instances with a
+     scratch per thread to predict concurrently or repeatedly without
+     allocating.
    */
   void Predict( BaggedDatasetType& bags ) override {
-    if ( ! m_IndexIsBuilt ) {
-      Build();
-    }
-    SearchParamsType searchParams( flann::FLANN_CHECKS_UNLIMITED );
-    searchParams.use_heap = flann::FLANN_False;
-    searchParams.cores = 0; // Use as many as you like
+    LabelVectorType instanceLabels( bags.NumberOfInstances(), m_Labels.cols() );
+    PredictionScratch scratch( bags.NumberOfInstances() );
+    ForEachChunk( bags.Instances().data(),
+		  bags.NumberOfInstances(),
+		  scratch,
+		  [&]( std::size_t begin, std::size_t end ) {
+		    for ( std::size_t i = begin; i < end; ++i ) {
+		      instanceLabels.row(i) = m_Labels.row( scratch.indices[i - begin] );
+		    }
+		  });
+    bags.InstanceLabels( instanceLabels );
+  } 
 
-    std::vector< int > indicesBuffer( bags.NumberOfInstances() );
-    flann::Matrix< int > indices( indicesBuffer.data(), indicesBuffer.size(), 1 );
-    
-    std::vector< double > distancesBuffer( bags.NumberOfInstances() );
-    flann::Matrix< double > distances( distancesBuffer.data(), distancesBuffer.size(), 1 );
+  /**
+     Predict instances with a 1-NN centroid classifier.
 
-    flann::Matrix< double > instances( const_cast< double* >( bags.Instances().data() ),
-				       bags.NumberOfInstances(),
-				       bags.Dimension() );
+     The model is not modified, so one model can serve concurrent predictions
+     as long as each thread uses its own scratch. Build the model with a single
+     threaded search when the calling threads already saturate the machine.
 
-    m_Index->knnSearch( instances, indices, distances, 1, searchParams );
-    LabelVectorType instanceLabels( indices.rows, bags.InstanceLabels().cols() );
-    for ( std::size_t i = 0; i < indices.rows; ++i ) {
-      instanceLabels.row(i) = m_Labels.row( *indices[i] );
-    }
-    bags.InstanceLabels( instanceLabels );
-  } 
+     @param instances          Row-major numberOfInstances x dimension matrix
+     @param numberOfInstances  Number of instances
+     @param labels             Output. Row-major numberOfInstances x label
+                               dimension matrix
+     @param scratch            Buffers reused between calls
+   */
+  void Predict( const double* instances,
+		std::size_t numberOfInstances,
+		double* labels,
+		PredictionScratch& scratch ) const override {
+    const std::size_t labelDimension = m_Labels.cols();
+    ForEachChunk( instances,
+		  numberOfInstances,
+		  scratch,
+		  [&]( std::size_t begin, std::size_t end ) {
+		    for ( std::size_t i = begin; i < end; ++i ) {
+		      const int idx = scratch.indices[i - begin];
+		      for ( std::size_t j = 0; j < labelDimension; ++j ) {
+			labels[i * labelDimension + j] = m_Labels( idx, j );
+		      }
+		    }
+		  });
+  }
+
+  /**
+     Predict instances with a 1-NN centroid classifier, searching all
+     instances at once with a scratch allocated for them
+   */
+  void Predict( const double* instances,
+		std::size_t numberOfInstances,
+		double* labels ) const {
+    PredictionScratch scratch( numberOfInstances );
+    Predict( instances, numberOfInstances, labels, scratch );
+  }
 
 
   std::ostream& Save( std::ostream& os ) const override {
@@ -199,15 +243,36 @@ public:
     
   
 private:
-  typedef typename flann::LinearIndexParams IndexParamsType;
-  typedef typename flann::SearchParams SearchParamsType;
-  typedef typename flann::LinearIndex< DistanceFunctorType > IndexType;
+  typedef NearestCentroidSearch< DistanceFunctorType > SearchType;
+
+  /**
+     Search instances in chunks that fit in scratch and call
+     fn(begin, end) after each chunk [begin, end) with the nearest centroid of
+     instance i in scratch.indices[i - begin]
+  */
+  template< typename Function >
+  void ForEachChunk( const double* instances,
+		     std::size_t numberOfInstances,
+		     PredictionScratch& scratch,
+		     Function fn ) const {
+    if ( ! m_Search ) {
+      throw std::logic_error( "Model must be built before predicting" );
+    }
+    const std::size_t dimension = m_Centroids.cols();
+    for ( std::size_t begin = 0; begin < numberOfInstances; begin += scratch.ChunkSize() ) {
+      const std::size_t end = std::min( numberOfInstances, begin + scratch.ChunkSize() );
+      m_Search->Search( instances + begin * dimension,
+			end - begin,
+			scratch.indices.data(),
+			scratch.distances.data() );
+      fn( begin, end );
+    }
+  }
   
   MatrixType m_Centroids;
   LabelVectorType m_Labels;
   std::vector< double > m_Weights;
-  std::unique_ptr< IndexType > m_Index;
-  bool m_IndexIsBuilt;
+  std::unique_ptr< SearchType > m_Search;
 };
 
 template< typename T, typename T2 >
@@ -13,10 +13,14 @@
 #include <istream>
 #include <ostream>
 #include <ios>
+#include <fstream>
+#include <vector>
+#include <stdexcept>
 
-#include "flann/flann.hpp"
-
+#include "llp/Algorithms/NearestCentroidSearch.h"
 #include "llp/Models/BaseModel.h"
+#include "llp/Models/PredictionScratch.h"
+#include "llp/Util/PerfCounters.h"
 
 // TODO: Specify requirements on TDistanceFunctor and TBaggedDataset
 template< typename TDistanceFunctor, typename TBaggedDataset >
@@ -30,6 +34,7 @@ public:
 
   typedef typename BaggedDatasetType::MatrixType MatrixType;
   typedef typename BaggedDatasetType::InstanceLabelVectorType LabelVectorType;
+  typedef NearestCentroidSearchParameters SearchParameterType;
   
   /**
      Factory to simplify testing, where it is easier if we have a model member 
@@ -51,9 +56,10 @@ public:
     : m_Centroids()
     , m_Labels()
     , m_Weights()
-    , m_Index()
-    , m_IndexIsBuilt( false )
-  {}
+    , m_Search()
+  {
+    Build();
+  }
   
   ClusterModel( const MatrixType& centroids,
 		const LabelVectorType& labels,
@@ -61,18 +67,12 @@ public:
     : m_Centroids( centroids )
     , m_Labels( labels )
     , m_Weights( weights )
-    , m_Index()
-    , m_IndexIsBuilt( false )
+    , m_Search()
   {
     if ( m_Centroids.rows() != m_Labels.rows() ) {
       throw std::logic_error( "Number of centroid labels do not match number of centroids" );
     }
-    // This is just a wrapper around the memory allocated in m_Centroids.
-    flann::Matrix< double > flannCentroids( m_Centroids.data(),
-					    m_Centroids.rows(),
-					    m_Centroids.cols() );
-    DistanceFunctorType dist( m_Weights.data(), m_Weights.size() );   
-    m_Index = std::unique_ptr< IndexType >( new IndexType( flannCentroids, IndexParamsType(), dist ) );
+    Build();
   }
   
   ~ClusterModel() {
@@ -92,42 +92,211 @@ public:
   }
 
   /** 
-      This is expensive if the number of centroids is large
+      Prepare the nearest centroid search over the centroids. This is done by
+      the constructors, so it is only needed to change the search parameters.
+      Must not be called while other threads are predicting with the model.
   */ 
   void Build() override {
-    m_Index->buildIndex();
-    m_IndexIsBuilt = true;
+    Build( SearchParameterType() );
+  }
+
+  void Build( const SearchParameterType& params ) {
+    DistanceFunctorType dist( m_Weights.data(), m_Weights.size() );
+    m_Search = std::unique_ptr< SearchType >( new SearchType( m_Centroids.data(),
+							      m_Centroids.rows(),
+							      m_Centroids.cols(),
+							      dist,
+							      params ) );
   }
 
 
   /**
-     Predict instances in bags with a 1-NN centroid classifier
+     Predict instances in bags with a 1-NN centroid classifier and store the
+     labels as the instance labels of bags.
+
+     Allocates the labels and a scratch for all instances on every call, and
+     searches all instances at once. Use the overload on instances with a
+     scratch per thread to predict concurrently or repeatedly without
+     allocating.
    */
   void Predict( BaggedDatasetType& bags ) override {
-    if ( ! m_IndexIsBuilt ) {
-      Build();
+    LabelVectorType instanceLabels( bags.NumberOfInstances(), m_Labels.cols() );
+    PredictionScratch scratch( bags.NumberOfInstances() );
+    ForEachChunk( bags.Instances().data(),
+		  bags.NumberOfInstances(),
+		  scratch,
+		  [&]( std::size_t begin, std::size_t end ) {
+		    for ( std::size_t i = begin; i < end; ++i ) {
+		      instanceLabels.row(i) = m_Labels.row( scratch.indices[i - begin] );
+		    }
+		  });
+    bags.InstanceLabels( instanceLabels );
+  } 
+
+  /**
+     Predict instances with a 1-NN centroid classifier.
+
+     The model is not modified, so one model can serve concurrent predictions
+     as long as each thread uses its own scratch. Build the model with a single
+     threaded search when the calling threads already saturate the machine.
+
+     @param instances          Row-major numberOfInstances x dimension matrix
+     @param numberOfInstances  Number of instances
+     @param labels             Output. Row-major numberOfInstances x label
+                               dimension matrix
+     @param scratch            Buffers reused between calls
+   */
+  void Predict( const double* instances,
+		std::size_t numberOfInstances,
+		double* labels,
+		PredictionScratch& scratch ) const override {
+    const std::size_t labelDimension = m_Labels.cols();
+    ForEachChunk( instances,
+		  numberOfInstances,
+		  scratch,
+		  [&]( std::size_t begin, std::size_t end ) {
+		    for ( std::size_t i = begin; i < end; ++i ) {
+		      const int idx = scratch.indices[i - begin];
+		      for ( std::size_t j = 0; j < labelDimension; ++j ) {
+			labels[i * labelDimension + j] = m_Labels( idx, j );
+		      }
+		    }
+		  });
+  }
+
+  /**
+     Predict instances with a 1-NN centroid classifier, searching all
+     instances at once with a scratch allocated for them
+   */
+  void Predict( const double* instances,
+		std::size_t numberOfInstances,
+		double* labels ) const {
+    PredictionScratch scratch( numberOfInstances );
+    Predict( instances, numberOfInstances, labels, scratch );
+  }
+
+  /**
+     Predict instances with the k nearest centroids.
+
+     Gives the indices of and distances to the k nearest centroids, which can
+     be used to find the runner-up centroid or the margin to it, and a soft
+     label. The soft label is the mean of the labels of the k nearest
+     centroids, weighted by inverse distance. With k == 1 it is equal to the
+     label from Predict. Centroids at distance zero take all the weight.
+
+     @param instances          Row-major numberOfInstances x dimension matrix
+     @param numberOfInstances  Number of instances
+     @param k                  Number of centroids to find for each instance
+     @param indices            Output. Row-major numberOfInstances x k matrix
+                               of centroid indices sorted by distance. Index -1
+			       if k is larger than the number of centroids.
+     @param distances          Output. Row-major numberOfInstances x k matrix
+     @param softLabels         Output. Row-major numberOfInstances x label
+                               dimension matrix. Can be nullptr.
+   */
+  void PredictTopK( const double* instances,
+		    std::size_t numberOfInstances,
+		    std::size_t k,
+		    int* indices,
+		    double* distances,
+		    double* softLabels ) const {
+    if ( ! m_Search ) {
+      throw std::logic_error( "Model must be built before predicting" );
+    }
+    m_Search->Search( instances, numberOfInstances, k, indices, distances );
+    if ( softLabels == nullptr ) {
+      return;
     }
-    SearchParamsType searchParams( flann::FLANN_CHECKS_UNLIMITED );
-    searchParams.use_heap = flann::FLANN_False;
-    searchParams.cores = 0; // Use as many as you like
 
-    std::vector< int > indicesBuffer( bags.NumberOfInstances() );
-    flann::Matrix< int > indices( indicesBuffer.data(), indicesBuffer.size(), 1 );
-    
-    std::vector< double > distancesBuffer( bags.NumberOfInstances() );
-    flann::Matrix< double > distances( distancesBuffer.data(), distancesBuffer.size(), 1 );
+    const std::size_t labelDimension = m_Labels.cols();
+    for ( std::size_t i = 0; i < numberOfInstances; ++i ) {
+      double* label = softLabels + i * labelDimension;
+      std::fill( label, label + labelDimension, 0.0 );
+      // Inverse distance weights. If there are exact matches we only use them.
+      const bool exact = distances[i*k] == 0;
+      double weightSum = 0;
+      for ( std::size_t n = 0; n < k && indices[i*k + n] >= 0; ++n ) {
+	const double weight = exact ?
+	  ( distances[i*k + n] == 0 ? 1.0 : 0.0 ) :
+	  1.0 / distances[i*k + n];
+	for ( std::size_t j = 0; j < labelDimension; ++j ) {
+	  label[j] += weight * m_Labels( indices[i*k + n], j );
+	}
+	weightSum += weight;
+      }
+      for ( std::size_t j = 0; j < labelDimension; ++j ) {
+	label[j] /= weightSum;
+      }
+    }
+  }
+
 
-    flann::Matrix< double > instances( const_cast< double* >( bags.Instances().data() ),
-				       bags.NumberOfInstances(),
-				       bags.Dimension() );
+  /**
+     Predict the label proportion of each bag, i.e. the mean of the predicted
+     labels of the instances in the bag.
 
-    m_Index->knnSearch( instances, indices, distances, 1, searchParams );
-    LabelVectorType instanceLabels( indices.rows, bags.InstanceLabels().cols() );
-    for ( std::size_t i = 0; i < indices.rows; ++i ) {
-      instanceLabels.row(i) = m_Labels.row( *indices[i] );
+     The proportions are accumulated while the instances are searched chunk by
+     chunk, so the instance labels are never stored.
+
+     The error of a bag is the distance from the predicted proportion to the
+     interval spanned by the bag label. For scalar bag labels this is the
+     absolute error, for interval bag labels it is zero inside the interval.
+     Errors are only defined for scalar instance labels.
+
+     @param bags         Bags to predict
+     @param proportions  Output. Row-major number of bags x label dimension
+                         matrix. Bags without instances get NaN.
+     @param errors       Output. Array with an error for each bag. Can be
+                         nullptr.
+     @param scratch      Buffers reused between calls
+   */
+  void PredictBagProportions( const BaggedDatasetType& bags,
+			      double* proportions,
+			      double* errors,
+			      PredictionScratch& scratch ) const {
+    const std::size_t labelDimension = m_Labels.cols();
+    const std::size_t numberOfBags = bags.NumberOfBags();
+    if ( errors != nullptr && labelDimension != 1 ) {
+      throw std::logic_error( "Bag errors require scalar instance labels" );
     }
-    bags.InstanceLabels( instanceLabels );
-  } 
+
+    std::fill( proportions, proportions + numberOfBags * labelDimension, 0.0 );
+    std::vector< std::size_t > bagSizes( numberOfBags, 0 );
+    const auto& bagIndices = bags.Indices();
+    ForEachChunk( bags.Instances().data(),
+		  bags.NumberOfInstances(),
+		  scratch,
+		  [&]( std::size_t begin, std::size_t end ) {
+		    for ( std::size_t i = begin; i < end; ++i ) {
+		      const std::size_t bag = bagIndices[i];
+		      const int idx = scratch.indices[i - begin];
+		      for ( std::size_t j = 0; j < labelDimension; ++j ) {
+			proportions[bag * labelDimension + j] += m_Labels( idx, j );
+		      }
+		      ++bagSizes[bag];
+		    }
+		  });
+
+    const auto& bagLabels = bags.BagLabels();
+    for ( std::size_t bag = 0; bag < numberOfBags; ++bag ) {
+      for ( std::size_t j = 0; j < labelDimension; ++j ) {
+	proportions[bag * labelDimension + j] /= bagSizes[bag];
+      }
+      if ( errors != nullptr ) {
+	const double low = bagLabels.row( bag ).minCoeff();
+	const double high = bagLabels.row( bag ).maxCoeff();
+	const double p = proportions[bag];
+	errors[bag] = p < low ? low - p : ( p > high ? p - high : 0.0 );
+      }
+    }
+  }
+
+  void PredictBagProportions( const BaggedDatasetType& bags,
+			      double* proportions,
+			      double* errors ) const {
+    PredictionScratch scratch;
+    PredictBagProportions( bags, proportions, errors, scratch );
+  }
 
 
   std::ostream& Save( std::ostream& os ) const override {
@@ -215,15 +384,37 @@ public:
     
   
 private:
-  typedef typename flann::LinearIndexParams IndexParamsType;
-  typedef typename flann::SearchParams SearchParamsType;
-  typedef typename flann::LinearIndex< DistanceFunctorType > IndexType;
+  typedef NearestCentroidSearch< DistanceFunctorType > SearchType;
+
+  /**
+     Search instances in chunks that fit in scratch and call
+     fn(begin, end) after each chunk [begin, end) with the nearest centroid of
+     instance i in scratch.indices[i - begin]
+  */
+  template< typename Function >
+  void ForEachChunk( const double* instances,
+		     std::size_t numberOfInstances,
+		     PredictionScratch& scratch,
+		     Function fn ) const {
+    LLP_COUNT_PHASE( "predict" );
+    if ( ! m_Search ) {
+      throw std::logic_error( "Model must be built before predicting" );
+    }
+    const std::size_t dimension = m_Centroids.cols();
+    for ( std::size_t begin = 0; begin < numberOfInstances; begin += scratch.ChunkSize() ) {
+      const std::size_t end = std::min( numberOfInstances, begin + scratch.ChunkSize() );
+      m_Search->Search( instances + begin * dimension,
+			end - begin,
+			scratch.indices.data(),
+			scratch.distances.data() );
+      fn( begin, end );
+    }
+  }
   
   MatrixType m_Centroids;
   LabelVectorType m_Labels;
   std::vector< double > m_Weights;
-  std::unique_ptr< IndexType > m_Index;
-  bool m_IndexIsBuilt;
+  std::unique_ptr< SearchType > m_Search;
 };
 
 template< typename T, typename T2 >
@@ -0,0 +1,47 @@
+#ifndef __PredictionScratch_h
+#define __PredictionScratch_h
+
+#include <algorithm>
+#include <vector>
+
+#include "llp/Algorithms/NearestCentroidSearchParameters.h"
+#include "llp/Util/Parallel.h"
+
+/**
+   Buffers used by a model while predicting. Instances are predicted in chunks
+   of at most ChunkSize() instances, so the buffers have a fixed size and a
+   scratch can be reused for any number of predictions without allocating.
+
+   Each chunk is searched with the threads of the model's search, so by
+   default a chunk holds TasksPerThread tasks of the default search for every
+   core. A smaller chunk leaves cores idle. When the calling threads already
+   saturate the machine, as with one scratch per thread, a small chunk that
+   fits in cache is better.
+
+   A scratch must not be shared by threads that predict concurrently, keep one
+   per thread instead.
+ */
+struct PredictionScratch {
+  // Tasks per core in a default chunk, so the threads are balanced
+  static const std::size_t TasksPerThread = 4;
+
+  explicit PredictionScratch( std::size_t chunkSize=DefaultChunkSize() )
+    : indices( std::max< std::size_t >( 1, chunkSize ) )
+    , distances( std::max< std::size_t >( 1, chunkSize ) )
+  {}
+
+  static std::size_t DefaultChunkSize() {
+    return TasksPerThread
+      * NearestCentroidSearchParameters().instancesPerTask
+      * resolveNumberOfThreads( 0 );
+  }
+
+  std::size_t ChunkSize() const {
+    return indices.size();
+  }
+
+  std::vector< int > indices;
+  std::vector< double > distances;
+};
+
+#endif
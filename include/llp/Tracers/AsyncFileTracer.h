@@ -0,0 +1,215 @@
+#ifndef __AsyncFileTracer_h
+#define __AsyncFileTracer_h
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "TracerBase.h"
+#include "llp/Util/BoundedQueue.h"
+
+/**
+   File tracer that writes in a background thread.
+
+   Messages are formatted by the calling thread, in the same format as
+   FileTracer, and put in a lock-free bounded queue. A writer thread collects
+   them in blocks of blockBytes that are written to the file without flushing
+   per message. Any number of threads can trace at the same time.
+
+   When the queue is full the message is either dropped (DROP), which never
+   blocks the caller, or the caller waits for the writer to catch up (BLOCK).
+   The number of dropped messages is written at the end of the trace.
+
+   Everything traced by the calling thread before Flush() is in the file when
+   Flush returns, and everything traced before destruction is in the file
+   afterwards.
+*/
+template< int MinimumLevel >
+class BasicAsyncFileTracer : public TracerBase< BasicAsyncFileTracer< MinimumLevel >, MinimumLevel > {
+public:
+  typedef TracerBase< BasicAsyncFileTracer< MinimumLevel >, MinimumLevel > Super;
+  typedef typename Super::Level Level;
+  friend class TracerBase< BasicAsyncFileTracer< MinimumLevel >, MinimumLevel >;
+
+  enum OverflowPolicy {
+    DROP,
+    BLOCK
+  };
+
+  struct ParameterType  {
+    /*
+      @param level      Minimum level of messages to write
+      @param path       Path of the trace file
+      @param capacity   Maximum number of messages waiting to be written
+      @param overflow   What to do when capacity messages are waiting
+      @param blockBytes Size of the blocks written to the file
+    */
+    ParameterType(Level level=Level::DEBUG,
+		  const std::string& path=std::string(),
+		  std::size_t capacity=1 << 16,
+		  OverflowPolicy overflow=BLOCK,
+		  std::size_t blockBytes=1 << 20)
+      : level(level)
+      , path(path)
+      , capacity(capacity)
+      , overflow(overflow)
+      , blockBytes(blockBytes)
+    {}
+
+    Level level;
+    std::string path;
+    std::size_t capacity;
+    OverflowPolicy overflow;
+    std::size_t blockBytes;
+  };
+
+  BasicAsyncFileTracer(const ParameterType& params)
+    : Super(params.level)
+    , m_Params(params)
+    , m_Out(params.path, std::ios::binary)
+    , m_Queue(params.capacity)
+    , m_FlushTarget(0)
+    , m_Written(0)
+    , m_Dropped(0)
+    , m_Stop(false)
+    , m_WriterMutex()
+    , m_WriterWakeup()
+    , m_FlushMutex()
+    , m_Flushed()
+    , m_Writer()
+  {
+    if ( !m_Out ) {
+      throw std::runtime_error( "Could not open trace file " + params.path );
+    }
+    m_Writer = std::thread( &BasicAsyncFileTracer::WriterLoop, this );
+  }
+
+  ~BasicAsyncFileTracer() {
+    m_Stop.store( true, std::memory_order_release );
+    m_WriterWakeup.notify_one();
+    m_Writer.join();
+    const std::size_t dropped = m_Dropped.load();
+    if ( dropped > 0 ) {
+      m_Out << "[WARNING] Tracer : dropped " << dropped << " messages\n";
+    }
+  }
+
+  BasicAsyncFileTracer( const BasicAsyncFileTracer& ) = delete;
+  BasicAsyncFileTracer& operator=( const BasicAsyncFileTracer& ) = delete;
+
+  /**
+     Wait until all messages traced so far are written and flushed to the
+     file
+  */
+  void Flush() {
+    // The writer pops in push order, so everything this thread traced is
+    // written once the writer has popped this many messages
+    const std::size_t target = m_Queue.Pushed();
+    std::size_t requested = m_FlushTarget.load( std::memory_order_relaxed );
+    while ( requested < target &&
+	    !m_FlushTarget.compare_exchange_weak( requested, target, std::memory_order_acq_rel ) ) {}
+    m_WriterWakeup.notify_one();
+    std::unique_lock< std::mutex > lock( m_FlushMutex );
+    while ( m_Written.load( std::memory_order_acquire ) < target ) {
+      m_Flushed.wait_for( lock, std::chrono::milliseconds( 1 ) );
+    }
+  }
+
+  /**
+     Number of messages dropped because the queue was full
+  */
+  std::size_t Dropped() const {
+    return m_Dropped.load();
+  }
+
+protected:
+  template<typename T>
+  void write(Level level, const std::string& msg, const T& x) {
+    std::ostringstream ss;
+    ss << '[' << traceLevelName(level) << "] " << msg << " : " << x << '\n';
+    std::string message = ss.str();
+    while ( !m_Queue.TryPush( std::move( message ) ) ) {
+      if ( m_Params.overflow == DROP ) {
+	m_Dropped.fetch_add( 1 );
+	return;
+      }
+      // Only the slow path wakes the writer, the writer polls otherwise
+      m_WriterWakeup.notify_one();
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  void WriterLoop() {
+    std::string block;
+    block.reserve( m_Params.blockBytes );
+    std::string message;
+    std::size_t popped = 0;
+    while ( true ) {
+      // Read the stop flag before draining, so nothing pushed before the
+      // destructor was called is left behind
+      const bool stop = m_Stop.load( std::memory_order_acquire );
+      std::size_t messages = 0;
+      bool drained = false;
+      while ( block.size() < m_Params.blockBytes ) {
+	if ( !m_Queue.TryPop( message ) ) {
+	  drained = true;
+	  break;
+	}
+	block += message;
+	++messages;
+      }
+      if ( messages > 0 ) {
+	m_Out.write( block.data(), block.size() );
+	block.clear();
+	popped += messages;
+      }
+      // Flush when the queue is drained or a Flush waits for these messages.
+      // Messages are only counted as written once they are flushed.
+      const std::size_t written = m_Written.load( std::memory_order_relaxed );
+      const std::size_t target = m_FlushTarget.load( std::memory_order_acquire );
+      if ( popped > written && ( drained || ( target > written && popped >= target ) ) ) {
+	m_Out.flush();
+	{
+	  std::lock_guard< std::mutex > lock( m_FlushMutex );
+	  m_Written.store( popped, std::memory_order_release );
+	}
+	m_Flushed.notify_all();
+      }
+      if ( messages > 0 ) {
+	continue;
+      }
+      if ( stop ) {
+	break;
+      }
+      std::unique_lock< std::mutex > lock( m_WriterMutex );
+      m_WriterWakeup.wait_for( lock, std::chrono::milliseconds( 1 ) );
+    }
+    m_Out.flush();
+  }
+
+  ParameterType m_Params;
+  std::ofstream m_Out;
+  BoundedQueue< std::string > m_Queue;
+  // Number of popped messages a Flush waits for, and number of popped
+  // messages that are flushed to the file
+  std::atomic< std::size_t > m_FlushTarget;
+  std::atomic< std::size_t > m_Written;
+  std::atomic< std::size_t > m_Dropped;
+  std::atomic< bool > m_Stop;
+  std::mutex m_WriterMutex;
+  std::condition_variable m_WriterWakeup;
+  std::mutex m_FlushMutex;
+  std::condition_variable m_Flushed;
+  std::thread m_Writer;
+};
+
+typedef BasicAsyncFileTracer< LLP_TRACE_MIN_LEVEL > AsyncFileTracer;
+
+#endif
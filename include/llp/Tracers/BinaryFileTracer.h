@@ -0,0 +1,235 @@
+#ifndef __BinaryFileTracer_h
+#define __BinaryFileTracer_h
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "TracerBase.h"
+#include "BinaryTraceFormat.h"
+#include "llp/Util/BufferedWriter.h"
+
+/**
+   Tracer that writes typed binary records, see BinaryTraceFormat.h.
+
+   Keys are written once and referred to by id, floating point and integral
+   payloads are written as 8 byte values and Eigen matrices and
+   std::vector<double> as raw doubles, or floats with singlePrecision, so a
+   trace is much smaller and cheaper to write than the text of
+   FileTracer. Other payloads are written as the string FileTracer would
+   print. Use the DecodeTrace tool to convert a trace to CSV or JSON.
+
+   Records are buffered and written in large blocks. Everything traced before
+   Flush() or destruction is in the file afterwards. Tracing from several
+   threads is safe.
+*/
+template< int MinimumLevel >
+class BasicBinaryFileTracer : public TracerBase< BasicBinaryFileTracer< MinimumLevel >, MinimumLevel > {
+public:
+  typedef TracerBase< BasicBinaryFileTracer< MinimumLevel >, MinimumLevel > Super;
+  typedef typename Super::Level Level;
+  friend class TracerBase< BasicBinaryFileTracer< MinimumLevel >, MinimumLevel >;
+
+  struct ParameterType  {
+    /*
+      @param level      Minimum level of messages to write
+      @param path       Path of the trace file
+      @param singlePrecision  Write matrices as floats instead of doubles
+    */
+    ParameterType(Level level=Level::DEBUG,
+		  const std::string& path=std::string(),
+		  bool singlePrecision=false)
+      : level(level)
+      , path(path)
+      , singlePrecision(singlePrecision)
+    {}
+
+    Level level;
+    std::string path;
+    bool singlePrecision;
+  };
+
+  BasicBinaryFileTracer(const ParameterType& params)
+    : Super(params.level)
+    , m_SinglePrecision(params.singlePrecision)
+    , m_Out(params.path, std::ios::binary)
+    , m_Writer(m_Out)
+    , m_Mutex()
+    , m_Keys()
+    , m_Start(ClockType::now())
+    , m_Last(0)
+  {
+    if ( !m_Out ) {
+      throw std::runtime_error( "Could not open trace file " + params.path );
+    }
+    const std::int64_t startTime =
+      std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::system_clock::now().time_since_epoch() ).count();
+    m_Writer.Write( BinaryTrace::Magic, sizeof( BinaryTrace::Magic ) );
+    m_Writer.WriteBinary( startTime );
+  }
+
+  BasicBinaryFileTracer( const BasicBinaryFileTracer& ) = delete;
+  BasicBinaryFileTracer& operator=( const BasicBinaryFileTracer& ) = delete;
+
+  /**
+     Write all buffered records to the file
+  */
+  void Flush() {
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    m_Writer.Flush();
+  }
+
+protected:
+  typedef std::chrono::steady_clock ClockType;
+
+  template<typename T>
+  void write(Level level, const std::string& msg, const T& x) {
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    // Read the clock under the lock, so times increase in file order
+    const std::uint64_t time =
+      std::chrono::duration_cast< std::chrono::nanoseconds >( ClockType::now() - m_Start ).count();
+    const std::uint64_t keyId = Intern( msg );
+    m_Writer.WriteBinary( static_cast< std::uint8_t >( BinaryTrace::MESSAGE ) );
+    m_Writer.WriteBinary( static_cast< std::uint8_t >( level ) );
+    m_Writer.WriteBinary( static_cast< std::uint8_t >( PayloadType( x ) ) );
+    m_Writer.WriteVarint( keyId );
+    m_Writer.WriteVarint( time - m_Last );
+    m_Last = time;
+    WritePayload( x );
+  }
+
+private:
+  std::uint64_t Intern( const std::string& key ) {
+    auto inserted = m_Keys.insert( std::make_pair( key, static_cast< std::uint64_t >( m_Keys.size() ) ) );
+    const std::uint64_t id = inserted.first->second;
+    if ( inserted.second ) {
+      m_Writer.WriteBinary( static_cast< std::uint8_t >( BinaryTrace::KEY ) );
+      m_Writer.WriteVarint( id );
+      WriteString( key );
+    }
+    return id;
+  }
+
+  void WriteString( const std::string& s ) {
+    m_Writer.WriteVarint( s.size() );
+    m_Writer.Write( s );
+  }
+
+  void WriteMatrixHeader( std::size_t rows, std::size_t cols ) {
+    if ( rows > std::numeric_limits< std::uint32_t >::max() ||
+	 cols > std::numeric_limits< std::uint32_t >::max() ) {
+      throw std::length_error( "Matrix too large for binary trace" );
+    }
+    m_Writer.WriteVarint( rows );
+    m_Writer.WriteVarint( cols );
+  }
+
+  template< typename T >
+  void WriteMatrixValue( const T& x ) {
+    if ( m_SinglePrecision ) {
+      m_Writer.WriteBinary( static_cast< float >( x ) );
+    }
+    else {
+      m_Writer.WriteBinary( static_cast< double >( x ) );
+    }
+  }
+
+  template< typename T >
+  struct IsMatrix {
+    enum { value = std::is_base_of< Eigen::DenseBase< T >, T >::value ||
+	   std::is_same< T, std::vector< double > >::value };
+  };
+
+  template< typename T >
+  struct IsText {
+    enum { value = !std::is_arithmetic< T >::value && !IsMatrix< T >::value };
+  };
+
+  template< typename T >
+  static typename std::enable_if< std::is_floating_point< T >::value, BinaryTrace::PayloadType >::type
+  PayloadType( const T& ) {
+    return BinaryTrace::DOUBLE;
+  }
+
+  template< typename T >
+  typename std::enable_if< std::is_floating_point< T >::value >::type
+  WritePayload( const T& x ) {
+    m_Writer.WriteBinary( static_cast< double >( x ) );
+  }
+
+  template< typename T >
+  static typename std::enable_if< std::is_integral< T >::value, BinaryTrace::PayloadType >::type
+  PayloadType( const T& ) {
+    return BinaryTrace::INTEGER;
+  }
+
+  template< typename T >
+  typename std::enable_if< std::is_integral< T >::value >::type
+  WritePayload( const T& x ) {
+    m_Writer.WriteBinary( static_cast< std::int64_t >( x ) );
+  }
+
+  template< typename T >
+  typename std::enable_if< IsMatrix< T >::value, BinaryTrace::PayloadType >::type
+  PayloadType( const T& ) const {
+    return m_SinglePrecision ? BinaryTrace::FLOAT_MATRIX : BinaryTrace::MATRIX;
+  }
+
+  template< typename Derived >
+  void WritePayload( const Eigen::DenseBase< Derived >& x ) {
+    WriteMatrixHeader( x.rows(), x.cols() );
+    for ( typename Derived::Index i = 0; i < x.rows(); ++i ) {
+      for ( typename Derived::Index j = 0; j < x.cols(); ++j ) {
+	WriteMatrixValue( x( i, j ) );
+      }
+    }
+  }
+
+  void WritePayload( const std::vector< double >& x ) {
+    WriteMatrixHeader( x.size(), 1 );
+    if ( m_SinglePrecision ) {
+      for ( double xi : x ) {
+	WriteMatrixValue( xi );
+      }
+    }
+    else {
+      m_Writer.Write( reinterpret_cast< const char* >( x.data() ), x.size() * sizeof( double ) );
+    }
+  }
+
+  template< typename T >
+  static typename std::enable_if< IsText< T >::value, BinaryTrace::PayloadType >::type
+  PayloadType( const T& ) {
+    return BinaryTrace::STRING;
+  }
+
+  template< typename T >
+  typename std::enable_if< IsText< T >::value >::type
+  WritePayload( const T& x ) {
+    std::ostringstream ss;
+    ss << x;
+    WriteString( ss.str() );
+  }
+
+  const bool m_SinglePrecision;
+  std::ofstream m_Out;
+  BufferedWriter m_Writer;
+  std::mutex m_Mutex;
+  std::unordered_map< std::string, std::uint64_t > m_Keys;
+  ClockType::time_point m_Start;
+  std::uint64_t m_Last;   // Time of the last message
+};
+
+typedef BasicBinaryFileTracer< LLP_TRACE_MIN_LEVEL > BinaryFileTracer;
+
+#endif
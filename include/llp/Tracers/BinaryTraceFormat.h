@@ -0,0 +1,274 @@
+#ifndef __BinaryTraceFormat_h
+#define __BinaryTraceFormat_h
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "TracerBase.h"
+#include "llp/Util/MappedFile.h"
+
+/*
+  Binary trace format written by BinaryFileTracer.
+
+  All fixed size values are in native byte order, like the bagged dataset
+  cache. Ids, lengths and times are varints (LEB128, see
+  BufferedWriter::WriteVarint), which take one to three bytes for typical
+  values. The file starts with
+
+    char[8]  magic "LLPTRC01"
+    int64    start time in nanoseconds since the epoch
+
+  followed by records, each starting with a uint8 record kind.
+
+  KEY records intern a key. They are written the first time a key is used
+    varint   key id, numbered from 0 in order of first use
+    varint   length
+    char[]   key
+
+  MESSAGE records hold one traced message
+    uint8    level
+    uint8    payload type
+    varint   key id
+    varint   nanoseconds since the previous message, or since the start time
+	     for the first message
+    payload
+
+  The payload depends on the type
+    DOUBLE        double
+    INTEGER       int64
+    STRING        varint length, char[]
+    MATRIX        varint rows, varint cols, double[rows*cols] in row-major order
+    FLOAT_MATRIX  varint rows, varint cols, float[rows*cols] in row-major order
+  Vectors are written as matrices with one column.
+*/
+
+namespace BinaryTrace {
+  const char Magic[8] = { 'L', 'L', 'P', 'T', 'R', 'C', '0', '1' };
+
+  enum RecordKind {
+    KEY = 1,
+    MESSAGE = 2
+  };
+
+  enum PayloadType {
+    DOUBLE = 1,
+    INTEGER = 2,
+    STRING = 3,
+    MATRIX = 4,
+    FLOAT_MATRIX = 5
+  };
+
+  inline const char* PayloadTypeName( PayloadType type ) {
+    switch ( type ) {
+    case DOUBLE: return "double";
+    case INTEGER: return "integer";
+    case STRING: return "string";
+    case MATRIX: return "matrix";
+    case FLOAT_MATRIX: return "float matrix";
+    }
+    return "unknown";
+  }
+
+  /**
+     A decoded message. Only the members for the payload type are set.
+  */
+  struct Record {
+    std::uint64_t time;   // Nanoseconds since the start of the trace
+    TraceLevel level;
+    const std::string* key;
+    PayloadType type;
+    double scalar;
+    std::int64_t integer;
+    std::string text;
+    std::uint32_t rows;
+    std::uint32_t cols;
+    std::vector< double > values;   // Row-major, also for FLOAT_MATRIX
+  };
+}
+
+
+/**
+   Read a binary trace file written by BinaryFileTracer.
+
+   The file is mapped into memory and decoded one record at a time, so traces
+   larger than memory can be read.
+*/
+class BinaryTraceReader {
+public:
+  typedef BinaryTrace::Record RecordType;
+
+  explicit BinaryTraceReader( const std::string& path )
+    : m_File( MappedFile::OpenReadOnly( path ) )
+    , m_Pos( 0 )
+    , m_StartTime( 0 )
+    , m_Time( 0 )
+    , m_Keys()
+  {
+    char magic[sizeof( BinaryTrace::Magic )];
+    Read( magic, sizeof( magic ) );
+    if ( std::memcmp( magic, BinaryTrace::Magic, sizeof( magic ) ) != 0 ) {
+      throw std::runtime_error( "Not a binary trace file: " + path );
+    }
+    m_StartTime = Read< std::int64_t >();
+  }
+
+  /**
+     Start time of the trace in nanoseconds since the epoch
+  */
+  std::int64_t StartTime() const {
+    return m_StartTime;
+  }
+
+  /**
+     Decode the next message into record. Returns false at the end of the
+     file. A truncated last record, e.g. from a crashed run, is ignored.
+  */
+  bool Next( RecordType& record ) {
+    while ( m_Pos < m_File.Size() ) {
+      const std::size_t recordStart = m_Pos;
+      try {
+	const std::uint8_t kind = Read< std::uint8_t >();
+	if ( kind == BinaryTrace::KEY ) {
+	  ReadKey();
+	}
+	else if ( kind == BinaryTrace::MESSAGE ) {
+	  ReadMessage( record );
+	  return true;
+	}
+	else {
+	  throw std::runtime_error( "Invalid record in binary trace" );
+	}
+      }
+      catch ( const Truncated& ) {
+	m_Pos = recordStart;
+	return false;
+      }
+    }
+    return false;
+  }
+
+  /**
+     Keys seen so far, indexed by key id
+  */
+  const std::deque< std::string >& Keys() const {
+    return m_Keys;
+  }
+
+private:
+  struct Truncated {};
+
+  void Read( void* out, std::size_t n ) {
+    if ( n > m_File.Size() - m_Pos ) {
+      throw Truncated();
+    }
+    std::memcpy( out, m_File.Data() + m_Pos, n );
+    m_Pos += n;
+  }
+
+  template< typename T >
+  T Read() {
+    T x;
+    Read( &x, sizeof( T ) );
+    return x;
+  }
+
+  std::uint64_t ReadVarint() {
+    std::uint64_t x = 0;
+    for ( int shift = 0; shift < 64; shift += 7 ) {
+      const std::uint8_t byte = Read< std::uint8_t >();
+      x |= static_cast< std::uint64_t >( byte & 0x7f ) << shift;
+      if ( ( byte & 0x80 ) == 0 ) {
+	return x;
+      }
+    }
+    throw std::runtime_error( "Invalid varint in binary trace" );
+  }
+
+  std::size_t ReadLength() {
+    const std::uint64_t length = ReadVarint();
+    if ( length > m_File.Size() - m_Pos ) {
+      throw Truncated();
+    }
+    return static_cast< std::size_t >( length );
+  }
+
+  void ReadMatrix( RecordType& record, std::size_t valueSize ) {
+    record.rows = static_cast< std::uint32_t >( ReadVarint() );
+    record.cols = static_cast< std::uint32_t >( ReadVarint() );
+    const std::uint64_t n = static_cast< std::uint64_t >( record.rows ) * record.cols;
+    if ( n > ( m_File.Size() - m_Pos ) / valueSize ) {
+      throw Truncated();
+    }
+    record.values.resize( n );
+    if ( valueSize == sizeof( double ) ) {
+      Read( record.values.data(), n * sizeof( double ) );
+    }
+    else {
+      for ( std::uint64_t i = 0; i < n; ++i ) {
+	record.values[i] = Read< float >();
+      }
+    }
+  }
+
+  void ReadKey() {
+    const std::uint64_t id = ReadVarint();
+    const std::size_t length = ReadLength();
+    std::string key( length, '\0' );
+    Read( &key[0], length );
+    if ( id != m_Keys.size() ) {
+      throw std::runtime_error( "Key ids out of order in binary trace" );
+    }
+    m_Keys.push_back( key );
+  }
+
+  void ReadMessage( RecordType& record ) {
+    const std::uint8_t level = Read< std::uint8_t >();
+    const std::uint8_t type = Read< std::uint8_t >();
+    const std::uint64_t keyId = ReadVarint();
+    const std::uint64_t time = m_Time + ReadVarint();
+    if ( level > static_cast< std::uint8_t >( TraceLevel::ERROR ) || keyId >= m_Keys.size() ) {
+      throw std::runtime_error( "Invalid message in binary trace" );
+    }
+    record.level = static_cast< TraceLevel >( level );
+    record.key = &m_Keys[keyId];
+    record.type = static_cast< BinaryTrace::PayloadType >( type );
+    switch ( record.type ) {
+    case BinaryTrace::DOUBLE:
+      record.scalar = Read< double >();
+      break;
+    case BinaryTrace::INTEGER:
+      record.integer = Read< std::int64_t >();
+      break;
+    case BinaryTrace::STRING: {
+      const std::size_t length = ReadLength();
+      record.text.assign( length, '\0' );
+      Read( &record.text[0], length );
+      break;
+    }
+    case BinaryTrace::MATRIX:
+      ReadMatrix( record, sizeof( double ) );
+      break;
+    case BinaryTrace::FLOAT_MATRIX:
+      ReadMatrix( record, sizeof( float ) );
+      break;
+    default:
+      throw std::runtime_error( "Invalid payload type in binary trace" );
+    }
+    // Only advance when the whole record is read, so a truncated record
+    // leaves the reader unchanged
+    record.time = m_Time = time;
+  }
+
+  MappedFile m_File;
+  std::size_t m_Pos;
+  std::int64_t m_StartTime;
+  std::uint64_t m_Time;   // Time of the last message
+  // A deque, so the key pointers in records stay valid when keys are added
+  std::deque< std::string > m_Keys;
+};
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef __ChromeTraceTracer_h
+#define __ChromeTraceTracer_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <unistd.h>
+
+#include "TracerBase.h"
+#include "llp/Util/BufferedWriter.h"
+#include "llp/Util/Json.h"
+
+/**
+   Tracer that writes a timeline in the Chrome trace event format, which can
+   be loaded in chrome://tracing or Perfetto.
+
+   Spans become duration events on the thread that traced them. Messages
+   become instant events with the payload as the value argument. Times are in
+   microseconds since the tracer was constructed.
+
+   The file is a JSON array that is closed on destruction. The viewers also
+   load a trace that was not closed, e.g. from a crashed run. Tracing from
+   several threads is safe.
+*/
+template< int MinimumLevel >
+class BasicChromeTraceTracer : public TracerBase< BasicChromeTraceTracer< MinimumLevel >, MinimumLevel > {
+public:
+  typedef TracerBase< BasicChromeTraceTracer< MinimumLevel >, MinimumLevel > Super;
+  typedef typename Super::Level Level;
+  typedef std::chrono::steady_clock ClockType;
+  friend class TracerBase< BasicChromeTraceTracer< MinimumLevel >, MinimumLevel >;
+
+  struct ParameterType  {
+    /*
+      @param level      Minimum level of messages to write. Spans are always
+                        written
+      @param path       Path of the trace file
+    */
+    ParameterType(Level level=Level::DEBUG,
+		  const std::string& path=std::string())
+      : level(level)
+      , path(path)
+    {}
+
+    Level level;
+    std::string path;
+  };
+
+  BasicChromeTraceTracer(const ParameterType& params)
+    : Super(params.level)
+    , m_Out(params.path)
+    , m_Writer(m_Out)
+    , m_Mutex()
+    , m_Start(ClockType::now())
+    , m_ProcessId(getpid())
+    , m_First(true)
+  {
+    if ( !m_Out ) {
+      throw std::runtime_error( "Could not open trace file " + params.path );
+    }
+    m_Writer.Put( '[' );
+  }
+
+  ~BasicChromeTraceTracer() {
+    m_Writer.Write( "\n]\n", 3 );
+  }
+
+  BasicChromeTraceTracer( const BasicChromeTraceTracer& ) = delete;
+  BasicChromeTraceTracer& operator=( const BasicChromeTraceTracer& ) = delete;
+
+  /**
+     Write all buffered events to the file
+  */
+  void Flush() {
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    m_Writer.Flush();
+  }
+
+protected:
+  template<typename T>
+  void write(Level level, const std::string& msg, const T& x) {
+    const ClockType::time_point now = ClockType::now();
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    BeginEvent( msg, 'i', now );
+    m_Writer.Write( std::string( ",\"s\":\"t\",\"cat\":\"" ) )
+      .Write( std::string( traceLevelName( level ) ) )
+      .Write( std::string( "\",\"args\":{\"value\":" ) );
+    WriteValue( x );
+    m_Writer.Write( "}}", 2 );
+  }
+
+  template< typename K >
+  void beginSpan( const K& name ) {
+    const ClockType::time_point now = ClockType::now();
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    BeginEvent( std::string( evaluateTracePayload( name, 0 ) ), 'B', now );
+    m_Writer.Put( '}' );
+  }
+
+  void endSpan() {
+    const ClockType::time_point now = ClockType::now();
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    Separate();
+    m_Writer.Write( std::string( "{\"ph\":\"E\",\"ts\":" ) );
+    WriteTime( now );
+    WriteIds();
+    m_Writer.Put( '}' );
+  }
+
+  template< typename K >
+  void completeSpan( const K& name, ClockType::time_point start, ClockType::time_point end ) {
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    BeginEvent( std::string( evaluateTracePayload( name, 0 ) ), 'X', start );
+    m_Writer.Write( std::string( ",\"dur\":" ) );
+    WriteMicroseconds( std::chrono::duration_cast< std::chrono::nanoseconds >( end - start ).count() );
+    m_Writer.Put( '}' );
+  }
+
+private:
+  /**
+     Small id of the calling thread. Ids are numbered from 1 in the order
+     threads first trace.
+  */
+  static int ThreadId() {
+    static std::atomic< int > next( 1 );
+    static thread_local int id = next.fetch_add( 1 );
+    return id;
+  }
+
+  void Separate() {
+    m_Writer.Write( m_First ? "\n" : ",\n", m_First ? 1 : 2 );
+    m_First = false;
+  }
+
+  // Write the fields common to all events except the closing brace
+  void BeginEvent( const std::string& name, char phase, ClockType::time_point time ) {
+    Separate();
+    m_Writer.Write( std::string( "{\"name\":" ) );
+    writeJsonString( m_Writer, name );
+    m_Writer.Write( std::string( ",\"ph\":\"" ) ).Put( phase ).Write( std::string( "\",\"ts\":" ) );
+    WriteTime( time );
+    WriteIds();
+  }
+
+  void WriteIds() {
+    m_Writer.Write( std::string( ",\"pid\":" ) ).WriteInteger( m_ProcessId )
+      .Write( std::string( ",\"tid\":" ) ).WriteInteger( ThreadId() );
+  }
+
+  void WriteTime( ClockType::time_point time ) {
+    WriteMicroseconds( std::chrono::duration_cast< std::chrono::nanoseconds >( time - m_Start ).count() );
+  }
+
+  // Microseconds with three decimals
+  void WriteMicroseconds( std::int64_t nanoseconds ) {
+    if ( nanoseconds < 0 ) {
+      m_Writer.Put( '-' );
+      nanoseconds = -nanoseconds;
+    }
+    m_Writer.WriteInteger( nanoseconds / 1000 ).Put( '.' );
+    const int fraction = static_cast< int >( nanoseconds % 1000 );
+    m_Writer.Put( static_cast< char >( '0' + fraction / 100 ) )
+      .Put( static_cast< char >( '0' + fraction / 10 % 10 ) )
+      .Put( static_cast< char >( '0' + fraction % 10 ) );
+  }
+
+  template< typename T >
+  typename std::enable_if< std::is_floating_point< T >::value >::type
+  WriteValue( const T& x ) {
+    writeJsonNumber( m_Writer, static_cast< double >( x ) );
+  }
+
+  template< typename T >
+  typename std::enable_if< std::is_integral< T >::value >::type
+  WriteValue( const T& x ) {
+    m_Writer.WriteInteger( static_cast< long long >( x ) );
+  }
+
+  template< typename T >
+  typename std::enable_if< !std::is_arithmetic< T >::value >::type
+  WriteValue( const T& x ) {
+    std::ostringstream ss;
+    ss << x;
+    writeJsonString( m_Writer, ss.str() );
+  }
+
+  std::ofstream m_Out;
+  BufferedWriter m_Writer;
+  std::mutex m_Mutex;
+  ClockType::time_point m_Start;
+  const long long m_ProcessId;
+  bool m_First;
+};
+
+typedef BasicChromeTraceTracer< LLP_TRACE_MIN_LEVEL > ChromeTraceTracer;
+
+#endif
@@ -1,15 +1,17 @@
 #ifndef __FileTracer_h
 #define __FileTracer_h
 
-class FileTracer {
+#include <fstream>
+#include <string>
+
+#include "TracerBase.h"
+
+template< int MinimumLevel >
+class BasicFileTracer : public TracerBase< BasicFileTracer< MinimumLevel >, MinimumLevel > {
 public:
-  enum Level {
-    TRACE,
-    DEBUG,
-    INFO,
-    WARNING,
-    ERROR
-  };
+  typedef TracerBase< BasicFileTracer< MinimumLevel >, MinimumLevel > Super;
+  typedef typename Super::Level Level;
+  friend class TracerBase< BasicFileTracer< MinimumLevel >, MinimumLevel >;
 
   struct ParameterType  {
     ParameterType(Level level=Level::DEBUG, const std::string& path=std::string())
@@ -21,55 +23,20 @@ public:
     std::string path;
   };
     
-  FileTracer(const ParameterType& params)
-    : m_Level(params.level)
+  BasicFileTracer(const ParameterType& params)
+    : Super(params.level)
     , m_Out(params.path)
   {}
 
-  template<typename T>
-  void Trace(const std::string& s, const T& x) {
-    if (m_Level <= Level::TRACE) {
-      write("TRACE", s, x);
-    }
-  }
-
-  template<typename T>
-  void Debug(const std::string& s, const T& x) {
-    if (m_Level <= Level::DEBUG) {
-      write("DEBUG", s, x);
-    }
-  }
-  
-  template<typename T>
-  void Info(const std::string& s, const T& x) {
-    if (m_Level <= Level::INFO) {
-      write("INFO", s, x);
-    }
-  }
-
-  template<typename T>
-  void Warning(const std::string& s, const T& x) {
-    if (m_Level <= Level::WARNING) {
-      write("WARNING", s, x);
-    }
-  }
-  
-  template<typename T>
-  void Error(const std::string& s, const T&x) {
-    if (m_Level <= Level::ERROR) {
-      write("ERROR", s, x);
-    }
-  }
-
-  
 protected:
   template<typename T>
-  void write(const std::string& prefix, const std::string& msg, const T& x) {
-    m_Out << '[' << prefix << "] " << msg << " : " << x << std::endl;
+  void write(Level level, const std::string& msg, const T& x) {
+    m_Out << '[' << traceLevelName(level) << "] " << msg << " : " << x << std::endl;
   }
   
-  Level m_Level;
   std::ofstream m_Out;
 };
 
+typedef BasicFileTracer< LLP_TRACE_MIN_LEVEL > FileTracer;
+
 #endif
@@ -1,18 +1,19 @@
 #ifndef __SilentTracer_h
 #define __SilentTracer_h
 
-#include <iostream>
+#include <string>
 
-class SilentTracer {
+#include "TracerBase.h"
+
+/**
+   Tracer that ignores all messages. The minimum level is above ERROR, so all
+   messages are removed at compile time and lazy payloads are never evaluated.
+*/
+class SilentTracer : public TracerBase< SilentTracer, static_cast< int >( TraceLevel::ERROR ) + 1 > {
 public:
-  enum Level {
-    TRACE,
-    DEBUG,
-    INFO,
-    WARNING,
-    ERROR
-  };
-  
+  typedef TracerBase< SilentTracer, static_cast< int >( TraceLevel::ERROR ) + 1 > Super;
+  friend Super;
+
   struct ParameterType {    
     ParameterType(Level level=Level::DEBUG)
       : level( level )
@@ -21,49 +22,12 @@ public:
   };
 
   SilentTracer(const ParameterType& p=ParameterType())
-    : m_Level(p.level)
+    : Super(p.level)
   {}
 
-  template<typename T>
-  void Trace(const std::string& s, const T& x) {
-    if (m_Level <= Level::TRACE) {
-      write("TRACE", s, x);
-    }
-  }
-
-  template<typename T>
-  void Debug(const std::string& s, const T& x) {
-    if (m_Level <= Level::DEBUG) {
-      write("DEBUG", s, x);
-    }
-  }
-  
-  template<typename T>
-  void Info(const std::string& s, const T& x) {
-    if (m_Level <= Level::INFO) {
-      write("INFO", s, x);
-    }
-  }
-
-  template<typename T>
-  void Warning(const std::string& s, const T& x) {
-    if (m_Level <= Level::WARNING) {
-      write("WARNING", s, x);
-    }
-  }
-  
-  template<typename T>
-  void Error(const std::string& s, const T&x) {
-    if (m_Level <= Level::ERROR) {
-      write("ERROR", s, x);
-    }
-  }
-
 protected:
   template<typename T>
-  void write(const std::string&, const std::string&, const T&) { }
-
-  Level m_Level;
+  void write(Level, const std::string&, const T&) { }
 };
 
 #endif
@@ -2,21 +2,35 @@
 #define __StdOutTracer_h
 
 #include <iostream>
-#include "SilentTracer.h"
+#include <string>
 
-class StdOutTracer : public SilentTracer {
-public:   
-  StdOutTracer(const ParameterType& params)
-    : m_Level(params.level)
+#include "TracerBase.h"
+
+template< int MinimumLevel >
+class BasicStdOutTracer : public TracerBase< BasicStdOutTracer< MinimumLevel >, MinimumLevel > {
+public:
+  typedef TracerBase< BasicStdOutTracer< MinimumLevel >, MinimumLevel > Super;
+  typedef typename Super::Level Level;
+  friend class TracerBase< BasicStdOutTracer< MinimumLevel >, MinimumLevel >;
+
+  struct ParameterType {    
+    ParameterType(Level level=Level::DEBUG)
+      : level( level )
+    {}
+    Level level;
+  };
+
+  BasicStdOutTracer(const ParameterType& params=ParameterType())
+    : Super(params.level)
   {}
 
 protected:
   template<typename T>
-  void write( const std::string& prefix, const std::string& msg, const T& x) {
-    std::cout << '[' << prefix << "] " << msg << " : " << x << '\n';
+  void write( Level level, const std::string& msg, const T& x) {
+    std::cout << '[' << traceLevelName(level) << "] " << msg << " : " << x << '\n';
   }
-  
-  Level m_Level;
 };
 
+typedef BasicStdOutTracer< LLP_TRACE_MIN_LEVEL > StdOutTracer;
+
 #endif
@@ -0,0 +1,180 @@
+#ifndef __TracerBase_h
+#define __TracerBase_h
+
+#include <chrono>
+#include <string>
+
+/*
+  Messages below this level are removed at compile time by all tracers. Set
+  it with e.g. -DLLP_TRACE_MIN_LEVEL=2 to keep INFO and above.
+*/
+#ifndef LLP_TRACE_MIN_LEVEL
+#define LLP_TRACE_MIN_LEVEL 0
+#endif
+
+/*
+  Scoped, so the levels do not clash with e.g. the INFO, WARNING and ERROR
+  severities glog declares globally.
+*/
+enum class TraceLevel : int {
+  TRACE,
+  DEBUG,
+  INFO,
+  WARNING,
+  ERROR
+};
+
+inline const char*
+traceLevelName( TraceLevel level ) {
+  static const char* names[] = { "TRACE", "DEBUG", "INFO", "WARNING", "ERROR" };
+  return names[static_cast< int >( level )];
+}
+
+/**
+   Get the value of a trace key or payload. Callables are called, so an
+   expensive message can be passed as a lambda that is only evaluated when the
+   message is written. Everything else is passed through.
+*/
+template< typename T >
+auto evaluateTracePayload( const T& x, int ) -> decltype( x() ) {
+  return x();
+}
+
+template< typename T >
+const T& evaluateTracePayload( const T& x, long ) {
+  return x;
+}
+
+
+/**
+   Common interface of the tracers.
+
+   TDerived must define
+     template<typename T> void write(Level level, const std::string& key, const T& x)
+   which is only called for messages that pass both the compile-time minimum
+   level MinimumLevel and the level given at runtime.
+
+   Keys and payloads can be values or callables returning the value, e.g.
+     tracer.Trace( [i]{ return "Weight " + std::to_string(i); }, w[i] );
+   Callables are not called for messages that are filtered out.
+
+   Tracers that record a timeline can also define
+     template<typename K> void beginSpan(const K& name)
+     void endSpan()
+     template<typename K> void completeSpan(const K& name, ClockType::time_point start, ClockType::time_point end)
+   The defaults do nothing.
+*/
+template< typename TDerived, int MinimumLevel=LLP_TRACE_MIN_LEVEL >
+class TracerBase {
+public:
+  typedef TraceLevel Level;
+
+  typedef std::chrono::steady_clock ClockType;
+
+  explicit TracerBase( Level level )
+    : m_Level( level )
+  {}
+
+  template< typename K, typename T >
+  void Trace( const K& key, const T& x ) {
+    Log< Level::TRACE >( key, x );
+  }
+
+  template< typename K, typename T >
+  void Debug( const K& key, const T& x ) {
+    Log< Level::DEBUG >( key, x );
+  }
+
+  template< typename K, typename T >
+  void Info( const K& key, const T& x ) {
+    Log< Level::INFO >( key, x );
+  }
+
+  template< typename K, typename T >
+  void Warning( const K& key, const T& x ) {
+    Log< Level::WARNING >( key, x );
+  }
+
+  template< typename K, typename T >
+  void Error( const K& key, const T& x ) {
+    Log< Level::ERROR >( key, x );
+  }
+
+  /**
+     Begin a span of work named name on the calling thread. It ends at the
+     next EndSpan on the same thread, so spans nest. Use ScopedTraceSpan to
+     end spans automatically.
+  */
+  template< typename K >
+  void BeginSpan( const K& name ) {
+    static_cast< TDerived* >( this )->beginSpan( name );
+  }
+
+  void EndSpan() {
+    static_cast< TDerived* >( this )->endSpan();
+  }
+
+  /**
+     Record a span of work on the calling thread that ran from start to end
+  */
+  template< typename K >
+  void CompleteSpan( const K& name, ClockType::time_point start, ClockType::time_point end ) {
+    static_cast< TDerived* >( this )->completeSpan( name, start, end );
+  }
+
+  /**
+     True if messages at level are written
+  */
+  bool IsEnabled( Level level ) const {
+    return static_cast< int >( level ) >= MinimumLevel && level >= m_Level;
+  }
+
+protected:
+  template< Level MessageLevel, typename K, typename T >
+  void Log( const K& key, const T& x ) {
+    // The first condition is known at compile time, so filtered out levels
+    // leave no code behind
+    if ( static_cast< int >( MessageLevel ) >= MinimumLevel && MessageLevel >= m_Level ) {
+      static_cast< TDerived* >( this )->write( MessageLevel,
+					       std::string( evaluateTracePayload( key, 0 ) ),
+					       evaluateTracePayload( x, 0 ) );
+    }
+  }
+
+  template< typename K >
+  void beginSpan( const K& ) {}
+
+  void endSpan() {}
+
+  template< typename K >
+  void completeSpan( const K&, ClockType::time_point, ClockType::time_point ) {}
+
+  Level m_Level;
+};
+
+
+/**
+   Span of work from construction to destruction, see TracerBase::BeginSpan
+*/
+template< typename TTracer >
+class ScopedTraceSpan {
+public:
+  template< typename K >
+  ScopedTraceSpan( TTracer& tracer, const K& name )
+    : m_Tracer( tracer )
+  {
+    m_Tracer.BeginSpan( name );
+  }
+
+  ~ScopedTraceSpan() {
+    m_Tracer.EndSpan();
+  }
+
+  ScopedTraceSpan( const ScopedTraceSpan& ) = delete;
+  ScopedTraceSpan& operator=( const ScopedTraceSpan& ) = delete;
+
+private:
+  TTracer& m_Tracer;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef __BoundedQueue_h
+#define __BoundedQueue_h
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+   Lock-free bounded multi-producer multi-consumer queue.
+
+   This is Dmitry Vyukov's array based queue. Every cell carries a sequence
+   number that tells producers and consumers whose turn it is, so a push or pop
+   is a single compare-and-swap on the shared position plus a store to the
+   cell. TryPush fails instead of waiting when the queue is full and TryPop
+   fails when it is empty.
+*/
+template< typename T >
+class BoundedQueue {
+public:
+  /**
+     @param capacity   Maximum number of elements. Rounded up to a power of two
+  */
+  explicit BoundedQueue( std::size_t capacity )
+    : m_Cells( RoundUpToPowerOfTwo( capacity ) )
+    , m_Mask( m_Cells.size() - 1 )
+    , m_Padding0()
+    , m_EnqueuePos( 0 )
+    , m_Padding1()
+    , m_DequeuePos( 0 )
+  {
+    for ( std::size_t i = 0; i < m_Cells.size(); ++i ) {
+      m_Cells[i].sequence.store( i, std::memory_order_relaxed );
+    }
+  }
+
+  BoundedQueue( const BoundedQueue& ) = delete;
+  BoundedQueue& operator=( const BoundedQueue& ) = delete;
+
+  std::size_t Capacity() const {
+    return m_Cells.size();
+  }
+
+  /**
+     Number of successful pushes so far, counting pushes that have claimed
+     their cell but not yet stored the value. Elements are popped in this
+     order, so once a single consumer has popped this many elements it has
+     popped everything pushed before the call.
+  */
+  std::size_t Pushed() const {
+    return m_EnqueuePos.load( std::memory_order_acquire );
+  }
+
+  bool TryPush( T&& value ) {
+    Cell* cell;
+    std::size_t pos = m_EnqueuePos.load( std::memory_order_relaxed );
+    while ( true ) {
+      cell = &m_Cells[pos & m_Mask];
+      const std::size_t sequence = cell->sequence.load( std::memory_order_acquire );
+      const std::ptrdiff_t diff = static_cast< std::ptrdiff_t >( sequence ) - static_cast< std::ptrdiff_t >( pos );
+      if ( diff == 0 ) {
+	if ( m_EnqueuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+	  break;
+	}
+      }
+      else if ( diff < 0 ) {
+	return false;   // Full
+      }
+      else {
+	pos = m_EnqueuePos.load( std::memory_order_relaxed );
+      }
+    }
+    cell->value = std::move( value );
+    cell->sequence.store( pos + 1, std::memory_order_release );
+    return true;
+  }
+
+  bool TryPop( T& value ) {
+    Cell* cell;
+    std::size_t pos = m_DequeuePos.load( std::memory_order_relaxed );
+    while ( true ) {
+      cell = &m_Cells[pos & m_Mask];
+      const std::size_t sequence = cell->sequence.load( std::memory_order_acquire );
+      const std::ptrdiff_t diff = static_cast< std::ptrdiff_t >( sequence ) - static_cast< std::ptrdiff_t >( pos + 1 );
+      if ( diff == 0 ) {
+	if ( m_DequeuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+	  break;
+	}
+      }
+      else if ( diff < 0 ) {
+	return false;   // Empty
+      }
+      else {
+	pos = m_DequeuePos.load( std::memory_order_relaxed );
+      }
+    }
+    value = std::move( cell->value );
+    cell->sequence.store( pos + m_Mask + 1, std::memory_order_release );
+    return true;
+  }
+
+private:
+  struct Cell {
+    Cell()
+      : sequence( 0 )
+      , value()
+    {}
+
+    std::atomic< std::size_t > sequence;
+    T value;
+  };
+
+  static std::size_t RoundUpToPowerOfTwo( std::size_t n ) {
+    if ( n == 0 ) {
+      throw std::logic_error( "Queue capacity must be positive" );
+    }
+    std::size_t p = 1;
+    while ( p < n ) {
+      p *= 2;
+    }
+    return p;
+  }
+
+  // Padding keeps the producer and consumer positions on separate cache lines
+  std::vector< Cell > m_Cells;
+  const std::size_t m_Mask;
+  char m_Padding0[64];
+  std::atomic< std::size_t > m_EnqueuePos;
+  char m_Padding1[64];
+  std::atomic< std::size_t > m_DequeuePos;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef __BufferedWriter_h
+#define __BufferedWriter_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+   Buffered writer for large text and binary outputs.
+
+   Values are formatted directly into a large buffer that is handed to the
+   stream in one block when it is full, so the stream is never flushed per line
+   and no locale aware formatting is done.
+
+   Doubles are formatted like std::ostream does by default (%g with six
+   significant digits), so text output is the same as when writing to the
+   stream directly. Integral valued doubles, which is what labels usually are,
+   take a fast path that avoids printf.
+
+   The buffer is flushed on destruction. Call Flush() to check for errors.
+*/
+class BufferedWriter {
+public:
+  BufferedWriter( std::ostream& os, std::size_t bufferSize=1 << 20 )
+    : m_Out( os )
+    , m_Buffer( std::max< std::size_t >( bufferSize, static_cast< std::size_t >( MaxFieldSize ) ) )
+    , m_Size( 0 )
+  {}
+
+  ~BufferedWriter() {
+    try {
+      Flush();
+    }
+    catch ( ... ) {
+      // Destructors must not throw. Call Flush() to get errors.
+    }
+  }
+
+  BufferedWriter( const BufferedWriter& ) = delete;
+  BufferedWriter& operator=( const BufferedWriter& ) = delete;
+
+  BufferedWriter& Put( char c ) {
+    Reserve( 1 );
+    m_Buffer[m_Size++] = c;
+    return *this;
+  }
+
+  BufferedWriter& Write( const char* s, std::size_t n ) {
+    if ( n > m_Buffer.size() ) {
+      Flush();
+      WriteToStream( s, n );
+      return *this;
+    }
+    Reserve( n );
+    std::memcpy( m_Buffer.data() + m_Size, s, n );
+    m_Size += n;
+    return *this;
+  }
+
+  BufferedWriter& Write( const std::string& s ) {
+    return Write( s.data(), s.size() );
+  }
+
+  BufferedWriter& WriteInteger( long long x ) {
+    Reserve( MaxFieldSize );
+    if ( x < 0 ) {
+      m_Buffer[m_Size++] = '-';
+      // Negate in unsigned arithmetic so the smallest value is handled
+      return WriteDigits( 0ull - static_cast< unsigned long long >( x ) );
+    }
+    return WriteDigits( static_cast< unsigned long long >( x ) );
+  }
+
+  BufferedWriter& WriteUnsigned( unsigned long long x ) {
+    Reserve( MaxFieldSize );
+    return WriteDigits( x );
+  }
+
+  /**
+     Write x formatted as std::ostream would with default flags and precision.
+  */
+  BufferedWriter& WriteDouble( double x ) {
+    // %g with six significant digits prints integers up to 999999 exactly
+    if ( x < 1e6 && x > -1e6 &&
+	 x == static_cast< double >( static_cast< long long >( x ) ) &&
+	 !( x == 0 && std::signbit( x ) ) ) {
+      return WriteInteger( static_cast< long long >( x ) );
+    }
+    Reserve( MaxFieldSize );
+    const int n = std::snprintf( m_Buffer.data() + m_Size, MaxFieldSize, "%g", x );
+    if ( n < 0 || static_cast< std::size_t >( n ) >= MaxFieldSize ) {
+      throw std::runtime_error( "Could not format double" );
+    }
+    m_Size += n;
+    return *this;
+  }
+
+  /**
+     Write x formatted as %g with the given number of significant digits. With
+     17 digits the value is read back exactly.
+  */
+  BufferedWriter& WriteDouble( double x, int significantDigits ) {
+    Reserve( MaxFieldSize );
+    const int n = std::snprintf( m_Buffer.data() + m_Size, MaxFieldSize, "%.*g", significantDigits, x );
+    if ( n < 0 || static_cast< std::size_t >( n ) >= MaxFieldSize ) {
+      throw std::runtime_error( "Could not format double" );
+    }
+    m_Size += n;
+    return *this;
+  }
+
+  /**
+     Write the object representation of x, i.e. in native byte order
+  */
+  template< typename T >
+  BufferedWriter& WriteBinary( const T& x ) {
+    static_assert( std::is_trivially_copyable< T >::value, "Binary output requires trivially copyable types" );
+    return Write( reinterpret_cast< const char* >( &x ), sizeof( T ) );
+  }
+
+  /**
+     Write x as a LEB128 varint, i.e. seven bits per byte starting with the
+     lowest, with the high bit set on all but the last byte
+  */
+  BufferedWriter& WriteVarint( std::uint64_t x ) {
+    Reserve( MaxVarintSize );
+    while ( x >= 0x80 ) {
+      m_Buffer[m_Size++] = static_cast< char >( ( x & 0x7f ) | 0x80 );
+      x >>= 7;
+    }
+    m_Buffer[m_Size++] = static_cast< char >( x );
+    return *this;
+  }
+
+  void Flush() {
+    WriteToStream( m_Buffer.data(), m_Size );
+    m_Size = 0;
+    m_Out.flush();
+    if ( !m_Out ) {
+      throw std::runtime_error( "Could not write output" );
+    }
+  }
+
+private:
+  // Enough for any integer or %g formatted double
+  enum { MaxFieldSize = 32 };
+  enum { MaxVarintSize = 10 };
+
+  void Reserve( std::size_t n ) {
+    if ( m_Size + n > m_Buffer.size() ) {
+      WriteToStream( m_Buffer.data(), m_Size );
+      m_Size = 0;
+    }
+  }
+
+  void WriteToStream( const char* s, std::size_t n ) {
+    if ( n > 0 && m_Out.rdbuf()->sputn( s, n ) != static_cast< std::streamsize >( n ) ) {
+      m_Out.setstate( std::ios::badbit );
+      throw std::runtime_error( "Could not write output" );
+    }
+  }
+
+  BufferedWriter& WriteDigits( unsigned long long x ) {
+    char digits[MaxFieldSize];
+    std::size_t n = 0;
+    do {
+      digits[n++] = static_cast< char >( '0' + x % 10 );
+      x /= 10;
+    } while ( x > 0 );
+    while ( n > 0 ) {
+      m_Buffer[m_Size++] = digits[--n];
+    }
+    return *this;
+  }
+
+  std::ostream& m_Out;
+  std::vector< char > m_Buffer;
+  std::size_t m_Size;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef __Json_h
+#define __Json_h
+
+#include <cmath>
+#include <string>
+
+#include "BufferedWriter.h"
+
+/**
+   Write s as a JSON string, with quotes and escapes
+*/
+inline void
+writeJsonString( BufferedWriter& out, const std::string& s ) {
+  static const char hex[] = "0123456789abcdef";
+  out.Put( '"' );
+  for ( char c : s ) {
+    switch ( c ) {
+    case '"': out.Write( "\\\"", 2 ); break;
+    case '\\': out.Write( "\\\\", 2 ); break;
+    case '\n': out.Write( "\\n", 2 ); break;
+    case '\t': out.Write( "\\t", 2 ); break;
+    default:
+      if ( static_cast< unsigned char >( c ) < 0x20 ) {
+	out.Write( "\\u00", 4 ).Put( hex[c >> 4] ).Put( hex[c & 0xf] );
+      }
+      else {
+	out.Put( c );
+      }
+    }
+  }
+  out.Put( '"' );
+}
+
+/**
+   Write x as a JSON number that reads back exactly. JSON has no
+   representation of nan and infinity, they are written as null.
+*/
+inline void
+writeJsonNumber( BufferedWriter& out, double x ) {
+  if ( std::isfinite( x ) ) {
+    out.WriteDouble( x, 17 );
+  }
+  else {
+    out.Write( "null", 4 );
+  }
+}
+
+#endif
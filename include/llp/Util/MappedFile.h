@@ -0,0 +1,218 @@
+#ifndef __MappedFile_h
+#define __MappedFile_h
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+   A file mapped into memory with mmap. The mapping is released on destruction.
+
+   Read-only mappings are private, read-write mappings are shared, so writes
+   end up in the file and are visible to other processes mapping it.
+*/
+class MappedFile {
+public:
+  MappedFile()
+    : m_Data( nullptr )
+    , m_Size( 0 )
+  {}
+
+  MappedFile( MappedFile&& other )
+    : m_Data( other.m_Data )
+    , m_Size( other.m_Size )
+  {
+    other.m_Data = nullptr;
+    other.m_Size = 0;
+  }
+
+  MappedFile& operator=( MappedFile&& other ) {
+    if ( this != &other ) {
+      Unmap();
+      m_Data = other.m_Data;
+      m_Size = other.m_Size;
+      other.m_Data = nullptr;
+      other.m_Size = 0;
+    }
+    return *this;
+  }
+
+  MappedFile( const MappedFile& ) = delete;
+  MappedFile& operator=( const MappedFile& ) = delete;
+
+  ~MappedFile() {
+    Unmap();
+  }
+
+  /**
+     Map an existing file for reading
+  */
+  static MappedFile OpenReadOnly( const std::string& path ) {
+    int fd = open( path.c_str(), O_RDONLY );
+    if ( fd < 0 ) {
+      throw std::runtime_error( "Could not open " + path + ": " + std::strerror( errno ) );
+    }
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 ) {
+      close( fd );
+      throw std::runtime_error( "Could not stat " + path + ": " + std::strerror( errno ) );
+    }
+    MappedFile file;
+    file.m_Size = static_cast< std::size_t >( st.st_size );
+    if ( file.m_Size > 0 ) {
+      void* data = mmap( nullptr, file.m_Size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      if ( data == MAP_FAILED ) {
+	close( fd );
+	throw std::runtime_error( "Could not map " + path + ": " + std::strerror( errno ) );
+      }
+      file.m_Data = static_cast< char* >( data );
+    }
+    close( fd );
+    return file;
+  }
+
+  /**
+     Create, or truncate, a file of the given size and map it for reading and
+     writing
+  */
+  static MappedFile Create( const std::string& path, std::size_t size ) {
+    int fd = open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if ( fd < 0 ) {
+      throw std::runtime_error( "Could not create " + path + ": " + std::strerror( errno ) );
+    }
+    if ( ftruncate( fd, static_cast< off_t >( size ) ) != 0 ) {
+      close( fd );
+      throw std::runtime_error( "Could not resize " + path + ": " + std::strerror( errno ) );
+    }
+    MappedFile file;
+    file.m_Size = size;
+    if ( size > 0 ) {
+      void* data = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+      if ( data == MAP_FAILED ) {
+	close( fd );
+	throw std::runtime_error( "Could not map " + path + ": " + std::strerror( errno ) );
+      }
+      file.m_Data = static_cast< char* >( data );
+    }
+    close( fd );
+    return file;
+  }
+
+  /**
+     Map zero-filled memory of the given size for reading and writing that is
+     not backed by a file. The mapping is shared, so processes forked after
+     it is made see each others writes.
+  */
+  static MappedFile Anonymous( std::size_t size ) {
+    MappedFile file;
+    file.m_Size = size;
+    if ( size > 0 ) {
+      void* data = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+      if ( data == MAP_FAILED ) {
+	throw std::runtime_error( std::string( "Could not map shared memory: " ) + std::strerror( errno ) );
+      }
+      file.m_Data = static_cast< char* >( data );
+    }
+    return file;
+  }
+
+  const char* Data() const {
+    return m_Data;
+  }
+
+  char* Data() {
+    return m_Data;
+  }
+
+  std::size_t Size() const {
+    return m_Size;
+  }
+
+  /**
+     Write changes in a read-write mapping to the file
+  */
+  void Sync() {
+    if ( m_Data != nullptr && msync( m_Data, m_Size, MS_SYNC ) != 0 ) {
+      throw std::runtime_error( std::string( "Could not sync mapped file: " ) + std::strerror( errno ) );
+    }
+  }
+
+private:
+  void Unmap() {
+    if ( m_Data != nullptr ) {
+      munmap( m_Data, m_Size );
+      m_Data = nullptr;
+      m_Size = 0;
+    }
+  }
+
+  char* m_Data;
+  std::size_t m_Size;
+};
+
+
+/**
+   Modification time of a file in nanoseconds since the epoch
+*/
+inline int64_t
+modificationTime( const struct stat& st ) {
+  return static_cast< int64_t >( st.st_mtim.tv_sec ) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+/**
+   Size and modification time of a file, which identify a version of it much
+   better than the modification time in seconds alone. A value-initialized
+   stamp, FileStamp(), is zero and unset.
+*/
+struct FileStamp {
+  static FileStamp Of( const std::string& path ) {
+    struct stat st;
+    if ( stat( path.c_str(), &st ) != 0 ) {
+      throw std::runtime_error( "Could not stat " + path + ": " + std::strerror( errno ) );
+    }
+    FileStamp stamp;
+    stamp.size = static_cast< uint64_t >( st.st_size );
+    stamp.modified = modificationTime( st );
+    return stamp;
+  }
+
+  bool IsSet() const {
+    return size != 0 || modified != 0;
+  }
+
+  bool operator==( const FileStamp& other ) const {
+    return size == other.size && modified == other.modified;
+  }
+
+  bool operator!=( const FileStamp& other ) const {
+    return !( *this == other );
+  }
+
+  uint64_t size;
+  int64_t modified;
+};
+
+/**
+   True if path exists and was modified no earlier than reference, compared
+   with the nanosecond modification times
+*/
+inline bool
+isUpToDate( const std::string& path, const std::string& reference ) {
+  struct stat st, refSt;
+  if ( stat( path.c_str(), &st ) != 0 ) {
+    return false;
+  }
+  if ( stat( reference.c_str(), &refSt ) != 0 ) {
+    return true;
+  }
+  return modificationTime( st ) >= modificationTime( refSt );
+}
+
+#endif
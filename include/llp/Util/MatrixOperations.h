@@ -1,6 +1,8 @@
 #ifndef __MatrixOperations_h
 #define __MatrixOperations_h
 
+#include <vector>
+
 
 /**
    Make a co-occurence matrix of the values in the sequences [begin1,end1) and
@@ -39,6 +41,79 @@ coOccurenceMatrix(InputIter1 begin1,
 }
 
 
+/**
+   Make a weighted co-occurence matrix of the values in the sequences
+   [begin1,end1) and [begin2,end2). The k'th pair of values has the weight
+   *(weights + k), so if value i and value j occur together at the positions
+   k in K, then out(i,j) == sum_{k in K} weights[k]. With unit weights this is
+   the same as the unweighted co-occurence matrix.
+
+   out should be initialied by the caller.
+
+   @param begin1    iterator to begining of sequence1
+   @param end1      iterator to end of sequence1
+   @param begin2    iterator to begining of sequence2
+   @param end2      iterator to end of sequence2
+   @param weights   iterator to begining of the weights of the pairs. There
+                    should be a weight for every pair
+   @param out       Matrix object that support operator()(i,j). Elements in out
+                    should support operator+=.
+ */
+template< typename TMatrix,
+	  typename InputIter1,
+	  typename InputIter2,
+	  typename WeightIter >
+TMatrix&
+coOccurenceMatrix(InputIter1 begin1,
+		  const InputIter1 end1,
+		  InputIter2 begin2,
+		  const InputIter2 end2,
+		  WeightIter weights,
+		  TMatrix& out ) {
+  while ( begin1 < end1 && begin2 < end2 ) {
+    out(*begin1++, *begin2++) += *weights++;
+  }
+  return out;
+}
+
+
+/**
+   Set row c of means to the weighted mean of the rows i of X that are in
+   group c, where row i is in group *(groups + i) and has weight
+   *(weights + i). Rows of means with no weight in their group are left as
+   they are.
+
+   @param X         Eigen matrix
+   @param groups    iterator to the group of each row of X. Groups should be
+                    integral values in [0, rows in means)
+   @param weights   iterator to the weight of each row of X
+   @param means     Eigen matrix with the same number of columns as X
+*/
+template< typename TEigenMatrix,
+	  typename InputIter,
+	  typename WeightIter >
+TEigenMatrix&
+weightedMeans( const TEigenMatrix& X,
+	       InputIter groups,
+	       WeightIter weights,
+	       TEigenMatrix& means ) {
+  TEigenMatrix sums = TEigenMatrix::Zero( means.rows(), means.cols() );
+  std::vector< typename TEigenMatrix::Scalar > totals( means.rows(), 0 );
+  for ( typename TEigenMatrix::Index i = 0; i < X.rows(); ++i ) {
+    const auto group = *groups++;
+    const auto weight = *weights++;
+    sums.row( group ) += weight * X.row( i );
+    totals[group] += weight;
+  }
+  for ( typename TEigenMatrix::Index c = 0; c < means.rows(); ++c ) {
+    if ( totals[c] > 0 ) {
+      means.row( c ) = sums.row( c ) / totals[c];
+    }
+  }
+  return means;
+}
+
+
 /**
    Normalize so each row sum to one
 */
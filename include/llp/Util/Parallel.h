@@ -0,0 +1,96 @@
+#ifndef __Parallel_h
+#define __Parallel_h
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+   Number of threads to use when the caller asks for numberOfThreads threads.
+   Zero means "as many as you like", in the same way as the cores search
+   parameter in flann.
+*/
+inline unsigned int
+resolveNumberOfThreads( unsigned int numberOfThreads ) {
+  if ( numberOfThreads == 0 ) {
+    numberOfThreads = std::thread::hardware_concurrency();
+  }
+  return std::max( 1u, numberOfThreads );
+}
+
+
+/**
+   Call fn(begin, end) for consecutive chunks [begin, end) of [0, n), each of at
+   most grain elements. Chunks are handed out dynamically to at most
+   numberOfThreads threads, including the calling thread.
+
+   fn must be safe to call concurrently on disjoint chunks. If fn throws, the
+   first exception is rethrown in the calling thread after all threads are
+   done.
+
+   @param n                Number of elements
+   @param grain            Maximum number of elements in a chunk
+   @param numberOfThreads  Maximum number of threads. 0 means hardware concurrency
+   @param fn               Callable with signature void(std::size_t, std::size_t)
+ */
+template< typename Function >
+void
+parallelFor( std::size_t n,
+	     std::size_t grain,
+	     unsigned int numberOfThreads,
+	     Function fn ) {
+  if ( n == 0 ) {
+    return;
+  }
+  grain = std::max< std::size_t >( 1, grain );
+  const std::size_t numberOfChunks = ( n + grain - 1 ) / grain;
+  const std::size_t threads =
+    std::min< std::size_t >( resolveNumberOfThreads( numberOfThreads ), numberOfChunks );
+
+  if ( threads <= 1 ) {
+    for ( std::size_t begin = 0; begin < n; begin += grain ) {
+      fn( begin, std::min( n, begin + grain ) );
+    }
+    return;
+  }
+
+  std::atomic< std::size_t > nextChunk( 0 );
+  std::exception_ptr error;
+  std::mutex errorMutex;
+
+  auto worker = [&]() {
+    try {
+      for ( std::size_t chunk = nextChunk++; chunk < numberOfChunks; chunk = nextChunk++ ) {
+	const std::size_t begin = chunk * grain;
+	fn( begin, std::min( n, begin + grain ) );
+      }
+    }
+    catch ( ... ) {
+      std::lock_guard< std::mutex > lock( errorMutex );
+      if ( !error ) {
+	error = std::current_exception();
+      }
+      // Make the other threads stop picking up work
+      nextChunk = numberOfChunks;
+    }
+  };
+
+  std::vector< std::thread > pool;
+  pool.reserve( threads - 1 );
+  for ( std::size_t i = 1; i < threads; ++i ) {
+    pool.emplace_back( worker );
+  }
+  worker();
+  for ( auto& t : pool ) {
+    t.join();
+  }
+
+  if ( error ) {
+    std::rethrow_exception( error );
+  }
+}
+
+#endif
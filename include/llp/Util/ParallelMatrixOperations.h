@@ -0,0 +1,289 @@
+#ifndef __ParallelMatrixOperations_h
+#define __ParallelMatrixOperations_h
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "llp/Util/MatrixOperations.h"
+#include "llp/Util/Parallel.h"
+
+/**
+   How parallelCoOccurenceMatrix splits the work
+
+   Automatic       Choose from the sizes and the order of the rows
+   Serial          Same as coOccurenceMatrix
+   RowBlocks       The rows are sorted, so the sequences are cut into blocks
+                   that do not share a row and each thread counts whole rows
+   ThreadPartials  Each thread counts a part of the sequences in its own
+                   matrix, and the matrices are summed pairwise in a tree.
+		   Only for counts, where the order of the additions does not
+		   change the sum
+   RowRanges       Each thread reads the whole sequences and counts the pairs
+                   of its own range of rows
+*/
+enum class CoOccurenceStrategy {
+  Automatic,
+  Serial,
+  RowBlocks,
+  ThreadPartials,
+  RowRanges
+};
+
+
+/**
+   Unit weight of every pair, for counting co-occurences with the weighted
+   code path
+*/
+struct CoOccurenceUnitWeights {
+  double operator*() const {
+    return 1;
+  }
+  double operator[]( std::ptrdiff_t ) const {
+    return 1;
+  }
+  CoOccurenceUnitWeights operator+( std::ptrdiff_t ) const {
+    return *this;
+  }
+  CoOccurenceUnitWeights& operator++() {
+    return *this;
+  }
+  CoOccurenceUnitWeights operator++( int ) {
+    return *this;
+  }
+};
+
+
+/**
+   The strategy parallelCoOccurenceMatrix uses for n pairs, a rows x cols
+   matrix and numberOfThreads threads.
+
+   Short sequences are counted serially. Sorted rows are cut into row blocks.
+   Otherwise counts use per thread matrices when all of them together are not
+   larger than the sequences, and weights and large matrices use row ranges,
+   which keep the order of the additions to every element.
+*/
+inline CoOccurenceStrategy
+chooseCoOccurenceStrategy( std::size_t n,
+			   std::size_t rows,
+			   std::size_t cols,
+			   bool sortedRows,
+			   bool weighted,
+			   unsigned int numberOfThreads ) {
+  const std::size_t minimumParallelPairs = 1 << 15;
+  const std::size_t threads = resolveNumberOfThreads( numberOfThreads );
+  if ( threads <= 1 || n < minimumParallelPairs ) {
+    return CoOccurenceStrategy::Serial;
+  }
+  if ( sortedRows ) {
+    return CoOccurenceStrategy::RowBlocks;
+  }
+  if ( !weighted && rows * cols * threads <= n ) {
+    return CoOccurenceStrategy::ThreadPartials;
+  }
+  return CoOccurenceStrategy::RowRanges;
+}
+
+
+/**
+   True if [begin, begin + n) is sorted in non-descending order. The check is
+   done in parallel.
+*/
+template< typename RandomIter >
+bool
+isSortedParallel( RandomIter begin, std::size_t n, unsigned int numberOfThreads ) {
+  const std::size_t grain = 1 << 16;
+  std::atomic< bool > sorted( true );
+  parallelFor( n, grain, numberOfThreads,
+	       [&]( std::size_t first, std::size_t last ) {
+		 // Each chunk also compares its first element with the one before
+		 const std::size_t from = first > 0 ? first - 1 : first;
+		 if ( sorted && !std::is_sorted( begin + from, begin + last ) ) {
+		   sorted = false;
+		 }
+	       } );
+  return sorted;
+}
+
+
+/**
+   Weighted co-occurence matrix of the pairs [from, to) of the sequences,
+   only counting the pairs with a row in [firstRow, lastRow)
+*/
+template< typename TMatrix,
+	  typename RandomIter1,
+	  typename RandomIter2,
+	  typename WeightIter >
+void
+coOccurenceRows( RandomIter1 begin1,
+		 RandomIter2 begin2,
+		 WeightIter weights,
+		 std::size_t from,
+		 std::size_t to,
+		 std::size_t firstRow,
+		 std::size_t lastRow,
+		 TMatrix& out ) {
+  for ( std::size_t k = from; k < to; ++k ) {
+    const std::size_t row = begin1[k];
+    if ( row >= firstRow && row < lastRow ) {
+      out( row, begin2[k] ) += weights[k];
+    }
+  }
+}
+
+
+/**
+   Parallel weighted co-occurence matrix of the values in the sequences
+   [begin1,end1) and [begin2,end2), see coOccurenceMatrix. The result is bit
+   for bit the same as the result of coOccurenceMatrix:
+   RowBlocks and RowRanges add the weights to each element of out in the same
+   order as coOccurenceMatrix, and ThreadPartials is only used for counts,
+   which are exact in any order.
+
+   [begin1,end1) should contain integral values in [0, out.rows()), and
+   [begin2,end2) integral values in [0, out.cols()). The iterators should be
+   random access.
+
+   @param begin1           iterator to begining of sequence1
+   @param end1             iterator to end of sequence1
+   @param begin2           iterator to begining of sequence2
+   @param end2             iterator to end of sequence2
+   @param weights          iterator to begining of the weights of the pairs
+   @param out              Matrix object with rows(), cols() and operator()(i,j)
+   @param numberOfThreads  Maximum number of threads. 0 means use all cores
+   @param strategy         How the work is split. Automatic chooses with
+                           chooseCoOccurenceStrategy
+ */
+template< typename TMatrix,
+	  typename RandomIter1,
+	  typename RandomIter2,
+	  typename WeightIter >
+typename std::enable_if< !std::is_arithmetic< TMatrix >::value, TMatrix& >::type
+parallelCoOccurenceMatrix( RandomIter1 begin1,
+			   const RandomIter1 end1,
+			   RandomIter2 begin2,
+			   const RandomIter2 end2,
+			   WeightIter weights,
+			   TMatrix& out,
+			   unsigned int numberOfThreads = 0,
+			   CoOccurenceStrategy strategy = CoOccurenceStrategy::Automatic ) {
+  const bool weighted = !std::is_same< WeightIter, CoOccurenceUnitWeights >::value;
+  const std::size_t n = std::max< std::ptrdiff_t >( 0, std::min< std::ptrdiff_t >( end1 - begin1, end2 - begin2 ) );
+  const std::size_t rows = out.rows();
+  const std::size_t cols = out.cols();
+  const std::size_t threads = resolveNumberOfThreads( numberOfThreads );
+
+  if ( strategy == CoOccurenceStrategy::Automatic ) {
+    const bool sortedRows = n > 0 && threads > 1 && isSortedParallel( begin1, n, numberOfThreads );
+    strategy = chooseCoOccurenceStrategy( n, rows, cols, sortedRows, weighted, numberOfThreads );
+  }
+  if ( strategy == CoOccurenceStrategy::ThreadPartials && weighted ) {
+    throw std::invalid_argument( "Per thread matrices are only bit identical for counts" );
+  }
+
+  switch ( strategy ) {
+  case CoOccurenceStrategy::RowBlocks: {
+    // Blocks of about the same number of pairs, moved forward so that a row
+    // is never split between two blocks
+    const std::size_t numberOfBlocks = std::max< std::size_t >( 1, std::min( n, 4 * threads ) );
+    std::vector< std::size_t > blockStart( 1, 0 );
+    for ( std::size_t b = 1; b < numberOfBlocks; ++b ) {
+      std::size_t start = std::max( blockStart.back(), b * n / numberOfBlocks );
+      while ( start > 0 && start < n && begin1[start] == begin1[start - 1] ) {
+	++start;
+      }
+      if ( start > blockStart.back() && start < n ) {
+	blockStart.push_back( start );
+      }
+    }
+    blockStart.push_back( n );
+    parallelFor( blockStart.size() - 1, 1, numberOfThreads,
+		 [&]( std::size_t first, std::size_t last ) {
+		   for ( std::size_t b = first; b < last; ++b ) {
+		     coOccurenceRows( begin1, begin2, weights, blockStart[b], blockStart[b + 1], 0, rows, out );
+		   }
+		 } );
+    break;
+  }
+
+  case CoOccurenceStrategy::ThreadPartials: {
+    typedef typename std::decay< decltype( out( 0, 0 ) ) >::type ValueType;
+    // A matrix for each part of the sequences, summed pairwise into the first
+    const std::size_t parts = std::max< std::size_t >( 1, std::min( n, threads ) );
+    const std::size_t partSize = ( n + parts - 1 ) / std::max< std::size_t >( 1, parts );
+    std::vector< std::vector< ValueType > > partials( parts, std::vector< ValueType >( rows * cols, 0 ) );
+    parallelFor( n, partSize, numberOfThreads,
+		 [&]( std::size_t first, std::size_t last ) {
+		   ValueType* partial = partials[first / partSize].data();
+		   for ( std::size_t k = first; k < last; ++k ) {
+		     ++partial[static_cast< std::size_t >( begin1[k] ) * cols + begin2[k]];
+		   }
+		 } );
+    for ( std::size_t stride = 1; stride < parts; stride *= 2 ) {
+      parallelFor( ( parts + 2 * stride - 1 ) / ( 2 * stride ), 1, numberOfThreads,
+		   [&]( std::size_t first, std::size_t last ) {
+		     for ( std::size_t p = first; p < last; ++p ) {
+		       const std::size_t to = 2 * stride * p;
+		       const std::size_t from = to + stride;
+		       if ( from < parts ) {
+			 for ( std::size_t e = 0; e < rows * cols; ++e ) {
+			   partials[to][e] += partials[from][e];
+			 }
+		       }
+		     }
+		   } );
+    }
+    if ( !partials.empty() ) {
+      for ( std::size_t i = 0; i < rows; ++i ) {
+	for ( std::size_t j = 0; j < cols; ++j ) {
+	  out( i, j ) += partials[0][i * cols + j];
+	}
+      }
+    }
+    break;
+  }
+
+  case CoOccurenceStrategy::RowRanges: {
+    const std::size_t ranges = std::max< std::size_t >( 1, std::min( rows, threads ) );
+    parallelFor( ranges, 1, numberOfThreads,
+		 [&]( std::size_t first, std::size_t last ) {
+		   for ( std::size_t r = first; r < last; ++r ) {
+		     coOccurenceRows( begin1, begin2, weights, 0, n,
+				      r * rows / ranges, ( r + 1 ) * rows / ranges, out );
+		   }
+		 } );
+    break;
+  }
+
+  default:
+    coOccurenceRows( begin1, begin2, weights, 0, n, 0, rows, out );
+    break;
+  }
+  return out;
+}
+
+
+/**
+   Parallel co-occurence matrix of the values in the sequences [begin1,end1)
+   and [begin2,end2), bit for bit the same as coOccurenceMatrix. See the
+   weighted parallelCoOccurenceMatrix for the parameters.
+ */
+template< typename TMatrix,
+	  typename RandomIter1,
+	  typename RandomIter2 >
+TMatrix&
+parallelCoOccurenceMatrix( RandomIter1 begin1,
+			   const RandomIter1 end1,
+			   RandomIter2 begin2,
+			   const RandomIter2 end2,
+			   TMatrix& out,
+			   unsigned int numberOfThreads = 0,
+			   CoOccurenceStrategy strategy = CoOccurenceStrategy::Automatic ) {
+  return parallelCoOccurenceMatrix( begin1, end1, begin2, end2, CoOccurenceUnitWeights(), out, numberOfThreads, strategy );
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef __ParseNumber_h
+#define __ParseNumber_h
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+/**
+   Parse a double from the characters in [begin, end), which need not be null
+   terminated.
+
+   Plain decimal numbers with at most 19 significant digits and a small
+   exponent are converted with a single exact multiplication or division
+   (Clinger's fast path), which gives the correctly rounded result without
+   going through strtod. Everything else, including inf and nan, is handed to
+   strtod, so the result is always the same as strtod in the C locale.
+
+   @param begin  First character of the number
+   @param end    End of the buffer
+   @param value  The parsed value
+   @return       Pointer past the parsed number, or begin if there is no number
+*/
+inline const char*
+parseDouble( const char* begin, const char* end, double& value ) {
+  static const double powersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const uint64_t maxExactMantissa = uint64_t( 1 ) << 53;
+
+  const char* p = begin;
+  bool negative = false;
+  if ( p < end && ( *p == '-' || *p == '+' ) ) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  uint64_t mantissa = 0;
+  int significantDigits = 0;
+  int exponent = 0;
+  bool anyDigits = false;
+  bool truncated = false;
+
+  for ( ; p < end && *p >= '0' && *p <= '9'; ++p ) {
+    anyDigits = true;
+    if ( significantDigits < 19 ) {
+      mantissa = mantissa * 10 + ( *p - '0' );
+      significantDigits += mantissa != 0;
+    }
+    else {
+      truncated = true;
+      ++exponent;
+    }
+  }
+  if ( p < end && *p == '.' ) {
+    for ( ++p; p < end && *p >= '0' && *p <= '9'; ++p ) {
+      anyDigits = true;
+      if ( significantDigits < 19 ) {
+	mantissa = mantissa * 10 + ( *p - '0' );
+	significantDigits += mantissa != 0;
+	--exponent;
+      }
+      else {
+	truncated = true;
+      }
+    }
+  }
+  if ( anyDigits && p < end && ( *p == 'e' || *p == 'E' ) ) {
+    const char* q = p + 1;
+    bool negativeExponent = false;
+    if ( q < end && ( *q == '-' || *q == '+' ) ) {
+      negativeExponent = *q == '-';
+      ++q;
+    }
+    if ( q < end && *q >= '0' && *q <= '9' ) {
+      int e = 0;
+      for ( ; q < end && *q >= '0' && *q <= '9'; ++q ) {
+	if ( e < 100000 ) {
+	  e = e * 10 + ( *q - '0' );
+	}
+      }
+      exponent += negativeExponent ? -e : e;
+      p = q;
+    }
+  }
+
+  if ( anyDigits && !truncated && mantissa <= maxExactMantissa && exponent >= -22 && exponent <= 22 ) {
+    double x = static_cast< double >( mantissa );
+    x = exponent < 0 ? x / powersOf10[-exponent] : x * powersOf10[exponent];
+    value = negative ? -x : x;
+    return p;
+  }
+
+  // Slow path. strtod needs a null terminated string.
+  std::string token( begin, anyDigits ? p : std::min( end, begin + 64 ) );
+  char* tokenEnd = nullptr;
+  value = std::strtod( token.c_str(), &tokenEnd );
+  return begin + ( tokenEnd - token.c_str() );
+}
+
+#endif
@@ -0,0 +1,363 @@
+#ifndef __PerfCounters_h
+#define __PerfCounters_h
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+  Hardware performance counters for the hot kernels.
+
+  Code marks a phase with
+    LLP_COUNT_PHASE( "predict" );
+  which counts cycles, instructions, cache misses and branch misses for the
+  rest of the enclosing scope and adds them to the PerfCounterTotals installed
+  on the current thread by a PerfCounterScope. Threads started inside the
+  scope, e.g. by parallelFor, are included.
+
+  The counters are only compiled in when LLP_PERF_COUNTERS is defined (cmake
+  option ENABLE_PERF_COUNTERS). They use Linux perf_event_open. When the
+  kernel does not allow it, e.g. because of perf_event_paranoid or in a
+  container, or for events the CPU does not have, nothing is counted and
+  PerfCounterGroup::Error() tells why.
+*/
+
+/**
+   Counts of the events in a PerfCounterGroup
+*/
+struct PerfCounterValues {
+  enum Event {
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_MISSES,
+    BRANCH_MISSES,
+    NumberOfEvents
+  };
+
+  PerfCounterValues() {
+    for ( int i = 0; i < NumberOfEvents; ++i ) {
+      counts[i] = 0;
+    }
+  }
+
+  static const char* EventName( int event ) {
+    static const char* names[] = { "cycles", "instructions", "cache-misses", "branch-misses" };
+    return names[event];
+  }
+
+  PerfCounterValues& operator+=( const PerfCounterValues& other ) {
+    for ( int i = 0; i < NumberOfEvents; ++i ) {
+      counts[i] += other.counts[i];
+    }
+    return *this;
+  }
+
+  /**
+     Counts from other to this. Counters never decrease, so the differences
+     are non-negative.
+  */
+  PerfCounterValues operator-( const PerfCounterValues& other ) const {
+    PerfCounterValues difference;
+    for ( int i = 0; i < NumberOfEvents; ++i ) {
+      difference.counts[i] = counts[i] >= other.counts[i] ? counts[i] - other.counts[i] : 0;
+    }
+    return difference;
+  }
+
+  std::uint64_t counts[NumberOfEvents];
+};
+
+
+/**
+   Counters for the calling thread and the threads it starts afterwards. The
+   counters run from construction, take differences of Read() to count a
+   span of work. Counters that cannot be opened read as zero.
+*/
+class PerfCounterGroup {
+public:
+  PerfCounterGroup()
+    : m_Error()
+  {
+    for ( int i = 0; i < PerfCounterValues::NumberOfEvents; ++i ) {
+      m_Fds[i] = -1;
+    }
+#ifdef __linux__
+    static const std::uint64_t configs[] = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES,
+      PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for ( int i = 0; i < PerfCounterValues::NumberOfEvents; ++i ) {
+      struct perf_event_attr attr;
+      std::memset( &attr, 0, sizeof( attr ) );
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof( attr );
+      attr.config = configs[i];
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      // Events are opened separately rather than as a group, because a group
+      // can not be inherited by new threads
+      m_Fds[i] = static_cast< int >( syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 ) );
+      if ( m_Fds[i] < 0 && m_Error.empty() ) {
+	m_Error = std::string( "Could not open " ) + PerfCounterValues::EventName( i ) +
+	  " counter: " + std::strerror( errno );
+      }
+    }
+#else
+    m_Error = "Performance counters need Linux perf_event_open";
+#endif
+  }
+
+  ~PerfCounterGroup() {
+#ifdef __linux__
+    for ( int i = 0; i < PerfCounterValues::NumberOfEvents; ++i ) {
+      if ( m_Fds[i] >= 0 ) {
+	close( m_Fds[i] );
+      }
+    }
+#endif
+  }
+
+  PerfCounterGroup( const PerfCounterGroup& ) = delete;
+  PerfCounterGroup& operator=( const PerfCounterGroup& ) = delete;
+
+  /**
+     True if any event is counted
+  */
+  bool Available() const {
+    for ( int i = 0; i < PerfCounterValues::NumberOfEvents; ++i ) {
+      if ( Available( i ) ) {
+	return true;
+      }
+    }
+    return false;
+  }
+
+  bool Available( int event ) const {
+    return m_Fds[event] >= 0;
+  }
+
+  /**
+     Why the first unavailable event could not be opened, or empty
+  */
+  const std::string& Error() const {
+    return m_Error;
+  }
+
+  /**
+     Counts since construction. When the kernel multiplexes more events than
+     the CPU has counters, counts are scaled up to the time the event was
+     enabled.
+  */
+  PerfCounterValues Read() const {
+    PerfCounterValues values;
+#ifdef __linux__
+    for ( int i = 0; i < PerfCounterValues::NumberOfEvents; ++i ) {
+      std::uint64_t data[3];   // Value, time enabled, time running
+      if ( m_Fds[i] < 0 || read( m_Fds[i], data, sizeof( data ) ) != static_cast< ssize_t >( sizeof( data ) ) ) {
+	continue;
+      }
+      if ( data[2] > 0 && data[2] < data[1] ) {
+	data[0] = static_cast< std::uint64_t >( static_cast< double >( data[0] ) * data[1] / data[2] );
+      }
+      values.counts[i] = data[0];
+    }
+#endif
+    return values;
+  }
+
+  /**
+     Counters of the calling thread, opened on first use
+  */
+  static PerfCounterGroup& ForCurrentThread() {
+    static thread_local PerfCounterGroup group;
+    return group;
+  }
+
+private:
+  int m_Fds[PerfCounterValues::NumberOfEvents];
+  std::string m_Error;
+};
+
+
+/**
+   Counter totals of named phases. Recording is thread-safe.
+*/
+class PerfCounterTotals {
+public:
+  struct Summary {
+    std::string phase;
+    std::size_t count;
+    PerfCounterValues total;
+    bool available[PerfCounterValues::NumberOfEvents];
+  };
+
+  PerfCounterTotals()
+    : m_Mutex()
+    , m_Phases()
+  {}
+
+  void Record( const std::string& phase, const PerfCounterValues& delta ) {
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    Phase& p = m_Phases[phase];
+    ++p.count;
+    p.total += delta;
+  }
+
+  bool Empty() const {
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    return m_Phases.empty();
+  }
+
+  void Clear() {
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    m_Phases.clear();
+  }
+
+  /**
+     Totals of each phase, ordered by phase name
+  */
+  std::vector< Summary > Summarize() const {
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    const PerfCounterGroup& group = PerfCounterGroup::ForCurrentThread();
+    std::vector< Summary > summaries;
+    for ( const auto& phase : m_Phases ) {
+      Summary summary;
+      summary.phase = phase.first;
+      summary.count = phase.second.count;
+      summary.total = phase.second.total;
+      for ( int i = 0; i < PerfCounterValues::NumberOfEvents; ++i ) {
+	summary.available[i] = group.Available( i );
+      }
+      summaries.push_back( summary );
+    }
+    return summaries;
+  }
+
+  /**
+     The PerfCounterTotals installed on the calling thread, or nullptr
+  */
+  static PerfCounterTotals*& Current() {
+    static thread_local PerfCounterTotals* current = nullptr;
+    return current;
+  }
+
+private:
+  struct Phase {
+    Phase()
+      : count( 0 )
+      , total()
+    {}
+
+    std::size_t count;
+    PerfCounterValues total;
+  };
+
+  mutable std::mutex m_Mutex;
+  std::map< std::string, Phase > m_Phases;
+};
+
+inline std::ostream&
+operator<<( std::ostream& os, const PerfCounterTotals::Summary& summary ) {
+  os << "count=" << summary.count;
+  for ( int i = 0; i < PerfCounterValues::NumberOfEvents; ++i ) {
+    if ( summary.available[i] ) {
+      os << ' ' << PerfCounterValues::EventName( i ) << '=' << summary.total.counts[i];
+    }
+  }
+  const std::uint64_t cycles = summary.total.counts[PerfCounterValues::CYCLES];
+  if ( summary.available[PerfCounterValues::CYCLES] &&
+       summary.available[PerfCounterValues::INSTRUCTIONS] &&
+       cycles > 0 ) {
+    os << " ipc=" << static_cast< double >( summary.total.counts[PerfCounterValues::INSTRUCTIONS] ) / cycles;
+  }
+  return os;
+}
+
+
+/**
+   Install totals as the PerfCounterTotals of the calling thread for the
+   lifetime of the scope
+*/
+class PerfCounterScope {
+public:
+  explicit PerfCounterScope( PerfCounterTotals& totals )
+    : m_Previous( PerfCounterTotals::Current() )
+  {
+    PerfCounterTotals::Current() = &totals;
+  }
+
+  ~PerfCounterScope() {
+    PerfCounterTotals::Current() = m_Previous;
+  }
+
+  PerfCounterScope( const PerfCounterScope& ) = delete;
+  PerfCounterScope& operator=( const PerfCounterScope& ) = delete;
+
+private:
+  PerfCounterTotals* m_Previous;
+};
+
+
+/**
+   Add the counts from construction to destruction as phase to the
+   PerfCounterTotals of the calling thread. Use LLP_COUNT_PHASE instead of
+   using this directly.
+*/
+class ScopedPerfCounters {
+public:
+  explicit ScopedPerfCounters( const char* phase )
+    : m_Totals( PerfCounterTotals::Current() )
+    , m_Phase( phase )
+    , m_Start()
+  {
+    // Nothing is recorded when no counters could be opened
+    if ( m_Totals != nullptr && !PerfCounterGroup::ForCurrentThread().Available() ) {
+      m_Totals = nullptr;
+    }
+    if ( m_Totals != nullptr ) {
+      m_Start = PerfCounterGroup::ForCurrentThread().Read();
+    }
+  }
+
+  ~ScopedPerfCounters() {
+    if ( m_Totals != nullptr ) {
+      m_Totals->Record( m_Phase, PerfCounterGroup::ForCurrentThread().Read() - m_Start );
+    }
+  }
+
+  ScopedPerfCounters( const ScopedPerfCounters& ) = delete;
+  ScopedPerfCounters& operator=( const ScopedPerfCounters& ) = delete;
+
+private:
+  PerfCounterTotals* m_Totals;
+  const char* m_Phase;
+  PerfCounterValues m_Start;
+};
+
+
+#define LLP_PERF_COUNTERS_CONCAT2( a, b ) a ## b
+#define LLP_PERF_COUNTERS_CONCAT( a, b ) LLP_PERF_COUNTERS_CONCAT2( a, b )
+
+#ifdef LLP_PERF_COUNTERS
+#define LLP_COUNT_PHASE( phase ) \
+  ScopedPerfCounters LLP_PERF_COUNTERS_CONCAT( llpPerfCounters, __LINE__ )( phase )
+#else
+#define LLP_COUNT_PHASE( phase ) static_cast< void >( 0 )
+#endif
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef __PhaseTimer_h
+#define __PhaseTimer_h
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+  Timing of the phases of the training objective.
+
+  Code marks a phase with
+    LLP_TIME_PHASE( "kmeans" );
+  which times the rest of the enclosing scope and records it in the
+  PhaseTimings installed on the current thread by a PhaseTimingScope. If no
+  PhaseTimings is installed nothing is recorded. A span listener set on the
+  PhaseTimings gets the start and end of every timed phase, e.g. to put the
+  phases on a timeline.
+
+  The timers are only compiled in when LLP_PHASE_TIMING is defined (cmake
+  option ENABLE_PHASE_TIMING). Otherwise LLP_TIME_PHASE expands to nothing, so
+  it costs nothing and the installed PhaseTimings stays empty.
+*/
+
+/**
+   Durations of named phases, summarized per phase as count, mean and
+   percentiles. Recording is thread-safe.
+*/
+class PhaseTimings {
+public:
+  typedef std::chrono::steady_clock ClockType;
+  typedef std::function< void( const std::string&, ClockType::time_point, ClockType::time_point ) > SpanListenerType;
+
+  struct Summary {
+    std::string phase;
+    std::size_t count;
+    double mean;   // Seconds
+    double p50;    // Seconds
+    double p99;    // Seconds
+  };
+
+  PhaseTimings()
+    : m_Mutex()
+    , m_Samples()
+    , m_SpanListener()
+  {}
+
+  void Record( const std::string& phase, double seconds ) {
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    m_Samples[phase].push_back( seconds );
+  }
+
+  /**
+     Record a phase that ran from start to end and pass it on to the span
+     listener
+  */
+  void Record( const std::string& phase, ClockType::time_point start, ClockType::time_point end ) {
+    const std::chrono::duration< double > elapsed = end - start;
+    Record( phase, elapsed.count() );
+    if ( m_SpanListener ) {
+      m_SpanListener( phase, start, end );
+    }
+  }
+
+  /**
+     Set a function that is called with every phase recorded with its start
+     and end. Set it before timing starts, it is not synchronized.
+  */
+  void SetSpanListener( const SpanListenerType& listener ) {
+    m_SpanListener = listener;
+  }
+
+  bool Empty() const {
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    return m_Samples.empty();
+  }
+
+  void Clear() {
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    m_Samples.clear();
+  }
+
+  /**
+     Summary of each phase, ordered by phase name. Percentiles use the
+     nearest-rank method.
+  */
+  std::vector< Summary > Summarize() const {
+    std::lock_guard< std::mutex > lock( m_Mutex );
+    std::vector< Summary > summaries;
+    for ( const auto& phase : m_Samples ) {
+      std::vector< double > samples( phase.second );
+      std::sort( samples.begin(), samples.end() );
+      double sum = 0;
+      for ( double s : samples ) {
+	sum += s;
+      }
+      Summary summary;
+      summary.phase = phase.first;
+      summary.count = samples.size();
+      summary.mean = sum / samples.size();
+      summary.p50 = Percentile( samples, 50 );
+      summary.p99 = Percentile( samples, 99 );
+      summaries.push_back( summary );
+    }
+    return summaries;
+  }
+
+  /**
+     The PhaseTimings installed on the calling thread, or nullptr
+  */
+  static PhaseTimings*& Current() {
+    static thread_local PhaseTimings* current = nullptr;
+    return current;
+  }
+
+private:
+  static double Percentile( const std::vector< double >& sorted, double percent ) {
+    std::size_t rank = static_cast< std::size_t >( percent / 100 * sorted.size() + 0.999999 );
+    rank = std::min( sorted.size(), std::max< std::size_t >( rank, 1 ) );
+    return sorted[rank - 1];
+  }
+
+  mutable std::mutex m_Mutex;
+  std::map< std::string, std::vector< double > > m_Samples;
+  SpanListenerType m_SpanListener;
+};
+
+inline std::ostream&
+operator<<( std::ostream& os, const PhaseTimings::Summary& summary ) {
+  os << "count=" << summary.count
+     << " mean=" << summary.mean
+     << "s p50=" << summary.p50
+     << "s p99=" << summary.p99 << 's';
+  return os;
+}
+
+
+/**
+   Install timings as the PhaseTimings of the calling thread for the lifetime
+   of the scope
+*/
+class PhaseTimingScope {
+public:
+  explicit PhaseTimingScope( PhaseTimings& timings )
+    : m_Previous( PhaseTimings::Current() )
+  {
+    PhaseTimings::Current() = &timings;
+  }
+
+  ~PhaseTimingScope() {
+    PhaseTimings::Current() = m_Previous;
+  }
+
+  PhaseTimingScope( const PhaseTimingScope& ) = delete;
+  PhaseTimingScope& operator=( const PhaseTimingScope& ) = delete;
+
+private:
+  PhaseTimings* m_Previous;
+};
+
+
+/**
+   Record the time from construction to destruction as phase in the
+   PhaseTimings of the calling thread. Use LLP_TIME_PHASE instead of using
+   this directly.
+*/
+class ScopedPhaseTimer {
+public:
+  typedef PhaseTimings::ClockType ClockType;
+
+  explicit ScopedPhaseTimer( const char* phase )
+    : m_Timings( PhaseTimings::Current() )
+    , m_Phase( phase )
+    , m_Start()
+  {
+    if ( m_Timings != nullptr ) {
+      m_Start = ClockType::now();
+    }
+  }
+
+  ~ScopedPhaseTimer() {
+    if ( m_Timings != nullptr ) {
+      m_Timings->Record( m_Phase, m_Start, ClockType::now() );
+    }
+  }
+
+  ScopedPhaseTimer( const ScopedPhaseTimer& ) = delete;
+  ScopedPhaseTimer& operator=( const ScopedPhaseTimer& ) = delete;
+
+private:
+  PhaseTimings* m_Timings;
+  const char* m_Phase;
+  ClockType::time_point m_Start;
+};
+
+
+#define LLP_PHASE_TIMER_CONCAT2( a, b ) a ## b
+#define LLP_PHASE_TIMER_CONCAT( a, b ) LLP_PHASE_TIMER_CONCAT2( a, b )
+
+#ifdef LLP_PHASE_TIMING
+#define LLP_TIME_PHASE( phase ) \
+  ScopedPhaseTimer LLP_PHASE_TIMER_CONCAT( llpPhaseTimer, __LINE__ )( phase )
+#else
+#define LLP_TIME_PHASE( phase ) static_cast< void >( 0 )
+#endif
+
+#endif
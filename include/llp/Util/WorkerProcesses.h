@@ -0,0 +1,281 @@
+#ifndef __WorkerProcesses_h
+#define __WorkerProcesses_h
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "llp/Util/MappedFile.h"
+
+/**
+   A fixed set of forked worker processes that run a task on request.
+
+   The workers are forked in the constructor. They see the memory of the
+   calling process as it was at that point, copy-on-write, so memory that
+   neither side writes, such as a dataset, is shared and never copied. Work
+   is handed to the workers and results are passed back through memory mapped
+   with MappedFile::Anonymous before the workers are started.
+
+   Run() wakes every worker with a process-shared semaphore, calls
+   task(worker) in each of them and returns when all are done. If a task
+   throws, Run throws std::runtime_error with its message. If a worker dies,
+   the workers are stopped and Run throws std::runtime_error.
+
+   Idle workers exit when the parent process exits, also when it did not get
+   to stop them. They check for a new parent process every 100 ms while they
+   wait for work. PR_SET_PDEATHSIG is not used, since it fires when the
+   thread that forked the workers exits, even if the process lives on, so
+   the workers can be made by any thread.
+
+   Linux only. Workers are forked from the calling thread only, so the task
+   must not depend on locks or state owned by other threads of the parent.
+*/
+class WorkerProcesses {
+public:
+  typedef std::function< void( std::size_t ) > TaskType;
+
+  /**
+     @param numberOfWorkers  Number of processes to fork
+     @param task             Called as task(worker) in worker number worker on
+                             every call of Run
+  */
+  WorkerProcesses( std::size_t numberOfWorkers, TaskType task )
+    : m_Control( MappedFile::Anonymous( sizeof( Control ) + numberOfWorkers * sizeof( Slot ) ) )
+    , m_NumberOfWorkers( numberOfWorkers )
+  {
+    Control* control = GetControl();
+    control->quit = 0;
+    if ( sem_init( &control->done, 1, 0 ) != 0 ) {
+      throw std::runtime_error( std::string( "Could not create semaphore: " ) + std::strerror( errno ) );
+    }
+    for ( std::size_t w = 0; w < m_NumberOfWorkers; ++w ) {
+      if ( sem_init( &GetSlot( w )->start, 1, 0 ) != 0 ) {
+	throw std::runtime_error( std::string( "Could not create semaphore: " ) + std::strerror( errno ) );
+      }
+    }
+
+    const pid_t parent = getpid();
+    for ( std::size_t w = 0; w < m_NumberOfWorkers; ++w ) {
+      const pid_t pid = fork();
+      if ( pid < 0 ) {
+	const int error = errno;
+	Kill();
+	throw std::runtime_error( std::string( "Could not fork worker process: " ) + std::strerror( error ) );
+      }
+      if ( pid == 0 ) {
+	Work( w, parent, task );
+      }
+      m_Pids.push_back( pid );
+    }
+  }
+
+  WorkerProcesses( const WorkerProcesses& ) = delete;
+  WorkerProcesses& operator=( const WorkerProcesses& ) = delete;
+
+  ~WorkerProcesses() {
+    Stop();
+    sem_destroy( &GetControl()->done );
+    for ( std::size_t w = 0; w < m_NumberOfWorkers; ++w ) {
+      sem_destroy( &GetSlot( w )->start );
+    }
+  }
+
+  std::size_t NumberOfWorkers() const {
+    return m_NumberOfWorkers;
+  }
+
+  /**
+     Run the task in every worker and wait until all are done
+  */
+  void Run() {
+    if ( m_Pids.empty() ) {
+      throw std::runtime_error( "Worker processes are stopped" );
+    }
+    Control* control = GetControl();
+    for ( std::size_t w = 0; w < m_NumberOfWorkers; ++w ) {
+      sem_post( &GetSlot( w )->start );
+    }
+    for ( std::size_t done = 0; done < m_NumberOfWorkers; ) {
+      const timespec deadline = Deadline( PollInterval );
+      if ( sem_timedwait( &control->done, &deadline ) == 0 ) {
+	++done;
+      }
+      else if ( errno == ETIMEDOUT && AnyWorkerExited() ) {
+	Kill();
+	throw std::runtime_error( "A worker process died" );
+      }
+    }
+    for ( std::size_t w = 0; w < m_NumberOfWorkers; ++w ) {
+      const Slot* slot = GetSlot( w );
+      if ( slot->failed ) {
+	throw std::runtime_error( "Worker process " + std::to_string( w ) + " failed: " + slot->message );
+      }
+    }
+  }
+
+  /**
+     Let the workers finish and wait for them to exit. Workers that have not
+     exited after timeout seconds, such as workers stuck in a task, are
+     killed.
+
+     @param timeout  Seconds to wait for the workers to exit
+  */
+  void Stop( double timeout = 5 ) {
+    if ( m_Pids.empty() ) {
+      return;
+    }
+    GetControl()->quit = 1;
+    for ( std::size_t w = 0; w < m_Pids.size(); ++w ) {
+      sem_post( &GetSlot( w )->start );
+    }
+
+    // waitpid has no timeout, so the workers are polled until the deadline
+    std::vector< pid_t > running( m_Pids );
+    const double deadline = Now() + timeout;
+    for (;;) {
+      running.erase( std::remove_if( running.begin(),
+				     running.end(),
+				     []( pid_t pid ) {
+				       int status;
+				       const pid_t result = waitpid( pid, &status, WNOHANG );
+				       return result > 0 || ( result < 0 && errno == ECHILD );
+				     } ),
+		     running.end() );
+      if ( running.empty() || Now() >= deadline ) {
+	break;
+      }
+      usleep( 1000 );
+    }
+    m_Pids.swap( running );
+    Kill();
+  }
+
+private:
+  // Milliseconds between checks for dead workers and a dead parent
+  static const long PollInterval = 100;
+
+  struct Control {
+    sem_t done;
+    volatile int quit;
+  };
+
+  struct Slot {
+    sem_t start;
+    volatile int failed;
+    char message[256];
+  };
+
+  Control* GetControl() {
+    return reinterpret_cast< Control* >( m_Control.Data() );
+  }
+
+  Slot* GetSlot( std::size_t worker ) {
+    return reinterpret_cast< Slot* >( m_Control.Data() + sizeof( Control ) ) + worker;
+  }
+
+  /*
+    Absolute CLOCK_REALTIME time in milliseconds from now, for sem_timedwait
+  */
+  static timespec Deadline( long milliseconds ) {
+    timespec deadline;
+    clock_gettime( CLOCK_REALTIME, &deadline );
+    deadline.tv_sec += milliseconds / 1000;
+    deadline.tv_nsec += ( milliseconds % 1000 ) * 1000000;
+    if ( deadline.tv_nsec >= 1000000000 ) {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+  }
+
+  /*
+    Monotonic time in seconds
+  */
+  static double Now() {
+    timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return now.tv_sec + now.tv_nsec * 1e-9;
+  }
+
+  /*
+    The loop of a worker process. It never returns.
+  */
+  void Work( std::size_t worker, pid_t parent, TaskType& task ) {
+    Control* control = GetControl();
+    Slot* slot = GetSlot( worker );
+    for (;;) {
+      // When the parent process exits the worker gets a new parent
+      for (;;) {
+	if ( getppid() != parent ) {
+	  _exit( 1 );
+	}
+	const timespec deadline = Deadline( PollInterval );
+	if ( sem_timedwait( &slot->start, &deadline ) == 0 ) {
+	  break;
+	}
+	if ( errno != ETIMEDOUT && errno != EINTR ) {
+	  _exit( 1 );
+	}
+      }
+      if ( control->quit ) {
+	_exit( 0 );
+      }
+      slot->failed = 0;
+      try {
+	task( worker );
+      }
+      catch ( const std::exception& e ) {
+	slot->failed = 1;
+	std::strncpy( slot->message, e.what(), sizeof( slot->message ) - 1 );
+      }
+      catch ( ... ) {
+	slot->failed = 1;
+	std::strncpy( slot->message, "unknown exception", sizeof( slot->message ) - 1 );
+      }
+      sem_post( &control->done );
+    }
+  }
+
+  bool AnyWorkerExited() {
+    for ( pid_t pid : m_Pids ) {
+      int status;
+      if ( waitpid( pid, &status, WNOHANG ) != 0 ) {
+	return true;
+      }
+    }
+    return false;
+  }
+
+  void Kill() {
+    for ( pid_t pid : m_Pids ) {
+      kill( pid, SIGKILL );
+    }
+    Wait();
+  }
+
+  void Wait() {
+    for ( pid_t pid : m_Pids ) {
+      int status;
+      while ( waitpid( pid, &status, 0 ) < 0 && errno == EINTR ) {}
+    }
+    m_Pids.clear();
+  }
+
+  MappedFile m_Control;
+  std::size_t m_NumberOfWorkers;
+  std::vector< pid_t > m_Pids;
+};
+
+#endif
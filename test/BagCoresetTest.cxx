@@ -0,0 +1,162 @@
+/*
+  Test BagCoreset
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bd/BaggedDataset.h"
+#include "Algorithms/BagCoreset.h"
+#include "Algorithms/MiniBatchKMeansInstanceClusterer.h"
+#include "Distances/EarthMoversDistance.h"
+#include "Distances/WeightedNxMDistance.h"
+
+class BagCoresetTest : public ::testing::Test {
+public:
+  typedef BaggedDataset< 1, 1 > BaggedDatasetType;
+  typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
+  typedef BagCoresetBuilder< BaggedDatasetType, DistanceType > BuilderType;
+  typedef BuilderType::ParameterType ParameterType;
+  typedef BuilderType::CoresetType CoresetType;
+
+  typedef BaggedDatasetType::MatrixType MatrixType;
+  typedef BaggedDatasetType::InstanceLabelVectorType InstanceLabelVectorType;
+  typedef BaggedDatasetType::BagLabelVectorType BagLabelVectorType;
+  typedef BaggedDatasetType::IndexVectorType IndexVectorType;
+
+protected:
+  virtual void SetUp() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<size_t> disBagSize(1, 400);
+    std::uniform_real_distribution<double> disProportion(0, 1);
+    std::uniform_real_distribution<double> disValue(0, 1);
+
+    // Bags of different sizes and proportions of instances from two well
+    // separated clusters, with their instances interleaved
+    std::vector< size_t > bagOfInstance;
+    std::vector< double > positiveOfInstance;
+    bagSizes.resize( numberOfBags );
+    BagLabelVectorType bagLabels( numberOfBags );
+    for ( size_t b = 0; b < numberOfBags; ++b ) {
+      bagSizes[b] = disBagSize( gen );
+      const size_t positives = static_cast< size_t >( disProportion( gen ) * bagSizes[b] );
+      bagLabels( b ) = static_cast< double >( positives ) / bagSizes[b];
+      for ( size_t i = 0; i < bagSizes[b]; ++i ) {
+	bagOfInstance.push_back( b );
+	positiveOfInstance.push_back( i < positives ? 1 : 0 );
+      }
+    }
+    std::vector< size_t > order( bagOfInstance.size() );
+    for ( size_t i = 0; i < order.size(); ++i ) {
+      order[i] = i;
+    }
+    std::shuffle( order.begin(), order.end(), gen );
+
+    MatrixType instances( order.size(), dimension );
+    IndexVectorType indices( order.size() );
+    InstanceLabelVectorType instanceLabels( order.size() );
+    for ( size_t i = 0; i < order.size(); ++i ) {
+      indices( i ) = bagOfInstance[order[i]];
+      instanceLabels( i ) = positiveOfInstance[order[i]];
+      for ( size_t j = 0; j < dimension; ++j ) {
+	instances( i, j ) = disValue( gen ) + ( instanceLabels( i ) > 0 ? 10 : 0 );
+      }
+    }
+    bags = BaggedDatasetType( instances, indices, bagLabels, instanceLabels );
+    weights.assign( 2, 0.5 );
+  }
+
+  static const size_t numberOfBags = 20;
+  static const size_t dimension = 8;
+  BaggedDatasetType bags;
+  std::vector< size_t > bagSizes;
+  std::vector< double > weights;
+};
+
+const size_t BagCoresetTest::numberOfBags;
+const size_t BagCoresetTest::dimension;
+
+
+TEST_F( BagCoresetTest, PreservesBags ) {
+  const DistanceType dist( weights.data(), weights.size() );
+  const CoresetType coreset = BuilderType( dist, ParameterType( 200, 3 ) ).Build( bags );
+
+  ASSERT_EQ( coreset.Size(), coreset.bags.NumberOfInstances() );
+  ASSERT_EQ( coreset.Size(), coreset.sourceIndices.size() );
+  ASSERT_LT( coreset.Size(), bags.NumberOfInstances() );
+  ASSERT_EQ( bags.BagLabels(), coreset.bags.BagLabels() );
+
+  // Every instance comes from the same bag of the full dataset, in the same
+  // order
+  for ( size_t i = 0; i < coreset.Size(); ++i ) {
+    const size_t source = coreset.sourceIndices[i];
+    if ( i > 0 ) {
+      ASSERT_LT( coreset.sourceIndices[i - 1], source );
+    }
+    ASSERT_EQ( bags.Indices()( source ), coreset.bags.Indices()( i ) );
+    ASSERT_EQ( bags.Instances().row( source ), coreset.bags.Instances().row( i ) );
+    ASSERT_EQ( bags.InstanceLabels()( source ), coreset.bags.InstanceLabels()( i ) );
+    ASSERT_GT( coreset.weights[i], 0 );
+  }
+
+  // Every bag keeps some instances and its weight
+  std::vector< size_t > counts( numberOfBags, 0 );
+  std::vector< double > bagWeights( numberOfBags, 0 );
+  for ( size_t i = 0; i < coreset.Size(); ++i ) {
+    ++counts[coreset.bags.Indices()( i )];
+    bagWeights[coreset.bags.Indices()( i )] += coreset.weights[i];
+  }
+  for ( size_t b = 0; b < numberOfBags; ++b ) {
+    ASSERT_GE( counts[b], std::min< size_t >( 1, bagSizes[b] ) ) << b;
+    ASSERT_NEAR( bagSizes[b], bagWeights[b], 1e-9 * bagSizes[b] ) << b;
+  }
+}
+
+TEST_F( BagCoresetTest, SmallDatasetIsKeptWhole ) {
+  const DistanceType dist( weights.data(), weights.size() );
+  const CoresetType coreset = BuilderType( dist, ParameterType( bags.NumberOfInstances() ) ).Build( bags );
+  ASSERT_EQ( bags.NumberOfInstances(), coreset.Size() );
+  ASSERT_EQ( bags.Instances(), coreset.bags.Instances() );
+  ASSERT_EQ( bags.Indices(), coreset.bags.Indices() );
+  ASSERT_EQ( std::vector< double >( coreset.Size(), 1 ), coreset.weights );
+}
+
+TEST_F( BagCoresetTest, Deterministic ) {
+  const DistanceType dist( weights.data(), weights.size() );
+  const CoresetType first = BuilderType( dist, ParameterType( 300, 1, 7 ) ).Build( bags );
+  const CoresetType second = BuilderType( dist, ParameterType( 300, 1, 7 ) ).Build( bags );
+  ASSERT_EQ( first.sourceIndices, second.sourceIndices );
+  ASSERT_EQ( first.weights, second.weights );
+}
+
+TEST_F( BagCoresetTest, EstimatesBagProportions ) {
+  const DistanceType dist( weights.data(), weights.size() );
+  const CoresetType coreset = BuilderType( dist, ParameterType( bags.NumberOfInstances() / 4, 100 ) ).Build( bags );
+
+  // Clustering the weighted coreset gives about the proportions of the two
+  // clusters in the full bags
+  typedef MiniBatchKMeansInstanceClusterer< BaggedDatasetType, DistanceType > ClustererType;
+  ClustererType clusterer( ClustererType::ParameterType( 2, coreset.Size() ) );
+  BaggedDatasetType coresetBags = coreset.bags;
+  auto clustering = clusterer.Cluster( coresetBags, dist, coreset.weights );
+  ASSERT_EQ( numberOfBags, clustering.NumberOfBags() );
+
+  const int first = clustering.clusterMembershipIndices[0];
+  const int positive = coreset.bags.InstanceLabels()( 0 ) > 0 ? first : 1 - first;
+  for ( size_t i = 0; i < coreset.Size(); ++i ) {
+    ASSERT_EQ( coreset.bags.InstanceLabels()( i ) > 0, clustering.clusterMembershipIndices[i] == positive ) << i;
+  }
+  for ( size_t b = 0; b < numberOfBags; ++b ) {
+    ASSERT_NEAR( bags.BagLabels()( b ), clustering.clusterBagMap( b, positive ), 0.25 ) << b;
+  }
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,195 @@
+/*
+  Test BagDistanceMatrix
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bd/BaggedDataset.h"
+#include "Algorithms/BagDistanceMatrix.h"
+#include "Distances/EarthMoversDistance.h"
+#include "Distances/Hausdorff.h"
+#include "Distances/WeightedNxMDistance.h"
+
+class BagDistanceMatrixTest : public ::testing::Test {
+public:
+  typedef BaggedDataset< 1, 1 > BaggedDatasetType;
+  typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
+  typedef BagDistanceMatrixEngine< DistanceType > EngineType;
+  typedef EngineType::ParameterType ParameterType;
+
+protected:
+  virtual void SetUp() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<size_t> disBags(1, 40);
+    std::uniform_int_distribution<size_t> disBagSize(1, 20);
+    std::uniform_int_distribution<size_t> disHistograms(1, 4);
+    std::uniform_int_distribution<size_t> disBins(1, 8);
+    std::uniform_real_distribution<double> disValue(0, 1);
+
+    // Bags of different sizes with their instances interleaved
+    const size_t numberOfBags = disBags( gen );
+    std::vector< size_t > bagOfInstance;
+    for ( size_t b = 0; b < numberOfBags; ++b ) {
+      bagOfInstance.insert( bagOfInstance.end(), disBagSize( gen ), b );
+    }
+    std::shuffle( bagOfInstance.begin(), bagOfInstance.end(), gen );
+
+    const size_t numberOfHistograms = disHistograms( gen );
+    const size_t dimension = numberOfHistograms * disBins( gen );
+    BaggedDatasetType::MatrixType instances( bagOfInstance.size(), dimension );
+    BaggedDatasetType::IndexVectorType indices( bagOfInstance.size() );
+    for ( size_t i = 0; i < bagOfInstance.size(); ++i ) {
+      indices[i] = bagOfInstance[i];
+      for ( size_t j = 0; j < dimension; ++j ) {
+	instances( i, j ) = disValue( gen );
+      }
+    }
+    bags = BaggedDatasetType( instances,
+			      indices,
+			      BaggedDatasetType::BagLabelVectorType::Zero( numberOfBags, 1 ),
+			      BaggedDatasetType::InstanceLabelVectorType::Zero( instances.rows(), 1 ) );
+    weights.resize( numberOfHistograms );
+    std::generate( weights.begin(), weights.end(), [&]{ return disValue( gen ); } );
+  }
+
+  std::vector< double > BagInstances( size_t bag ) const {
+    std::vector< double > instances;
+    for ( size_t k = 0; k < bags.NumberOfInstances(); ++k ) {
+      if ( bags.Indices()[k] == bag ) {
+	for ( size_t c = 0; c < bags.Dimension(); ++c ) {
+	  instances.push_back( bags.Instances()( k, c ) );
+	}
+      }
+    }
+    return instances;
+  }
+
+  // Hausdorff distance between bags i and j, one pair at a time
+  double Expected( size_t i, size_t j ) const {
+    const std::vector< double > x = BagInstances( i );
+    const std::vector< double > y = BagInstances( j );
+    return hausdorff( x.begin(), x.end(), y.begin(), y.end(), bags.Dimension(), DistanceType( weights.data(), weights.size() ) );
+  }
+
+  // Overwrite the diagonal element of the first bag in the matrix stored at
+  // path, to tell a reused matrix from a computed one
+  static void MarkStored( const std::string& path ) {
+    std::fstream file( path, std::ios::in | std::ios::out | std::ios::binary );
+    file.seekp( sizeof( BagDistanceMatrixHeader ) );
+    file.write( reinterpret_cast< const char* >( &Marker ), sizeof Marker );
+  }
+
+  static constexpr double Marker = 42;
+
+  BaggedDatasetType bags;
+  std::vector< double > weights;
+};
+
+constexpr double BagDistanceMatrixTest::Marker;
+
+
+TEST_F( BagDistanceMatrixTest, SameAsPairwise ) {
+  const DistanceType dist( weights.data(), weights.size() );
+  for ( size_t bagsPerTile : { 1, 3, 64 } ) {
+    for ( unsigned int threads : { 1, 4 } ) {
+      const BagDistanceMatrix matrix = EngineType( dist, ParameterType( bagsPerTile, threads ) ).Compute( bags );
+      ASSERT_EQ( bags.NumberOfBags(), matrix.NumberOfBags() );
+      ASSERT_FALSE( matrix.IsMapped() );
+      for ( size_t i = 0; i < bags.NumberOfBags(); ++i ) {
+	EXPECT_EQ( 0, matrix( i, i ) );
+	for ( size_t j = i + 1; j < bags.NumberOfBags(); ++j ) {
+	  EXPECT_NEAR( Expected( i, j ), matrix( i, j ), 1e-12 ) << i << ", " << j;
+	  EXPECT_EQ( matrix( i, j ), matrix( j, i ) );
+	}
+      }
+    }
+  }
+}
+
+TEST_F( BagDistanceMatrixTest, IndependentOfTiling ) {
+  const DistanceType dist( weights.data(), weights.size() );
+  const BagDistanceMatrix a = EngineType( dist, ParameterType( 1, 1 ) ).Compute( bags );
+  const BagDistanceMatrix b = EngineType( dist, ParameterType( 5, 3 ) ).Compute( bags );
+  ASSERT_EQ( a.Matrix(), b.Matrix() );
+}
+
+TEST_F( BagDistanceMatrixTest, StoredAndReused ) {
+  const std::string path = "BagDistanceMatrixTest.StoredAndReused.bdm";
+  std::remove( path.c_str() );
+  const DistanceType dist( weights.data(), weights.size() );
+  const ParameterType params( 4, 2, path );
+  const BagDistanceMatrix inMemory = EngineType( dist, ParameterType( 4, 2 ) ).Compute( bags );
+  {
+    BagDistanceMatrix computed = EngineType( dist, params ).Compute( bags );
+    ASSERT_TRUE( computed.IsMapped() );
+    ASSERT_EQ( bagDatasetFingerprint( bags ), computed.Fingerprint() );
+    ASSERT_EQ( bagDistanceKey( dist, "" ), computed.DistanceKey() );
+    ASSERT_EQ( inMemory.Matrix(), computed.Matrix() );
+  }
+
+  // The same dataset and distance reuse the stored matrix
+  MarkStored( path );
+  ASSERT_EQ( Marker, EngineType( dist, params ).Compute( bags )( 0, 0 ) );
+
+  // Different weights are computed again
+  std::vector< double > otherWeights( weights.size(), 100 );
+  const DistanceType otherDist( otherWeights.data(), otherWeights.size() );
+  ASSERT_NE( bagDistanceKey( dist, "" ), bagDistanceKey( otherDist, "" ) );
+  {
+    const BagDistanceMatrix recomputed = EngineType( otherDist, params ).Compute( bags );
+    ASSERT_EQ( 0, recomputed( 0, 0 ) );
+    ASSERT_EQ( EngineType( otherDist ).Compute( bags ).Matrix(), recomputed.Matrix() );
+  }
+
+  // So is a different tag
+  MarkStored( path );
+  const ParameterType tagged( 4, 2, path, HausdorffParameters(), "other" );
+  ASSERT_EQ( 0, EngineType( otherDist, tagged ).Compute( bags )( 0, 0 ) );
+
+  // And a different dataset
+  BaggedDatasetType::MatrixType instances = bags.Instances();
+  instances( 0, 0 ) += 1;
+  const BaggedDatasetType changed( instances, bags.Indices(), bags.BagLabels(), bags.InstanceLabels() );
+  const BagDistanceMatrix recomputed = EngineType( dist, params ).Compute( changed );
+  ASSERT_EQ( bagDatasetFingerprint( changed ), recomputed.Fingerprint() );
+  ASSERT_NE( bagDatasetFingerprint( bags ), recomputed.Fingerprint() );
+}
+
+TEST_F( BagDistanceMatrixTest, UnweightedDistanceNeedsTag ) {
+  typedef BagDistanceMatrixEngine< EarthMoversDistance > UnweightedEngineType;
+  const std::string path = "BagDistanceMatrixTest.UnweightedDistanceNeedsTag.bdm";
+  std::remove( path.c_str() );
+  const EarthMoversDistance dist;
+  const ParameterType untagged( 4, 2, path );
+  ASSERT_EQ( 0u, bagDistanceKey( dist, "" ) );
+  UnweightedEngineType( dist, untagged ).Compute( bags );
+  MarkStored( path );
+  ASSERT_EQ( 0, UnweightedEngineType( dist, untagged ).Compute( bags )( 0, 0 ) );
+
+  const ParameterType tagged( 4, 2, path, HausdorffParameters(), "emd" );
+  ASSERT_NE( 0u, bagDistanceKey( dist, "emd" ) );
+  UnweightedEngineType( dist, tagged ).Compute( bags );
+  MarkStored( path );
+  ASSERT_EQ( Marker, UnweightedEngineType( dist, tagged ).Compute( bags )( 0, 0 ) );
+}
+
+TEST_F( BagDistanceMatrixTest, OpenRejectsIncompleteFile ) {
+  const std::string path = "BagDistanceMatrixTest.OpenRejectsIncompleteFile.bdm";
+  {
+    MappedFile file = MappedFile::Create( path, sizeof( BagDistanceMatrixHeader ) + sizeof(double) );
+  }
+  ASSERT_THROW( BagDistanceMatrix::Open( path ), std::runtime_error );
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,136 @@
+/*
+  Test BaggedDatasetCache
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "gtest/gtest.h"
+
+#include "bd/BaggedDataset.h"
+#include "IO/BaggedDatasetCache.h"
+
+class BaggedDatasetCacheTest : public ::testing::Test {
+public:
+  typedef BaggedDataset< 2, 1 > BaggedDatasetType;
+  
+protected:
+  virtual void SetUp() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<size_t> disBags(1, 20);
+    std::uniform_int_distribution<size_t> disBagSize(1, 50);
+    std::uniform_int_distribution<size_t> disDimension(1, 33);
+    bags = BaggedDatasetType::Random( disBags( gen ), disBagSize( gen ), disDimension( gen ) );
+  }
+
+  BaggedDatasetType bags;
+};
+
+
+TEST_F( BaggedDatasetCacheTest, SaveMap ) {
+  std::string path = "BaggedDatasetCacheTest.SaveMap.llpbin";
+  saveBaggedDatasetCache( bags, path );
+
+  MappedBaggedDataset< BaggedDatasetType > mapped( path );
+  ASSERT_EQ( bags.NumberOfInstances(), mapped.NumberOfInstances() );
+  ASSERT_EQ( bags.NumberOfBags(), mapped.NumberOfBags() );
+  ASSERT_EQ( bags.Dimension(), mapped.Dimension() );
+  ASSERT_EQ( 0u, reinterpret_cast< uintptr_t >( mapped.Instances().data() ) % 64 );
+  ASSERT_EQ( bags.Instances(), mapped.Instances() );
+  ASSERT_EQ( bags.BagLabels(), mapped.BagLabels() );
+  ASSERT_EQ( bags.InstanceLabels(), mapped.InstanceLabels() );
+  for ( size_t i = 0; i < bags.NumberOfInstances(); ++i ) {
+    ASSERT_EQ( bags.Indices()[i], mapped.Indices()[i] );
+  }
+
+  BaggedDatasetType copy = mapped.ToBaggedDataset();
+  ASSERT_EQ( bags.Instances(), copy.Instances() );
+  ASSERT_EQ( bags.Indices(), copy.Indices() );
+  ASSERT_EQ( bags.BagLabels(), copy.BagLabels() );
+  ASSERT_EQ( bags.InstanceLabels(), copy.InstanceLabels() );
+}
+
+TEST_F( BaggedDatasetCacheTest, LoadPicksCache ) {
+  std::string path = "BaggedDatasetCacheTest.LoadPicksCache.llpbin";
+  saveBaggedDatasetCache( bags, path );
+  BaggedDatasetType loaded = loadBaggedDataset< BaggedDatasetType >( path );
+  ASSERT_EQ( bags.Instances(), loaded.Instances() );
+  ASSERT_EQ( bags.Indices(), loaded.Indices() );
+}
+
+TEST_F( BaggedDatasetCacheTest, LoadChecksSourceStamp ) {
+  // Two one-instance datasets of the same length
+  std::string path = "BaggedDatasetCacheTest.LoadChecksSourceStamp.csv";
+  {
+    std::ofstream os( path );
+    os << "bag,label0,label1,instanceLabel,f0\n1,0.5,0.6,0,3\n";
+  }
+  const FileStamp source = FileStamp::Of( path );
+  saveBaggedDatasetCache( bags, baggedDatasetCachePath( path ), source );
+  ASSERT_EQ( source, MappedBaggedDataset< BaggedDatasetType >( baggedDatasetCachePath( path ) ).Source() );
+  BaggedDatasetType loaded = loadBaggedDataset< BaggedDatasetType >( path, true );
+  ASSERT_EQ( bags.Instances(), loaded.Instances() );
+
+  // Rewritten in the same second as the cache, so the modification times in
+  // seconds do not tell the versions apart
+  {
+    std::ofstream os( path );
+    os << "bag,label0,label1,instanceLabel,f0\n1,0.5,0.6,0,2\n";
+  }
+  struct stat st;
+  ASSERT_EQ( 0, stat( baggedDatasetCachePath( path ).c_str(), &st ) );
+  struct timespec times[2];
+  times[0].tv_sec = times[1].tv_sec = st.st_mtim.tv_sec;
+  times[0].tv_nsec = times[1].tv_nsec = 0;
+  ASSERT_EQ( 0, utimensat( AT_FDCWD, path.c_str(), times, 0 ) );
+  ASSERT_NE( source, FileStamp::Of( path ) );
+
+  loaded = loadBaggedDataset< BaggedDatasetType >( path, true );
+  ASSERT_EQ( 1, loaded.NumberOfInstances() );
+  ASSERT_EQ( 2, loaded.Instances()( 0, 0 ) );
+}
+
+TEST_F( BaggedDatasetCacheTest, LoadWithoutTextFile ) {
+  std::string path = "BaggedDatasetCacheTest.LoadWithoutTextFile.csv";
+  {
+    std::ofstream os( path );
+    os << "bag,label0,label1,instanceLabel,f0\n1,0.5,0.6,0,3\n";
+  }
+  saveBaggedDatasetCache( bags, baggedDatasetCachePath( path ), FileStamp::Of( path ) );
+  ASSERT_EQ( 0, std::remove( path.c_str() ) );
+
+  BaggedDatasetType loaded = loadBaggedDataset< BaggedDatasetType >( path );
+  ASSERT_EQ( bags.Instances(), loaded.Instances() );
+  ASSERT_EQ( bags.Indices(), loaded.Indices() );
+}
+
+TEST_F( BaggedDatasetCacheTest, WrongLabelDimensionThrows ) {
+  std::string path = "BaggedDatasetCacheTest.WrongLabelDimension.llpbin";
+  saveBaggedDatasetCache( bags, path );
+  typedef MappedBaggedDataset< BaggedDataset< 1, 1 > > WrongMappedType;
+  ASSERT_THROW( WrongMappedType mapped( path ), std::runtime_error );
+}
+
+TEST_F( BaggedDatasetCacheTest, TruncatedThrows ) {
+  std::string path = "BaggedDatasetCacheTest.Truncated.llpbin";
+  saveBaggedDatasetCache( bags, path );
+  std::ifstream is( path, std::ios::binary );
+  std::string content( (std::istreambuf_iterator<char>( is )), std::istreambuf_iterator<char>() );
+  std::ofstream os( path, std::ios::binary );
+  os.write( content.data(), content.size() - 1 );
+  os.close();
+  ASSERT_THROW( MappedBaggedDataset< BaggedDatasetType > mapped( path ), std::runtime_error );
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
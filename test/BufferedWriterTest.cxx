@@ -0,0 +1,90 @@
+/*
+  Test BufferedWriter
+ */
+
+#include <cstring>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "Util/BufferedWriter.h"
+
+class BufferedWriterTest : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<double> disReal(-1e8, 1e8);
+    std::uniform_real_distribution<double> disUnit(0, 1);
+    std::uniform_int_distribution<long long> disInt(std::numeric_limits<long long>::min(),
+						    std::numeric_limits<long long>::max());
+    std::uniform_int_distribution<int> disSmall(-2000000, 2000000);
+
+    for ( size_t i = 0; i < 1000; ++i ) {
+      doubles.push_back( disReal( gen ) );
+      doubles.push_back( disUnit( gen ) );
+      doubles.push_back( disSmall( gen ) );
+      integers.push_back( disInt( gen ) );
+      integers.push_back( disSmall( gen ) );
+    }
+    double special[] = { 0.0, -0.0, 1.0, -1.0, 0.5, 1e-300, 999999, 1e6, -1e6, 123456789,
+			 std::numeric_limits<double>::infinity(),
+			 -std::numeric_limits<double>::infinity(),
+			 std::numeric_limits<double>::max(),
+			 std::numeric_limits<double>::lowest() };
+    doubles.insert( doubles.end(), std::begin( special ), std::end( special ) );
+    integers.push_back( 0 );
+    integers.push_back( std::numeric_limits<long long>::min() );
+    integers.push_back( std::numeric_limits<long long>::max() );
+  }
+
+  std::vector< double > doubles;
+  std::vector< long long > integers;
+};
+
+
+TEST_F( BufferedWriterTest, SameTextAsOstream ) {
+  std::ostringstream expected;
+  std::ostringstream actual;
+  {
+    // A tiny buffer to exercise flushing
+    BufferedWriter writer( actual, 40 );
+    for ( auto x : doubles ) {
+      expected << x << ',';
+      writer.WriteDouble( x ).Put( ',' );
+    }
+    for ( auto x : integers ) {
+      expected << x << '\n';
+      writer.WriteInteger( x ).Put( '\n' );
+    }
+    expected << "done";
+    writer.Write( std::string( "done" ) );
+  }
+  ASSERT_EQ( expected.str(), actual.str() );
+}
+
+TEST_F( BufferedWriterTest, Binary ) {
+  std::ostringstream actual;
+  {
+    BufferedWriter writer( actual, 40 );
+    for ( auto x : doubles ) {
+      writer.WriteBinary( x );
+    }
+  }
+  const std::string s = actual.str();
+  ASSERT_EQ( doubles.size() * sizeof(double), s.size() );
+  for ( size_t i = 0; i < doubles.size(); ++i ) {
+    double x;
+    std::memcpy( &x, s.data() + i * sizeof(double), sizeof(double) );
+    ASSERT_EQ( doubles[i], x );
+  }
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
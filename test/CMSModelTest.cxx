@@ -6,6 +6,8 @@
 #include <random>
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <vector>
 
 
 #include "gtest/gtest.h"
@@ -67,6 +69,36 @@ TEST_F( CMSModelTest, PredictClustersAsSelf ) {
   ASSERT_EQ( centroidLabels, bags.InstanceLabels() );
 }
 
+TEST_F( CMSModelTest, ConcurrentPredictMatchesPredict ) {
+  BaggedDatasetType bags = BaggedDatasetType::Random( 20, 50, dimension );
+  ModelType::Pointer model = ModelType::New( centroids, centroidLabels, weights );
+  model->Build( ModelType::SearchParameterType( 256*1024, 1024, 1 ) );
+  model->Predict( bags );
+
+  const size_t numberOfThreads = 4;
+  std::vector< std::vector< double > > labels( numberOfThreads,
+					       std::vector< double >( bags.NumberOfInstances() * InstanceLabelDim ) );
+  std::vector< std::thread > threads;
+  for ( size_t t = 0; t < numberOfThreads; ++t ) {
+    threads.emplace_back( [&, t]() {
+	// A small chunk size to exercise chunking
+	PredictionScratch scratch( 7 );
+	model->Predict( bags.Instances().data(), bags.NumberOfInstances(), labels[t].data(), scratch );
+      });
+  }
+  for ( auto& thread : threads ) {
+    thread.join();
+  }
+
+  for ( size_t t = 0; t < numberOfThreads; ++t ) {
+    for ( size_t i = 0; i < bags.NumberOfInstances(); ++i ) {
+      for ( size_t j = 0; j < InstanceLabelDim; ++j ) {
+	ASSERT_EQ( bags.InstanceLabels()(i,j), labels[t][i*InstanceLabelDim + j] );
+      }
+    }
+  }
+}
+
 TEST_F( CMSModelTest, LoadSave ) {
   std::string path = "CMSModelTest.LoadSave.model";
   ModelType::Pointer m1 = ModelType::New( centroids, centroidLabels, weights );
@@ -12,7 +12,10 @@
 
 #include "bd/BaggedDataset.h"
 
+#include "Algorithms/DeduplicatingInstanceClusterer.h"
 #include "Algorithms/KMeansInstanceClusterer.h"
+#include "Algorithms/MiniBatchKMeansInstanceClusterer.h"
+#include "Algorithms/ShardedInstanceClusterer.h"
 #include "Algorithms/GreedyBinaryClusterLabeler.h"
 #include "Algorithms/Trainers/CMSTrainer.h"
 #include "Distances/EarthMoversDistance.h"
@@ -125,6 +128,53 @@ TEST_F( CMSTrainerTest, EasyBags ) {
 }
 
 
+// Mini-batch k-means that records the seed of every unweighted clustering
+class SeedRecordingClusterer
+  : public MiniBatchKMeansInstanceClusterer< CMSTrainerTest::BaggedDatasetType, CMSTrainerTest::DistanceType > {
+public:
+  typedef MiniBatchKMeansInstanceClusterer< CMSTrainerTest::BaggedDatasetType, CMSTrainerTest::DistanceType > Super;
+
+  SeedRecordingClusterer( const ParameterType& params )
+    : Super( params )
+  {}
+
+  InstanceClusteringType Cluster( BaggedDatasetType& bags, const DistanceType& dist ) {
+    seeds.push_back( Parameters().seed );
+    return Super::Cluster( bags, dist );
+  }
+
+  static std::vector< unsigned int > seeds;
+};
+
+std::vector< unsigned int > SeedRecordingClusterer::seeds;
+
+TEST_F( CMSTrainerTest, FinalClusteringsAreReseeded ) {
+  typedef MiniBatchKMeansInstanceClusterer< BaggedDatasetType, DistanceType > MiniBatchType;
+  static_assert( HasSeed< MiniBatchType >::value, "Mini-batch k-means is seeded" );
+  static_assert( HasSeed< DeduplicatingInstanceClusterer< MiniBatchType > >::value, "Deduplication keeps the seed" );
+  static_assert( HasSeed< ShardedInstanceClusterer< MiniBatchType > >::value, "Sharding keeps the seed" );
+  static_assert( !HasSeed< ClustererType >::value, "flann k-means is not seeded" );
+
+  typedef CMSTrainer< BaggedDatasetType, SeedRecordingClusterer, LabelerType, SilentTracer > RecordingTrainerType;
+  const size_t finalNumberOfClusterings = 4;
+  const unsigned int seed = 7;
+  RecordingTrainerType trainer( CMSTrainerParameters( 2, "", 0.5, -1, 0, false, finalNumberOfClusterings ),
+				SeedRecordingClusterer::ParameterType( 2, 64, 100, 1e-3, 10, 4096, seed ) );
+  SeedRecordingClusterer::seeds.clear();
+  trainer.Train( bags, bags.Dimension() / 2 );
+
+  const std::vector< unsigned int >& seeds = SeedRecordingClusterer::seeds;
+  ASSERT_LT( finalNumberOfClusterings, seeds.size() );
+  // The optimization uses the same seed for every candidate
+  for ( size_t i = 0; i + finalNumberOfClusterings < seeds.size(); ++i ) {
+    ASSERT_EQ( seed, seeds[i] );
+  }
+  for ( size_t i = 0; i < finalNumberOfClusterings; ++i ) {
+    ASSERT_EQ( seed + i, seeds[seeds.size() - finalNumberOfClusterings + i] );
+  }
+}
+
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,119 @@
+/*
+  Test ClusterModel
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "Models/ClusterModel.h"
+#include "Distances/WeightedEarthMoversDistance2.h"
+#include "bd/BaggedDataset.h"
+
+class ClusterModelTest : public ::testing::Test {
+public:
+  typedef WeightedEarthMoversDistance2 DistanceFunctorType;
+  static const size_t InstanceLabelDim = 1;
+  static const size_t BagLabelDim = 1;
+  typedef BaggedDataset< BagLabelDim, InstanceLabelDim > BaggedDatasetType;
+  typedef ClusterModel< DistanceFunctorType, BaggedDatasetType > ModelType;
+  typedef ModelType::MatrixType MatrixType;
+  typedef typename ModelType::LabelVectorType LabelVectorType;
+
+protected:
+  virtual void SetUp() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<size_t> disCentroids(3, 50);
+    std::uniform_int_distribution<size_t> disFeatureSize(2, 20);
+    std::uniform_int_distribution<size_t> disWeights(1, 10);
+    std::uniform_int_distribution<int> disLabel(0, 1);
+
+    numberOfCentroids = disCentroids( gen );
+    numberOfWeights = disWeights( gen );
+    dimension = disFeatureSize( gen ) * numberOfWeights;
+
+    centroids = MatrixType::Random( numberOfCentroids, dimension );
+    centroidLabels = LabelVectorType( numberOfCentroids, InstanceLabelDim );
+    for ( size_t i = 0; i < numberOfCentroids; ++i ) {
+      centroidLabels(i) = disLabel( gen );
+    }
+    weights = std::vector< double >( numberOfWeights, 0.5 );
+    bags = BaggedDatasetType::Random( 10, 20, dimension );
+  }
+
+  MatrixType centroids;
+  LabelVectorType centroidLabels;
+  std::vector< double > weights;
+  BaggedDatasetType bags;
+  size_t numberOfCentroids, numberOfWeights, dimension;
+};
+
+
+TEST_F( ClusterModelTest, TopOneIsPredict ) {
+  ModelType::Pointer model = ModelType::New( centroids, centroidLabels, weights );
+  const size_t n = bags.NumberOfInstances();
+  std::vector< int > indices( n );
+  std::vector< double > distances( n ), softLabels( n );
+  model->PredictTopK( bags.Instances().data(), n, 1, indices.data(), distances.data(), softLabels.data() );
+  model->Predict( bags );
+  for ( size_t i = 0; i < n; ++i ) {
+    ASSERT_EQ( bags.InstanceLabels()(i), centroidLabels( indices[i] ) );
+    ASSERT_DOUBLE_EQ( bags.InstanceLabels()(i), softLabels[i] );
+  }
+}
+
+TEST_F( ClusterModelTest, SoftLabelsAreInRangeAndSorted ) {
+  ModelType::Pointer model = ModelType::New( centroids, centroidLabels, weights );
+  const size_t n = bags.NumberOfInstances();
+  const size_t k = 3;
+  std::vector< int > indices( n*k );
+  std::vector< double > distances( n*k ), softLabels( n );
+  model->PredictTopK( bags.Instances().data(), n, k, indices.data(), distances.data(), softLabels.data() );
+  for ( size_t i = 0; i < n; ++i ) {
+    ASSERT_TRUE( std::is_sorted( distances.begin() + i*k, distances.begin() + (i+1)*k ) );
+    ASSERT_GE( softLabels[i], 0 );
+    ASSERT_LE( softLabels[i], 1 );
+  }
+}
+
+TEST_F( ClusterModelTest, CentroidsGetTheirOwnSoftLabel ) {
+  ModelType::Pointer model = ModelType::New( centroids, centroidLabels, weights );
+  const size_t k = 3;
+  std::vector< int > indices( numberOfCentroids*k );
+  std::vector< double > distances( numberOfCentroids*k ), softLabels( numberOfCentroids );
+  model->PredictTopK( centroids.data(), numberOfCentroids, k, indices.data(), distances.data(), softLabels.data() );
+  for ( size_t i = 0; i < numberOfCentroids; ++i ) {
+    ASSERT_DOUBLE_EQ( centroidLabels(i), softLabels[i] );
+  }
+}
+
+TEST_F( ClusterModelTest, BagProportionsAreMeanOfInstanceLabels ) {
+  ModelType::Pointer model = ModelType::New( centroids, centroidLabels, weights );
+  const size_t nBags = bags.NumberOfBags();
+  std::vector< double > proportions( nBags ), errors( nBags );
+  // A small chunk size to exercise chunking
+  PredictionScratch scratch( 7 );
+  model->PredictBagProportions( bags, proportions.data(), errors.data(), scratch );
+
+  model->Predict( bags );
+  std::vector< double > expected( nBags, 0 );
+  std::vector< double > bagSizes( nBags, 0 );
+  for ( size_t i = 0; i < bags.NumberOfInstances(); ++i ) {
+    expected[ bags.Indices()[i] ] += bags.InstanceLabels()(i);
+    ++bagSizes[ bags.Indices()[i] ];
+  }
+  for ( size_t i = 0; i < nBags; ++i ) {
+    ASSERT_DOUBLE_EQ( expected[i] / bagSizes[i], proportions[i] );
+    ASSERT_DOUBLE_EQ( std::abs( proportions[i] - bags.BagLabels()(i) ), errors[i] );
+  }
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
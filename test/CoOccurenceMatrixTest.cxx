@@ -13,6 +13,9 @@
 #include "gtest/gtest.h"
 
 #include "Util/MatrixOperations.h"
+#include "Util/ParallelMatrixOperations.h"
+
+#include "WeightedInstancesTestHelpers.h"
 
 class CoOccurenceMatrixTest : public ::testing::Test {
 public:
@@ -93,6 +96,127 @@ TEST_F( CoOccurenceMatrixTest, DifferentSize ) {
   ASSERT_EQ( MatrixType::Zero( maxA+1, maxC+1 ), out );  
 }
 
+TEST_F( CoOccurenceMatrixTest, UnitWeightsGiveCounts ) {
+  const std::vector< double > weights( A.size(), 1 );
+  MatrixType counts = MatrixType::Zero( maxA+1, maxB+1 );
+  coOccurenceMatrix( A.cbegin(), A.cend(),
+		     B.cbegin(), B.cend(),
+		     counts );
+  MatrixType weighted = MatrixType::Zero( maxA+1, maxB+1 );
+  coOccurenceMatrix( A.cbegin(), A.cend(),
+		     B.cbegin(), B.cend(),
+		     weights.cbegin(),
+		     weighted );
+  ASSERT_EQ( counts, weighted );
+}
+
+TEST_F( CoOccurenceMatrixTest, DuplicatesAreWeightTwo ) {
+  const std::vector< size_t > rows = everyThirdDuplicatedRows( A.size() );
+  const std::vector< size_t > duplicatedA = selectElements( A, rows );
+  const std::vector< size_t > duplicatedB = selectElements( B, rows );
+  const std::vector< double > weights = everyThirdDuplicatedWeights( A.size() );
+
+  MatrixType counts = MatrixType::Zero( maxA+1, maxB+1 );
+  coOccurenceMatrix( duplicatedA.cbegin(), duplicatedA.cend(),
+		     duplicatedB.cbegin(), duplicatedB.cend(),
+		     counts );
+  MatrixType weighted = MatrixType::Zero( maxA+1, maxB+1 );
+  coOccurenceMatrix( A.cbegin(), A.cend(),
+		     B.cbegin(), B.cend(),
+		     weights.cbegin(),
+		     weighted );
+  ASSERT_EQ( counts, weighted );
+}
+
+TEST_F( CoOccurenceMatrixTest, SumsWeights ) {
+  // Each entry is the sum of the weights of its pairs, so fractional and zero
+  // weights are not rounded to counts
+  const std::vector< size_t > rows{ 0, 0, 1, 1, 1, 2 };
+  const std::vector< size_t > columns{ 1, 1, 0, 2, 2, 0 };
+  const std::vector< double > weights{ 0.25, 0.5, 1.5, 0, 0.125, 3 };
+  MatrixType weighted = MatrixType::Zero( 3, 3 );
+  coOccurenceMatrix( rows.cbegin(), rows.cend(),
+		     columns.cbegin(), columns.cend(),
+		     weights.cbegin(),
+		     weighted );
+  MatrixType expected = MatrixType::Zero( 3, 3 );
+  expected( 0, 1 ) = 0.75;
+  expected( 1, 0 ) = 1.5;
+  expected( 1, 2 ) = 0.125;
+  expected( 2, 0 ) = 3;
+  ASSERT_EQ( expected, weighted );
+}
+
+TEST_F( CoOccurenceMatrixTest, ParallelSameAsSerial ) {
+  std::mt19937 gen( 1 );
+  const size_t n = 100000;
+  const size_t rows = 50;
+  const size_t cols = 20;
+  std::uniform_int_distribution<size_t> disRow(0, rows - 1);
+  std::uniform_int_distribution<size_t> disCol(0, cols - 1);
+  std::uniform_real_distribution<double> disWeight(0, 1);
+  std::vector< size_t > unsortedRows( n ), sortedRows( n ), columns( n );
+  std::vector< double > weights( n );
+  std::generate( unsortedRows.begin(), unsortedRows.end(), [&]{ return disRow( gen ); } );
+  std::generate( columns.begin(), columns.end(), [&]{ return disCol( gen ); } );
+  std::generate( weights.begin(), weights.end(), [&]{ return disWeight( gen ); } );
+  sortedRows = unsortedRows;
+  std::sort( sortedRows.begin(), sortedRows.end() );
+
+  for ( const std::vector< size_t >* rowValues : { &unsortedRows, &sortedRows } ) {
+    const bool sorted = rowValues == &sortedRows;
+    MatrixType expectedCounts = MatrixType::Zero( rows, cols );
+    coOccurenceMatrix( rowValues->cbegin(), rowValues->cend(), columns.cbegin(), columns.cend(), expectedCounts );
+    MatrixType expectedWeighted = MatrixType::Zero( rows, cols );
+    coOccurenceMatrix( rowValues->cbegin(), rowValues->cend(), columns.cbegin(), columns.cend(), weights.cbegin(), expectedWeighted );
+
+    for ( CoOccurenceStrategy strategy : { CoOccurenceStrategy::Automatic,
+					   CoOccurenceStrategy::Serial,
+					   CoOccurenceStrategy::RowBlocks,
+					   CoOccurenceStrategy::ThreadPartials,
+					   CoOccurenceStrategy::RowRanges } ) {
+      if ( strategy == CoOccurenceStrategy::RowBlocks && !sorted ) {
+	continue;
+      }
+      for ( unsigned int threads : { 1, 3, 8 } ) {
+	MatrixType counts = MatrixType::Zero( rows, cols );
+	parallelCoOccurenceMatrix( rowValues->cbegin(), rowValues->cend(), columns.cbegin(), columns.cend(), counts, threads, strategy );
+	ASSERT_EQ( expectedCounts, counts ) << sorted << " " << static_cast< int >( strategy ) << " " << threads;
+
+	if ( strategy == CoOccurenceStrategy::ThreadPartials ) {
+	  MatrixType weighted = MatrixType::Zero( rows, cols );
+	  ASSERT_THROW( parallelCoOccurenceMatrix( rowValues->cbegin(), rowValues->cend(), columns.cbegin(), columns.cend(), weights.cbegin(), weighted, threads, strategy ),
+			std::invalid_argument );
+	  continue;
+	}
+	MatrixType weighted = MatrixType::Zero( rows, cols );
+	parallelCoOccurenceMatrix( rowValues->cbegin(), rowValues->cend(), columns.cbegin(), columns.cend(), weights.cbegin(), weighted, threads, strategy );
+	// Bit for bit the same sums
+	ASSERT_EQ( expectedWeighted, weighted ) << sorted << " " << static_cast< int >( strategy ) << " " << threads;
+      }
+    }
+  }
+}
+
+TEST_F( CoOccurenceMatrixTest, ParallelDifferentSize ) {
+  MatrixType expected = MatrixType::Zero( maxA+1, maxC+1 );
+  coOccurenceMatrix( A.cbegin(), A.cend(), C.cbegin(), C.cend(), expected );
+  for ( CoOccurenceStrategy strategy : { CoOccurenceStrategy::ThreadPartials, CoOccurenceStrategy::RowRanges } ) {
+    MatrixType out = MatrixType::Zero( maxA+1, maxC+1 );
+    parallelCoOccurenceMatrix( A.cbegin(), A.cend(), C.cbegin(), C.cend(), out, 4, strategy );
+    ASSERT_EQ( expected, out );
+  }
+}
+
+TEST_F( CoOccurenceMatrixTest, ChooseStrategy ) {
+  const size_t n = 1 << 20;
+  ASSERT_EQ( CoOccurenceStrategy::Serial, chooseCoOccurenceStrategy( n, 100, 10, true, false, 1 ) );
+  ASSERT_EQ( CoOccurenceStrategy::Serial, chooseCoOccurenceStrategy( 1000, 100, 10, false, false, 8 ) );
+  ASSERT_EQ( CoOccurenceStrategy::RowBlocks, chooseCoOccurenceStrategy( n, 100, 10, true, true, 8 ) );
+  ASSERT_EQ( CoOccurenceStrategy::ThreadPartials, chooseCoOccurenceStrategy( n, 100, 10, false, false, 8 ) );
+  ASSERT_EQ( CoOccurenceStrategy::RowRanges, chooseCoOccurenceStrategy( n, 100, 10, false, true, 8 ) );
+  ASSERT_EQ( CoOccurenceStrategy::RowRanges, chooseCoOccurenceStrategy( n, 100000, 100, false, false, 8 ) );
+}
 
 
 int main(int argc, char **argv) {
@@ -12,6 +12,8 @@
 
 #include "Losses/IntervalLosses.h"
 #include "Losses/IntervalRisk.h"
+#include "Losses/ScalarLosses.h"
+#include "Losses/ScalarRisk.h"
 #include "Algorithms/GreedyBinaryClusterLabeler.h"
 
 
@@ -89,6 +91,130 @@ TEST_F( GreedyBinaryClusterLabelerTest, UnitClusterBagMap ) {
 }
 
 
+TEST_F( GreedyBinaryClusterLabelerTest, AllClustersPositive ) {
+  auto instances = MatrixType::Zero(2,1);
+  auto instanceLabels = ClusterLabelVectorType::Zero(2);
+  IndexVectorType indices(2);
+  indices << 0, 1;
+  BagLabelVectorType bagLabels(2,2);
+  bagLabels <<  1, 1, 1, 1;
+  BaggedDatasetType bags( instances, indices, bagLabels, instanceLabels );
+  MatrixType clusterBagMap(2,2);
+  clusterBagMap << 1, 0, 0, 1;
+
+  for ( bool batched : { false, true } ) {
+    const Labeler::ParameterType params( batched );
+    Labeler labeler( params );
+    ClusterLabelVectorType clusterLabels(2);
+    ASSERT_EQ( 0, labeler.Label( bags, clusterBagMap, clusterLabels ) );
+    ASSERT_EQ( 1, clusterLabels(0) );
+    ASSERT_EQ( 1, clusterLabels(1) );
+  }
+}
+
+
+/*
+  A risk with only the call operator on predicted labels, and without const,
+  as the risks were before they could take the cluster to bag map
+*/
+template< typename TRisk >
+struct UnfusedRisk {
+  typedef typename TRisk::KnownLabelVectorType KnownLabelVectorType;
+  typedef typename TRisk::PredictedLabelVectorType PredictedLabelVectorType;
+
+  double operator()( const KnownLabelVectorType& knownLabels,
+		     const PredictedLabelVectorType& predictedLabels ) {
+    return risk( knownLabels, predictedLabels );
+  }
+
+  TRisk risk;
+};
+
+
+/*
+  Label random bags with TLabeler and TOtherLabeler, and expect the same
+  risk, and the same labeling when sameLabels is true
+*/
+template< typename TLabeler, typename TOtherLabeler >
+void expectSameLabeling( std::size_t nBags, std::size_t nClusters, std::mt19937& gen,
+			 const typename TLabeler::ParameterType& params,
+			 const typename TOtherLabeler::ParameterType& otherParams,
+			 double tolerance,
+			 bool sameLabels ) {
+  typedef typename TLabeler::BaggedDatasetType BaggedDatasetType;
+  typedef typename TLabeler::MatrixType MatrixType;
+  typedef typename TLabeler::BagLabelVectorType BagLabelVectorType;
+  typedef typename TLabeler::ClusterLabelVectorType ClusterLabelVectorType;
+  typedef typename BaggedDatasetType::IndexVectorType IndexVectorType;
+  std::uniform_real_distribution< double > dis( 0, 1 );
+
+  MatrixType clusterBagMap( nBags, nClusters );
+  for ( std::size_t i = 0; i < nBags; ++i ) {
+    for ( std::size_t j = 0; j < nClusters; ++j ) {
+      clusterBagMap( i, j ) = dis( gen );
+    }
+    clusterBagMap.row( i ) /= clusterBagMap.row( i ).sum();
+  }
+  BagLabelVectorType bagLabels( nBags, BagLabelVectorType::ColsAtCompileTime );
+  for ( std::size_t i = 0; i < nBags; ++i ) {
+    const double low = dis( gen );
+    bagLabels( i, 0 ) = low;
+    bagLabels( i, bagLabels.cols() - 1 ) = std::min( 1.0, low + 0.1 * dis( gen ) );
+  }
+  const BaggedDatasetType bags( MatrixType::Zero( nBags, 1 ),
+				IndexVectorType::Zero( nBags ),
+				bagLabels,
+				ClusterLabelVectorType::Zero( nBags ) );
+
+  TLabeler labeler( params );
+  TOtherLabeler other( otherParams );
+  ClusterLabelVectorType labels( nClusters ), otherLabels( nClusters );
+  const double risk = labeler.Label( bags, clusterBagMap, labels );
+  const double otherRisk = other.Label( bags, clusterBagMap, otherLabels );
+  if ( sameLabels ) {
+    ASSERT_EQ( labels, otherLabels );
+  }
+  ASSERT_NEAR( risk, otherRisk, tolerance );
+}
+
+template< typename TLabeler >
+void expectBatchedSameAsSequential( std::size_t nBags, std::size_t nClusters, std::mt19937& gen ) {
+  const typename TLabeler::ParameterType sequentialParams( false ), batchedParams( true );
+  expectSameLabeling< TLabeler, TLabeler >( nBags, nClusters, gen, sequentialParams, batchedParams, 1e-12, true );
+}
+
+template< typename TRisk, size_t BagLabelDim >
+void expectFusedSameAsUnfused( std::size_t nBags, std::size_t nClusters, std::mt19937& gen ) {
+  typedef GreedyBinaryClusterLabeler< UnfusedRisk< TRisk >, BagLabelDim > UnfusedLabeler;
+  typedef GreedyBinaryClusterLabeler< TRisk, BagLabelDim > FusedLabeler;
+  // The fused risks sum in a different order, so nearly equal candidates can
+  // be chosen differently, but the best risk must be the same
+  for ( bool batched : { false, true } ) {
+    const GreedyBinaryClusterLabelerParameters params( batched );
+    expectSameLabeling< UnfusedLabeler, FusedLabeler >( nBags, nClusters, gen, params, params, 1e-9, false );
+  }
+}
+
+TEST_F( GreedyBinaryClusterLabelerTest, BatchedSameAsSequential ) {
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  for ( int trial = 0; trial < 20; ++trial ) {
+    expectBatchedSameAsSequential< Labeler >( 300, 16, gen );
+    expectBatchedSameAsSequential< GreedyBinaryClusterLabeler< ScalarRisk< L1_ScalarLoss > > >( 300, 16, gen );
+    expectBatchedSameAsSequential< GreedyBinaryClusterLabeler< ScalarRisk< L2_ScalarLoss > > >( 300, 16, gen );
+  }
+}
+
+TEST_F( GreedyBinaryClusterLabelerTest, FusedSameAsUnfused ) {
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  for ( int trial = 0; trial < 20; ++trial ) {
+    expectFusedSameAsUnfused< Risk, 2 >( 300, 16, gen );
+    expectFusedSameAsUnfused< ScalarRisk< L1_ScalarLoss >, 1 >( 300, 16, gen );
+    expectFusedSameAsUnfused< ScalarRisk< L2_ScalarLoss >, 1 >( 300, 16, gen );
+  }
+}
+
 
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,210 @@
+/*
+  Test HausdorffDistance
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <random>
+#include <vector>
+
+#include <malloc.h>
+
+#include "gtest/gtest.h"
+
+#include "Distances/EarthMoversDistance.h"
+#include "Distances/Hausdorff.h"
+#include "Distances/WeightedEarthMoversDistance2.h"
+#include "Distances/WeightedNxMDistance.h"
+
+// Track the heap usage of the test, to check that the memory of the distance
+// does not grow with the product of the set sizes
+namespace {
+  std::atomic< std::size_t > allocatedBytes( 0 );
+  std::atomic< std::size_t > peakAllocatedBytes( 0 );
+}
+
+void* operator new( std::size_t size ) {
+  void* p = std::malloc( size );
+  if ( p == nullptr ) {
+    throw std::bad_alloc();
+  }
+  const std::size_t allocated = allocatedBytes += malloc_usable_size( p );
+  std::size_t peak = peakAllocatedBytes.load();
+  while ( peak < allocated && !peakAllocatedBytes.compare_exchange_weak( peak, allocated ) ) {}
+  return p;
+}
+
+void operator delete( void* p ) noexcept {
+  if ( p != nullptr ) {
+    allocatedBytes -= malloc_usable_size( p );
+    std::free( p );
+  }
+}
+
+class HausdorffTest : public ::testing::Test {
+public:
+  typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
+
+  // Counts the calls of the distance it wraps
+  struct CountingDistance {
+    typedef DistanceType::ResultType ResultType;
+
+    CountingDistance( const DistanceType& dist, std::size_t& count )
+      : dist( dist )
+      , count( count )
+    {}
+
+    template< typename Iter1, typename Iter2 >
+    ResultType operator()( Iter1 a, Iter2 b, std::size_t size ) const {
+      ++count;
+      return dist( a, b, size );
+    }
+
+    DistanceType dist;
+    std::size_t& count;
+  };
+
+protected:
+  virtual void SetUp() {
+    std::random_device rd;
+    gen.seed( rd() );
+    std::uniform_int_distribution<size_t> disHistograms(1, 4);
+    std::uniform_int_distribution<size_t> disBins(1, 16);
+    std::uniform_real_distribution<double> disValue(0, 1);
+    numberOfHistograms = disHistograms( gen );
+    dimension = numberOfHistograms * disBins( gen );
+    weights.resize( numberOfHistograms );
+    std::generate( weights.begin(), weights.end(), [&]{ return disValue( gen ); } );
+  }
+
+  std::vector< double > RandomSet( std::size_t n ) {
+    std::uniform_real_distribution<double> disValue(0, 1);
+    std::vector< double > set( n * dimension );
+    std::generate( set.begin(), set.end(), [&]{ return disValue( gen ); } );
+    return set;
+  }
+
+  // Brute force reference
+  template< typename TDistance >
+  double Reference( const std::vector< double >& x, const std::vector< double >& y, const TDistance& dist ) {
+    return std::max( DirectedReference( x, y, dist ), DirectedReference( y, x, dist ) );
+  }
+
+  template< typename TDistance >
+  double DirectedReference( const std::vector< double >& x, const std::vector< double >& y, const TDistance& dist ) {
+    double sup = std::numeric_limits< double >::lowest();
+    for ( std::size_t i = 0; i < x.size(); i += dimension ) {
+      double inf = std::numeric_limits< double >::max();
+      for ( std::size_t j = 0; j < y.size(); j += dimension ) {
+	inf = std::min( inf, dist( &x[i], &y[j], dimension ) );
+      }
+      sup = std::max( sup, inf );
+    }
+    return sup;
+  }
+
+  std::mt19937 gen;
+  std::size_t numberOfHistograms;
+  std::size_t dimension;
+  std::vector< double > weights;
+};
+
+
+TEST_F( HausdorffTest, SameAsBruteForce ) {
+  const DistanceType dist( weights.data(), weights.size() );
+  std::uniform_int_distribution<size_t> disSize(1, 100);
+  for ( std::size_t pivots : { 0, 1, 4, 200 } ) {
+    for ( unsigned int seed = 0; seed < 3; ++seed ) {
+      const std::vector< double > x = RandomSet( disSize( gen ) );
+      const std::vector< double > y = RandomSet( disSize( gen ) );
+      const HausdorffDistance< DistanceType > hausdorffDistance( dist, HausdorffParameters( pivots, seed ) );
+      EXPECT_NEAR( Reference( x, y, dist ),
+		   hausdorffDistance( x.begin(), x.end(), y.begin(), y.end(), dimension ),
+		   1e-12 )
+	<< "pivots " << pivots << ", seed " << seed;
+    }
+  }
+}
+
+TEST_F( HausdorffTest, SameAsBruteForceWeightedEarthMoversDistance2 ) {
+  const WeightedEarthMoversDistance2 dist( weights.data(), weights.size() );
+  const std::vector< double > x = RandomSet( 50 );
+  const std::vector< double > y = RandomSet( 70 );
+  for ( std::size_t pivots : { 0, 8 } ) {
+    EXPECT_NEAR( Reference( x, y, dist ),
+		 hausdorff( x.begin(), x.end(), y.begin(), y.end(), dimension, dist, HausdorffParameters( pivots ) ),
+		 1e-12 )
+      << "pivots " << pivots;
+  }
+}
+
+TEST_F( HausdorffTest, Identical ) {
+  const DistanceType dist( weights.data(), weights.size() );
+  const std::vector< double > x = RandomSet( 30 );
+  EXPECT_EQ( 0, hausdorff( x.begin(), x.end(), x.begin(), x.end(), dimension, dist ) );
+  EXPECT_EQ( 0, hausdorff( x.begin(), x.end(), x.begin(), x.end(), dimension, dist, HausdorffParameters( 4 ) ) );
+}
+
+TEST_F( HausdorffTest, EmptySets ) {
+  const DistanceType dist( weights.data(), weights.size() );
+  const std::vector< double > x = RandomSet( 5 );
+  const std::vector< double > empty;
+  EXPECT_EQ( std::numeric_limits< double >::lowest(),
+	     hausdorff( empty.begin(), empty.end(), empty.begin(), empty.end(), dimension, dist ) );
+  EXPECT_EQ( std::numeric_limits< double >::max(),
+	     hausdorff( x.begin(), x.end(), empty.begin(), empty.end(), dimension, dist ) );
+  EXPECT_EQ( std::numeric_limits< double >::max(),
+	     hausdorff( empty.begin(), empty.end(), x.begin(), x.end(), dimension, dist ) );
+}
+
+TEST_F( HausdorffTest, FewerEvaluations ) {
+  // Two sets of a similar distribution, where most points have a close
+  // neighbour in the other set
+  const std::size_t n = 200;
+  const std::vector< double > x = RandomSet( n );
+  const std::vector< double > y = RandomSet( n );
+  std::size_t count = 0;
+  const CountingDistance dist( DistanceType( weights.data(), weights.size() ), count );
+  const double expected = Reference( x, y, dist.dist );
+
+  std::size_t evaluations;
+  const HausdorffDistance< CountingDistance > hausdorffDistance( dist );
+  EXPECT_NEAR( expected, hausdorffDistance( x.begin(), x.end(), y.begin(), y.end(), dimension, evaluations ), 1e-12 );
+  EXPECT_EQ( count, evaluations );
+  EXPECT_LT( evaluations, n * n );
+
+  const HausdorffDistance< CountingDistance > indexed( dist, HausdorffParameters( 8 ) );
+  EXPECT_NEAR( expected, indexed( x.begin(), x.end(), y.begin(), y.end(), dimension, evaluations ), 1e-12 );
+  EXPECT_LT( evaluations, n * n );
+}
+
+TEST_F( HausdorffTest, MemoryIsLinear ) {
+  // A cache of all pairs would take close to a gigabyte
+  const std::size_t n = 10000;
+  numberOfHistograms = 1;
+  dimension = 8;
+  weights.assign( 1, 1.0 );
+  const std::vector< double > x = RandomSet( n );
+  const std::vector< double > y = RandomSet( n + 1 );
+  const DistanceType dist( weights.data(), weights.size() );
+  for ( std::size_t pivots : { 0, 4 } ) {
+    const HausdorffDistance< DistanceType > hausdorffDistance( dist, HausdorffParameters( pivots ) );
+    const std::size_t before = allocatedBytes.load();
+    peakAllocatedBytes = before;
+    std::size_t evaluations;
+    const double d = hausdorffDistance( x.begin(), x.end(), y.begin(), y.end(), dimension, evaluations );
+    EXPECT_LT( 0, d );
+    EXPECT_LT( evaluations, n * n / 10 );
+    EXPECT_LT( peakAllocatedBytes.load() - before, ( 4 + pivots ) * 2 * n * sizeof( double ) )
+      << "pivots " << pivots;
+  }
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,198 @@
+/*
+  Test InstanceDeduplication and DeduplicatingInstanceClusterer
+ */
+
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bd/BaggedDataset.h"
+#include "Algorithms/DeduplicatingInstanceClusterer.h"
+#include "Algorithms/InstanceDeduplication.h"
+#include "Algorithms/MiniBatchKMeansInstanceClusterer.h"
+#include "Distances/EarthMoversDistance.h"
+#include "Distances/WeightedNxMDistance.h"
+
+class InstanceDeduplicationTest : public ::testing::Test {
+public:
+  typedef BaggedDataset< 1, 1 > BaggedDatasetType;
+  typedef InstanceDeduplication< BaggedDatasetType > DeduplicationType;
+  typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
+
+  typedef BaggedDatasetType::MatrixType MatrixType;
+  typedef BaggedDatasetType::InstanceLabelVectorType InstanceLabelVectorType;
+  typedef BaggedDatasetType::BagLabelVectorType BagLabelVectorType;
+  typedef BaggedDatasetType::IndexVectorType IndexVectorType;
+
+protected:
+  virtual void SetUp() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<int> disLevel(0, 2);
+    std::uniform_int_distribution<size_t> disBag(0, numberOfBags - 1);
+
+    // Quantized instances in two well separated groups, so there are many
+    // copies of each instance within and across bags
+    MatrixType instances( numberOfInstances, dimension );
+    IndexVectorType indices( numberOfInstances );
+    InstanceLabelVectorType instanceLabels( numberOfInstances );
+    for ( size_t i = 0; i < numberOfInstances; ++i ) {
+      const bool positive = i % 2 == 0;
+      for ( size_t j = 0; j < dimension; ++j ) {
+	instances( i, j ) = disLevel( gen ) + ( positive ? 100 : 0 );
+      }
+      indices( i ) = disBag( gen );
+      instanceLabels( i ) = positive ? 1 : 0;
+    }
+    bags = BaggedDatasetType( instances, indices, BagLabelVectorType::Zero( numberOfBags ), instanceLabels );
+    weights.assign( 1, 0.5 );
+  }
+
+  static const size_t numberOfInstances = 1000;
+  static const size_t numberOfBags = 7;
+  static const size_t dimension = 4;
+  BaggedDatasetType bags;
+  std::vector< double > weights;
+};
+
+const size_t InstanceDeduplicationTest::numberOfInstances;
+const size_t InstanceDeduplicationTest::numberOfBags;
+const size_t InstanceDeduplicationTest::dimension;
+
+
+TEST_F( InstanceDeduplicationTest, FindsDistinctInstances ) {
+  const DeduplicationType deduplication( bags );
+  const MatrixType& unique = deduplication.UniqueInstances();
+  ASSERT_EQ( numberOfInstances, deduplication.NumberOfInstances() );
+  // There are 2 * 3^4 possible instances
+  ASSERT_LE( deduplication.NumberOfUniqueInstances(), 162u );
+
+  for ( size_t u = 0; u < deduplication.NumberOfUniqueInstances(); ++u ) {
+    for ( size_t v = u + 1; v < deduplication.NumberOfUniqueInstances(); ++v ) {
+      ASSERT_NE( unique.row( u ), unique.row( v ) );
+    }
+  }
+
+  // Every instance is a copy of its distinct instance, and the copies are
+  // counted per distinct instance and per bag
+  std::vector< double > multiplicities( deduplication.NumberOfUniqueInstances(), 0 );
+  std::map< std::pair< size_t, size_t >, double > bagCounts;
+  for ( size_t i = 0; i < numberOfInstances; ++i ) {
+    const size_t u = deduplication.UniqueOfInstance()[i];
+    ASSERT_EQ( bags.Instances().row( i ), unique.row( u ) );
+    ++multiplicities[u];
+    ++bagCounts[std::make_pair( bags.Indices()( i ), u )];
+    const size_t e = deduplication.EntryOfInstance()[i];
+    ASSERT_EQ( bags.Indices()( i ), deduplication.BagIndices()[e] );
+    ASSERT_EQ( u, deduplication.UniqueIndices()[e] );
+  }
+  ASSERT_EQ( multiplicities, deduplication.Multiplicities() );
+  ASSERT_EQ( bagCounts.size(), deduplication.BagCounts().size() );
+  for ( size_t e = 0; e < deduplication.BagCounts().size(); ++e ) {
+    const auto pair = std::make_pair( deduplication.BagIndices()[e], deduplication.UniqueIndices()[e] );
+    ASSERT_EQ( bagCounts[pair], deduplication.BagCounts()[e] );
+  }
+}
+
+TEST_F( InstanceDeduplicationTest, Expand ) {
+  const DeduplicationType deduplication( bags );
+  std::vector< int > uniqueValues( deduplication.NumberOfUniqueInstances() );
+  for ( size_t u = 0; u < uniqueValues.size(); ++u ) {
+    uniqueValues[u] = static_cast< int >( u ) * 3;
+  }
+  const std::vector< int > values = deduplication.Expand( uniqueValues );
+  ASSERT_EQ( numberOfInstances, values.size() );
+  for ( size_t i = 0; i < numberOfInstances; ++i ) {
+    ASSERT_EQ( 3 * static_cast< int >( deduplication.UniqueOfInstance()[i] ), values[i] );
+  }
+  ASSERT_THROW( deduplication.Expand( std::vector< int >( 1 ) ), std::invalid_argument );
+}
+
+TEST_F( InstanceDeduplicationTest, Fingerprint ) {
+  const DeduplicationType deduplication( bags );
+  ASSERT_EQ( DeduplicationType::Fingerprint( bags ), deduplication.Fingerprint() );
+
+  // A changed value or bag changes the fingerprint
+  MatrixType instances = bags.Instances();
+  instances( numberOfInstances - 1, dimension - 1 ) += 1;
+  const BaggedDatasetType changedInstance( instances, bags.Indices(), bags.BagLabels(), bags.InstanceLabels() );
+  ASSERT_NE( deduplication.Fingerprint(), DeduplicationType::Fingerprint( changedInstance ) );
+  IndexVectorType indices = bags.Indices();
+  indices( 0 ) = ( indices( 0 ) + 1 ) % numberOfBags;
+  const BaggedDatasetType changedBag( bags.Instances(), indices, bags.BagLabels(), bags.InstanceLabels() );
+  ASSERT_NE( deduplication.Fingerprint(), DeduplicationType::Fingerprint( changedBag ) );
+}
+
+TEST_F( InstanceDeduplicationTest, ClusteringSameAsAllInstances ) {
+  typedef MiniBatchKMeansInstanceClusterer< BaggedDatasetType, DistanceType > InstanceClustererType;
+  typedef DeduplicatingInstanceClusterer< InstanceClustererType > ClustererType;
+  const DistanceType dist( weights.data(), weights.size() );
+  const InstanceClustererType::ParameterType params( 2, numberOfInstances );
+
+  auto expected = InstanceClustererType( params ).Cluster( bags, dist );
+  ClustererType clusterer( params );
+  auto clustering = clusterer.Cluster( bags, dist );
+  ASSERT_LT( clusterer.Deduplication().NumberOfUniqueInstances(), numberOfInstances );
+
+  ASSERT_EQ( numberOfBags, clustering.NumberOfBags() );
+  ASSERT_EQ( numberOfInstances, clustering.clusterMembershipIndices.size() );
+  const bool swapped = clustering.clusterMembershipIndices[0] != expected.clusterMembershipIndices[0];
+  for ( int j = 0; j < 2; ++j ) {
+    const int other = swapped ? 1 - j : j;
+    ASSERT_TRUE( clustering.centroids.row( j ).isApprox( expected.centroids.row( other ), 1e-9 ) );
+    for ( size_t b = 0; b < numberOfBags; ++b ) {
+      ASSERT_NEAR( expected.clusterBagMap( b, other ), clustering.clusterBagMap( b, j ), 1e-12 );
+    }
+  }
+  for ( size_t i = 0; i < numberOfInstances; ++i ) {
+    ASSERT_EQ( expected.clusterMembershipIndices[i],
+	       swapped ? 1 - clustering.clusterMembershipIndices[i] : clustering.clusterMembershipIndices[i] );
+  }
+
+  // Instance weights are summed over the copies
+  auto weighted = clusterer.Cluster( bags, dist, std::vector< double >( numberOfInstances, 1 ) );
+  ASSERT_EQ( clustering.clusterMembershipIndices, weighted.clusterMembershipIndices );
+  ASSERT_TRUE( clustering.clusterBagMap.isApprox( weighted.clusterBagMap, 1e-12 ) );
+}
+
+TEST_F( InstanceDeduplicationTest, InvalidatedIsDeduplicatedAgain ) {
+  typedef MiniBatchKMeansInstanceClusterer< BaggedDatasetType, DistanceType > InstanceClustererType;
+  typedef DeduplicatingInstanceClusterer< InstanceClustererType > ClustererType;
+  const DistanceType dist( weights.data(), weights.size() );
+  const InstanceClustererType::ParameterType params( 2, numberOfInstances );
+  ClustererType clusterer( params );
+  clusterer.Cluster( bags, dist );
+
+  // Change the instances and bags in place, so the new dataset is at the
+  // same address and has the same size as the old one
+  double* instances = const_cast< double* >( bags.Instances().data() );
+  IndexVectorType::Scalar* indices = const_cast< IndexVectorType::Scalar* >( bags.Indices().data() );
+  for ( size_t i = 0; i < numberOfInstances; ++i ) {
+    instances[i * dimension] += i % 3;
+    indices[i] = i % numberOfBags;
+  }
+  clusterer.Invalidate();
+  auto clustering = clusterer.Cluster( bags, dist );
+  const DeduplicationType expectedDeduplication( bags );
+  ASSERT_EQ( expectedDeduplication.Fingerprint(), clusterer.Deduplication().Fingerprint() );
+  ASSERT_EQ( expectedDeduplication.UniqueOfInstance(), clusterer.Deduplication().UniqueOfInstance() );
+  ASSERT_EQ( expectedDeduplication.BagCounts(), clusterer.Deduplication().BagCounts() );
+
+  auto expected = InstanceClustererType( params ).Cluster( bags, dist );
+  const bool swapped = clustering.clusterMembershipIndices[0] != expected.clusterMembershipIndices[0];
+  for ( int j = 0; j < 2; ++j ) {
+    const int other = swapped ? 1 - j : j;
+    for ( size_t b = 0; b < numberOfBags; ++b ) {
+      ASSERT_NEAR( expected.clusterBagMap( b, other ), clustering.clusterBagMap( b, j ), 1e-12 );
+    }
+  }
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -3,6 +3,8 @@
  */
 
 
+#include <random>
+
 #include "gtest/gtest.h"
 
 #include "llp/Losses/IntervalRisk.h"
@@ -68,6 +70,35 @@ TEST_F( IntervalRiskTest, L1 ) {
   ASSERT_DOUBLE_EQ( sum/intervals.rows(), risk(intervals, points)  );
 }
 
+TEST_F( IntervalRiskTest, FusedSameAsPredicted ) {
+  typedef Eigen::Matrix< double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor > MatrixType;
+  const size_t nClusters = 5;
+  std::mt19937 gen( 0 );
+  std::uniform_real_distribution< double > dis( 0, 1 );
+  MatrixType clusterBagMap( intervals.rows(), nClusters );
+  for ( size_t i = 0; i < static_cast<size_t>(intervals.rows()); ++i ) {
+    for ( size_t j = 0; j < nClusters; ++j ) {
+      clusterBagMap( i, j ) = dis( gen );
+    }
+  }
+  // Labelings that give predictions both inside and outside the intervals
+  MatrixType labelings( nClusters, 3 );
+  labelings.col( 0 ).setConstant( 10 );
+  labelings.col( 1 ).setConstant( -10 );
+  labelings.col( 2 ) << 100, 0, -50, 20, 1;
+
+  Risk risk;
+  Risk::RiskVectorType risks;
+  risk.Risks( intervals, clusterBagMap, labelings, risks );
+  ASSERT_EQ( 3, risks.size() );
+  for ( size_t j = 0; j < 3; ++j ) {
+    const PointMatrix labeling = labelings.col( j );
+    const PointMatrix predicted = clusterBagMap * labeling;
+    ASSERT_NEAR( risk( intervals, predicted ), risk( intervals, clusterBagMap, labeling ), 1e-9 );
+    ASSERT_NEAR( risk( intervals, predicted ), risks( j ), 1e-9 );
+  }
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
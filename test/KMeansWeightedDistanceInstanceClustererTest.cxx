@@ -14,6 +14,8 @@
 #include "Distances/WeightedEarthMoversDistance2.h"
 #include "bd/BaggedDataset.h"
 
+#include "WeightedInstancesTestHelpers.h"
+
 class KMeansWeightedDistanceInstanceClustererTest : public ::testing::Test {
 public:
   typedef WeightedEarthMoversDistance2 DistanceType;
@@ -97,6 +99,53 @@ TEST_F( KMeansWeightedDistanceInstanceClustererTest, TwoClusters ) {
   }
 }
 
+TEST_F( KMeansWeightedDistanceInstanceClustererTest, DuplicatesAreWeightTwo ) {
+  const size_t n = instances.rows();
+  BaggedDatasetType bags( instances, bagMembershipIndices, bagLabels, instanceLabels );
+  const std::vector< size_t > rows = everyThirdDuplicatedRows( n );
+  BaggedDatasetType duplicated = selectInstances( bags, rows );
+
+  std::vector< double > weights( instances.cols(), 0.5 );
+  ParameterType params(2);
+  auto weighted = ClustererType( params ).Cluster( bags, weights.data(), weights.size(), everyThirdDuplicatedWeights( n ) );
+  // Unit weights give the weighted means of the duplicated instances
+  auto expected = ClustererType( params ).Cluster( duplicated, weights.data(), weights.size(), std::vector< double >( rows.size(), 1 ) );
+  assertSameTwoClusterings( expected, weighted, n );
+}
+
+TEST_F( KMeansWeightedDistanceInstanceClustererTest, CentroidsAreWeightedMeans ) {
+  // flann does not see the weights, so the centroids must be moved to the
+  // weighted means afterwards. Instances with weight zero are ignored.
+  const size_t n = instances.rows();
+  std::mt19937 gen( 1 );
+  std::uniform_real_distribution< double > disWeight( 0, 4 );
+  std::vector< double > instanceWeights( n );
+  for ( size_t i = 0; i < n; ++i ) {
+    instanceWeights[i] = i % 5 == 0 ? 0 : disWeight( gen );
+  }
+  BaggedDatasetType bags( instances, bagMembershipIndices, bagLabels, instanceLabels );
+  std::vector< double > weights( instances.cols(), 0.5 );
+  auto clustering = ClustererType( ParameterType(2) ).Cluster( bags, weights.data(), weights.size(), instanceWeights );
+
+  MatrixType sums = MatrixType::Zero( 2, instances.cols() );
+  std::vector< double > clusterWeights( 2, 0 );
+  MatrixType bagWeights = MatrixType::Zero( bagLabels.rows(), 2 );
+  for ( size_t i = 0; i < n; ++i ) {
+    const int c = clustering.clusterMembershipIndices[i];
+    sums.row( c ) += instanceWeights[i] * instances.row( i );
+    clusterWeights[c] += instanceWeights[i];
+    bagWeights( bagMembershipIndices( i ), c ) += instanceWeights[i];
+  }
+  for ( int c = 0; c < 2; ++c ) {
+    ASSERT_TRUE( ( sums.row( c ) / clusterWeights[c] ).isApprox( clustering.centroids.row( c ), 1e-9 ) );
+  }
+  for ( int b = 0; b < bagWeights.rows(); ++b ) {
+    for ( int c = 0; c < 2; ++c ) {
+      ASSERT_NEAR( bagWeights( b, c ) / bagWeights.row( b ).sum(), clustering.clusterBagMap( b, c ), 1e-12 );
+    }
+  }
+}
+
 
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
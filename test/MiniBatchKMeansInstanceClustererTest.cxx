@@ -0,0 +1,212 @@
+/*
+  Test MiniBatchKMeansInstanceClusterer
+ */
+
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "Algorithms/MiniBatchKMeansInstanceClusterer.h"
+#include "Distances/EarthMoversDistance.h"
+#include "Distances/WeightedNxMDistance.h"
+#include "bd/BaggedDataset.h"
+
+#include "WeightedInstancesTestHelpers.h"
+
+class MiniBatchKMeansInstanceClustererTest : public ::testing::Test {
+public:
+  typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
+  typedef BaggedDataset< 1, 1 > BaggedDatasetType;
+
+  typedef MiniBatchKMeansInstanceClusterer< BaggedDatasetType, DistanceType > ClustererType;
+  typedef ClustererType::ParameterType ParameterType;
+
+  typedef BaggedDatasetType::MatrixType MatrixType;
+  typedef BaggedDatasetType::InstanceLabelVectorType InstanceLabelVectorType;
+  typedef BaggedDatasetType::BagLabelVectorType BagLabelVectorType;
+  typedef BaggedDatasetType::IndexVectorType IndexVectorType;
+
+protected:
+  virtual void SetUp() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<double> disValue(-1, 1);
+    std::uniform_int_distribution<size_t> disIndex(0, numberOfBags - 1);
+
+    // Two well separated clusters, the first half is positive
+    instances = MatrixType( numberOfInstances, dimension );
+    instanceLabels = InstanceLabelVectorType::Zero( numberOfInstances );
+    for ( size_t i = 0; i < numberOfInstances; ++i ) {
+      const bool positive = i < numberOfInstances / 2;
+      for ( size_t j = 0; j < dimension; ++j ) {
+	instances( i, j ) = disValue( gen ) + ( positive ? -10 : 10 );
+      }
+      instanceLabels( i ) = positive ? 1 : 0;
+    }
+
+    bagMembershipIndices = IndexVectorType::Zero( numberOfInstances );
+    std::vector<size_t> bagSizes( numberOfBags, 0 );
+    bagLabels = BagLabelVectorType::Zero( numberOfBags );
+    for ( size_t i = 0; i < numberOfInstances; ++i ) {
+      auto idx = disIndex( gen );
+      bagMembershipIndices( i ) = idx;
+      ++bagSizes[idx];
+      bagLabels( idx ) += instanceLabels( i );
+    }
+    for ( size_t i = 0; i < numberOfBags; ++i ) {
+      bagLabels( i ) /= std::max< size_t >( 1, bagSizes[i] );
+    }
+    weights.assign( 1, 0.5 );
+  }
+
+  BaggedDatasetType Bags() const {
+    return BaggedDatasetType( instances, bagMembershipIndices, bagLabels, instanceLabels );
+  }
+
+  static const size_t numberOfInstances = 2000;
+  static const size_t numberOfBags = 10;
+  static const size_t dimension = 4;
+  MatrixType instances;
+  InstanceLabelVectorType instanceLabels;
+  IndexVectorType bagMembershipIndices;
+  BagLabelVectorType bagLabels;
+  std::vector< double > weights;
+};
+
+const size_t MiniBatchKMeansInstanceClustererTest::numberOfInstances;
+const size_t MiniBatchKMeansInstanceClustererTest::numberOfBags;
+const size_t MiniBatchKMeansInstanceClustererTest::dimension;
+
+
+TEST_F( MiniBatchKMeansInstanceClustererTest, TwoClustersFullBatch ) {
+  BaggedDatasetType bags = Bags();
+  ClustererType c( ParameterType( 2, numberOfInstances ) );
+  auto clustering = c.Cluster( bags, DistanceType( weights.data(), weights.size() ) );
+
+  ASSERT_EQ( 2u, clustering.NumberOfClusters() );
+  ASSERT_EQ( bags.NumberOfBags(), clustering.NumberOfBags() );
+  // A centroid is the mean of the instances assigned to it
+  auto expC1 = instances.topRows( numberOfInstances / 2 ).colwise().mean();
+  auto expC2 = instances.bottomRows( numberOfInstances / 2 ).colwise().mean();
+  auto c1 = clustering.centroids.row(0);
+  auto c2 = clustering.centroids.row(1);
+  if ( expC1.isApprox( c1, 1e-9 ) ) {
+    ASSERT_TRUE( expC2.isApprox( c2, 1e-9 ) );
+  }
+  else {
+    ASSERT_TRUE( expC1.isApprox( c2, 1e-9 ) );
+    ASSERT_TRUE( expC2.isApprox( c1, 1e-9 ) );
+  }
+
+  for ( int i = 0; i < clustering.clusterBagMap.rows(); ++i ) {
+    ASSERT_NEAR( 1.0, clustering.clusterBagMap.row(i).sum(), 1e-12 );
+  }
+}
+
+TEST_F( MiniBatchKMeansInstanceClustererTest, TwoClustersMiniBatches ) {
+  BaggedDatasetType bags = Bags();
+  ClustererType c( ParameterType( 2, 64, 200, 1e-3, 10, 32 ) );
+  auto clustering = c.Cluster( bags, DistanceType( weights.data(), weights.size() ) );
+  ASSERT_LE( c.NumberOfIterations(), 200u );
+
+  // Every instance ends up with the other instances of its class
+  const int positive = clustering.clusterMembershipIndices[0];
+  for ( size_t i = 0; i < numberOfInstances; ++i ) {
+    ASSERT_EQ( instanceLabels( i ) == 1, clustering.clusterMembershipIndices[i] == positive ) << i;
+  }
+
+  // The bag map gives the proportions of the bags
+  for ( size_t i = 0; i < numberOfBags; ++i ) {
+    ASSERT_NEAR( bagLabels( i ), clustering.clusterBagMap( i, positive ), 1e-12 );
+  }
+}
+
+TEST_F( MiniBatchKMeansInstanceClustererTest, AssignsNearestCentroid ) {
+  BaggedDatasetType bags = Bags();
+  const DistanceType dist( weights.data(), weights.size() );
+  ClustererType c( ParameterType( 7, 100, 20 ) );
+  auto clustering = c.Cluster( bags, dist );
+  for ( size_t i = 0; i < numberOfInstances; ++i ) {
+    double best = std::numeric_limits< double >::max();
+    int expected = -1;
+    for ( int j = 0; j < 7; ++j ) {
+      const double d = dist( instances.row(i).data(), clustering.centroids.row(j).data(), dimension );
+      if ( d < best ) {
+	best = d;
+	expected = j;
+      }
+    }
+    ASSERT_EQ( expected, clustering.clusterMembershipIndices[i] );
+  }
+}
+
+TEST_F( MiniBatchKMeansInstanceClustererTest, Deterministic ) {
+  BaggedDatasetType bags = Bags();
+  const DistanceType dist( weights.data(), weights.size() );
+  ParameterType params( 5, 50, 30 );
+  params.numberOfThreads = 1;
+  ClustererType c( params );
+  auto first = c.Cluster( bags, dist );
+  auto second = c.Cluster( bags, dist );
+  ASSERT_EQ( first.centroids, second.centroids );
+  ASSERT_EQ( first.clusterMembershipIndices, second.clusterMembershipIndices );
+
+  // The number of threads does not change the result
+  params.numberOfThreads = 4;
+  auto threaded = ClustererType( params ).Cluster( bags, dist );
+  ASSERT_EQ( first.centroids, threaded.centroids );
+  ASSERT_EQ( first.clusterMembershipIndices, threaded.clusterMembershipIndices );
+  ASSERT_EQ( first.clusterBagMap, threaded.clusterBagMap );
+}
+
+TEST_F( MiniBatchKMeansInstanceClustererTest, DuplicatesAreWeightTwo ) {
+  BaggedDatasetType bags = Bags();
+  BaggedDatasetType duplicated = selectInstances( bags, everyThirdDuplicatedRows( numberOfInstances ) );
+  const DistanceType dist( weights.data(), weights.size() );
+  ClustererType c( ParameterType( 2, 2 * numberOfInstances ) );
+  auto weighted = c.Cluster( bags, dist, everyThirdDuplicatedWeights( numberOfInstances ) );
+  auto expected = c.Cluster( duplicated, dist );
+  assertSameTwoClusterings( expected, weighted, numberOfInstances );
+}
+
+TEST_F( MiniBatchKMeansInstanceClustererTest, ZeroWeightsAreIgnored ) {
+  // Instances with weight zero are never drawn as initial centroids, do not
+  // move the centroids and do not count in the bag map, so the clustering is
+  // that of the remaining instances
+  BaggedDatasetType bags = Bags();
+  std::vector< double > instanceWeights( numberOfInstances, 1 );
+  std::vector< size_t > remaining;
+  for ( size_t i = 0; i < numberOfInstances; ++i ) {
+    if ( i % 3 == 1 ) {
+      instanceWeights[i] = 0;
+    }
+    else {
+      remaining.push_back( i );
+    }
+  }
+  const DistanceType dist( weights.data(), weights.size() );
+  ClustererType c( ParameterType( 2, numberOfInstances ) );
+  BaggedDatasetType remainingBags = selectInstances( bags, remaining );
+  auto weighted = c.Cluster( bags, dist, instanceWeights );
+  auto expected = c.Cluster( remainingBags, dist );
+  // The memberships are of different instances, so only compare the clusters
+  assertSameTwoClusterings( expected, weighted, 0 );
+}
+
+TEST_F( MiniBatchKMeansInstanceClustererTest, UnitWeights ) {
+  BaggedDatasetType bags = Bags();
+  const DistanceType dist( weights.data(), weights.size() );
+  ClustererType c( ParameterType( 5, 50, 30 ) );
+  auto unweighted = c.Cluster( bags, dist );
+  auto weighted = c.Cluster( bags, dist, std::vector< double >( numberOfInstances, 1 ) );
+  ASSERT_EQ( unweighted.clusterMembershipIndices, weighted.clusterMembershipIndices );
+  ASSERT_TRUE( unweighted.centroids.isApprox( weighted.centroids, 1e-12 ) );
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
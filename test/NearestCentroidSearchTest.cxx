@@ -0,0 +1,150 @@
+/*
+  Test NearestCentroidSearch
+ */
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "Algorithms/NearestCentroidSearch.h"
+#include "Distances/EarthMoversDistance.h"
+#include "Distances/WeightedNxMDistance.h"
+
+class NearestCentroidSearchTest : public ::testing::Test {
+public:
+  typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
+  typedef NearestCentroidSearch< DistanceType > SearchType;
+  typedef SearchType::ParameterType ParameterType;
+
+protected:
+  virtual void SetUp() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<size_t> disInstances(1, 2000);
+    std::uniform_int_distribution<size_t> disCentroids(1, 300);
+    std::uniform_int_distribution<size_t> disHistograms(1, 8);
+    std::uniform_int_distribution<size_t> disBins(1, 16);
+    std::uniform_real_distribution<double> disValue(0, 1);
+
+    numberOfInstances = disInstances( gen );
+    numberOfCentroids = disCentroids( gen );
+    numberOfHistograms = disHistograms( gen );
+    dimension = numberOfHistograms * disBins( gen );
+
+    instances.resize( numberOfInstances * dimension );
+    centroids.resize( numberOfCentroids * dimension );
+    weights.resize( numberOfHistograms );
+    std::generate( instances.begin(), instances.end(), [&]{ return disValue( gen ); } );
+    std::generate( centroids.begin(), centroids.end(), [&]{ return disValue( gen ); } );
+    std::generate( weights.begin(), weights.end(), [&]{ return disValue( gen ); } );
+
+    // Brute force reference
+    DistanceType dist( weights.data(), weights.size() );
+    expectedIndices.resize( numberOfInstances );
+    expectedDistances.resize( numberOfInstances );
+    for ( size_t i = 0; i < numberOfInstances; ++i ) {
+      double best = std::numeric_limits< double >::infinity();
+      for ( size_t j = 0; j < numberOfCentroids; ++j ) {
+	double d = dist( &instances[i*dimension], &centroids[j*dimension], dimension );
+	if ( d < best ) {
+	  best = d;
+	  expectedIndices[i] = static_cast< int >( j );
+	}
+      }
+      expectedDistances[i] = best;
+    }
+  }
+
+  void Check( const ParameterType& params ) {
+    SearchType search( centroids.data(),
+		       numberOfCentroids,
+		       dimension,
+		       DistanceType( weights.data(), weights.size() ),
+		       params );
+    std::vector< int > indices( numberOfInstances, -1 );
+    std::vector< double > distances( numberOfInstances, -1 );
+    search.Search( instances.data(), numberOfInstances, indices.data(), distances.data() );
+    ASSERT_EQ( expectedIndices, indices );
+    ASSERT_EQ( expectedDistances, distances );
+  }
+
+  size_t numberOfInstances, numberOfCentroids, numberOfHistograms, dimension;
+  std::vector< double > instances, centroids, weights;
+  std::vector< int > expectedIndices;
+  std::vector< double > expectedDistances;
+};
+
+
+TEST_F( NearestCentroidSearchTest, DefaultParameters ) {
+  Check( ParameterType() );
+}
+
+TEST_F( NearestCentroidSearchTest, SingleThread ) {
+  Check( ParameterType( 256*1024, 1024, 1 ) );
+}
+
+TEST_F( NearestCentroidSearchTest, TinyBlocksManyThreads ) {
+  Check( ParameterType( 1, 7, 8 ) );
+}
+
+TEST_F( NearestCentroidSearchTest, CentroidsFindThemselves ) {
+  SearchType search( centroids.data(),
+		     numberOfCentroids,
+		     dimension,
+		     DistanceType( weights.data(), weights.size() ) );
+  std::vector< int > indices( numberOfCentroids );
+  std::vector< double > distances( numberOfCentroids );
+  search.Search( centroids.data(), numberOfCentroids, indices.data(), distances.data() );
+  for ( size_t j = 0; j < numberOfCentroids; ++j ) {
+    ASSERT_EQ( 0, distances[j] );
+    ASSERT_LE( indices[j], static_cast< int >( j ) ) << "Ties must go to the lowest index";
+  }
+}
+
+TEST_F( NearestCentroidSearchTest, TopK ) {
+  DistanceType dist( weights.data(), weights.size() );
+  SearchType search( centroids.data(), numberOfCentroids, dimension, dist, ParameterType( 1, 7, 8 ) );
+  const size_t k = 5;
+  std::vector< int > indices( numberOfInstances * k );
+  std::vector< double > distances( numberOfInstances * k );
+  search.Search( instances.data(), numberOfInstances, k, indices.data(), distances.data() );
+
+  for ( size_t i = 0; i < numberOfInstances; ++i ) {
+    std::vector< std::pair< double, int > > all;
+    for ( size_t j = 0; j < numberOfCentroids; ++j ) {
+      all.push_back( std::make_pair( dist( &instances[i*dimension], &centroids[j*dimension], dimension ),
+				     static_cast< int >( j ) ) );
+    }
+    std::sort( all.begin(), all.end() );
+    ASSERT_EQ( expectedIndices[i], indices[i*k] );
+    for ( size_t n = 0; n < k; ++n ) {
+      if ( n < numberOfCentroids ) {
+	ASSERT_EQ( all[n].second, indices[i*k + n] );
+	ASSERT_EQ( all[n].first, distances[i*k + n] );
+      }
+      else {
+	ASSERT_EQ( -1, indices[i*k + n] );
+	ASSERT_EQ( std::numeric_limits< double >::infinity(), distances[i*k + n] );
+      }
+    }
+  }
+}
+
+TEST_F( NearestCentroidSearchTest, NoCentroidsThrows ) {
+  SearchType search( centroids.data(),
+		     0,
+		     dimension,
+		     DistanceType( weights.data(), weights.size() ) );
+  std::vector< int > indices( numberOfInstances );
+  ASSERT_THROW( search.Search( instances.data(), numberOfInstances, indices.data(), nullptr ),
+		std::logic_error );
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
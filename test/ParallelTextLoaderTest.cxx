@@ -0,0 +1,167 @@
+/*
+  Test ParallelTextLoader and parseDouble
+ */
+
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "bd/BaggedDataset.h"
+#include "IO/ParallelTextLoader.h"
+#include "Util/ParseNumber.h"
+
+class ParallelTextLoaderTest : public ::testing::Test {
+public:
+  typedef BaggedDataset< 2, 1 > BaggedDatasetType;
+  typedef ParallelTextLoader< BaggedDatasetType > LoaderType;
+  typedef LoaderType::ParameterType ParameterType;
+
+protected:
+  virtual void SetUp() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<size_t> disBags(1, 20);
+    std::uniform_int_distribution<size_t> disBagSize(1, 50);
+    std::uniform_int_distribution<size_t> disDimension(1, 33);
+    bags = BaggedDatasetType::Random( disBags( gen ), disBagSize( gen ), disDimension( gen ) );
+  }
+
+  // Write bags as "bag, bag labels, instance labels, features" with bag i
+  // having id firstId + i*idStep and enough digits to round trip
+  static void WriteText( const BaggedDatasetType& bags,
+			 const std::string& path,
+			 size_t firstId = 1,
+			 size_t idStep = 1,
+			 bool finalNewline = true ) {
+    std::ofstream os( path );
+    os << "bag,label0,label1,instanceLabel";
+    for ( size_t j = 0; j < bags.Dimension(); ++j ) {
+      os << ",f" << j;
+    }
+    os << '\n';
+    char buffer[32];
+    auto field = [&]( double x ) {
+      std::snprintf( buffer, sizeof buffer, ",%.17g", x );
+      os << buffer;
+    };
+    for ( size_t i = 0; i < bags.NumberOfInstances(); ++i ) {
+      const size_t bag = bags.Indices()[i];
+      os << firstId + bag * idStep;
+      field( bags.BagLabels()(bag, 0) );
+      field( bags.BagLabels()(bag, 1) );
+      field( bags.InstanceLabels()(i, 0) );
+      for ( size_t j = 0; j < bags.Dimension(); ++j ) {
+	field( bags.Instances()(i, j) );
+      }
+      if ( finalNewline || i + 1 < bags.NumberOfInstances() ) {
+	os << '\n';
+      }
+    }
+  }
+
+  static void ExpectEqual( const BaggedDatasetType& expected, const BaggedDatasetType& actual ) {
+    ASSERT_EQ( expected.NumberOfInstances(), actual.NumberOfInstances() );
+    ASSERT_EQ( expected.NumberOfBags(), actual.NumberOfBags() );
+    ASSERT_EQ( expected.Dimension(), actual.Dimension() );
+    ASSERT_EQ( expected.Instances(), actual.Instances() );
+    ASSERT_EQ( expected.Indices(), actual.Indices() );
+    ASSERT_EQ( expected.BagLabels(), actual.BagLabels() );
+    ASSERT_EQ( expected.InstanceLabels(), actual.InstanceLabels() );
+  }
+
+  BaggedDatasetType bags;
+};
+
+
+TEST_F( ParallelTextLoaderTest, RoundTrip ) {
+  std::string path = "ParallelTextLoaderTest.RoundTrip.csv";
+  WriteText( bags, path );
+  BaggedDatasetType loaded = LoaderType().Load( path );
+  ExpectEqual( bags, loaded );
+}
+
+TEST_F( ParallelTextLoaderTest, SameAsLoadText ) {
+  // The reference is what LoadText makes of the same file, for bag ids from
+  // 0 and 1, sparse bag ids and a last line without a newline
+  struct Variant {
+    size_t firstId;
+    size_t idStep;
+    bool finalNewline;
+  };
+  const Variant variants[] = { { 1, 1, true }, { 0, 1, true }, { 7, 3, true }, { 1, 1, false } };
+  std::string path = "ParallelTextLoaderTest.SameAsLoadText.csv";
+  for ( const Variant& v : variants ) {
+    WriteText( bags, path, v.firstId, v.idStep, v.finalNewline );
+    std::ifstream is( path );
+    BaggedDatasetType expected = BaggedDatasetType::LoadText( is, true );
+    ASSERT_EQ( bags.NumberOfInstances(), expected.NumberOfInstances() );
+    ExpectEqual( expected, LoaderType().Load( path ) );
+  }
+}
+
+TEST_F( ParallelTextLoaderTest, IndependentOfNumberOfThreads ) {
+  // Large enough to be split in many ranges
+  bags = BaggedDatasetType::Random( 50, 200, 20 );
+  std::string path = "ParallelTextLoaderTest.IndependentOfNumberOfThreads.csv";
+  WriteText( bags, path );
+
+  ParameterType serial;
+  serial.numberOfThreads = 1;
+  BaggedDatasetType expected = LoaderType( serial ).Load( path );
+  ExpectEqual( bags, expected );
+
+  for ( unsigned int threads : { 2u, 3u, 8u, 0u } ) {
+    ParameterType params;
+    params.numberOfThreads = threads;
+    ExpectEqual( expected, LoaderType( params ).Load( path ) );
+  }
+}
+
+TEST_F( ParallelTextLoaderTest, WrongNumberOfFieldsThrows ) {
+  std::string path = "ParallelTextLoaderTest.WrongNumberOfFields.csv";
+  WriteText( bags, path );
+  std::ofstream os( path, std::ios::app );
+  os << "1,0,0,0\n";
+  os.close();
+  ASSERT_THROW( LoaderType().Load( path ), std::runtime_error );
+}
+
+TEST( ParseNumberTest, SameAsStrtod ) {
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_real_distribution<double> disMantissa(-10, 10);
+  std::uniform_int_distribution<int> disExponent(-40, 40);
+  const char* formats[] = { "%.17g", "%g", "%.3f", "%.20e", "%.25f" };
+  char buffer[128];
+  for ( int i = 0; i < 10000; ++i ) {
+    const double x = disMantissa( gen ) * std::pow( 10.0, disExponent( gen ) );
+    for ( const char* format : formats ) {
+      const int n = std::snprintf( buffer, sizeof buffer, format, x );
+      double parsed;
+      const char* end = parseDouble( buffer, buffer + n, parsed );
+      char* strtodEnd;
+      const double expected = std::strtod( buffer, &strtodEnd );
+      ASSERT_EQ( strtodEnd, end ) << buffer;
+      ASSERT_EQ( expected, parsed ) << buffer;
+    }
+  }
+
+  const char* special[] = { "0", "-0", "1e400", "1e-400", "inf", "-nan", ".5", "5.", "1e", "12345678901234567890123" };
+  for ( const char* s : special ) {
+    double parsed;
+    const char* end = parseDouble( s, s + std::strlen( s ), parsed );
+    char* strtodEnd;
+    const double expected = std::strtod( s, &strtodEnd );
+    ASSERT_EQ( strtodEnd, end ) << s;
+    if ( expected == expected ) {
+      ASSERT_EQ( expected, parsed ) << s;
+      ASSERT_EQ( std::signbit( expected ), std::signbit( parsed ) ) << s;
+    }
+  }
+}
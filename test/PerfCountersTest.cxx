@@ -0,0 +1,102 @@
+/*
+  Test PerfCounters
+ */
+
+// The counters are compiled out unless this is defined
+#define LLP_PERF_COUNTERS
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "Util/PerfCounters.h"
+
+// Some work the compiler can not remove
+static double work( int n ) {
+  volatile double sum = 0;
+  for ( int i = 0; i < n; ++i ) {
+    sum = sum + i * 0.5;
+  }
+  return sum;
+}
+
+TEST( PerfCountersTest, ValuesArithmetic ) {
+  PerfCounterValues a, b;
+  for ( int i = 0; i < PerfCounterValues::NumberOfEvents; ++i ) {
+    a.counts[i] = 10 * ( i + 1 );
+    b.counts[i] = i + 1;
+  }
+  PerfCounterValues difference = a - b;
+  for ( int i = 0; i < PerfCounterValues::NumberOfEvents; ++i ) {
+    ASSERT_EQ( 9u * ( i + 1 ), difference.counts[i] );
+  }
+  // Never negative
+  difference = b - a;
+  for ( int i = 0; i < PerfCounterValues::NumberOfEvents; ++i ) {
+    ASSERT_EQ( 0u, difference.counts[i] );
+  }
+  b += a;
+  ASSERT_EQ( 11u, b.counts[PerfCounterValues::CYCLES] );
+}
+
+TEST( PerfCountersTest, GroupCountsOrExplains ) {
+  const PerfCounterGroup& group = PerfCounterGroup::ForCurrentThread();
+  const PerfCounterValues start = group.Read();
+  work( 100000 );
+  const PerfCounterValues delta = group.Read() - start;
+  if ( group.Available( PerfCounterValues::INSTRUCTIONS ) ) {
+    ASSERT_LT( 100000u, delta.counts[PerfCounterValues::INSTRUCTIONS] );
+  }
+  if ( !group.Available() ) {
+    // Counters are not permitted here, so they read as zero
+    ASSERT_FALSE( group.Error().empty() );
+    for ( int i = 0; i < PerfCounterValues::NumberOfEvents; ++i ) {
+      ASSERT_EQ( 0u, delta.counts[i] );
+    }
+  }
+}
+
+TEST( PerfCountersTest, RecordsOnlyInScope ) {
+  PerfCounterTotals totals;
+  {
+    LLP_COUNT_PHASE( "outside" );
+  }
+  {
+    PerfCounterScope scope( totals );
+    LLP_COUNT_PHASE( "inside" );
+    work( 1000 );
+  }
+  ASSERT_EQ( nullptr, PerfCounterTotals::Current() );
+
+  std::vector< PerfCounterTotals::Summary > summaries = totals.Summarize();
+  if ( !PerfCounterGroup::ForCurrentThread().Available() ) {
+    // Nothing is recorded without counters
+    ASSERT_TRUE( summaries.empty() );
+    return;
+  }
+  ASSERT_EQ( 1u, summaries.size() );
+  ASSERT_EQ( "inside", summaries[0].phase );
+  ASSERT_EQ( 1u, summaries[0].count );
+  std::ostringstream ss;
+  ss << summaries[0];
+  ASSERT_EQ( 0u, ss.str().find( "count=1" ) );
+}
+
+TEST( PerfCountersTest, SummaryShowsAvailableEvents ) {
+  PerfCounterTotals::Summary summary;
+  summary.phase = "label";
+  summary.count = 2;
+  summary.total.counts[PerfCounterValues::CYCLES] = 200;
+  summary.total.counts[PerfCounterValues::INSTRUCTIONS] = 300;
+  summary.total.counts[PerfCounterValues::CACHE_MISSES] = 4;
+  summary.total.counts[PerfCounterValues::BRANCH_MISSES] = 5;
+  summary.available[PerfCounterValues::CYCLES] = true;
+  summary.available[PerfCounterValues::INSTRUCTIONS] = true;
+  summary.available[PerfCounterValues::CACHE_MISSES] = false;
+  summary.available[PerfCounterValues::BRANCH_MISSES] = true;
+  std::ostringstream ss;
+  ss << summary;
+  ASSERT_EQ( "count=2 cycles=200 instructions=300 branch-misses=5 ipc=1.5", ss.str() );
+}
@@ -0,0 +1,113 @@
+/*
+  Test PhaseTimer
+ */
+
+// The timers are compiled out unless this is defined
+#define LLP_PHASE_TIMING
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bd/BaggedDataset.h"
+
+#include "Algorithms/KMeansInstanceClusterer.h"
+#include "Distances/EarthMoversDistance.h"
+#include "Distances/WeightedNxMDistance.h"
+#include "Util/PhaseTimer.h"
+
+
+TEST( PhaseTimerTest, Summarize ) {
+  PhaseTimings timings;
+  ASSERT_TRUE( timings.Empty() );
+  for ( int i = 100; i >= 1; --i ) {
+    timings.Record( "a", i );
+  }
+  timings.Record( "b", 2 );
+
+  std::vector< PhaseTimings::Summary > summaries = timings.Summarize();
+  ASSERT_EQ( 2u, summaries.size() );
+  ASSERT_EQ( "a", summaries[0].phase );
+  ASSERT_EQ( 100u, summaries[0].count );
+  ASSERT_DOUBLE_EQ( 50.5, summaries[0].mean );
+  ASSERT_DOUBLE_EQ( 50, summaries[0].p50 );
+  ASSERT_DOUBLE_EQ( 99, summaries[0].p99 );
+  ASSERT_EQ( "b", summaries[1].phase );
+  ASSERT_EQ( 1u, summaries[1].count );
+  ASSERT_DOUBLE_EQ( 2, summaries[1].p50 );
+  ASSERT_DOUBLE_EQ( 2, summaries[1].p99 );
+
+  timings.Clear();
+  ASSERT_TRUE( timings.Empty() );
+}
+
+TEST( PhaseTimerTest, RecordsOnlyInScope ) {
+  PhaseTimings timings;
+  {
+    LLP_TIME_PHASE( "outside" );
+  }
+  {
+    PhaseTimingScope scope( timings );
+    LLP_TIME_PHASE( "inside" );
+  }
+  ASSERT_EQ( nullptr, PhaseTimings::Current() );
+  {
+    LLP_TIME_PHASE( "outside" );
+  }
+
+  std::vector< PhaseTimings::Summary > summaries = timings.Summarize();
+  ASSERT_EQ( 1u, summaries.size() );
+  ASSERT_EQ( "inside", summaries[0].phase );
+  ASSERT_LE( 0, summaries[0].mean );
+}
+
+TEST( PhaseTimerTest, SpanListener ) {
+  PhaseTimings timings;
+  std::vector< std::string > phases;
+  std::vector< PhaseTimings::ClockType::time_point > starts, ends;
+  timings.SetSpanListener(
+    [&]( const std::string& phase, PhaseTimings::ClockType::time_point start, PhaseTimings::ClockType::time_point end ) {
+      phases.push_back( phase );
+      starts.push_back( start );
+      ends.push_back( end );
+    } );
+  {
+    PhaseTimingScope scope( timings );
+    LLP_TIME_PHASE( "outer" );
+    {
+      LLP_TIME_PHASE( "inner" );
+    }
+  }
+  // Spans are reported when they end
+  ASSERT_EQ( std::vector< std::string >( { "inner", "outer" } ), phases );
+  ASSERT_LE( starts[1], starts[0] );
+  ASSERT_LE( starts[0], ends[0] );
+  ASSERT_LE( ends[0], ends[1] );
+  ASSERT_EQ( 2u, timings.Summarize().size() );
+}
+
+TEST( PhaseTimerTest, ClustererPhases ) {
+  typedef BaggedDataset< 1, 1 > BaggedDatasetType;
+  typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
+  typedef KMeansInstanceClusterer< BaggedDatasetType, DistanceType > ClustererType;
+
+  BaggedDatasetType bags = BaggedDatasetType::Random( 10, 20, 8 );
+  std::vector< double > weights( 2, 0.5 );
+  DistanceType dist( weights.data(), weights.size() );
+  ClustererType clusterer( ClustererType::ParameterType( 4 ) );
+
+  PhaseTimings timings;
+  {
+    PhaseTimingScope scope( timings );
+    clusterer.Cluster( bags, dist );
+    clusterer.Cluster( bags, dist );
+  }
+  std::vector< PhaseTimings::Summary > summaries = timings.Summarize();
+  ASSERT_EQ( 3u, summaries.size() );
+  ASSERT_EQ( "assignment", summaries[0].phase );
+  ASSERT_EQ( "cooccurrence", summaries[1].phase );
+  ASSERT_EQ( "kmeans", summaries[2].phase );
+  for ( const auto& summary : summaries ) {
+    ASSERT_EQ( 2u, summary.count );
+  }
+}
@@ -0,0 +1,154 @@
+/*
+  Test ScalarRisk
+ */
+
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "llp/Losses/ScalarRisk.h"
+#include "llp/Losses/ScalarLosses.h"
+
+class ScalarRiskTest : public ::testing::Test {
+public:
+  typedef ScalarRisk< L1_ScalarLoss > L1Risk;
+  typedef ScalarRisk< L2_ScalarLoss > L2Risk;
+  typedef L1Risk::KnownLabelVectorType LabelVector;
+  typedef L1Risk::RiskVectorType RiskVector;
+  typedef Eigen::Matrix< double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor > MatrixType;
+
+protected:
+  virtual void SetUp() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution< double > dis( 0, 1 );
+    std::bernoulli_distribution flip( 0.5 );
+
+    // More bags than ScalarRisk::BlockSize, so the fused risks use several
+    // blocks
+    clusterBagMap = MatrixType::Zero( nBags, nClusters );
+    labels = LabelVector::Zero( nBags );
+    for ( size_t i = 0; i < nBags; ++i ) {
+      for ( size_t j = 0; j < nClusters; ++j ) {
+	clusterBagMap( i, j ) = dis( gen );
+      }
+      clusterBagMap.row( i ) /= clusterBagMap.row( i ).sum();
+      labels( i ) = dis( gen );
+    }
+    labeling = LabelVector::Zero( nClusters );
+    for ( size_t j = 0; j < nClusters; ++j ) {
+      labeling( j ) = flip( gen ) ? 1 : 0;
+    }
+  }
+
+  // Risks of labeling and all its single flips, one at a time
+  template< typename TRisk >
+  RiskVector FlipRisks( const TRisk& risk ) const {
+    RiskVector risks( nClusters );
+    for ( size_t j = 0; j < nClusters; ++j ) {
+      LabelVector flipped = labeling;
+      flipped( j ) = 1 - flipped( j );
+      risks( j ) = risk( labels, LabelVector( clusterBagMap * flipped ) );
+    }
+    return risks;
+  }
+
+  static const size_t nBags = 1000;
+  static const size_t nClusters = 17;
+  MatrixType clusterBagMap;
+  LabelVector labels;
+  LabelVector labeling;
+};
+
+const size_t ScalarRiskTest::nBags;
+const size_t ScalarRiskTest::nClusters;
+
+
+TEST_F( ScalarRiskTest, L1 ) {
+  L1Risk risk;
+  L1_ScalarLoss L1;
+  const LabelVector predicted = clusterBagMap * labeling;
+  double sum = 0;
+  for ( size_t i = 0; i < nBags; ++i ) {
+    sum += L1( labels(i), predicted(i) );
+  }
+  ASSERT_DOUBLE_EQ( sum/nBags, risk( labels, predicted ) );
+}
+
+TEST_F( ScalarRiskTest, FusedSameAsPredicted ) {
+  L1Risk l1;
+  L2Risk l2;
+  const LabelVector predicted = clusterBagMap * labeling;
+  ASSERT_NEAR( l1( labels, predicted ), l1( labels, clusterBagMap, labeling ), 1e-12 );
+  ASSERT_NEAR( l2( labels, predicted ), l2( labels, clusterBagMap, labeling ), 1e-12 );
+  ASSERT_EQ( 0, l1( predicted, clusterBagMap, labeling ) );
+}
+
+TEST_F( ScalarRiskTest, BatchedSameAsSingle ) {
+  // All single flips of labeling, one in each column
+  MatrixType labelings = labeling.replicate( 1, nClusters );
+  for ( size_t j = 0; j < nClusters; ++j ) {
+    labelings( j, j ) = 1 - labelings( j, j );
+  }
+  RiskVector risks;
+  L1Risk l1;
+  l1.Risks( labels, clusterBagMap, labelings, risks );
+  ASSERT_EQ( nClusters, static_cast< size_t >( risks.size() ) );
+  ASSERT_TRUE( risks.isApprox( FlipRisks( l1 ), 1e-12 ) );
+
+  L2Risk l2;
+  l2.Risks( labels, clusterBagMap, labelings, risks );
+  ASSERT_TRUE( risks.isApprox( FlipRisks( l2 ), 1e-12 ) );
+}
+
+TEST_F( ScalarRiskTest, IncrementRisks ) {
+  // Raising the label of cluster j by one is the same as flipping it when it
+  // is zero
+  L1Risk l1;
+  const RiskVector expected = FlipRisks( l1 );
+  const LabelVector predicted = clusterBagMap * labeling;
+  RiskVector risks;
+  l1.IncrementRisks( labels, clusterBagMap, predicted, risks );
+  ASSERT_EQ( nClusters, static_cast< size_t >( risks.size() ) );
+
+  typedef Eigen::Matrix< double, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor > ColMajorMatrixType;
+  const ColMajorMatrixType colMajor = clusterBagMap;
+  RiskVector colMajorRisks;
+  l1.IncrementRisks( labels, colMajor, predicted, colMajorRisks );
+  for ( size_t j = 0; j < nClusters; ++j ) {
+    if ( labeling( j ) == 0 ) {
+      ASSERT_NEAR( expected( j ), risks( j ), 1e-12 );
+      ASSERT_NEAR( expected( j ), colMajorRisks( j ), 1e-12 );
+    }
+  }
+}
+
+// A loss with a non-const call operator, which counts its calls
+struct CountingL1Loss {
+  CountingL1Loss() : calls( 0 ) {}
+
+  double operator()( double t, double y ) {
+    ++calls;
+    return t < y ? y - t : t - y;
+  }
+
+  std::size_t calls;
+};
+
+TEST_F( ScalarRiskTest, NonConstLoss ) {
+  ScalarRisk< CountingL1Loss > counting;
+  L1Risk l1;
+  const LabelVector predicted = clusterBagMap * labeling;
+  ASSERT_DOUBLE_EQ( l1( labels, predicted ), counting( labels, predicted ) );
+  ASSERT_NEAR( l1( labels, predicted ), counting( labels, clusterBagMap, labeling ), 1e-12 );
+  RiskVector risks, countingRisks;
+  l1.IncrementRisks( labels, clusterBagMap, predicted, risks );
+  counting.IncrementRisks( labels, clusterBagMap, predicted, countingRisks );
+  ASSERT_TRUE( risks.isApprox( countingRisks, 1e-12 ) );
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,152 @@
+/*
+  Test ShardedInstanceClusterer
+ */
+
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bd/BaggedDataset.h"
+#include "Algorithms/MiniBatchKMeansInstanceClusterer.h"
+#include "Algorithms/ShardedInstanceClusterer.h"
+#include "Distances/EarthMoversDistance.h"
+#include "Distances/WeightedNxMDistance.h"
+
+class ShardedInstanceClustererTest : public ::testing::Test {
+public:
+  typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
+  typedef BaggedDataset< 1, 1 > BaggedDatasetType;
+  typedef MiniBatchKMeansInstanceClusterer< BaggedDatasetType, DistanceType > InstanceClustererType;
+  typedef ShardedInstanceClusterer< InstanceClustererType > ClustererType;
+  typedef ClustererType::ParameterType ParameterType;
+
+  typedef BaggedDatasetType::MatrixType MatrixType;
+  typedef BaggedDatasetType::InstanceLabelVectorType InstanceLabelVectorType;
+  typedef BaggedDatasetType::BagLabelVectorType BagLabelVectorType;
+  typedef BaggedDatasetType::IndexVectorType IndexVectorType;
+
+protected:
+  virtual void SetUp() {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_real_distribution<double> disValue(0, 1);
+    std::uniform_int_distribution<size_t> disIndex(0, numberOfBags - 1);
+
+    // Histograms in two histogram groups, so the distance weights matter
+    MatrixType instances( numberOfInstances, dimension );
+    IndexVectorType indices( numberOfInstances );
+    for ( size_t i = 0; i < numberOfInstances; ++i ) {
+      for ( size_t j = 0; j < dimension; ++j ) {
+	instances( i, j ) = disValue( gen );
+      }
+      indices( i ) = disIndex( gen );
+    }
+    bags = BaggedDatasetType( instances,
+			      indices,
+			      BagLabelVectorType::Zero( numberOfBags ),
+			      InstanceLabelVectorType::Zero( numberOfInstances ) );
+  }
+
+  static void ExpectSameClustering( const ClustererType::InstanceClusteringType& expected,
+				    const ClustererType::InstanceClusteringType& clustering ) {
+    ASSERT_EQ( expected.centroids, clustering.centroids );
+    ASSERT_EQ( expected.clusterMembershipIndices, clustering.clusterMembershipIndices );
+    ASSERT_EQ( expected.clusterBagMap, clustering.clusterBagMap );
+  }
+
+  static const size_t numberOfInstances = 5000;
+  static const size_t numberOfBags = 13;
+  static const size_t dimension = 8;
+  static const size_t k = 5;
+  BaggedDatasetType bags;
+};
+
+const size_t ShardedInstanceClustererTest::numberOfInstances;
+const size_t ShardedInstanceClustererTest::numberOfBags;
+const size_t ShardedInstanceClustererTest::dimension;
+const size_t ShardedInstanceClustererTest::k;
+
+
+TEST_F( ShardedInstanceClustererTest, SameAsInstanceClusterer ) {
+  const InstanceClustererType::ParameterType clustererParams( k, 256 );
+  ClustererType clusterer( ParameterType( clustererParams, 3 ) );
+  InstanceClustererType instanceClusterer( clustererParams );
+
+  // The workers are reused for new distances
+  const std::vector< std::vector< double > > weights{ { 0.5, 0.5 }, { 0.9, 0.1 }, { 0.2, 0.8 } };
+  for ( const std::vector< double >& w : weights ) {
+    const DistanceType dist( w.data(), w.size() );
+    ExpectSameClustering( instanceClusterer.Cluster( bags, dist ), clusterer.Cluster( bags, dist ) );
+  }
+
+  // and forked again for other bags
+  BaggedDatasetType firstBags( bags.Instances().topRows( 1000 ),
+			       bags.Indices().head( 1000 ),
+			       bags.BagLabels(),
+			       bags.InstanceLabels().head( 1000 ) );
+  const DistanceType dist( weights[0].data(), weights[0].size() );
+  ExpectSameClustering( instanceClusterer.Cluster( firstBags, dist ), clusterer.Cluster( firstBags, dist ) );
+}
+
+TEST_F( ShardedInstanceClustererTest, InvalidatedIsForkedAgain ) {
+  const InstanceClustererType::ParameterType clustererParams( k, 256 );
+  ClustererType clusterer( ParameterType( clustererParams, 3 ) );
+  InstanceClustererType instanceClusterer( clustererParams );
+  const std::vector< double > w{ 0.5, 0.5 };
+  const DistanceType dist( w.data(), w.size() );
+  clusterer.Cluster( bags, dist );
+
+  // Change the instances and bags in place, so the new dataset is at the
+  // same address and has the same size as the old one. Workers forked
+  // before still see the old dataset until they are invalidated.
+  double* instances = const_cast< double* >( bags.Instances().data() );
+  IndexVectorType::Scalar* indices = const_cast< IndexVectorType::Scalar* >( bags.Indices().data() );
+  for ( size_t i = 0; i < numberOfInstances; ++i ) {
+    for ( size_t j = 0; j < dimension; ++j ) {
+      instances[i * dimension + j] = 1 - instances[i * dimension + j];
+    }
+    indices[i] = i % numberOfBags;
+  }
+  clusterer.Invalidate();
+  ExpectSameClustering( instanceClusterer.Cluster( bags, dist ), clusterer.Cluster( bags, dist ) );
+}
+
+TEST_F( ShardedInstanceClustererTest, MoreProcessesThanInstances ) {
+  // Two bags, so none are empty
+  IndexVectorType indices( 7 );
+  for ( size_t i = 0; i < 7; ++i ) {
+    indices( i ) = i % 2;
+  }
+  BaggedDatasetType fewBags( bags.Instances().topRows( 7 ),
+			     indices,
+			     BagLabelVectorType::Zero( 2 ),
+			     bags.InstanceLabels().head( 7 ) );
+  const InstanceClustererType::ParameterType clustererParams( 2, 7 );
+  ClustererType clusterer( ParameterType( clustererParams, 8 ) );
+  InstanceClustererType instanceClusterer( clustererParams );
+  const std::vector< double > w{ 0.5, 0.5 };
+  const DistanceType dist( w.data(), w.size() );
+  ExpectSameClustering( instanceClusterer.Cluster( fewBags, dist ), clusterer.Cluster( fewBags, dist ) );
+}
+
+TEST_F( ShardedInstanceClustererTest, WeightedAndSingleProcess ) {
+  const InstanceClustererType::ParameterType clustererParams( k, 256 );
+  InstanceClustererType instanceClusterer( clustererParams );
+  const std::vector< double > w{ 0.5, 0.5 };
+  const DistanceType dist( w.data(), w.size() );
+  const std::vector< double > instanceWeights( numberOfInstances, 2 );
+
+  ClustererType clusterer( ParameterType( clustererParams, 2 ) );
+  ExpectSameClustering( instanceClusterer.Cluster( bags, dist, instanceWeights ),
+			clusterer.Cluster( bags, dist, instanceWeights ) );
+
+  ClustererType singleProcess( ParameterType( clustererParams, 1 ) );
+  ExpectSameClustering( instanceClusterer.Cluster( bags, dist ), singleProcess.Cluster( bags, dist ) );
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,116 @@
+/*
+  Test SyntheticBaggedDataset
+ */
+
+#include <fstream>
+
+#include "gtest/gtest.h"
+
+#include "bd/BaggedDataset.h"
+#include "IO/BaggedDatasetCache.h"
+#include "IO/ParallelTextLoader.h"
+#include "IO/SyntheticBaggedDataset.h"
+
+class SyntheticBaggedDatasetTest : public ::testing::Test {
+public:
+  typedef BaggedDataset< 1, 1 > BaggedDatasetType;
+  typedef BaggedDataset< 2, 1 > IntervalBaggedDatasetType;
+  typedef SyntheticBaggedDataset::ParameterType ParameterType;
+
+protected:
+  virtual void SetUp() {
+    params = ParameterType( 37,                        // bags
+			    20,                        // mean bag size
+			    ParameterType::LOGNORMAL,  // bag size distribution
+			    2,                         // min bag size
+			    60,                        // max bag size
+			    3,                         // histograms
+			    8,                         // bins
+			    0.5,                       // separation
+			    false,                     // interval labels
+			    0.2,                       // interval width
+			    1234 );                    // seed
+  }
+
+  template< typename TBaggedDataset >
+  static void ExpectEqual( const TBaggedDataset& expected, const TBaggedDataset& actual ) {
+    ASSERT_EQ( expected.Instances(), actual.Instances() );
+    ASSERT_EQ( expected.Indices(), actual.Indices() );
+    ASSERT_EQ( expected.BagLabels(), actual.BagLabels() );
+    ASSERT_EQ( expected.InstanceLabels(), actual.InstanceLabels() );
+  }
+
+  ParameterType params;
+};
+
+
+TEST_F( SyntheticBaggedDatasetTest, Deterministic ) {
+  BaggedDatasetType a = SyntheticBaggedDataset( params ).ToBaggedDataset< BaggedDatasetType >( 1 );
+  BaggedDatasetType b = SyntheticBaggedDataset( params ).ToBaggedDataset< BaggedDatasetType >( 4 );
+  ExpectEqual( a, b );
+
+  params.seed += 1;
+  BaggedDatasetType c = SyntheticBaggedDataset( params ).ToBaggedDataset< BaggedDatasetType >();
+  ASSERT_FALSE( a.Instances().rows() == c.Instances().rows() && a.Instances() == c.Instances() );
+}
+
+TEST_F( SyntheticBaggedDatasetTest, BagsAndLabels ) {
+  SyntheticBaggedDataset dataset( params );
+  BaggedDatasetType bags = dataset.ToBaggedDataset< BaggedDatasetType >();
+  ASSERT_EQ( params.numberOfBags, bags.NumberOfBags() );
+  ASSERT_EQ( params.histograms * params.bins, bags.Dimension() );
+
+  for ( size_t bag = 0; bag < dataset.NumberOfBags(); ++bag ) {
+    const size_t size = dataset.BagSize( bag );
+    ASSERT_GE( size, params.minBagSize );
+    ASSERT_LE( size, params.maxBagSize );
+    double positives = 0;
+    for ( size_t i = dataset.BagOffset( bag ); i < dataset.BagOffset( bag ) + size; ++i ) {
+      ASSERT_EQ( bag, bags.Indices()[i] );
+      positives += bags.InstanceLabels()(i);
+    }
+    ASSERT_DOUBLE_EQ( positives / size, bags.BagLabels()(bag) );
+  }
+
+  // Every histogram sums to one
+  for ( size_t i = 0; i < bags.NumberOfInstances(); ++i ) {
+    for ( size_t h = 0; h < params.histograms; ++h ) {
+      ASSERT_NEAR( 1.0, bags.Instances().row(i).segment( h * params.bins, params.bins ).sum(), 1e-12 );
+    }
+  }
+}
+
+TEST_F( SyntheticBaggedDatasetTest, IntervalLabelsContainProportion ) {
+  params.intervalLabels = true;
+  SyntheticBaggedDataset dataset( params );
+  ASSERT_THROW( dataset.ToBaggedDataset< BaggedDatasetType >(), std::logic_error );
+
+  IntervalBaggedDatasetType bags = dataset.ToBaggedDataset< IntervalBaggedDatasetType >();
+  for ( size_t bag = 0; bag < dataset.NumberOfBags(); ++bag ) {
+    double positives = 0;
+    for ( size_t i = dataset.BagOffset( bag ); i < dataset.BagOffset( bag ) + dataset.BagSize( bag ); ++i ) {
+      positives += bags.InstanceLabels()(i);
+    }
+    const double proportion = positives / dataset.BagSize( bag );
+    ASSERT_LE( 0, bags.BagLabels()(bag, 0) );
+    ASSERT_LE( bags.BagLabels()(bag, 0), proportion );
+    ASSERT_LE( proportion, bags.BagLabels()(bag, 1) );
+    ASSERT_LE( bags.BagLabels()(bag, 1), 1 );
+  }
+}
+
+TEST_F( SyntheticBaggedDatasetTest, TextAndCacheAreSame ) {
+  SyntheticBaggedDataset dataset( params );
+  BaggedDatasetType expected = dataset.ToBaggedDataset< BaggedDatasetType >();
+
+  std::string path = "SyntheticBaggedDatasetTest.TextAndCacheAreSame.csv";
+  {
+    std::ofstream os( path );
+    dataset.WriteText( os );
+  }
+  ExpectEqual( expected, ParallelTextLoader< BaggedDatasetType >().Load( path ) );
+
+  std::string cachePath = "SyntheticBaggedDatasetTest.TextAndCacheAreSame.llpbin";
+  dataset.WriteCache( cachePath );
+  ExpectEqual( expected, MappedBaggedDataset< BaggedDatasetType >( cachePath ).ToBaggedDataset() );
+}
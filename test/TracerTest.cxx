@@ -0,0 +1,367 @@
+/*
+  Test the tracers
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "Tracers/AsyncFileTracer.h"
+#include "Tracers/BinaryFileTracer.h"
+#include "Tracers/ChromeTraceTracer.h"
+#include "Tracers/FileTracer.h"
+#include "Tracers/SilentTracer.h"
+#include "Tracers/StdOutTracer.h"
+
+// The tracers are used together with glog, which declares these globally
+const int INFO = 0, WARNING = 1, ERROR = 2;
+
+static std::string readFile( const std::string& path ) {
+  std::ifstream is( path );
+  return std::string( (std::istreambuf_iterator<char>( is )), std::istreambuf_iterator<char>() );
+}
+
+static size_t countLines( const std::string& s ) {
+  return std::count( s.begin(), s.end(), '\n' );
+}
+
+// Count how many times the payload is evaluated
+struct CountingPayload {
+  explicit CountingPayload( int& calls ) : calls( calls ) {}
+  double operator()() const {
+    ++calls;
+    return 42;
+  }
+  int& calls;
+};
+
+
+TEST( TracerTest, SilentTracerNeverEvaluates ) {
+  SilentTracer tracer( SilentTracer::ParameterType( SilentTracer::Level::TRACE ) );
+  int calls = 0;
+  tracer.Trace( "x", CountingPayload( calls ) );
+  tracer.Error( "x", CountingPayload( calls ) );
+  ASSERT_EQ( 0, calls );
+  ASSERT_FALSE( tracer.IsEnabled( SilentTracer::Level::ERROR ) );
+}
+
+TEST( TracerTest, RuntimeLevelFilters ) {
+  std::stringstream out;
+  std::streambuf* old = std::cout.rdbuf( out.rdbuf() );
+  StdOutTracer tracer( StdOutTracer::ParameterType( StdOutTracer::Level::INFO ) );
+  int calls = 0;
+  tracer.Debug( "Debug", CountingPayload( calls ) );
+  tracer.Info( [] { return std::string( "Lazy key" ); }, CountingPayload( calls ) );
+  tracer.Warning( "Value", 1.5 );
+  std::cout.rdbuf( old );
+
+  ASSERT_EQ( 1, calls );
+  ASSERT_EQ( "[INFO] Lazy key : 42\n[WARNING] Value : 1.5\n", out.str() );
+}
+
+TEST( TracerTest, CompileTimeLevelFilters ) {
+  typedef BasicStdOutTracer< static_cast< int >( TraceLevel::INFO ) > TracerType;
+  std::stringstream out;
+  std::streambuf* old = std::cout.rdbuf( out.rdbuf() );
+  TracerType tracer( TracerType::ParameterType( TracerType::Level::TRACE ) );
+  int calls = 0;
+  tracer.Trace( "Trace", CountingPayload( calls ) );
+  tracer.Debug( "Debug", CountingPayload( calls ) );
+  tracer.Info( "Info", CountingPayload( calls ) );
+  std::cout.rdbuf( old );
+
+  ASSERT_EQ( 1, calls );
+  ASSERT_FALSE( tracer.IsEnabled( TracerType::Level::DEBUG ) );
+  ASSERT_TRUE( tracer.IsEnabled( TracerType::Level::INFO ) );
+  ASSERT_EQ( "[INFO] Info : 42\n", out.str() );
+}
+
+TEST( TracerTest, FileTracerWrites ) {
+  std::string path = "TracerTest.FileTracerWrites.trace";
+  {
+    FileTracer tracer( FileTracer::ParameterType( FileTracer::Level::DEBUG, path ) );
+    tracer.Trace( "Trace", 1 );
+    tracer.Debug( "Debug", 2 );
+  }
+  ASSERT_EQ( "[DEBUG] Debug : 2\n", readFile( path ) );
+}
+
+TEST( TracerTest, AsyncFileTracerSameAsFileTracer ) {
+  std::string path = "TracerTest.AsyncFileTracerSameAsFileTracer.trace";
+  std::string asyncPath = "TracerTest.AsyncFileTracerSameAsFileTracer.async.trace";
+  {
+    FileTracer tracer( FileTracer::ParameterType( FileTracer::Level::DEBUG, path ) );
+    AsyncFileTracer asyncTracer( AsyncFileTracer::ParameterType( AsyncFileTracer::Level::DEBUG, asyncPath ) );
+    for ( int i = 0; i < 1000; ++i ) {
+      tracer.Trace( "Trace", i );
+      tracer.Debug( "Debug", i );
+      asyncTracer.Trace( "Trace", i );
+      asyncTracer.Debug( "Debug", i );
+    }
+    asyncTracer.Flush();
+    ASSERT_EQ( readFile( path ), readFile( asyncPath ) );
+  }
+  ASSERT_EQ( readFile( path ), readFile( asyncPath ) );
+}
+
+TEST( TracerTest, AsyncFileTracerManyThreads ) {
+  const int numberOfThreads = 8;
+  const int messagesPerThread = 10000;
+  std::string path = "TracerTest.AsyncFileTracerManyThreads.trace";
+  {
+    // A small queue and small blocks, so producers have to wait for the writer
+    AsyncFileTracer tracer( AsyncFileTracer::ParameterType( AsyncFileTracer::Level::DEBUG,
+							    path,
+							    16,
+							    AsyncFileTracer::BLOCK,
+							    256 ) );
+    std::vector< std::thread > threads;
+    for ( int t = 0; t < numberOfThreads; ++t ) {
+      threads.push_back( std::thread( [&tracer, t, messagesPerThread]() {
+	    for ( int i = 0; i < messagesPerThread; ++i ) {
+	      tracer.Info( "Thread " + std::to_string( t ), i );
+	    }
+	  }));
+    }
+    for ( auto& thread : threads ) {
+      thread.join();
+    }
+    ASSERT_EQ( 0u, tracer.Dropped() );
+  }
+  ASSERT_EQ( static_cast< size_t >( numberOfThreads * messagesPerThread ), countLines( readFile( path ) ) );
+}
+
+TEST( TracerTest, AsyncFileTracerFlushWritesOwnMessages ) {
+  const int numberOfThreads = 4;
+  const int messagesPerThread = 200;
+  std::string path = "TracerTest.AsyncFileTracerFlushWritesOwnMessages.trace";
+  AsyncFileTracer tracer( AsyncFileTracer::ParameterType( AsyncFileTracer::Level::DEBUG,
+							  path,
+							  16,
+							  AsyncFileTracer::BLOCK,
+							  256 ) );
+  std::vector< std::thread > threads;
+  std::vector< int > missing( numberOfThreads, 0 );
+  for ( int t = 0; t < numberOfThreads; ++t ) {
+    threads.push_back( std::thread( [&tracer, &missing, &path, t, messagesPerThread]() {
+	  for ( int i = 0; i < messagesPerThread; ++i ) {
+	    // Other threads keep tracing while this one flushes
+	    const std::string key = "Thread " + std::to_string( t ) + " message " + std::to_string( i );
+	    tracer.Info( key, i );
+	    tracer.Flush();
+	    if ( readFile( path ).find( "[INFO] " + key + " : " ) == std::string::npos ) {
+	      ++missing[t];
+	    }
+	  }
+	}));
+  }
+  for ( auto& thread : threads ) {
+    thread.join();
+  }
+  for ( int t = 0; t < numberOfThreads; ++t ) {
+    ASSERT_EQ( 0, missing[t] );
+  }
+}
+
+TEST( TracerTest, AsyncFileTracerDrops ) {
+  const int numberOfMessages = 100000;
+  std::string path = "TracerTest.AsyncFileTracerDrops.trace";
+  size_t dropped;
+  {
+    AsyncFileTracer tracer( AsyncFileTracer::ParameterType( AsyncFileTracer::Level::DEBUG,
+							    path,
+							    4,
+							    AsyncFileTracer::DROP ) );
+    for ( int i = 0; i < numberOfMessages; ++i ) {
+      tracer.Info( "Message", i );
+    }
+    dropped = tracer.Dropped();
+  }
+  std::string content = readFile( path );
+  if ( dropped > 0 ) {
+    // The last line reports the dropped messages
+    ASSERT_NE( std::string::npos, content.find( "dropped " + std::to_string( dropped ) + " messages" ) );
+    ASSERT_EQ( numberOfMessages - dropped + 1, countLines( content ) );
+  }
+  else {
+    ASSERT_EQ( static_cast< size_t >( numberOfMessages ), countLines( content ) );
+  }
+}
+
+
+TEST( TracerTest, BinaryFileTracerRoundTrip ) {
+  std::string path = "TracerTest.BinaryFileTracerRoundTrip.trace";
+  Eigen::MatrixXd m( 2, 3 );
+  m << 1, 2, 3, 4, 5, 6;
+  std::vector< double > v{ 0.1, 0.2 };
+  {
+    BinaryFileTracer tracer( BinaryFileTracer::ParameterType( BinaryFileTracer::Level::DEBUG, path ) );
+    tracer.Trace( "Trace", 1 );
+    tracer.Debug( "Double", 0.5 );
+    tracer.Info( "Integer", -7 );
+    tracer.Warning( "String", "text" );
+    tracer.Error( "Matrix", m );
+    tracer.Debug( "Vector", v );
+    tracer.Debug( "Double", 1.5 );
+  }
+
+  BinaryTraceReader reader( path );
+  BinaryTraceReader::RecordType record;
+  ASSERT_TRUE( reader.Next( record ) );
+  ASSERT_EQ( TraceLevel::DEBUG, record.level );
+  ASSERT_EQ( "Double", *record.key );
+  ASSERT_EQ( BinaryTrace::DOUBLE, record.type );
+  ASSERT_EQ( 0.5, record.scalar );
+
+  ASSERT_TRUE( reader.Next( record ) );
+  ASSERT_EQ( TraceLevel::INFO, record.level );
+  ASSERT_EQ( BinaryTrace::INTEGER, record.type );
+  ASSERT_EQ( -7, record.integer );
+
+  ASSERT_TRUE( reader.Next( record ) );
+  ASSERT_EQ( TraceLevel::WARNING, record.level );
+  ASSERT_EQ( BinaryTrace::STRING, record.type );
+  ASSERT_EQ( "text", record.text );
+
+  ASSERT_TRUE( reader.Next( record ) );
+  ASSERT_EQ( TraceLevel::ERROR, record.level );
+  ASSERT_EQ( BinaryTrace::MATRIX, record.type );
+  ASSERT_EQ( 2u, record.rows );
+  ASSERT_EQ( 3u, record.cols );
+  ASSERT_EQ( std::vector< double >( { 1, 2, 3, 4, 5, 6 } ), record.values );
+
+  ASSERT_TRUE( reader.Next( record ) );
+  ASSERT_EQ( BinaryTrace::MATRIX, record.type );
+  ASSERT_EQ( 2u, record.rows );
+  ASSERT_EQ( 1u, record.cols );
+  ASSERT_EQ( v, record.values );
+
+  const std::uint64_t time = record.time;
+  ASSERT_TRUE( reader.Next( record ) );
+  ASSERT_EQ( "Double", *record.key );
+  ASSERT_EQ( 1.5, record.scalar );
+  ASSERT_LE( time, record.time );
+
+  ASSERT_FALSE( reader.Next( record ) );
+  // Keys are only written once
+  ASSERT_EQ( 5u, reader.Keys().size() );
+}
+
+TEST( TracerTest, BinaryFileTracerIsSmaller ) {
+  std::string path = "TracerTest.BinaryFileTracerIsSmaller.trace";
+  std::string binaryPath = "TracerTest.BinaryFileTracerIsSmaller.binary.trace";
+  std::string floatPath = "TracerTest.BinaryFileTracerIsSmaller.float.trace";
+  std::mt19937 gen( 0 );
+  std::uniform_real_distribution< double > dist;
+  Eigen::MatrixXd m( 50, 50 );
+  {
+    FileTracer tracer( FileTracer::ParameterType( FileTracer::Level::DEBUG, path ) );
+    BinaryFileTracer binaryTracer( BinaryFileTracer::ParameterType( BinaryFileTracer::Level::DEBUG, binaryPath ) );
+    BinaryFileTracer floatTracer( BinaryFileTracer::ParameterType( BinaryFileTracer::Level::DEBUG, floatPath, true ) );
+    for ( int i = 0; i < 10; ++i ) {
+      for ( Eigen::Index j = 0; j < m.size(); ++j ) {
+	m( j ) = dist( gen );
+      }
+      tracer.Debug( "Matrix", m );
+      binaryTracer.Debug( "Matrix", m );
+      floatTracer.Debug( "Matrix", m );
+      for ( int j = 0; j < 100; ++j ) {
+	const double w = dist( gen );
+	tracer.Debug( [j]{ return "Weight " + std::to_string( j ); }, w );
+	binaryTracer.Debug( [j]{ return "Weight " + std::to_string( j ); }, w );
+	floatTracer.Debug( [j]{ return "Weight " + std::to_string( j ); }, w );
+      }
+    }
+  }
+  // The binary traces keep all digits and are still smaller than the text
+  // with six significant digits
+  const size_t textSize = readFile( path ).size();
+  ASSERT_LT( readFile( binaryPath ).size(), textSize );
+  ASSERT_LT( 2 * readFile( floatPath ).size(), textSize );
+
+  BinaryTraceReader reader( binaryPath );
+  BinaryTraceReader::RecordType record;
+  size_t count = 0;
+  Eigen::MatrixXd last;
+  while ( reader.Next( record ) ) {
+    if ( record.type == BinaryTrace::MATRIX ) {
+      last = Eigen::Map< Eigen::Matrix< double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor > >( record.values.data(), record.rows, record.cols );
+    }
+    ++count;
+  }
+  ASSERT_EQ( 1010u, count );
+  ASSERT_EQ( m, last );
+}
+
+TEST( TracerTest, BinaryTraceReaderIgnoresTruncatedRecord ) {
+  std::string path = "TracerTest.BinaryTraceReaderIgnoresTruncatedRecord.trace";
+  {
+    BinaryFileTracer tracer( BinaryFileTracer::ParameterType( BinaryFileTracer::Level::DEBUG, path ) );
+    tracer.Debug( "First", 1.0 );
+    tracer.Debug( "Second", 2.0 );
+  }
+  std::string content = readFile( path );
+  {
+    std::ofstream os( path, std::ios::binary );
+    os.write( content.data(), content.size() - 3 );
+  }
+  BinaryTraceReader reader( path );
+  BinaryTraceReader::RecordType record;
+  ASSERT_TRUE( reader.Next( record ) );
+  ASSERT_EQ( "First", *record.key );
+  ASSERT_FALSE( reader.Next( record ) );
+}
+
+TEST( TracerTest, ChromeTraceTracerWritesEvents ) {
+  std::string path = "TracerTest.ChromeTraceTracerWritesEvents.json";
+  {
+    ChromeTraceTracer tracer( ChromeTraceTracer::ParameterType( ChromeTraceTracer::Level::DEBUG, path ) );
+    {
+      ScopedTraceSpan< ChromeTraceTracer > span( tracer, "outer" );
+      tracer.Debug( "Risk", 0.5 );
+      tracer.Trace( "Filtered", 1 );
+      const ChromeTraceTracer::ClockType::time_point start = ChromeTraceTracer::ClockType::now();
+      tracer.CompleteSpan( [] { return std::string( "phase" ); }, start, start + std::chrono::microseconds( 2 ) );
+    }
+    std::thread worker( [&tracer] { tracer.Info( "Worker", "done \"quoted\"" ); } );
+    worker.join();
+  }
+  std::string content = readFile( path );
+  ASSERT_EQ( '[', content.front() );
+  ASSERT_EQ( "\n]\n", content.substr( content.size() - 3 ) );
+  // One event per line
+  ASSERT_EQ( 7u, countLines( content ) );
+  ASSERT_NE( std::string::npos, content.find( "{\"name\":\"outer\",\"ph\":\"B\"" ) );
+  ASSERT_NE( std::string::npos, content.find( "{\"ph\":\"E\"" ) );
+  ASSERT_NE( std::string::npos, content.find( "{\"name\":\"Risk\",\"ph\":\"i\"" ) );
+  ASSERT_NE( std::string::npos, content.find( "\"args\":{\"value\":0.5}" ) );
+  ASSERT_NE( std::string::npos, content.find( "{\"name\":\"phase\",\"ph\":\"X\"" ) );
+  ASSERT_NE( std::string::npos, content.find( "\"dur\":2.000" ) );
+  ASSERT_NE( std::string::npos, content.find( "\"value\":\"done \\\"quoted\\\"\"" ) );
+  ASSERT_EQ( std::string::npos, content.find( "Filtered" ) );
+  // The worker thread gets its own id
+  const std::string workerEvent = content.substr( content.find( "\"Worker\"" ) );
+  const std::string outerEvent = content.substr( content.find( "\"outer\"" ) );
+  auto tid = []( const std::string& event ) {
+    const size_t begin = event.find( "\"tid\":" ) + 6;
+    return event.substr( begin, event.find_first_of( ",}", begin ) - begin );
+  };
+  ASSERT_NE( tid( outerEvent ), tid( workerEvent ) );
+}
+
+TEST( TracerTest, SpansAreNoOpsForOtherTracers ) {
+  std::string path = "TracerTest.SpansAreNoOpsForOtherTracers.trace";
+  {
+    FileTracer tracer( FileTracer::ParameterType( FileTracer::Level::TRACE, path ) );
+    ScopedTraceSpan< FileTracer > span( tracer, [] { ADD_FAILURE(); return std::string(); } );
+    tracer.CompleteSpan( "phase", FileTracer::ClockType::now(), FileTracer::ClockType::now() );
+  }
+  ASSERT_EQ( "", readFile( path ) );
+}
@@ -0,0 +1,96 @@
+#ifndef __WeightedInstancesTestHelpers_h
+#define __WeightedInstancesTestHelpers_h
+
+/*
+  Fixture shared by the tests of instance weights: a dataset where every
+  third instance is duplicated should give the same result as the original
+  dataset where those instances have weight 2.
+ */
+
+#include <cstddef>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+/*
+  Rows of the duplicated dataset: all n rows followed by rows 0, 3, 6, ...
+*/
+inline std::vector< std::size_t > everyThirdDuplicatedRows( std::size_t n ) {
+  std::vector< std::size_t > rows( n );
+  for ( std::size_t i = 0; i < n; ++i ) {
+    rows[i] = i;
+  }
+  for ( std::size_t i = 0; i < n; i += 3 ) {
+    rows.push_back( i );
+  }
+  return rows;
+}
+
+/*
+  Weights of the n original rows, 2 for the rows that are duplicated
+*/
+inline std::vector< double > everyThirdDuplicatedWeights( std::size_t n ) {
+  std::vector< double > weights( n, 1 );
+  for ( std::size_t i = 0; i < n; i += 3 ) {
+    weights[i] = 2;
+  }
+  return weights;
+}
+
+/*
+  Elements of values in the order of rows
+*/
+template< typename T >
+std::vector< T > selectElements( const std::vector< T >& values,
+				 const std::vector< std::size_t >& rows ) {
+  std::vector< T > selected;
+  selected.reserve( rows.size() );
+  for ( std::size_t row : rows ) {
+    selected.push_back( values[row] );
+  }
+  return selected;
+}
+
+/*
+  The instances of bags in the order of rows. Bags keep their labels.
+*/
+template< typename TBaggedDataset >
+TBaggedDataset selectInstances( const TBaggedDataset& bags,
+				const std::vector< std::size_t >& rows ) {
+  typename TBaggedDataset::MatrixType instances( rows.size(), bags.Dimension() );
+  typename TBaggedDataset::IndexVectorType indices( rows.size() );
+  typename TBaggedDataset::InstanceLabelVectorType labels( rows.size(), bags.InstanceLabels().cols() );
+  for ( std::size_t i = 0; i < rows.size(); ++i ) {
+    instances.row( i ) = bags.Instances().row( rows[i] );
+    indices( i ) = bags.Indices()( rows[i] );
+    labels.row( i ) = bags.InstanceLabels().row( rows[i] );
+  }
+  return TBaggedDataset( instances, indices, bags.BagLabels(), labels );
+}
+
+/*
+  Assert that two clusterings with two clusters have the same centroids and
+  bag map, where the clusters can be in any order. The membership of the
+  first numberOfInstances instances must also agree.
+*/
+template< typename TClustering >
+void assertSameTwoClusterings( const TClustering& expected,
+			       const TClustering& actual,
+			       std::size_t numberOfInstances ) {
+  ASSERT_EQ( 2, actual.centroids.rows() );
+  ASSERT_EQ( 2, expected.centroids.rows() );
+  const bool swapped = !actual.centroids.row(0).isApprox( expected.centroids.row(0), 1e-9 );
+  for ( int j = 0; j < 2; ++j ) {
+    const int other = swapped ? 1 - j : j;
+    ASSERT_TRUE( actual.centroids.row(j).isApprox( expected.centroids.row(other), 1e-9 ) );
+    for ( int b = 0; b < actual.clusterBagMap.rows(); ++b ) {
+      ASSERT_NEAR( expected.clusterBagMap( b, other ), actual.clusterBagMap( b, j ), 1e-12 );
+    }
+  }
+  for ( std::size_t i = 0; i < numberOfInstances; ++i ) {
+    const int membership = actual.clusterMembershipIndices[i];
+    ASSERT_EQ( expected.clusterMembershipIndices[i], swapped ? 1 - membership : membership ) << i;
+  }
+}
+
+#endif
@@ -0,0 +1,143 @@
+/*
+  Test WorkerProcesses
+ */
+
+#include <cerrno>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "llp/Util/MappedFile.h"
+#include "llp/Util/WorkerProcesses.h"
+
+TEST( WorkerProcessesTest, RunsTaskInEveryWorker ) {
+  const std::size_t numberOfWorkers = 3;
+  // Shared with the workers, since it is mapped before they are forked
+  MappedFile shared = MappedFile::Anonymous( 2 * numberOfWorkers * sizeof( int ) );
+  int* pids = reinterpret_cast< int* >( shared.Data() );
+  int* runs = pids + numberOfWorkers;
+  WorkerProcesses workers( numberOfWorkers,
+			   [pids, runs]( std::size_t worker ) {
+			     pids[worker] = getpid();
+			     ++runs[worker];
+			   } );
+  ASSERT_EQ( numberOfWorkers, workers.NumberOfWorkers() );
+  workers.Run();
+  workers.Run();
+  for ( std::size_t w = 0; w < numberOfWorkers; ++w ) {
+    ASSERT_EQ( 2, runs[w] );
+    ASSERT_NE( getpid(), pids[w] );
+    for ( std::size_t v = w + 1; v < numberOfWorkers; ++v ) {
+      ASSERT_NE( pids[v], pids[w] );
+    }
+  }
+  workers.Stop();
+  ASSERT_THROW( workers.Run(), std::runtime_error );
+}
+
+TEST( WorkerProcessesTest, ReportsFailedTask ) {
+  WorkerProcesses workers( 2,
+			   []( std::size_t worker ) {
+			     if ( worker == 1 ) {
+			       throw std::invalid_argument( "bad shard" );
+			     }
+			   } );
+  try {
+    workers.Run();
+    FAIL() << "Expected a failed worker";
+  }
+  catch ( const std::runtime_error& e ) {
+    ASSERT_NE( std::string::npos, std::string( e.what() ).find( "bad shard" ) );
+  }
+  // The workers are still there
+  ASSERT_THROW( workers.Run(), std::runtime_error );
+}
+
+TEST( WorkerProcessesTest, DetectsDeadWorker ) {
+  WorkerProcesses workers( 2,
+			   []( std::size_t worker ) {
+			     if ( worker == 0 ) {
+			       _exit( 3 );
+			     }
+			   } );
+  ASSERT_THROW( workers.Run(), std::runtime_error );
+  ASSERT_THROW( workers.Run(), std::runtime_error );
+}
+
+static double secondsSince( const timespec& start ) {
+  timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return ( now.tv_sec - start.tv_sec ) + ( now.tv_nsec - start.tv_nsec ) * 1e-9;
+}
+
+TEST( WorkerProcessesTest, StopKillsStuckWorker ) {
+  MappedFile shared = MappedFile::Anonymous( 2 * sizeof( int ) );
+  int* pids = reinterpret_cast< int* >( shared.Data() );
+  WorkerProcesses workers( 2, [pids]( std::size_t worker ) { pids[worker] = getpid(); } );
+  workers.Run();
+  // A stopped worker never sees that it should quit
+  ASSERT_EQ( 0, kill( pids[0], SIGSTOP ) );
+  timespec start;
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  workers.Stop( 0.2 );
+  ASSERT_LT( secondsSince( start ), 5.0 );
+  for ( std::size_t w = 0; w < 2; ++w ) {
+    ASSERT_EQ( -1, kill( pids[w], 0 ) );
+    ASSERT_EQ( ESRCH, errno );
+  }
+}
+
+TEST( WorkerProcessesTest, OutliveThreadThatForkedThem ) {
+  std::unique_ptr< WorkerProcesses > workers;
+  std::thread thread( [&workers] {
+      workers.reset( new WorkerProcesses( 2, []( std::size_t ) {} ) );
+      // Let the workers start before the thread exits
+      usleep( 100000 );
+    } );
+  thread.join();
+  // Longer than a worker takes to notice a dead parent
+  usleep( 300000 );
+  workers->Run();
+}
+
+TEST( WorkerProcessesTest, EndWithParentProcess ) {
+  // Orphaned workers become children of this process, so they can be reaped
+  ASSERT_EQ( 0, prctl( PR_SET_CHILD_SUBREAPER, 1 ) );
+  MappedFile shared = MappedFile::Anonymous( 2 * sizeof( int ) );
+  int* pids = reinterpret_cast< int* >( shared.Data() );
+  const pid_t parent = fork();
+  ASSERT_LE( 0, parent );
+  if ( parent == 0 ) {
+    // Exit without stopping the workers
+    WorkerProcesses workers( 2, [pids]( std::size_t worker ) { pids[worker] = getpid(); } );
+    workers.Run();
+    _exit( 0 );
+  }
+  int status;
+  ASSERT_EQ( parent, waitpid( parent, &status, 0 ) );
+  ASSERT_TRUE( WIFEXITED( status ) );
+
+  timespec start;
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  for ( std::size_t w = 0; w < 2; ++w ) {
+    while ( waitpid( pids[w], &status, WNOHANG ) == 0 && secondsSince( start ) < 5 ) {
+      usleep( 1000 );
+    }
+    ASSERT_EQ( -1, kill( pids[w], 0 ) ) << "Worker " << w << " outlived its parent";
+  }
+  prctl( PR_SET_CHILD_SUBREAPER, 0 );
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,72 @@
+/* 
+   Convert a bagged dataset in text format to the binary cache format, which
+   the other tools load by mapping it into memory instead of parsing it.
+*/
+
+#include <iostream>
+#include <fstream>
+
+#include "tclap/CmdLine.h"
+
+#include "bd/BaggedDataset.h"
+
+#include "IO/BaggedDatasetCache.h"
+
+int main(int argc, char *argv[]) {
+  TCLAP::CmdLine cmd("ConvertBaggedDataset", ' ', LLP_VERSION);
+
+  TCLAP::ValueArg<std::string> 
+    baggedDatasetArg("b", 
+		     "bags", 
+		     "Path to bagged dataset in text format",
+		     true,
+		     "",
+		     "path", 
+		     cmd);
+
+  TCLAP::ValueArg<std::string> 
+    outputArg("o", 
+	      "output", 
+	      "Path to the cache. Default is the dataset path with .llpbin appended, which the other tools pick up automatically.",
+	      false,
+	      "",
+	      "path", 
+	      cmd);
+
+  try {
+    cmd.parse(argc, argv);
+  } catch(TCLAP::ArgException &e) {
+    std::cerr << "Error : " << e.error() 
+	      << " for arg " << e.argId() 
+	      << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Store the arguments
+  const std::string baggedDatasetPath{ baggedDatasetArg.getValue() };
+  const std::string outputPath{ outputArg.getValue().empty() ?
+      baggedDatasetCachePath( baggedDatasetPath ) :
+      outputArg.getValue() };
+  //// Commandline parsing is done ////
+
+#ifdef USE_INTERVAL_LABELS
+  const size_t BagLabelDim = 2;
+#else
+  const size_t BagLabelDim = 1;
+#endif
+  const int InstanceLabelDim = 1;
+  typedef BaggedDataset<BagLabelDim, InstanceLabelDim> BaggedDatasetType;
+
+  // Stamp the text file before reading it, so a change while it is read
+  // makes the cache stale
+  const FileStamp source = FileStamp::Of( baggedDatasetPath );
+  std::ifstream baggedDatasetIs( baggedDatasetPath );
+  BaggedDatasetType bags = BaggedDatasetType::LoadText( baggedDatasetIs, true );
+
+  saveBaggedDatasetCache( bags, outputPath, source );
+
+  std::cout << "Wrote " << bags.NumberOfInstances() << " instances in "
+	    << bags.NumberOfBags() << " bags to " << outputPath << std::endl;
+  
+  return EXIT_SUCCESS;
+}
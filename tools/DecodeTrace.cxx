@@ -0,0 +1,191 @@
+/*
+   Convert a binary trace written by BinaryFileTracer to CSV or JSON.
+
+   CSV has one line per message with the columns
+     time,level,key,type,rows,cols,value
+   where time is in seconds since the start of the trace and the value of a
+   matrix is its values in row-major order separated by spaces.
+
+   JSON has one object per line (JSON Lines) with the same fields. The value
+   of a matrix is an array of its values in row-major order.
+*/
+
+#include <iostream>
+#include <fstream>
+
+#include "tclap/CmdLine.h"
+
+#include "Tracers/BinaryTraceFormat.h"
+#include "Util/BufferedWriter.h"
+#include "Util/Json.h"
+
+namespace {
+  void writeCsvString( BufferedWriter& out, const std::string& s ) {
+    out.Put( '"' );
+    for ( char c : s ) {
+      if ( c == '"' ) {
+	out.Put( '"' );
+      }
+      out.Put( c );
+    }
+    out.Put( '"' );
+  }
+
+  void writeTime( BufferedWriter& out, std::uint64_t nanoseconds ) {
+    out.WriteUnsigned( nanoseconds / 1000000000 ).Put( '.' );
+    const std::uint64_t fraction = nanoseconds % 1000000000;
+    for ( std::uint64_t digit = 100000000; digit > 0; digit /= 10 ) {
+      out.Put( static_cast< char >( '0' + fraction / digit % 10 ) );
+    }
+  }
+
+  void writeCsv( BinaryTraceReader& reader, BufferedWriter& out ) {
+    out.Write( std::string( "time,level,key,type,rows,cols,value\n" ) );
+    BinaryTraceReader::RecordType record;
+    while ( reader.Next( record ) ) {
+      writeTime( out, record.time );
+      out.Put( ',' ).Write( std::string( traceLevelName( record.level ) ) ).Put( ',' );
+      writeCsvString( out, *record.key );
+      out.Put( ',' ).Write( std::string( BinaryTrace::PayloadTypeName( record.type ) ) ).Put( ',' );
+      switch ( record.type ) {
+      case BinaryTrace::DOUBLE:
+	out.Write( ",,", 2 ).WriteDouble( record.scalar, 17 );
+	break;
+      case BinaryTrace::INTEGER:
+	out.Write( ",,", 2 ).WriteInteger( record.integer );
+	break;
+      case BinaryTrace::STRING:
+	out.Write( ",,", 2 );
+	writeCsvString( out, record.text );
+	break;
+      case BinaryTrace::MATRIX:
+      case BinaryTrace::FLOAT_MATRIX:
+	out.WriteUnsigned( record.rows ).Put( ',' ).WriteUnsigned( record.cols ).Put( ',' );
+	for ( std::size_t i = 0; i < record.values.size(); ++i ) {
+	  if ( i > 0 ) {
+	    out.Put( ' ' );
+	  }
+	  out.WriteDouble( record.values[i], 17 );
+	}
+	break;
+      }
+      out.Put( '\n' );
+    }
+  }
+
+  void writeJson( BinaryTraceReader& reader, BufferedWriter& out ) {
+    BinaryTraceReader::RecordType record;
+    while ( reader.Next( record ) ) {
+      out.Write( std::string( "{\"time\":" ) );
+      writeTime( out, record.time );
+      out.Write( std::string( ",\"level\":\"" ) )
+	.Write( std::string( traceLevelName( record.level ) ) )
+	.Write( std::string( "\",\"key\":" ) );
+      writeJsonString( out, *record.key );
+      out.Write( std::string( ",\"type\":\"" ) )
+	.Write( std::string( BinaryTrace::PayloadTypeName( record.type ) ) )
+	.Write( std::string( "\"," ) );
+      switch ( record.type ) {
+      case BinaryTrace::DOUBLE:
+	out.Write( std::string( "\"value\":" ) );
+	writeJsonNumber( out, record.scalar );
+	break;
+      case BinaryTrace::INTEGER:
+	out.Write( std::string( "\"value\":" ) ).WriteInteger( record.integer );
+	break;
+      case BinaryTrace::STRING:
+	out.Write( std::string( "\"value\":" ) );
+	writeJsonString( out, record.text );
+	break;
+      case BinaryTrace::MATRIX:
+      case BinaryTrace::FLOAT_MATRIX:
+	out.Write( std::string( "\"rows\":" ) ).WriteUnsigned( record.rows )
+	  .Write( std::string( ",\"cols\":" ) ).WriteUnsigned( record.cols )
+	  .Write( std::string( ",\"value\":[" ) );
+	for ( std::size_t i = 0; i < record.values.size(); ++i ) {
+	  if ( i > 0 ) {
+	    out.Put( ',' );
+	  }
+	  writeJsonNumber( out, record.values[i] );
+	}
+	out.Put( ']' );
+	break;
+      }
+      out.Write( "}\n", 2 );
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  TCLAP::CmdLine cmd("DecodeTrace", ' ', LLP_VERSION);
+
+  TCLAP::ValueArg<std::string>
+    inputArg("i",
+	     "input",
+	     "Path to the binary trace",
+	     true,
+	     "",
+	     "path",
+	     cmd);
+
+  TCLAP::ValueArg<std::string>
+    outputArg("o",
+	      "output",
+	      "Path to the decoded trace. Default is standard output.",
+	      false,
+	      "",
+	      "path",
+	      cmd);
+
+  std::vector<std::string> allowedFormats{ "csv", "json" };
+  TCLAP::ValuesConstraint<std::string> formatConstraint( allowedFormats );
+  TCLAP::ValueArg<std::string>
+    formatArg("f",
+	      "format",
+	      "Output format",
+	      false,
+	      "csv",
+	      &formatConstraint,
+	      cmd);
+
+  try {
+    cmd.parse(argc, argv);
+  } catch(TCLAP::ArgException &e) {
+    std::cerr << "Error : " << e.error()
+	      << " for arg " << e.argId()
+	      << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Store the arguments
+  const std::string inputPath{ inputArg.getValue() };
+  const std::string outputPath{ outputArg.getValue() };
+  const std::string format{ formatArg.getValue() };
+  //// Commandline parsing is done ////
+
+  try {
+    BinaryTraceReader reader( inputPath );
+    std::ofstream outputFile;
+    if ( !outputPath.empty() ) {
+      outputFile.open( outputPath );
+      if ( !outputFile ) {
+	std::cerr << "Could not open output file " << outputPath << std::endl;
+	return EXIT_FAILURE;
+      }
+    }
+    BufferedWriter out( outputPath.empty() ? std::cout : outputFile );
+    if ( format == "json" ) {
+      writeJson( reader, out );
+    }
+    else {
+      writeCsv( reader, out );
+    }
+    out.Flush();
+  }
+  catch ( const std::exception& e ) {
+    std::cerr << "Error : " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+/* 
+   Generate a deterministic synthetic bagged dataset of histogram features for
+   load testing and benchmarking.
+*/
+
+#include <iostream>
+#include <fstream>
+
+#include "tclap/CmdLine.h"
+
+#include "IO/SyntheticBaggedDataset.h"
+
+int main(int argc, char *argv[]) {
+  TCLAP::CmdLine cmd("GenerateBaggedDataset", ' ', LLP_VERSION);
+
+  TCLAP::ValueArg<std::string> 
+    outputArg("o", 
+	      "output", 
+	      "Path to the dataset. The text format is written to path and the binary cache to path.llpbin",
+	      true,
+	      "",
+	      "path", 
+	      cmd);
+
+  TCLAP::ValueArg<size_t> 
+    nBagsArg("N", 
+	     "bags", 
+	     "Number of bags",
+	     false,
+	     100,
+	     "size_t", 
+	     cmd);
+
+  TCLAP::ValueArg<size_t> 
+    bagSizeArg("s", 
+	       "bag-size", 
+	       "Mean number of instances in a bag",
+	       false,
+	       100,
+	       "size_t", 
+	       cmd);
+
+  std::vector<std::string> allowedDistributions{ "fixed", "uniform", "lognormal" };
+  TCLAP::ValuesConstraint<std::string> distributionConstraint( allowedDistributions );
+  TCLAP::ValueArg<std::string> 
+    bagSizeDistributionArg("d", 
+			   "bag-size-distribution", 
+			   "Distribution of bag sizes",
+			   false,
+			   "fixed",
+			   &distributionConstraint, 
+			   cmd);
+
+  TCLAP::ValueArg<size_t> 
+    minBagSizeArg("", 
+		  "min-bag-size", 
+		  "Smallest bag size for uniform and lognormal bag sizes",
+		  false,
+		  1,
+		  "size_t", 
+		  cmd);
+
+  TCLAP::ValueArg<size_t> 
+    maxBagSizeArg("", 
+		  "max-bag-size", 
+		  "Largest bag size for uniform and lognormal bag sizes",
+		  false,
+		  1000,
+		  "size_t", 
+		  cmd);
+
+  TCLAP::ValueArg<size_t> 
+    nHistogramsArg("n", 
+		   "histograms", 
+		   "Number of histograms",
+		   false,
+		   4,
+		   "size_t", 
+		   cmd);
+
+  TCLAP::ValueArg<size_t> 
+    nBinsArg("m", 
+	     "bins", 
+	     "Number of bins in each histogram",
+	     false,
+	     16,
+	     "size_t", 
+	     cmd);
+
+  TCLAP::ValueArg<double> 
+    separationArg("S", 
+		  "separation", 
+		  "Distance between the class peaks as a fraction of the histogram width",
+		  false,
+		  0.5,
+		  "[0,1]", 
+		  cmd);
+
+  TCLAP::SwitchArg
+    intervalLabelsArg("i",
+		      "interval-labels",
+		      "Label bags with intervals instead of proportions",
+		      cmd,
+		      false);
+
+  TCLAP::ValueArg<double> 
+    intervalWidthArg("w", 
+		     "interval-width", 
+		     "Width of interval labels",
+		     false,
+		     0.2,
+		     "[0,1]", 
+		     cmd);
+
+  TCLAP::ValueArg<uint64_t> 
+    seedArg("r", 
+	    "seed", 
+	    "Seed for the random generator",
+	    false,
+	    0,
+	    "uint64_t", 
+	    cmd);
+
+  std::vector<std::string> allowedFormats{ "text", "binary", "both" };
+  TCLAP::ValuesConstraint<std::string> formatConstraint( allowedFormats );
+  TCLAP::ValueArg<std::string> 
+    formatArg("f", 
+	      "format", 
+	      "Output format",
+	      false,
+	      "both",
+	      &formatConstraint, 
+	      cmd);
+
+  try {
+    cmd.parse(argc, argv);
+  } catch(TCLAP::ArgException &e) {
+    std::cerr << "Error : " << e.error() 
+	      << " for arg " << e.argId() 
+	      << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Store the arguments
+  typedef SyntheticBaggedDatasetParameters ParameterType;
+  const std::string outputPath{ outputArg.getValue() };
+  const std::string format{ formatArg.getValue() };
+  const std::string distribution{ bagSizeDistributionArg.getValue() };
+  ParameterType params( nBagsArg.getValue(),
+			bagSizeArg.getValue(),
+			distribution == "uniform" ? ParameterType::UNIFORM :
+			distribution == "lognormal" ? ParameterType::LOGNORMAL :
+			ParameterType::FIXED,
+			minBagSizeArg.getValue(),
+			maxBagSizeArg.getValue(),
+			nHistogramsArg.getValue(),
+			nBinsArg.getValue(),
+			separationArg.getValue(),
+			intervalLabelsArg.getValue(),
+			intervalWidthArg.getValue(),
+			seedArg.getValue() );
+  //// Commandline parsing is done ////
+
+  SyntheticBaggedDataset dataset( params );
+
+  if ( format != "binary" ) {
+    std::ofstream os( outputPath );
+    dataset.WriteText( os );
+  }
+  if ( format != "text" ) {
+    // The cache is written after the text so it is up to date and picked up
+    // by the other tools
+    const std::string cachePath{ format == "binary" ? outputPath : baggedDatasetCachePath( outputPath ) };
+    dataset.WriteCache( cachePath );
+  }
+
+  std::cout << "Wrote " << dataset.NumberOfInstances() << " instances in "
+	    << dataset.NumberOfBags() << " bags of dimension "
+	    << dataset.Dimension() << " to " << outputPath << std::endl;
+  
+  return EXIT_SUCCESS;
+}
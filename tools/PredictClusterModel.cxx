@@ -4,8 +4,10 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <unordered_map>
+#include <vector>
 
 #include "Eigen/Dense"
 
@@ -15,7 +17,24 @@
 
 #include "Distances/EarthMoversDistance.h"
 #include "Distances/WeightedNxMDistance.h"
+#include "IO/BaggedDatasetCache.h"
 #include "Models/ClusterModel.h"
+#include "Util/BufferedWriter.h"
+
+/*
+  Binary output is written in native byte order as
+    char[8]   "LLPPRED1"
+    uint64_t  number of rows
+    uint32_t  number of double columns
+  followed by the rows, each a uint64_t bag number and the double columns.
+  Instance predictions have the columns label, prediction.
+  Bag predictions have the columns label, prediction, error.
+*/
+void writeBinaryHeader( BufferedWriter& writer, uint64_t rows, uint32_t columns ) {
+  writer.Write( "LLPPRED1", 8 )
+    .WriteBinary( rows )
+    .WriteBinary( columns );
+}
 
 int main(int argc, char *argv[]) {
   TCLAP::CmdLine cmd("PredictClusterModel", ' ', LLP_VERSION);
@@ -49,7 +68,27 @@ int main(int argc, char *argv[]) {
 	      "path", 
 	      cmd);
 
+  TCLAP::SwitchArg
+    binaryArg("",
+	      "binary",
+	      "Write binary output instead of CSV",
+	      cmd,
+	      false);
+
+  TCLAP::SwitchArg
+    bagLevelArg("P",
+		"bag-proportions",
+		"Write predicted proportion and error for each bag instead of a prediction for each instance",
+		cmd,
+		false);
     
+  TCLAP::SwitchArg
+    parallelParseArg("",
+		     "parallel-parse",
+		     "Parse a text dataset with multiple threads",
+		     cmd,
+		     false);
+
   try {
     cmd.parse(argc, argv);
   } catch(TCLAP::ArgException &e) {
@@ -63,6 +102,9 @@ int main(int argc, char *argv[]) {
   const std::string baggedDatasetPath{ baggedDatasetArg.getValue() };
   const std::string modelPath{ modelArg.getValue() };
   const std::string outputPath{ outputArg.getValue() };  
+  const bool bagLevel{ bagLevelArg.getValue() };
+  const bool binary{ binaryArg.getValue() };
+  const bool parallelParse{ parallelParseArg.getValue() };
   //// Commandline parsing is done ////
   
 #ifdef USE_INTERVAL_LABELS
@@ -75,28 +117,74 @@ int main(int argc, char *argv[]) {
   typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
   typedef ClusterModel< DistanceType, BaggedDatasetType > ModelType;
   
-  std::ifstream baggedDatasetIs( baggedDatasetPath );
-  BaggedDatasetType bags = BaggedDatasetType::LoadText( baggedDatasetIs, true );
+  // Uses the binary cache made by ConvertBaggedDataset when it is up to date
+  BaggedDatasetType bags = loadBaggedDataset< BaggedDatasetType >( baggedDatasetPath, parallelParse );
 
   std::ifstream modelIs( modelPath );
   ModelType::Pointer model = ModelType::Load( modelIs );
-  model->Predict(bags);
 
-  std::ofstream os(outputPath);
-  os << "bag,label,prediction" << std::endl;
-  const auto& bagId = bags.Indices();
+  // The mean bag label is the same for all instances in a bag
   const auto& bagLabel = bags.BagLabels();
-  const auto& instanceLabel = bags.InstanceLabels();
-
-  for ( size_t i = 0; i < bagId.size(); ++i ) {
+  std::vector< double > meanBagLabels( bags.NumberOfBags() );
+  for ( size_t i = 0; i < bags.NumberOfBags(); ++i ) {
     double meanBagLabel = 0;
     for ( size_t j = 0; j < BagLabelDim; ++j ) {
-      meanBagLabel += bagLabel(bagId[i],j);
+      meanBagLabel += bagLabel(i,j);
     }
-    meanBagLabel /= BagLabelDim;
-    os << (1+bagId[i]) << ',' << meanBagLabel << ',' << instanceLabel[i] << std::endl;
+    meanBagLabels[i] = meanBagLabel / BagLabelDim;
   }
-  
+
+  std::ofstream os( outputPath, binary ? std::ios::binary : std::ios::out );
+  BufferedWriter writer( os );
+
+  if ( bagLevel ) {
+    std::vector< double > proportions( bags.NumberOfBags() );
+    std::vector< double > errors( bags.NumberOfBags() );
+    model->PredictBagProportions( bags, proportions.data(), errors.data() );
+
+    if ( binary ) {
+      writeBinaryHeader( writer, bags.NumberOfBags(), 3 );
+      for ( size_t i = 0; i < bags.NumberOfBags(); ++i ) {
+	writer.WriteBinary< uint64_t >( 1+i )
+	  .WriteBinary( meanBagLabels[i] )
+	  .WriteBinary( proportions[i] )
+	  .WriteBinary( errors[i] );
+      }
+    }
+    else {
+      writer.Write( std::string( "bag,label,prediction,error\n" ) );
+      for ( size_t i = 0; i < bags.NumberOfBags(); ++i ) {
+	writer.WriteUnsigned( 1+i ).Put( ',' )
+	  .WriteDouble( meanBagLabels[i] ).Put( ',' )
+	  .WriteDouble( proportions[i] ).Put( ',' )
+	  .WriteDouble( errors[i] ).Put( '\n' );
+      }
+    }
+    writer.Flush();
+    return EXIT_SUCCESS;
+  }
+
+  std::vector< double > predictions( bags.NumberOfInstances() );
+  model->Predict( bags.Instances().data(), bags.NumberOfInstances(), predictions.data() );
+
+  const auto& bagId = bags.Indices();
+  if ( binary ) {
+    writeBinaryHeader( writer, bagId.size(), 2 );
+    for ( size_t i = 0; i < bagId.size(); ++i ) {
+      writer.WriteBinary< uint64_t >( 1+bagId[i] )
+	.WriteBinary( meanBagLabels[bagId[i]] )
+	.WriteBinary( predictions[i] );
+    }
+  }
+  else {
+    writer.Write( std::string( "bag,label,prediction\n" ) );
+    for ( size_t i = 0; i < bagId.size(); ++i ) {
+      writer.WriteUnsigned( 1+bagId[i] ).Put( ',' )
+	.WriteDouble( meanBagLabels[bagId[i]] ).Put( ',' )
+	.WriteDouble( predictions[i] ).Put( '\n' );
+    }
+  }
+  writer.Flush();
   
   return EXIT_SUCCESS;
 }
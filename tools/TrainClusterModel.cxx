@@ -9,17 +9,22 @@
 
 #include "bd/BaggedDataset.h"
 
+#include "Algorithms/DeduplicatingInstanceClusterer.h"
 #include "Algorithms/KMeansInstanceClusterer.h"
+#include "Algorithms/MiniBatchKMeansInstanceClusterer.h"
+#include "Algorithms/ShardedInstanceClusterer.h"
 #include "Algorithms/GreedyBinaryClusterLabeler.h"
 #include "Algorithms/Trainers/CMSTrainer.h"
 #include "Algorithms/Trainers/CMSTrainerParameters.h"
 #include "Distances/EarthMoversDistance.h"
 #include "Distances/WeightedNxMDistance.h"
+#include "IO/BaggedDatasetCache.h"
 #include "Losses/ScalarLosses.h"
 #include "Losses/ScalarRisk.h"
 #include "Losses/IntervalLosses.h"
 #include "Losses/IntervalRisk.h"
-#include "Tracers/FileTracer.h"
+#include "Tracers/AsyncFileTracer.h"
+#include "Tracers/ChromeTraceTracer.h"
 #include "Tracers/StdOutTracer.h"
 
 int main(int argc, char *argv[]) {
@@ -91,6 +96,53 @@ int main(int argc, char *argv[]) {
 		"it", 
 		cmd);
   
+#ifdef LLP_MINI_BATCH_KMEANS
+  TCLAP::ValueArg<size_t> 
+    batchSizeArg("", 
+		 "batch-size", 
+		 "Number of instances in each mini-batch of k-means",
+		 false,
+		 1024,
+		 "size_t", 
+		 cmd);
+#endif
+
+#ifdef LLP_PROCESS_SHARDING
+  TCLAP::ValueArg<unsigned int> 
+    processesArg("", 
+		 "processes", 
+		 "Number of worker processes the instances are sharded over when assigning them to clusters",
+		 false,
+		 2,
+		 "unsigned int", 
+		 cmd);
+
+  TCLAP::ValueArg<unsigned int> 
+    threadsPerProcessArg("", 
+			 "threads-per-process", 
+			 "Number of threads each worker process uses. 0 means use all cores",
+			 false,
+			 1,
+			 "unsigned int", 
+			 cmd);
+#endif
+
+  TCLAP::ValueArg<size_t> 
+    coresetSizeArg("", 
+		   "coreset-size", 
+		   "Optimize the feature weights on a weighted coreset of this many instances. 0 means use all instances",
+		   false,
+		   0,
+		   "size_t", 
+		   cmd);
+
+  TCLAP::SwitchArg
+    parallelParseArg("",
+		     "parallel-parse",
+		     "Parse a text dataset with multiple threads",
+		     cmd,
+		     false);
+
   try {
     cmd.parse(argc, argv);
   } catch(TCLAP::ArgException &e) {
@@ -103,11 +155,22 @@ int main(int argc, char *argv[]) {
   // Store the arguments
   const std::string baggedDatasetPath{ baggedDatasetArg.getValue() };
   const size_t nHistograms{ nHistogramsArg.getValue() };
-  const int branching{ branchingArg.getValue() };
-  const int kMeansIterations{ kMeansIterationsArg.getValue() };
   const size_t k{ kArg.getValue() };
   const std::string outputPath{ outputArg.getValue() };
   const int maxIters{ maxItersArg.getValue() };  
+  const bool parallelParse{ parallelParseArg.getValue() };
+  const size_t coresetSize{ coresetSizeArg.getValue() };
+#ifdef LLP_MINI_BATCH_KMEANS
+  // branching and kmeans-iterations are flann parameters and not used
+  const size_t batchSize{ batchSizeArg.getValue() };
+#else
+  const int branching{ branchingArg.getValue() };
+  const int kMeansIterations{ kMeansIterationsArg.getValue() };
+#endif
+#ifdef LLP_PROCESS_SHARDING
+  const unsigned int processes{ processesArg.getValue() };
+  const unsigned int threadsPerProcess{ threadsPerProcessArg.getValue() };
+#endif
   //// Commandline parsing is done ////
   
   /* const size_t InstanceLabelDim = 1; */
@@ -125,22 +188,58 @@ int main(int argc, char *argv[]) {
 
   typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
 
-  typedef KMeansInstanceClusterer< BaggedDatasetType, DistanceType > ClustererType;
+  // Mini-batch k-means for datasets too large to cluster in every evaluation
+#ifdef LLP_MINI_BATCH_KMEANS
+  typedef MiniBatchKMeansInstanceClusterer< BaggedDatasetType, DistanceType > InstanceClustererType;
+#else
+  typedef KMeansInstanceClusterer< BaggedDatasetType, DistanceType > InstanceClustererType;
+#endif
+  typedef typename InstanceClustererType::ParameterType InstanceClustererParameterType;
+  // Assign the instances to clusters in worker processes sharing the dataset
+#ifdef LLP_PROCESS_SHARDING
+#if !defined( LLP_MINI_BATCH_KMEANS ) || defined( LLP_DEDUPLICATE_INSTANCES )
+#error "Process sharding needs mini-batch k-means and can not be combined with deduplication"
+#endif
+  typedef ShardedInstanceClusterer< InstanceClustererType > ClustererType;
+#else
+  // Cluster each distinct instance once, weighted by its number of copies
+#ifdef LLP_DEDUPLICATE_INSTANCES
+  typedef DeduplicatingInstanceClusterer< InstanceClustererType > ClustererType;
+#else
+  typedef InstanceClustererType ClustererType;
+#endif
+#endif
   typedef typename ClustererType::ParameterType ClustererParameterType;
 
-  typedef FileTracer TracerType;
+  // A timeline of the training that can be loaded in a trace viewer
+#ifdef LLP_CHROME_TRACE
+  typedef ChromeTraceTracer TracerType;
+  const std::string traceExtension( ".cms.trace.json" );
+#else
+  typedef AsyncFileTracer TracerType;
+  const std::string traceExtension( ".cms.trace" );
+#endif
   typedef typename TracerType::ParameterType TracerParameterType;
   
   typedef CMSTrainer<BaggedDatasetType, ClustererType, LabelerType, TracerType> TrainerType;
   typedef typename TrainerType::ParameterType TrainerParameterType;
   typedef typename TrainerType::ModelType ModelType;  
 
-  std::ifstream baggedDatasetIs( baggedDatasetPath );    
-  BaggedDatasetType bags = BaggedDatasetType::LoadText( baggedDatasetIs, true );
+  // Uses the binary cache made by ConvertBaggedDataset when it is up to date
+  BaggedDatasetType bags = loadBaggedDataset< BaggedDatasetType >( baggedDatasetPath, parallelParse );
 
-  ClustererParameterType clustererParams(k, branching, kMeansIterations);
+#ifdef LLP_MINI_BATCH_KMEANS
+  InstanceClustererParameterType instanceClustererParams(k, batchSize);
+#else
+  InstanceClustererParameterType instanceClustererParams(k, branching, kMeansIterations);
+#endif
+#ifdef LLP_PROCESS_SHARDING
+  ClustererParameterType clustererParams(instanceClustererParams, processes, threadsPerProcess);
+#else
+  ClustererParameterType clustererParams(instanceClustererParams);
+#endif
   LabelerParameterType labelerParams;
-  TracerParameterType tracerParams(TracerType::Level::INFO, outputPath + ".cms.trace");  
+  TracerParameterType tracerParams(TracerType::Level::INFO, outputPath + traceExtension);  
 
   std::string cmaTrace(outputPath + ".cma.trace");
   TrainerParameterType trainerParams(
@@ -150,7 +249,8 @@ int main(int argc, char *argv[]) {
     -1,               // Lambda for CMA-ES
     0,                // Random seed for CMA-ES
     false,            // Toggle trace for trainer
-    10                // Number of clusterings to run after optimization of feature weights is done
+    10,               // Number of clusterings to run after optimization of feature weights is done
+    coresetSize       // Number of instances in the coreset the feature weights are optimized on
   );
 
   TrainerType trainer( trainerParams, clustererParams, labelerParams, tracerParams );
@@ -9,14 +9,18 @@
 
 #include "bd/BaggedDataset.h"
 
+#include "Algorithms/DeduplicatingInstanceClusterer.h"
 #include "Algorithms/KMeansInstanceClusterer.h"
+#include "Algorithms/MiniBatchKMeansInstanceClusterer.h"
 #include "Algorithms/ContinuousClusterLabeler.h"
 #include "Algorithms/Trainers/CMSTrainer.h"
 #include "Algorithms/Trainers/CMSTrainerParameters.h"
 #include "Distances/EarthMoversDistance.h"
 #include "Distances/WeightedNxMDistance.h"
+#include "IO/BaggedDatasetCache.h"
 #include "Losses/CeresCostFunction2.h"
-#include "Tracers/FileTracer.h"
+#include "Tracers/AsyncFileTracer.h"
+#include "Tracers/ChromeTraceTracer.h"
 #include "Tracers/StdOutTracer.h"
 
 int main(int argc, char *argv[]) {
@@ -88,6 +92,33 @@ int main(int argc, char *argv[]) {
 		"it", 
 		cmd);
   
+#ifdef LLP_MINI_BATCH_KMEANS
+  TCLAP::ValueArg<size_t> 
+    batchSizeArg("", 
+		 "batch-size", 
+		 "Number of instances in each mini-batch of k-means",
+		 false,
+		 1024,
+		 "size_t", 
+		 cmd);
+#endif
+
+  TCLAP::ValueArg<size_t> 
+    coresetSizeArg("", 
+		   "coreset-size", 
+		   "Optimize the feature weights on a weighted coreset of this many instances. 0 means use all instances",
+		   false,
+		   0,
+		   "size_t", 
+		   cmd);
+
+  TCLAP::SwitchArg
+    parallelParseArg("",
+		     "parallel-parse",
+		     "Parse a text dataset with multiple threads",
+		     cmd,
+		     false);
+
   try {
     cmd.parse(argc, argv);
   } catch(TCLAP::ArgException &e) {
@@ -100,11 +131,18 @@ int main(int argc, char *argv[]) {
   // Store the arguments
   const std::string baggedDatasetPath{ baggedDatasetArg.getValue() };
   const size_t nHistograms{ nHistogramsArg.getValue() };
-  const int branching{ branchingArg.getValue() };
-  const int kMeansIterations{ kMeansIterationsArg.getValue() };
   const size_t k{ kArg.getValue() };
   const std::string outputPath{ outputArg.getValue() };
   const int maxIters{ maxItersArg.getValue() };  
+  const bool parallelParse{ parallelParseArg.getValue() };
+  const size_t coresetSize{ coresetSizeArg.getValue() };
+#ifdef LLP_MINI_BATCH_KMEANS
+  // branching and kmeans-iterations are flann parameters and not used
+  const size_t batchSize{ batchSizeArg.getValue() };
+#else
+  const int branching{ branchingArg.getValue() };
+  const int kMeansIterations{ kMeansIterationsArg.getValue() };
+#endif
   //// Commandline parsing is done ////
   
   /* const size_t InstanceLabelDim = 1; */
@@ -116,21 +154,44 @@ int main(int argc, char *argv[]) {
 
   typedef WeightedNxMDistance< EarthMoversDistance > DistanceType;
 
-  typedef KMeansInstanceClusterer< BaggedDatasetType, DistanceType > ClustererType;
+  // Mini-batch k-means for datasets too large to cluster in every evaluation
+#ifdef LLP_MINI_BATCH_KMEANS
+  typedef MiniBatchKMeansInstanceClusterer< BaggedDatasetType, DistanceType > InstanceClustererType;
+#else
+  typedef KMeansInstanceClusterer< BaggedDatasetType, DistanceType > InstanceClustererType;
+#endif
+  // Cluster each distinct instance once, weighted by its number of copies
+#ifdef LLP_DEDUPLICATE_INSTANCES
+  typedef DeduplicatingInstanceClusterer< InstanceClustererType > ClustererType;
+#else
+  typedef InstanceClustererType ClustererType;
+#endif
   typedef typename ClustererType::ParameterType ClustererParameterType;
 
-  typedef FileTracer TracerType;
+  // A timeline of the training that can be loaded in a trace viewer
+#ifdef LLP_CHROME_TRACE
+  typedef ChromeTraceTracer TracerType;
+  const std::string traceExtension( ".cms.trace.json" );
+#else
+  typedef AsyncFileTracer TracerType;
+  const std::string traceExtension( ".cms.trace" );
+#endif
   typedef typename TracerType::ParameterType TracerParameterType;
   
   typedef CMSTrainer<BaggedDatasetType, ClustererType, LabelerType, TracerType> TrainerType;
   typedef typename TrainerType::ParameterType TrainerParameterType;
   typedef typename TrainerType::ModelType ModelType;  
     
-  BaggedDatasetType bags = BaggedDatasetType::LoadText( baggedDatasetPath, true );
+  // Uses the binary cache made by ConvertBaggedDataset when it is up to date
+  BaggedDatasetType bags = loadBaggedDataset< BaggedDatasetType >( baggedDatasetPath, parallelParse );
 
+#ifdef LLP_MINI_BATCH_KMEANS
+  ClustererParameterType clustererParams(k, batchSize);
+#else
   ClustererParameterType clustererParams(k, branching, kMeansIterations);
+#endif
   LabelerParameterType labelerParams;
-  TracerParameterType tracerParams(TracerType::Level::DEBUG, outputPath + ".cms.trace");  
+  TracerParameterType tracerParams(TracerType::Level::DEBUG, outputPath + traceExtension);  
 
   std::string cmaTrace(outputPath + ".cma.trace");
   TrainerParameterType trainerParams(
@@ -140,7 +201,8 @@ int main(int argc, char *argv[]) {
     -1,               // Lambda for CMA-ES
     0,                // Random seed for CMA-ES
     false,            // Toggle trace for trainer
-    10                // Number of clusterings to run after optimization of feature weights is done
+    10,               // Number of clusterings to run after optimization of feature weights is done
+    coresetSize       // Number of instances in the coreset the feature weights are optimized on
   );
 
   TrainerType trainer( trainerParams, clustererParams, labelerParams, tracerParams );